@@ -0,0 +1,9 @@
+#include "actions.h"
+
+#include <string.h>
+
+action_id actionByKeyword(const char* keyword) {
+	const int8_t slot = action_hash.slots[actionHash(keyword, action_hash.seed) & (ACTION_HASH_SLOTS - 1)];
+	if (slot < 0 || strcmp(plugin_actions[slot].keyword, keyword) != 0) return ACTION_COUNT;
+	return (action_id)slot;
+}
@@ -0,0 +1,147 @@
+/*
+ * The actions the plugin offers in its menus and as hotkeys.
+ *
+ * One constexpr table names every action once: its menu item, its hotkey keyword and what it works on. The menu
+ * items and hotkeys are created from it and the action id is the menu id, so nothing has to be counted by hand.
+ * Hotkey keywords are found through a perfect hash the compiler works out over the table's keywords: one hash and
+ * one string compare per hotkey, and only the exact keyword matches.
+ */
+
+#ifndef ACTIONS_H
+#define ACTIONS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "plugin_definitions.h"
+
+#define ACTION_HASH_SLOTS 32  // power of two, at least the number of hotkeys
+
+enum action_id {
+	ACTION_MOVE_TO_OWN_CHANNEL,
+	ACTION_MOVE_TO_SELECTED_CHANNEL,
+	ACTION_FOLLOW,
+	ACTION_UNFOLLOW,
+	ACTION_LOCK_MOVEMENT,
+	ACTION_UNLOCK_MOVEMENT,
+	ACTION_UNFOLLOW_ALL,
+	ACTION_UNLOCK_ALL_MOVEMENT,
+	ACTION_MOVE_TREE_TO_OWN_CHANNEL,
+	ACTION_MOVE_TREE_TO_SELECTED_CHANNEL,
+	ACTION_BACKUP,
+	ACTION_DELTA_BACKUP,
+	ACTION_RESTORE,
+	ACTION_COUNT,
+};
+
+/* What an action works on: the item a menu was opened on, for a hotkey the item shown in the info frame last */
+enum action_target {
+	ACTION_TARGET_NONE,
+	ACTION_TARGET_CHANNEL,
+	ACTION_TARGET_CLIENT,
+};
+
+struct plugin_action {
+	action_id id;
+	PluginMenuType menu_type;
+	const char* menu_text;
+	const char* icon;
+	bool enabled;             // menu item state once the menus are created
+	const char* keyword;      // hotkey, NULL = none
+	const char* description;  // of the hotkey
+	action_target target;
+};
+
+constexpr plugin_action plugin_actions[] = {
+	{ ACTION_MOVE_TO_OWN_CHANNEL, PLUGIN_MENU_TYPE_CHANNEL, "Move all users from this channel to your channel", "1.png", true,
+		"MoveToOwnChannel", "Move clients from selected channel to my channel", ACTION_TARGET_CHANNEL },
+	{ ACTION_MOVE_TO_SELECTED_CHANNEL, PLUGIN_MENU_TYPE_CHANNEL, "Move all users from your channel to this channel", "2.png", true,
+		"MoveToSelectedChannel", "Move clients from my channel to selected channel", ACTION_TARGET_CHANNEL },
+	{ ACTION_FOLLOW, PLUGIN_MENU_TYPE_CLIENT, "Follow", "3.png", true,
+		"Follow", "Follow user", ACTION_TARGET_CLIENT },
+	{ ACTION_UNFOLLOW, PLUGIN_MENU_TYPE_CLIENT, "Unfollow", "4.png", false,
+		NULL, NULL, ACTION_TARGET_CLIENT },
+	{ ACTION_LOCK_MOVEMENT, PLUGIN_MENU_TYPE_CLIENT, "Lock movement", "5.png", true,
+		"LockMovement", "Lock user movement", ACTION_TARGET_CLIENT },
+	{ ACTION_UNLOCK_MOVEMENT, PLUGIN_MENU_TYPE_CLIENT, "Unlock movement", "6.png", false,
+		"UnlockMovement", "Unlock user movement", ACTION_TARGET_CLIENT },
+	{ ACTION_UNFOLLOW_ALL, PLUGIN_MENU_TYPE_GLOBAL, "Unfollow", "7.png", false,
+		"Unfollow", "Unfollow user", ACTION_TARGET_NONE },
+	{ ACTION_UNLOCK_ALL_MOVEMENT, PLUGIN_MENU_TYPE_GLOBAL, "Unlock all client movement", "8.png", false,
+		"UnlockAllMovement", "Unlock all users movement", ACTION_TARGET_NONE },
+	{ ACTION_MOVE_TREE_TO_OWN_CHANNEL, PLUGIN_MENU_TYPE_CHANNEL, "Move all users from this channel and its sub-channels to your channel", "1.png", true,
+		"MoveTreeToOwnChannel", "Move clients from selected channel and its sub-channels to my channel", ACTION_TARGET_CHANNEL },
+	{ ACTION_MOVE_TREE_TO_SELECTED_CHANNEL, PLUGIN_MENU_TYPE_CHANNEL, "Move all users from your channel and its sub-channels to this channel", "2.png", true,
+		"MoveTreeToSelectedChannel", "Move clients from my channel and its sub-channels to selected channel", ACTION_TARGET_CHANNEL },
+	{ ACTION_BACKUP, PLUGIN_MENU_TYPE_GLOBAL, "Backup server", "", true,
+		"BackupServer", "Backup the current server", ACTION_TARGET_NONE },
+	{ ACTION_DELTA_BACKUP, PLUGIN_MENU_TYPE_GLOBAL, "Backup server changes since the last backup", "", true,
+		"DeltaBackupServer", "Backup the changes on the current server since the last backup", ACTION_TARGET_NONE },
+	{ ACTION_RESTORE, PLUGIN_MENU_TYPE_GLOBAL, "Restore permissions from the last backup", "", true,
+		"RestorePermissions", "Restore permissions of the current server from the last backup", ACTION_TARGET_NONE },
+};
+
+/* FNV-1a with the seed mixed into the offset basis */
+constexpr uint32_t actionHash(const char* keyword, uint32_t seed) {
+	uint32_t h = 2166136261u ^ seed;
+	for (; *keyword; keyword++) {
+		h ^= (uint8_t)*keyword;
+		h *= 16777619u;
+	}
+	return h ^ (h >> 16);
+}
+
+constexpr bool actionTableValid() {
+	if (sizeof(plugin_actions) / sizeof(plugin_actions[0]) != ACTION_COUNT) return false;
+	for (size_t i = 0; i < ACTION_COUNT; i++) {
+		if (plugin_actions[i].id != (action_id)i) return false;
+	}
+	return true;
+}
+
+constexpr size_t actionHotkeyCount() {
+	size_t count = 0;
+	for (const plugin_action& a : plugin_actions) count += a.keyword ? 1 : 0;
+	return count;
+}
+
+/* First seed that gives every keyword its own slot, UINT32_MAX if there is none below the limit */
+constexpr uint32_t actionHashSeed() {
+	for (uint32_t seed = 0; seed < 100000; seed++) {
+		bool used[ACTION_HASH_SLOTS] = {};
+		bool collision = false;
+		for (const plugin_action& a : plugin_actions) {
+			if (!a.keyword) continue;
+			const uint32_t slot = actionHash(a.keyword, seed) & (ACTION_HASH_SLOTS - 1);
+			collision = collision || used[slot];
+			used[slot] = true;
+		}
+		if (!collision) return seed;
+	}
+	return UINT32_MAX;
+}
+
+struct action_hash_table {
+	uint32_t seed;
+	int8_t slots[ACTION_HASH_SLOTS];  // action id, -1 = empty
+};
+
+constexpr action_hash_table actionHashTable() {
+	action_hash_table table = action_hash_table{ actionHashSeed(), {} };
+	for (int8_t& slot : table.slots) slot = -1;
+	for (const plugin_action& a : plugin_actions) {
+		if (a.keyword) table.slots[actionHash(a.keyword, table.seed) & (ACTION_HASH_SLOTS - 1)] = (int8_t)a.id;
+	}
+	return table;
+}
+
+constexpr action_hash_table action_hash = actionHashTable();
+
+static_assert(actionTableValid(), "plugin_actions must list every action once, in the order of action_id");
+static_assert(ACTION_COUNT <= 32, "menu states are bits of a uint32_t");
+static_assert(actionHotkeyCount() <= ACTION_HASH_SLOTS, "more hotkeys than hash slots");
+static_assert(action_hash.seed != UINT32_MAX, "no perfect hash for the hotkey keywords, raise ACTION_HASH_SLOTS");
+
+/* Action of a hotkey keyword, ACTION_COUNT if no hotkey has this keyword */
+action_id actionByKeyword(const char* keyword);
+
+#endif
@@ -0,0 +1,160 @@
+#include "afk.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+static std::atomic<uint64> clock_skip(0);
+
+static std::mutex timer_mutex;
+static std::condition_variable timer_wakeup;
+static std::thread timer_thread;
+static bool timer_enabled = true;
+static bool timer_running = false;
+
+uint64 afkClock() {
+	const auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return (uint64)std::chrono::duration_cast<std::chrono::milliseconds>(now).count() + clock_skip.load(std::memory_order_relaxed);
+}
+
+void afkSkipClock(uint64 ms) {
+	clock_skip.fetch_add(ms, std::memory_order_relaxed);
+}
+
+/*** Tracker ***/
+
+static bool isAway(unsigned char flags) {
+	return (flags & (AFK_FLAG_AWAY | AFK_FLAG_OUTPUT_MUTED)) != 0;
+}
+
+static afk_client& client(afk_tracker& afk, anyID clientID) {
+	if (clientID >= afk.clients.size()) afk.clients.resize((size_t)clientID + 1, afk_client{ 0, 0, 0, 0, 0 });
+	return afk.clients[clientID];
+}
+
+/* Sets the client's deadline, or none if it can't be moved */
+static void schedule(afk_tracker& afk, anyID clientID) {
+	const afk_client& c = afk.clients[clientID];
+	if (afk.config.channelID == 0 || c.channelID == 0 || c.channelID == afk.config.channelID || c.home || clientID == afk.own_client) {
+		timerWheelCancel(afk.wheel, clientID);
+		return;
+	}
+	uint64 deadline = c.last_active_ms + (uint64)afk.config.idle_minutes * 60000;
+	if (isAway(c.flags) && afk.config.away_seconds) {
+		const uint64 away = c.away_since_ms + (uint64)afk.config.away_seconds * 1000;
+		if (away < deadline) deadline = away;
+	}
+	timerWheelSet(afk.wheel, clientID, deadline);
+}
+
+void afkEnable(afk_tracker& afk, const afk_config& config, anyID own_client, uint64 now_ms) {
+	afk.config = config;
+	afk.own_client = own_client;
+	afk.clients.clear();
+	timerWheelInit(afk.wheel, AFK_TICK_MS, now_ms);
+}
+
+void afkTrack(afk_tracker& afk, anyID clientID, uint64 channelID, unsigned char flags, uint64 last_active_ms) {
+	afk_client& c = client(afk, clientID);
+	c = afk_client{ channelID, 0, last_active_ms, last_active_ms, flags };
+	schedule(afk, clientID);
+}
+
+bool afkActivity(afk_tracker& afk, anyID clientID, uint64 now_ms, uint64* home) {
+	afk_client& c = client(afk, clientID);
+	c.last_active_ms = now_ms;
+	const bool back = c.home != 0 && c.channelID == afk.config.channelID;
+	if (back) *home = c.home;
+	// the move back arrives as a move event like any other
+	c.home = 0;
+	schedule(afk, clientID);
+	return back;
+}
+
+bool afkSetFlags(afk_tracker& afk, anyID clientID, unsigned char flags, uint64 now_ms, uint64* home) {
+	afk_client& c = client(afk, clientID);
+	const unsigned char cleared = (unsigned char)(c.flags & ~flags);
+	if (isAway(flags) && !isAway(c.flags)) c.away_since_ms = now_ms;
+	c.flags = flags;
+	if (cleared) return afkActivity(afk, clientID, now_ms, home);
+	schedule(afk, clientID);
+	return false;
+}
+
+void afkClientMoved(afk_tracker& afk, anyID clientID, uint64 channelID, uint64 now_ms) {
+	afk_client& c = client(afk, clientID);
+	if (channelID == 0) {
+		timerWheelCancel(afk.wheel, clientID);
+		c = afk_client{ 0, 0, 0, 0, 0 };
+		return;
+	}
+	const bool joined = c.channelID == 0;
+	c.channelID = channelID;
+	// our own move to the AFK channel arriving
+	if (c.home && channelID == afk.config.channelID) return;
+	c.home = 0;
+	c.last_active_ms = now_ms;
+	if (joined) {
+		c.flags = 0;
+		c.away_since_ms = now_ms;
+	}
+	schedule(afk, clientID);
+}
+
+size_t afkExpire(afk_tracker& afk, uint64 now_ms, std::vector<afk_move>& moves) {
+	if (afk.config.channelID == 0) return 0;
+	std::vector<uint32_t> expired;
+	timerWheelAdvance(afk.wheel, now_ms, expired);
+	size_t count = 0;
+	for (uint32_t clientID : expired) {
+		afk_client& c = afk.clients[clientID];
+		// tried again after another idle time if the move is not made
+		c.last_active_ms = now_ms;
+		c.away_since_ms = now_ms;
+		schedule(afk, (anyID)clientID);
+		moves.push_back(afk_move{ (anyID)clientID, afk.config.channelID });
+		count++;
+	}
+	return count;
+}
+
+void afkMovedAway(afk_tracker& afk, anyID clientID) {
+	afk_client& c = client(afk, clientID);
+	c.home = c.channelID;
+	timerWheelCancel(afk.wheel, clientID);
+}
+
+/*** Timer thread ***/
+
+static void timerLoop(afk_tick_handler handler) {
+	std::unique_lock<std::mutex> lock(timer_mutex);
+	while (timer_running) {
+		if (timer_wakeup.wait_for(lock, std::chrono::milliseconds(AFK_TICK_MS)) == std::cv_status::no_timeout) continue;
+		lock.unlock();
+		handler();
+		lock.lock();
+	}
+}
+
+void afkTimerSetThread(bool enabled) {
+	std::lock_guard<std::mutex> lock(timer_mutex);
+	timer_enabled = enabled;
+}
+
+void afkTimerStart(afk_tick_handler handler) {
+	std::lock_guard<std::mutex> lock(timer_mutex);
+	if (!timer_enabled || timer_running) return;
+	timer_running = true;
+	timer_thread = std::thread(timerLoop, handler);
+}
+
+void afkTimerStop() {
+	{
+		std::lock_guard<std::mutex> lock(timer_mutex);
+		timer_running = false;
+	}
+	timer_wakeup.notify_all();
+	if (timer_thread.joinable()) timer_thread.join();
+}
@@ -0,0 +1,91 @@
+/*
+ * Idle clients of a server connection, moved to an AFK channel and back.
+ *
+ * Every client in view has a deadline in a timer wheel: its last activity plus the idle time, or for a client that
+ * is away or has its speakers muted the time it went away plus the shorter away time. Talking, switching channel,
+ * coming back and unmuting are activity and move the deadline, each in O(1), there is no periodic scan of the client
+ * list. A tick of the timer thread advances the wheels, clients whose deadline ran out are moved to the AFK channel
+ * and remember the channel they were in. Their next activity sends them back there, a client that leaves the AFK
+ * channel on its own or is moved out by someone else stays where it went.
+ */
+
+#ifndef AFK_H
+#define AFK_H
+
+#include <stddef.h>
+#include <vector>
+#include "teamspeak/public_definitions.h"
+#include "timer_wheel.h"
+
+#define AFK_TICK_MS 1000
+
+/* Client variables the tracker is told about, bits of afk_client.flags */
+enum afk_flag {
+	AFK_FLAG_AWAY = 1,
+	AFK_FLAG_OUTPUT_MUTED = 2,
+	AFK_FLAG_INPUT_MUTED = 4,
+};
+
+struct afk_config {
+	uint64 channelID;           // AFK channel, 0 = off
+	unsigned int idle_minutes;
+	unsigned int away_seconds;  // for clients away or with their speakers muted, 0 = they get the idle time too
+};
+
+struct afk_client {
+	uint64 channelID;       // 0 = not in view
+	uint64 home;            // channel we moved the client to the AFK channel from, 0 = not moved by us
+	uint64 last_active_ms;
+	uint64 away_since_ms;
+	unsigned char flags;    // afk_flag bits
+};
+
+struct afk_tracker {
+	afk_config config = afk_config{ 0, 0, 0 };
+	anyID own_client = 0;  // never moved
+	timer_wheel wheel = timer_wheel();
+	std::vector<afk_client> clients = std::vector<afk_client>();  // indexed by client id
+};
+
+struct afk_move {
+	anyID clientID;
+	uint64 channelID;
+};
+
+/* Milliseconds of a steady clock, what the now arguments are measured in */
+uint64 afkClock();
+
+/* Moves afkClock forward, the bench skips idle minutes with it */
+void afkSkipClock(uint64 ms);
+
+/* Starts tracking from scratch with a new config, clients are added with afkTrack */
+void afkEnable(afk_tracker& afk, const afk_config& config, anyID own_client, uint64 now_ms);
+
+/* A client in view, last active at last_active_ms */
+void afkTrack(afk_tracker& afk, anyID clientID, uint64 channelID, unsigned char flags, uint64 last_active_ms);
+
+/* The client talked or did something else, true if it has to go back to *home */
+bool afkActivity(afk_tracker& afk, anyID clientID, uint64 now_ms, uint64* home);
+
+/* New afk_flag bits of a client. Clearing one is activity, true if the client has to go back to *home. */
+bool afkSetFlags(afk_tracker& afk, anyID clientID, unsigned char flags, uint64 now_ms, uint64* home);
+
+/* The client is in channelID now, 0 if it left */
+void afkClientMoved(afk_tracker& afk, anyID clientID, uint64 channelID, uint64 now_ms);
+
+/*
+ * Advances the wheel, appends a move to the AFK channel for every client whose deadline ran out and returns how many.
+ * Their deadlines start over, afkMovedAway stops the one of a client that was moved.
+ */
+size_t afkExpire(afk_tracker& afk, uint64 now_ms, std::vector<afk_move>& moves);
+
+/* The client was sent to the AFK channel, its next activity brings it back to where it is now */
+void afkMovedAway(afk_tracker& afk, anyID clientID);
+
+/* Calls the handler every AFK_TICK_MS on a timer thread, unless the thread is turned off (the bench ticks itself) */
+typedef void (*afk_tick_handler)();
+void afkTimerSetThread(bool enabled);
+void afkTimerStart(afk_tick_handler handler);
+void afkTimerStop();
+
+#endif
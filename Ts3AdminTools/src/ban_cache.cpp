@@ -0,0 +1,259 @@
+#include "ban_cache.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#define BAN_UID_MIN_SLOTS 64
+#define BAN_REBUILD_MIN_DEAD 64
+
+static unsigned char foldByte(char c, bool fold) {
+	return fold ? (unsigned char)tolower((unsigned char)c) : (unsigned char)c;
+}
+
+/* The literal or literal prefix a rule stands for, false if it is any other expression */
+static bool compilePattern(const std::string& text, bool fold, std::string& key, bool* prefix) {
+	key.clear();
+	*prefix = false;
+	size_t i = 0;
+	size_t end = text.size();
+	if (i < end && text[i] == '^') i++;
+	const bool escaped_end = end >= i + 2 && text[end - 2] == '\\';
+	if (end > i && text[end - 1] == '$' && !escaped_end) end--;
+	if (end >= i + 2 && text[end - 2] == '.' && text[end - 1] == '*' && !(end >= i + 3 && text[end - 3] == '\\')) {
+		end -= 2;
+		*prefix = true;
+	}
+	else if (end > i && text[end - 1] == '*' && !(end >= i + 2 && text[end - 2] == '\\')) {
+		end--;
+		*prefix = true;
+	}
+	for (; i < end; i++) {
+		char c = text[i];
+		if (c == '\\') {
+			// escaped punctuation is itself, \d and friends are classes
+			if (++i == end || isalnum((unsigned char)text[i])) return false;
+			c = text[i];
+		}
+		else if (strchr("*+?[](){}|^$", c)) {
+			return false;
+		}
+		key += (char)foldByte(c, fold);
+	}
+	return !key.empty();
+}
+
+/*** Unique identifier hash ***/
+
+static uint64 hashUid(const char* uid) {
+	uint64 hash = 14695981039346656037ULL;
+	for (; *uid; uid++) hash = (hash ^ (unsigned char)*uid) * 1099511628211ULL;
+	return hash;
+}
+
+static void placeUid(std::vector<uint32_t>& slots, const ban_cache& cache, uint32_t ref) {
+	const size_t mask = slots.size() - 1;
+	size_t i = hashUid(cache.entries[ref - 1].uid.c_str()) & mask;
+	while (slots[i]) i = (i + 1) & mask;
+	slots[i] = ref;
+}
+
+static void insertUid(ban_cache& cache, uint32_t ref) {
+	if ((cache.uid_keys + 1) * 2 > cache.uid_slots.size()) {
+		std::vector<uint32_t> slots(cache.uid_slots.empty() ? BAN_UID_MIN_SLOTS : cache.uid_slots.size() * 2, 0);
+		for (uint32_t head : cache.uid_slots) {
+			if (head) placeUid(slots, cache, head);
+		}
+		cache.uid_slots.swap(slots);
+	}
+	ban_entry& e = cache.entries[ref - 1];
+	const size_t mask = cache.uid_slots.size() - 1;
+	for (size_t i = hashUid(e.uid.c_str()) & mask;; i = (i + 1) & mask) {
+		const uint32_t head = cache.uid_slots[i];
+		if (head == 0) {
+			e.next[BAN_FIELD_UID] = 0;
+			cache.uid_slots[i] = ref;
+			cache.uid_keys++;
+			return;
+		}
+		if (cache.entries[head - 1].uid == e.uid) {
+			e.next[BAN_FIELD_UID] = head;
+			cache.uid_slots[i] = ref;
+			return;
+		}
+	}
+}
+
+static uint32_t findUid(const ban_cache& cache, const char* uid) {
+	if (cache.uid_slots.empty()) return 0;
+	const size_t mask = cache.uid_slots.size() - 1;
+	for (size_t i = hashUid(uid) & mask;; i = (i + 1) & mask) {
+		const uint32_t head = cache.uid_slots[i];
+		if (head == 0 || strcmp(cache.entries[head - 1].uid.c_str(), uid) == 0) return head;
+	}
+}
+
+/*** Prefix tries ***/
+
+static uint32_t insertKey(std::vector<ban_trie_node>& trie, const std::string& key) {
+	if (trie.empty()) trie.push_back(ban_trie_node{ 0, 0, 0, 0, 0 });
+	uint32_t node = 0;
+	for (char c : key) {
+		const unsigned char b = (unsigned char)c;
+		uint32_t child = trie[node].child;
+		while (child && trie[child].byte != b) child = trie[child].sibling;
+		if (!child) {
+			child = (uint32_t)trie.size();
+			trie.push_back(ban_trie_node{ 0, trie[node].child, 0, 0, b });
+			trie[node].child = child;
+		}
+		node = child;
+	}
+	return node;
+}
+
+static const ban_entry* firstLive(const ban_cache& cache, uint32_t ref, ban_field field, uint64 now) {
+	for (; ref; ref = cache.entries[ref - 1].next[field]) {
+		const ban_entry& e = cache.entries[ref - 1];
+		if (e.live && (e.expires == 0 || e.expires > now)) return &e;
+	}
+	return NULL;
+}
+
+static const ban_entry* findKey(const ban_cache& cache, const std::vector<ban_trie_node>& trie, const char* text, bool fold, ban_field field, uint64 now) {
+	if (trie.empty()) return NULL;
+	uint32_t node = 0;
+	for (; *text; text++) {
+		const unsigned char b = foldByte(*text, fold);
+		uint32_t child = trie[node].child;
+		while (child && trie[child].byte != b) child = trie[child].sibling;
+		if (!child) return NULL;
+		node = child;
+		const ban_entry* e = firstLive(cache, trie[node].prefix, field, now);
+		if (e) return e;
+	}
+	return firstLive(cache, trie[node].exact, field, now);
+}
+
+/*** Entries ***/
+
+static void indexPattern(ban_cache& cache, uint32_t ref, ban_field field, std::vector<ban_trie_node>& trie, bool fold) {
+	ban_entry& e = cache.entries[ref - 1];
+	const std::string& text = field == BAN_FIELD_IP ? e.ip : e.name;
+	if (text.empty()) return;
+	std::string key;
+	bool prefix;
+	if (!compilePattern(text, fold, key, &prefix)) {
+		e.unindexed |= (unsigned char)(1 << field);
+		cache.unindexed++;
+		return;
+	}
+	const uint32_t node = insertKey(trie, key);
+	uint32_t& head = prefix ? trie[node].prefix : trie[node].exact;
+	e.next[field] = head;
+	head = ref;
+	e.indexed |= (unsigned char)(1 << field);
+	cache.rules[field]++;
+}
+
+static void indexEntry(ban_cache& cache, uint32_t index) {
+	const uint32_t ref = index + 1;
+	ban_entry& e = cache.entries[index];
+	e.indexed = 0;
+	e.unindexed = 0;
+	if (!e.uid.empty()) {
+		insertUid(cache, ref);
+		e.indexed |= 1 << BAN_FIELD_UID;
+		cache.rules[BAN_FIELD_UID]++;
+	}
+	indexPattern(cache, ref, BAN_FIELD_IP, cache.ip_trie, false);
+	indexPattern(cache, ref, BAN_FIELD_NAME, cache.name_trie, true);
+	cache.by_id[e.id] = index;
+	cache.live++;
+}
+
+/* The entry stays in the indexes until the next rebuild, lookups skip it */
+static void dropEntry(ban_cache& cache, uint32_t index) {
+	ban_entry& e = cache.entries[index];
+	e.live = false;
+	for (int f = 0; f < BAN_FIELD_COUNT; f++) {
+		if (e.indexed & (1 << f)) cache.rules[f]--;
+		if (e.unindexed & (1 << f)) cache.unindexed--;
+	}
+	cache.by_id.erase(e.id);
+	cache.live--;
+	cache.dead++;
+}
+
+static void rebuild(ban_cache& cache) {
+	std::vector<ban_entry> entries;
+	entries.swap(cache.entries);
+	cache.by_id.clear();
+	cache.uid_slots.clear();
+	cache.uid_keys = 0;
+	cache.ip_trie.clear();
+	cache.name_trie.clear();
+	cache.live = 0;
+	cache.dead = 0;
+	cache.unindexed = 0;
+	for (size_t& rules : cache.rules) rules = 0;
+	for (ban_entry& e : entries) {
+		if (!e.live) continue;
+		cache.entries.push_back(std::move(e));
+		indexEntry(cache, (uint32_t)cache.entries.size() - 1);
+	}
+}
+
+void banCacheBeginRefresh(ban_cache& cache) {
+	cache.generation++;
+	cache.added = 0;
+}
+
+bool banCacheAdd(ban_cache& cache, uint64 banid, const char* ip, const char* name, const char* uid, uint64 creationTime, uint64 durationTime) {
+	ip = ip ? ip : "";
+	name = name ? name : "";
+	uid = uid ? uid : "";
+	const uint64 expires = durationTime ? creationTime + durationTime : 0;
+	const auto it = cache.by_id.find(banid);
+	if (it != cache.by_id.end()) {
+		ban_entry& e = cache.entries[it->second];
+		if (e.ip == ip && e.name == name && e.uid == uid) {
+			e.seen = cache.generation;
+			e.expires = expires;
+			return false;
+		}
+		// edited on the server, the old keys go with the old entry
+		dropEntry(cache, it->second);
+	}
+	cache.entries.push_back(ban_entry{ banid, expires, ip, name, uid, { 0, 0, 0 }, cache.generation, true, 0, 0 });
+	indexEntry(cache, (uint32_t)cache.entries.size() - 1);
+	cache.added++;
+	return true;
+}
+
+size_t banCacheEndRefresh(ban_cache& cache) {
+	size_t dropped = 0;
+	for (size_t i = 0; i < cache.entries.size(); i++) {
+		if (!cache.entries[i].live || cache.entries[i].seen == cache.generation) continue;
+		dropEntry(cache, (uint32_t)i);
+		dropped++;
+	}
+	if (cache.dead >= BAN_REBUILD_MIN_DEAD && cache.dead > cache.live) rebuild(cache);
+	return dropped;
+}
+
+const ban_entry* banCacheFind(const ban_cache& cache, const char* uid, const char* ip, const char* name, uint64 now, ban_field* field) {
+	const ban_entry* e = NULL;
+	if (uid && *uid && (e = firstLive(cache, findUid(cache, uid), BAN_FIELD_UID, now))) {
+		*field = BAN_FIELD_UID;
+		return e;
+	}
+	if (ip && (e = findKey(cache, cache.ip_trie, ip, false, BAN_FIELD_IP, now))) {
+		*field = BAN_FIELD_IP;
+		return e;
+	}
+	if (name && (e = findKey(cache, cache.name_trie, name, true, BAN_FIELD_NAME, now))) {
+		*field = BAN_FIELD_NAME;
+		return e;
+	}
+	return NULL;
+}
@@ -0,0 +1,92 @@
+/*
+ * Local copy of a server's ban list, indexed for the join path.
+ *
+ * The rows of requestBanList are kept by ban id. Unique identifiers go into an open addressing hash table, IP and
+ * name rules into a prefix trie each, so checking a joining client is a hash probe and two walks along its IP and
+ * name, without allocating. A ban matches when any of its fields does, like on the server.
+ *
+ * The server's IP and name rules are regular expressions. The cache understands the ones that are a literal or a
+ * literal prefix: "10.0.3.7", "10.0.3.*", "^10\.0\.3\..*", "troll.*". Names are compared without ASCII case. Other
+ * expressions are counted as unindexed and left to the server.
+ *
+ * A refresh is incremental: banCacheBeginRefresh starts a generation, banCacheAdd keeps unchanged rows where they are
+ * and indexes new ones, banCacheEndRefresh drops the rows the server no longer sent. Dropped rows stay in the indexes
+ * as dead entries until they outnumber the live ones, then the indexes are rebuilt.
+ */
+
+#ifndef BAN_CACHE_H
+#define BAN_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "teamspeak/public_definitions.h"
+
+enum ban_field {
+	BAN_FIELD_UID,
+	BAN_FIELD_IP,
+	BAN_FIELD_NAME,
+	BAN_FIELD_COUNT
+};
+
+struct ban_entry {
+	uint64 id;
+	uint64 expires;  // unix time, 0 = never
+	std::string ip;    // as the server sent them
+	std::string name;
+	std::string uid;
+	uint32_t next[BAN_FIELD_COUNT];  // next entry with the same key in each index, 1-based, 0 = none
+	uint32_t seen;                   // generation of the refresh that last sent it
+	bool live;                       // false once the server stopped sending it
+	unsigned char indexed;           // bits (1 << ban_field) of the fields in the indexes
+	unsigned char unindexed;         // and of the fields the cache cannot match
+};
+
+struct ban_trie_node {
+	uint32_t child;    // first child, 0 = none (the root is nobody's child)
+	uint32_t sibling;  // next child of the same parent
+	uint32_t exact;    // entries whose key ends here, 1-based chain head
+	uint32_t prefix;   // entries whose key starts with the path to here
+	unsigned char byte;
+};
+
+struct ban_cache {
+	// set by /jat bans
+	bool enabled = false;
+	anyID own_client = 0;  // never kicked
+	unsigned int refresh_minutes = 0;
+	uint64 refreshed_at = 0;  // unix time of the last refresh request
+	std::string refresh_code = std::string();  // return code of the refresh in flight, empty if none
+
+	std::vector<ban_entry> entries = std::vector<ban_entry>();
+	std::unordered_map<uint64, uint32_t> by_id = std::unordered_map<uint64, uint32_t>();  // ban id -> index into entries
+	std::vector<uint32_t> uid_slots = std::vector<uint32_t>();  // power of two, 1-based chain heads, 0 = empty
+	size_t uid_keys = 0;
+	std::vector<ban_trie_node> ip_trie = std::vector<ban_trie_node>();
+	std::vector<ban_trie_node> name_trie = std::vector<ban_trie_node>();
+	uint32_t generation = 0;
+	size_t added = 0;                    // rows new or changed since banCacheBeginRefresh
+	size_t live = 0;
+	size_t dead = 0;                     // dropped entries still in the indexes
+	size_t rules[BAN_FIELD_COUNT] = {};  // indexed fields of live entries
+	size_t unindexed = 0;                // fields of live entries the cache cannot match
+};
+
+/* Starts a refresh, rows not added before banCacheEndRefresh are dropped then */
+void banCacheBeginRefresh(ban_cache& cache);
+
+/* A row of the ban list. True if it is new or changed. */
+bool banCacheAdd(ban_cache& cache, uint64 banid, const char* ip, const char* name, const char* uid, uint64 creationTime, uint64 durationTime);
+
+/* Drops the rows the refresh did not send. Returns how many. */
+size_t banCacheEndRefresh(ban_cache& cache);
+
+/*
+ * First live, unexpired ban matching any of the fields (NULL ones are skipped), NULL if there is none. *field is the
+ * field that matched.
+ */
+const ban_entry* banCacheFind(const ban_cache& cache, const char* uid, const char* ip, const char* name, uint64 now, ban_field* field);
+
+#endif
@@ -0,0 +1,85 @@
+#include "channel_tree.h"
+
+#include <algorithm>
+#include "common.h"
+
+static void detach(channel_tree& tree, uint64 channelID, uint64 parentID) {
+	if (parentID == 0) return;
+	const auto p = tree.nodes.find(parentID);
+	if (p == tree.nodes.end()) return;
+	std::vector<uint64>& siblings = p->second.children;
+	const auto it = std::find(siblings.begin(), siblings.end(), channelID);
+	if (it != siblings.end()) {
+		*it = siblings.back();
+		siblings.pop_back();
+	}
+}
+
+static void attach(channel_tree& tree, uint64 channelID, uint64 parentID) {
+	if (parentID == 0) return;
+	tree.nodes[parentID].children.push_back(channelID);
+}
+
+unsigned int channelTreeSeed(channel_tree& tree, uint64 serverConnectionHandlerID) {
+	uint64* channels;
+	unsigned int r = ts3Functions.getChannelList(serverConnectionHandlerID, &channels);
+	if (r != ERROR_ok) return r;
+
+	tree.nodes.clear();
+	for (const uint64* c = channels; *c; c++) {
+		uint64 parent;
+		r = ts3Functions.getParentChannelOfChannel(serverConnectionHandlerID, *c, &parent);
+		if (r != ERROR_ok) break;
+		tree.nodes[*c].parent = parent;
+		attach(tree, *c, parent);
+	}
+	ts3Functions.freeMemory(channels);
+
+	tree.seeded = r == ERROR_ok;
+	if (!tree.seeded) tree.nodes.clear();
+	return r;
+}
+
+void channelTreeAdd(channel_tree& tree, uint64 channelID, uint64 parentID) {
+	const auto it = tree.nodes.find(channelID);
+	if (it != tree.nodes.end()) {
+		// already known (e.g. created as a parent placeholder), just make sure it hangs in the right place
+		channelTreeMove(tree, channelID, parentID);
+		return;
+	}
+	tree.nodes[channelID].parent = parentID;
+	attach(tree, channelID, parentID);
+}
+
+void channelTreeRemove(channel_tree& tree, uint64 channelID) {
+	const auto it = tree.nodes.find(channelID);
+	if (it == tree.nodes.end()) return;
+	detach(tree, channelID, it->second.parent);
+
+	std::vector<uint64> subtree;
+	channelTreeCollect(tree, channelID, subtree);
+	for (uint64 c : subtree) tree.nodes.erase(c);
+}
+
+void channelTreeMove(channel_tree& tree, uint64 channelID, uint64 parentID) {
+	channel_node& node = tree.nodes[channelID];
+	if (node.parent == parentID) return;
+	const uint64 oldParent = node.parent;
+	node.parent = parentID;
+	detach(tree, channelID, oldParent);
+	attach(tree, channelID, parentID);
+}
+
+bool channelTreeCollect(const channel_tree& tree, uint64 channelID, std::vector<uint64>& channels) {
+	if (tree.nodes.find(channelID) == tree.nodes.end()) return false;
+
+	const size_t start = channels.size();
+	channels.push_back(channelID);
+	// the output doubles as the work queue, so the walk is breadth first without extra allocations
+	for (size_t i = start; i < channels.size(); i++) {
+		const auto it = tree.nodes.find(channels[i]);
+		if (it == tree.nodes.end()) continue;
+		channels.insert(channels.end(), it->second.children.begin(), it->second.children.end());
+	}
+	return true;
+}
@@ -0,0 +1,38 @@
+/*
+ * Channel tree of a server connection.
+ *
+ * Seeded once from getChannelList / getParentChannelOfChannel and then kept up to date from the channel
+ * created / deleted / moved events, so walking the channels below a channel only touches that subtree.
+ */
+
+#ifndef CHANNEL_TREE_H
+#define CHANNEL_TREE_H
+
+#include <unordered_map>
+#include <vector>
+#include "teamspeak/public_definitions.h"
+
+struct channel_node {
+	uint64 parent;                  // 0 = top level
+	std::vector<uint64> children;
+};
+
+struct channel_tree {
+	bool seeded = false;
+	std::unordered_map<uint64, channel_node> nodes = std::unordered_map<uint64, channel_node>();
+};
+
+/* Builds the tree from the client lib, replacing what was there */
+unsigned int channelTreeSeed(channel_tree& tree, uint64 serverConnectionHandlerID);
+
+void channelTreeAdd(channel_tree& tree, uint64 channelID, uint64 parentID);
+
+/* Removes a channel together with its sub-channels */
+void channelTreeRemove(channel_tree& tree, uint64 channelID);
+
+void channelTreeMove(channel_tree& tree, uint64 channelID, uint64 parentID);
+
+/* Appends channelID and all channels below it, parents before their children. Returns false if channelID is unknown. */
+bool channelTreeCollect(const channel_tree& tree, uint64 channelID, std::vector<uint64>& channels);
+
+#endif
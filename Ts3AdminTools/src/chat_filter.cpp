@@ -0,0 +1,193 @@
+#include "chat_filter.h"
+
+#include <ctype.h>
+#include <string.h>
+#include <chrono>
+
+static bool isSpace(char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+uint64 chatClock() {
+	const auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return (uint64)std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+}
+
+size_t chatParseWords(const char* text, size_t length, std::vector<std::string>& words) {
+	size_t count = 0;
+	const char* end = text + length;
+	while (text < end) {
+		const char* line_end = (const char*)memchr(text, '\n', (size_t)(end - text));
+		if (!line_end) line_end = end;
+		const char* first = text;
+		const char* last = line_end;
+		while (first < last && isSpace(*first)) first++;
+		while (last > first && isSpace(last[-1])) last--;
+		if (first < last && *first != '#') {
+			words.emplace_back(first, (size_t)(last - first));
+			count++;
+		}
+		text = line_end + 1;
+	}
+	return count;
+}
+
+/*** Automaton ***/
+
+void chatMatcherBuild(chat_matcher& matcher, const std::vector<std::string>& words) {
+	matcher = chat_matcher();
+	matcher.words = words;
+
+	// one class per distinct byte of the words, upper and lower case share theirs
+	for (const std::string& w : words) {
+		for (unsigned char b : w) {
+			const unsigned char lower = (unsigned char)tolower(b);
+			if (matcher.byte_class[lower]) continue;
+			matcher.byte_class[lower] = (unsigned char)matcher.classes;
+			matcher.byte_class[toupper(lower)] = (unsigned char)matcher.classes;
+			matcher.classes++;
+		}
+	}
+	const size_t classes = matcher.classes;
+
+	// trie with a full row per state while building, a transition of 0 is no child yet (the root is nobody's child)
+	std::vector<uint32_t> trie(classes, 0);
+	std::vector<uint32_t> ends(1, 0);  // 1 + first word ending at a state
+	for (size_t i = 0; i < words.size(); i++) {
+		uint32_t state = 0;
+		for (unsigned char b : words[i]) {
+			uint32_t& child = trie[state * classes + matcher.byte_class[b]];
+			if (child == 0) {
+				child = (uint32_t)ends.size();
+				ends.push_back(0);
+				trie.resize(trie.size() + classes, 0);
+			}
+			// resize may have moved the table
+			state = trie[state * classes + matcher.byte_class[b]];
+		}
+		if (state != 0 && ends[state] == 0) ends[state] = (uint32_t)i + 1;
+	}
+	const size_t states = ends.size();
+
+	// breadth first: states are renumbered by depth, the failure state of a state comes before it
+	std::vector<uint32_t> order;
+	order.reserve(states);
+	order.push_back(0);
+	std::vector<uint32_t> id(states, 0);
+	std::vector<uint32_t> depth(states, 0);
+	std::vector<uint32_t> fail(states, 0);
+	for (size_t head = 0; head < order.size(); head++) {
+		const uint32_t state = order[head];
+		for (size_t c = 1; c < classes; c++) {
+			const uint32_t child = trie[state * classes + c];
+			if (!child) continue;
+			id[child] = (uint32_t)order.size();
+			order.push_back(child);
+			depth[child] = depth[state] + 1;
+			// longest proper suffix of the child that is a state too
+			uint32_t f = fail[state];
+			while (f && !trie[f * classes + c]) f = fail[f];
+			fail[child] = state ? trie[f * classes + c] : 0;
+		}
+	}
+
+	// whole depths get rows while the table fits the budget, the root always has one
+	size_t dense = 1;
+	for (size_t i = 1; i <= states; i++) {
+		if (i < states && depth[order[i]] == depth[order[i - 1]]) continue;
+		if (i * classes * sizeof(uint32_t) > CHAT_DENSE_TABLE_BYTES) break;
+		dense = i;
+	}
+	matcher.dense = (uint32_t)dense;
+
+	matcher.match.assign(states, 0);
+	matcher.next.assign(dense * classes, 0);
+	for (size_t i = 0; i < states; i++) {
+		const uint32_t state = order[i];
+		matcher.match[i] = ends[state] ? ends[state] : matcher.match[id[fail[state]]];
+		if (i < dense) {
+			// a missing child goes where the failure state goes, its row is filled already
+			uint32_t* row = &matcher.next[i * classes];
+			const uint32_t* fail_row = &matcher.next[(size_t)id[fail[state]] * classes];
+			for (size_t c = 0; c < classes; c++) {
+				const uint32_t child = trie[state * classes + c];
+				row[c] = child ? id[child] : (i ? fail_row[c] : 0);
+			}
+			continue;
+		}
+		matcher.fail.push_back(id[fail[state]]);
+		matcher.first_edge.push_back((uint32_t)matcher.edges.size());
+		for (size_t c = 1; c < classes; c++) {
+			const uint32_t child = trie[state * classes + c];
+			if (child) matcher.edges.push_back(chat_edge{ id[child], (uint32_t)c });
+		}
+	}
+	matcher.first_edge.push_back((uint32_t)matcher.edges.size());
+}
+
+/*
+ * Next state of a state without a row: its trie child, else the failure links are followed until a child or a state
+ * with a row. Bytes in no word go to the root.
+ */
+static uint32_t sparseNext(const chat_matcher& matcher, uint32_t state, uint32_t input_class) {
+	if (input_class == 0) return 0;
+	const chat_edge* edges = matcher.edges.data();
+	while (state >= matcher.dense) {
+		const uint32_t sparse = state - matcher.dense;
+		const chat_edge* end = edges + matcher.first_edge[sparse + 1];
+		for (const chat_edge* e = edges + matcher.first_edge[sparse]; e < end; e++) {
+			if (e->input_class == input_class) return e->target;
+		}
+		state = matcher.fail[sparse];
+	}
+	return matcher.next[state * matcher.classes + input_class];
+}
+
+int chatMatcherFind(const chat_matcher& matcher, const char* text, size_t length) {
+	if (matcher.words.empty()) return -1;
+	const uint32_t* next = matcher.next.data();
+	const uint32_t* match = matcher.match.data();
+	const size_t classes = matcher.classes;
+	const uint32_t dense = matcher.dense;
+	uint32_t state = 0;
+	for (size_t i = 0; i < length; i++) {
+		const uint32_t c = matcher.byte_class[(unsigned char)text[i]];
+		state = state < dense ? next[state * classes + c] : sparseNext(matcher, state, c);
+		if (match[state]) return (int)match[state] - 1;
+	}
+	return -1;
+}
+
+/*** Rate limit ***/
+
+chat_verdict chatRateCheck(chat_filter& filter, anyID clientID, uint64 now_ms) {
+	const unsigned int messages = filter.config.messages;
+	if (messages == 0) return CHAT_VERDICT_OK;
+	if (clientID >= filter.clients.size()) filter.clients.resize((size_t)clientID + 1, chat_rate());
+	chat_rate& r = filter.clients[clientID];
+
+	// once the ring is full, next is the oldest of the last messages
+	const bool over = r.count == messages && now_ms - r.times[r.next] < (uint64)filter.config.seconds * 1000;
+	r.times[r.next] = now_ms;
+	r.next = (unsigned char)((r.next + 1) % messages);
+	if (r.count < messages) r.count++;
+
+	if (!over) {
+		r.limited = false;
+		return CHAT_VERDICT_OK;
+	}
+	const chat_verdict verdict = r.limited ? CHAT_VERDICT_FLOODING : CHAT_VERDICT_RATE_LIMITED;
+	r.limited = true;
+	return verdict;
+}
+
+void chatForgetClient(chat_filter& filter, anyID clientID) {
+	if (clientID < filter.clients.size()) filter.clients[clientID] = chat_rate();
+}
+
+chat_verdict chatFilterCheck(chat_filter& filter, anyID clientID, const char* message, uint64 now_ms, int* word) {
+	const chat_verdict rate = chatRateCheck(filter, clientID, now_ms);
+	if (rate != CHAT_VERDICT_OK) return rate;
+	*word = chatMatcherFind(filter.matcher, message, strlen(message));
+	return *word >= 0 ? CHAT_VERDICT_BLOCKED_WORD : CHAT_VERDICT_OK;
+}
@@ -0,0 +1,104 @@
+/*
+ * Chat filter of a server connection: blocked words and a message rate limit per client.
+ *
+ * The word list is compiled into an Aho-Corasick automaton and a message is read once, whatever the number of words.
+ * Bytes that appear in no word share one input class, so a row has one column per distinct byte of the list instead
+ * of 256. The shallow states, where a message spends most of its bytes, have every failure link resolved into a full
+ * row, a DFA with one table lookup per byte. Rows are added by depth while the table stays within
+ * CHAT_DENSE_TABLE_BYTES, so it stays in cache. Deeper states only keep their trie children and failure link: a byte
+ * that is no child follows failure links until a state with a row (at most one step per byte read, amortized).
+ * Long lists still cost more per byte than short ones, the deep states are touched more often and are not cached.
+ * Matching ignores ASCII case, words match anywhere in a message, also inside longer words.
+ *
+ * The rate limit keeps the times of a client's last messages in a fixed ring: a client sending more than
+ * `messages` messages within `seconds` is over the limit.
+ */
+
+#ifndef CHAT_FILTER_H
+#define CHAT_FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "teamspeak/public_definitions.h"
+
+#define CHAT_RATE_MAX_MESSAGES 32
+#define CHAT_LIST_BUFSIZE (4 * 1024 * 1024)
+#define CHAT_DENSE_TABLE_BYTES (256 * 1024)
+
+/* Trie child of a sparse state */
+struct chat_edge {
+	uint32_t target;
+	uint32_t input_class;
+};
+
+struct chat_matcher {
+	unsigned int classes = 1;             // input classes, class 0 = bytes in no word
+	unsigned char byte_class[256] = {};
+	uint32_t dense = 1;                   // states below have a row in next, states are numbered by depth
+	std::vector<uint32_t> next = std::vector<uint32_t>();   // dense * classes, next state for a state and class
+	std::vector<uint32_t> match = std::vector<uint32_t>();  // per state: 1 + word ending there or at a suffix, 0 = none
+	std::vector<uint32_t> fail = std::vector<uint32_t>();   // per sparse state (state - dense): its failure state
+	std::vector<uint32_t> first_edge = std::vector<uint32_t>();  // per sparse state + 1: its children in edges
+	std::vector<chat_edge> edges = std::vector<chat_edge>();
+	std::vector<std::string> words = std::vector<std::string>();
+};
+
+enum chat_action {
+	CHAT_ACTION_REPORT,
+	CHAT_ACTION_KICK,  // kick from the server
+	CHAT_ACTION_LOCK,  // lock in the channel for lock_minutes
+};
+
+struct chat_filter_config {
+	unsigned int messages;  // rate limit, 0 = none
+	unsigned int seconds;
+	chat_action action;
+	unsigned int lock_minutes;
+};
+
+enum chat_verdict {
+	CHAT_VERDICT_OK,
+	CHAT_VERDICT_BLOCKED_WORD,
+	CHAT_VERDICT_RATE_LIMITED,  // the first message over the limit
+	CHAT_VERDICT_FLOODING,      // the messages after it, until one is within the limit again
+};
+
+struct chat_rate {
+	uint64 times[CHAT_RATE_MAX_MESSAGES];  // ring of the last message times
+	unsigned char next;
+	unsigned char count;
+	bool limited;
+};
+
+struct chat_filter {
+	bool enabled = false;
+	anyID own_client = 0;  // its messages are not checked
+	chat_filter_config config = chat_filter_config{ 0, 0, CHAT_ACTION_REPORT, 0 };
+	chat_matcher matcher = chat_matcher();
+	std::vector<chat_rate> clients = std::vector<chat_rate>();  // indexed by client id
+};
+
+/* Milliseconds of a steady clock, what the now arguments are measured in */
+uint64 chatClock();
+
+/* Appends the words of a list, one per line, blank lines and lines starting with '#' are skipped. Returns how many. */
+size_t chatParseWords(const char* text, size_t length, std::vector<std::string>& words);
+
+/* Compiles the automaton of the words, replacing what was there */
+void chatMatcherBuild(chat_matcher& matcher, const std::vector<std::string>& words);
+
+/* Index of a word found in the text, -1 if there is none */
+int chatMatcherFind(const chat_matcher& matcher, const char* text, size_t length);
+
+/* Records a message of the client at now_ms, CHAT_VERDICT_OK if it is within the rate limit */
+chat_verdict chatRateCheck(chat_filter& filter, anyID clientID, uint64 now_ms);
+
+/* Forgets a client's messages, its id may go to someone else */
+void chatForgetClient(chat_filter& filter, anyID clientID);
+
+/* Rate limit first, then the words. *word is the index of the blocked word. */
+chat_verdict chatFilterCheck(chat_filter& filter, anyID clientID, const char* message, uint64 now_ms, int* word);
+
+#endif
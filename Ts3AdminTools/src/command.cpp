@@ -0,0 +1,464 @@
+#include "command.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+struct command_word {
+	const char* text;
+	size_t length;
+};
+
+static bool isBlank(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == ',';
+}
+
+static bool isSeparator(char c) {
+	return c == ';' || c == '\n';
+}
+
+static bool isComment(char c) {
+	return c == '#';
+}
+
+static void skipBlanks(command_parser& parser) {
+	while (parser.cursor < parser.end && isBlank(*parser.cursor)) parser.cursor++;
+	if (parser.cursor < parser.end && isComment(*parser.cursor)) {
+		while (parser.cursor < parser.end && *parser.cursor != '\n') parser.cursor++;
+	}
+}
+
+/* Next word of the current command, false at the end of the command */
+static bool nextWord(command_parser& parser, command_word* word) {
+	skipBlanks(parser);
+	if (parser.cursor >= parser.end || isSeparator(*parser.cursor)) return false;
+	word->text = parser.cursor;
+	if (*parser.cursor == '"') {
+		// a name runs to the closing quote and may have blanks, separators and '#' in it
+		parser.cursor++;
+		while (parser.cursor < parser.end && *parser.cursor != '"' && *parser.cursor != '\n') parser.cursor++;
+		if (parser.cursor < parser.end && *parser.cursor == '"') parser.cursor++;
+		word->length = (size_t)(parser.cursor - word->text);
+		return true;
+	}
+	while (parser.cursor < parser.end && !isBlank(*parser.cursor) && !isSeparator(*parser.cursor) && !isComment(*parser.cursor)) {
+		parser.cursor++;
+	}
+	word->length = (size_t)(parser.cursor - word->text);
+	return true;
+}
+
+/* Moves past the separator ending the current command */
+static void skipCommand(command_parser& parser) {
+	while (parser.cursor < parser.end && !isSeparator(*parser.cursor)) parser.cursor++;
+	if (parser.cursor < parser.end) {
+		if (*parser.cursor == '\n') parser.line++;
+		parser.cursor++;
+	}
+}
+
+static bool isWord(const command_word& word, const char* text) {
+	return strlen(text) == word.length && memcmp(word.text, text, word.length) == 0;
+}
+
+static bool parseNumber(const command_word& word, uint64* number) {
+	if (word.length == 0 || word.length > 20) return false;
+	uint64 value = 0;
+	for (size_t i = 0; i < word.length; i++) {
+		const char c = word.text[i];
+		if (c < '0' || c > '9') return false;
+		const uint64 digit = (uint64)(c - '0');
+		if (value > (UINT64_MAX - digit) / 10) return false;
+		value = value * 10 + digit;
+	}
+	*number = value;
+	return true;
+}
+
+static bool parseId(const command_word& word, uint64* id) {
+	return parseNumber(word, id) && *id != 0;
+}
+
+static bool parseChannel(const command_word& word, command_channel* channel) {
+	if (word.length > 0 && word.text[0] == '"') {
+		// at least one character between the quotes
+		if (word.length < 3 || word.text[word.length - 1] != '"') return false;
+		channel->id = 0;
+		channel->name = word.text + 1;
+		channel->name_length = word.length - 2;
+		return true;
+	}
+	channel->name = NULL;
+	channel->name_length = 0;
+	return parseId(word, &channel->id);
+}
+
+static command_result fail(command_parser& parser, unsigned int line, char* error, size_t error_size, const char* what, const command_word* word) {
+	if (word) {
+		snprintf(error, error_size, "line %u: %s '%.*s'", line, what, (int)(word->length > 32 ? 32 : word->length), word->text);
+	}
+	else {
+		snprintf(error, error_size, "line %u: %s", line, what);
+	}
+	skipCommand(parser);
+	return COMMAND_ERROR;
+}
+
+/*
+ * Reads ids until the end of the command or a word that is not an id, which is left in word. A list of channels takes
+ * names as well.
+ */
+static command_result parseIds(command_parser& parser, command* out, command_word* word, bool* more, bool channels, char* error, size_t error_size) {
+	out->id_count = 0;
+	out->ids.cursor = parser.cursor;
+	out->ids.end = parser.cursor;
+	while ((*more = nextWord(parser, word))) {
+		command_channel channel;
+		if (channels ? !parseChannel(*word, &channel) : !parseId(*word, &channel.id)) break;
+		out->ids.end = parser.cursor;
+		out->id_count++;
+	}
+	if (out->id_count == 0) return fail(parser, out->line, error, error_size, *more ? "expected an id, got" : "expected an id", *more ? word : NULL);
+	return COMMAND_OK;
+}
+
+static command_result expectEnd(command_parser& parser, command* out, char* error, size_t error_size) {
+	command_word word;
+	if (nextWord(parser, &word)) return fail(parser, out->line, error, error_size, "unexpected", &word);
+	skipCommand(parser);
+	return COMMAND_OK;
+}
+
+static command_result parseMove(command_parser& parser, command* out, char* error, size_t error_size) {
+	command_word word;
+	bool more;
+	out->verb = COMMAND_MOVE_CLIENTS;
+
+	const char* kind = parser.cursor;
+	if (nextWord(parser, &word)) {
+		if (isWord(word, "channel")) out->verb = COMMAND_MOVE_CHANNELS;
+		else if (isWord(word, "tree")) out->verb = COMMAND_MOVE_TREES;
+		else parser.cursor = kind;
+	}
+
+	if (parseIds(parser, out, &word, &more, out->verb != COMMAND_MOVE_CLIENTS, error, error_size) != COMMAND_OK) return COMMAND_ERROR;
+	if (!more || !isWord(word, "to")) return fail(parser, out->line, error, error_size, "expected 'to <channel>'", NULL);
+	if (!nextWord(parser, &word) || !parseChannel(word, &out->target)) return fail(parser, out->line, error, error_size, "expected a channel after 'to'", NULL);
+	if (!nextWord(parser, &word)) return expectEnd(parser, out, error, error_size);
+	if (!isWord(word, "where")) return fail(parser, out->line, error, error_size, "unexpected", &word);
+
+	// filters, at least one
+	if (!nextWord(parser, &word)) return fail(parser, out->line, error, error_size, "expected 'nonadmin', 'silent' or 'idle <minutes>' after 'where'", NULL);
+	do {
+		if (isWord(word, "nonadmin")) out->filters |= COMMAND_FILTER_NON_ADMINS;
+		else if (isWord(word, "silent")) out->filters |= COMMAND_FILTER_SILENT;
+		else if (isWord(word, "idle")) {
+			uint64 minutes;
+			if (!nextWord(parser, &word) || !parseId(word, &minutes) || minutes > COMMAND_IDLE_MAX_MINUTES) {
+				return fail(parser, out->line, error, error_size, "expected minutes after 'idle'", NULL);
+			}
+			out->idle_minutes = (unsigned int)minutes;
+		}
+		else return fail(parser, out->line, error, error_size, "unknown filter", &word);
+	} while (nextWord(parser, &word));
+	skipCommand(parser);
+	return COMMAND_OK;
+}
+
+bool commandBroadcast(const char** text, size_t* length) {
+	command_parser parser;
+	commandParserInit(parser, *text, *length);
+	command_word word;
+	if (!nextWord(parser, &word) || !isWord(word, "all")) return false;
+	*length -= (size_t)(parser.cursor - *text);
+	*text = parser.cursor;
+	return true;
+}
+
+void commandParserInit(command_parser& parser, const char* text, size_t length) {
+	parser.cursor = text;
+	parser.end = text + length;
+	parser.line = 1;
+}
+
+command_result commandNext(command_parser& parser, command* out, char* error, size_t error_size) {
+	command_word word;
+	// empty commands and comment lines
+	for (;;) {
+		if (nextWord(parser, &word)) break;
+		if (parser.cursor >= parser.end) return COMMAND_END;
+		skipCommand(parser);
+	}
+
+	out->ids.cursor = NULL;
+	out->ids.end = NULL;
+	out->id_count = 0;
+	out->target = command_channel{ 0, NULL, 0 };
+	out->value = 0;
+	out->filters = 0;
+	out->idle_minutes = 0;
+	out->settings = 0;
+	out->file = NULL;
+	out->file_length = 0;
+	out->line = parser.line;
+	bool more;
+
+	if (isWord(word, "lock") || isWord(word, "unlock")) {
+		const bool lock = isWord(word, "lock");
+		out->verb = lock ? COMMAND_LOCK : COMMAND_UNLOCK;
+		const char* kind = parser.cursor;
+		if (nextWord(parser, &word)) {
+			if (isWord(word, "group")) out->verb = lock ? COMMAND_LOCK_SERVER_GROUPS : COMMAND_UNLOCK_SERVER_GROUPS;
+			else if (isWord(word, "channelgroup")) out->verb = lock ? COMMAND_LOCK_CHANNEL_GROUPS : COMMAND_UNLOCK_CHANNEL_GROUPS;
+			else if (!lock && isWord(word, "all")) out->verb = COMMAND_UNLOCK_ALL;
+			else parser.cursor = kind;
+		}
+		if (out->verb == COMMAND_UNLOCK_ALL) return expectEnd(parser, out, error, error_size);
+
+		if (parseIds(parser, out, &word, &more, false, error, error_size) != COMMAND_OK) return COMMAND_ERROR;
+		if (more) return fail(parser, out->line, error, error_size, "expected an id, got", &word);
+		return expectEnd(parser, out, error, error_size);
+	}
+	if (isWord(word, "move")) {
+		return parseMove(parser, out, error, error_size);
+	}
+	if (isWord(word, "follow")) {
+		out->verb = COMMAND_FOLLOW;
+		const char* option = parser.cursor;
+		if (nextWord(parser, &word) && isWord(word, "window")) {
+			out->verb = COMMAND_FOLLOW_WINDOW;
+			if (!nextWord(parser, &word) || !parseNumber(word, &out->value)) return fail(parser, out->line, error, error_size, "expected a window in ms", NULL);
+			return expectEnd(parser, out, error, error_size);
+		}
+		parser.cursor = option;
+		if (parseIds(parser, out, &word, &more, false, error, error_size) != COMMAND_OK) return COMMAND_ERROR;
+		if (more) return fail(parser, out->line, error, error_size, "expected a client id, got", &word);
+		return expectEnd(parser, out, error, error_size);
+	}
+	if (isWord(word, "unfollow")) {
+		out->verb = COMMAND_UNFOLLOW;
+		const char* ids = parser.cursor;
+		if (!nextWord(parser, &word)) return expectEnd(parser, out, error, error_size);
+		parser.cursor = ids;
+		out->verb = COMMAND_UNFOLLOW_CLIENTS;
+		if (parseIds(parser, out, &word, &more, false, error, error_size) != COMMAND_OK) return COMMAND_ERROR;
+		if (more) return fail(parser, out->line, error, error_size, "expected a client id, got", &word);
+		return expectEnd(parser, out, error, error_size);
+	}
+	if (isWord(word, "admins")) {
+		out->verb = COMMAND_ADMIN_GROUPS;
+		if (parseIds(parser, out, &word, &more, false, error, error_size) != COMMAND_OK) return COMMAND_ERROR;
+		if (more) return fail(parser, out->line, error, error_size, "expected a server group id, got", &word);
+		return expectEnd(parser, out, error, error_size);
+	}
+	if (isWord(word, "layout")) {
+		if (!nextWord(parser, &word)) return fail(parser, out->line, error, error_size, "expected a channel, 'others' or 'clear'", NULL);
+		if (isWord(word, "clear")) {
+			out->verb = COMMAND_LAYOUT_CLEAR;
+			return expectEnd(parser, out, error, error_size);
+		}
+		if (isWord(word, "others")) {
+			out->verb = COMMAND_LAYOUT_OTHERS;
+			if (!nextWord(parser, &word) || !parseChannel(word, &out->target)) return fail(parser, out->line, error, error_size, "expected a channel after 'others'", NULL);
+			return expectEnd(parser, out, error, error_size);
+		}
+		out->verb = COMMAND_LAYOUT;
+		if (!parseChannel(word, &out->target)) return fail(parser, out->line, error, error_size, "expected a channel, got", &word);
+		if (parseIds(parser, out, &word, &more, false, error, error_size) != COMMAND_OK) return COMMAND_ERROR;
+		if (more) return fail(parser, out->line, error, error_size, "expected a client db id, got", &word);
+		return expectEnd(parser, out, error, error_size);
+	}
+	if (isWord(word, "afk")) {
+		if (!nextWord(parser, &word)) return fail(parser, out->line, error, error_size, "expected a channel or 'off'", NULL);
+		if (isWord(word, "off")) {
+			out->verb = COMMAND_AFK_OFF;
+			return expectEnd(parser, out, error, error_size);
+		}
+		out->verb = COMMAND_AFK;
+		uint64 minutes;
+		if (!parseChannel(word, &out->target)) return fail(parser, out->line, error, error_size, "expected a channel, got", &word);
+		if (!nextWord(parser, &word) || !parseId(word, &minutes) || minutes > COMMAND_IDLE_MAX_MINUTES) {
+			return fail(parser, out->line, error, error_size, "expected idle minutes after the channel", NULL);
+		}
+		out->idle_minutes = (unsigned int)minutes;
+		if (!nextWord(parser, &word)) return expectEnd(parser, out, error, error_size);
+		if (!isWord(word, "away")) return fail(parser, out->line, error, error_size, "unexpected", &word);
+		if (!nextWord(parser, &word) || !parseNumber(word, &out->value) || out->value > COMMAND_AWAY_MAX_SECONDS) {
+			return fail(parser, out->line, error, error_size, "expected seconds after 'away'", NULL);
+		}
+		return expectEnd(parser, out, error, error_size);
+	}
+	if (isWord(word, "loudness")) {
+		if (!nextWord(parser, &word)) return fail(parser, out->line, error, error_size, "expected a level in dB or 'off'", NULL);
+		if (isWord(word, "off")) {
+			out->verb = COMMAND_LOUDNESS_OFF;
+			return expectEnd(parser, out, error, error_size);
+		}
+		out->verb = COMMAND_LOUDNESS;
+		// -12 and 12 both mean 12 dB below full scale
+		command_word level = word;
+		if (level.length > 1 && level.text[0] == '-') {
+			level.text++;
+			level.length--;
+		}
+		uint64 db;
+		if (!parseId(level, &db) || db > COMMAND_LOUDNESS_MAX_DB) return fail(parser, out->line, error, error_size, "expected a level in dB, got", &word);
+		out->level_db = (unsigned int)db;
+		out->value = COMMAND_HOLD_DEFAULT_MS;
+		while (nextWord(parser, &word)) {
+			if (isWord(word, "mute")) {
+				out->verb = COMMAND_LOUDNESS_MUTE;
+			}
+			else if (isWord(word, "hold")) {
+				if (!nextWord(parser, &word) || !parseNumber(word, &out->value) || out->value > COMMAND_HOLD_MAX_MS) {
+					return fail(parser, out->line, error, error_size, "expected ms after 'hold'", NULL);
+				}
+			}
+			else {
+				return fail(parser, out->line, error, error_size, "unexpected", &word);
+			}
+		}
+		return expectEnd(parser, out, error, error_size);
+	}
+	if (isWord(word, "chatfilter")) {
+		if (!nextWord(parser, &word)) return fail(parser, out->line, error, error_size, "expected 'words', 'rate' or 'off'", NULL);
+		if (isWord(word, "off")) {
+			out->verb = COMMAND_CHAT_FILTER_OFF;
+			return expectEnd(parser, out, error, error_size);
+		}
+		out->verb = COMMAND_CHAT_FILTER;
+		out->file = NULL;
+		out->file_length = 0;
+		out->rate_messages = 0;
+		out->rate_seconds = 0;
+		do {
+			uint64 number;
+			if (isWord(word, "words")) {
+				if (!nextWord(parser, &word)) return fail(parser, out->line, error, error_size, "expected a file name after 'words'", NULL);
+				out->file = word.text;
+				out->file_length = word.length;
+			}
+			else if (isWord(word, "rate")) {
+				if (!nextWord(parser, &word) || !parseId(word, &number) || number > COMMAND_RATE_MAX_MESSAGES) {
+					return fail(parser, out->line, error, error_size, "expected messages after 'rate'", NULL);
+				}
+				out->rate_messages = (unsigned int)number;
+				if (!nextWord(parser, &word) || !parseId(word, &number) || number > COMMAND_RATE_MAX_SECONDS) {
+					return fail(parser, out->line, error, error_size, "expected seconds after the messages", NULL);
+				}
+				out->rate_seconds = (unsigned int)number;
+			}
+			else if (isWord(word, "kick")) {
+				out->verb = COMMAND_CHAT_FILTER_KICK;
+			}
+			else if (isWord(word, "lock")) {
+				out->verb = COMMAND_CHAT_FILTER_LOCK;
+				if (!nextWord(parser, &word) || !parseId(word, &out->value) || out->value > COMMAND_IDLE_MAX_MINUTES) {
+					return fail(parser, out->line, error, error_size, "expected minutes after 'lock'", NULL);
+				}
+			}
+			else {
+				return fail(parser, out->line, error, error_size, "unexpected", &word);
+			}
+		} while (nextWord(parser, &word));
+		if (!out->file && !out->rate_messages) return fail(parser, out->line, error, error_size, "expected 'words' or 'rate'", NULL);
+		return expectEnd(parser, out, error, error_size);
+	}
+	if (isWord(word, "bans")) {
+		out->verb = COMMAND_BANS;
+		out->value = COMMAND_BANS_DEFAULT_MINUTES;
+		if (!nextWord(parser, &word)) return expectEnd(parser, out, error, error_size);
+		if (isWord(word, "off")) {
+			out->verb = COMMAND_BANS_OFF;
+			return expectEnd(parser, out, error, error_size);
+		}
+		if (!isWord(word, "every")) return fail(parser, out->line, error, error_size, "expected 'every' or 'off', got", &word);
+		if (!nextWord(parser, &word) || !parseId(word, &out->value) || out->value > COMMAND_IDLE_MAX_MINUTES) {
+			return fail(parser, out->line, error, error_size, "expected minutes after 'every'", NULL);
+		}
+		return expectEnd(parser, out, error, error_size);
+	}
+	if (isWord(word, "scheduler")) {
+		out->verb = COMMAND_SCHEDULER;
+		while (nextWord(parser, &word)) {
+			uint64 number;
+			if (isWord(word, "rate")) {
+				if (!nextWord(parser, &word) || !parseId(word, &number) || number > COMMAND_MOVE_RATE_MAX) {
+					return fail(parser, out->line, error, error_size, "expected moves per second after 'rate'", NULL);
+				}
+				out->move_rate = (unsigned int)number;
+				out->settings |= COMMAND_SET_MOVE_RATE;
+			}
+			else if (isWord(word, "burst")) {
+				if (!nextWord(parser, &word) || !parseId(word, &number) || number > COMMAND_MOVE_BURST_MAX) {
+					return fail(parser, out->line, error, error_size, "expected moves after 'burst'", NULL);
+				}
+				out->move_burst = (unsigned int)number;
+				out->settings |= COMMAND_SET_MOVE_BURST;
+			}
+			else if (isWord(word, "window")) {
+				if (!nextWord(parser, &word) || !parseId(word, &number) || number > COMMAND_MOVE_WINDOW_MAX) {
+					return fail(parser, out->line, error, error_size, "expected moves after 'window'", NULL);
+				}
+				out->move_window = (unsigned int)number;
+				out->settings |= COMMAND_SET_MOVE_WINDOW;
+			}
+			else if (isWord(word, "retries")) {
+				if (!nextWord(parser, &word) || !parseNumber(word, &number) || number > COMMAND_MOVE_RETRIES_MAX) {
+					return fail(parser, out->line, error, error_size, "expected a number after 'retries'", NULL);
+				}
+				out->move_retries = (unsigned int)number;
+				out->settings |= COMMAND_SET_MOVE_RETRIES;
+			}
+			else {
+				return fail(parser, out->line, error, error_size, "unexpected", &word);
+			}
+		}
+		return expectEnd(parser, out, error, error_size);
+	}
+	if (isWord(word, "backup")) {
+		out->verb = COMMAND_BACKUP;
+		const char* option = parser.cursor;
+		if (nextWord(parser, &word) && isWord(word, "delta")) out->verb = COMMAND_DELTA_BACKUP;
+		else parser.cursor = option;
+		return expectEnd(parser, out, error, error_size);
+	}
+	if (isWord(word, "restore")) {
+		out->verb = COMMAND_RESTORE;
+		return expectEnd(parser, out, error, error_size);
+	}
+	if (isWord(word, "run")) {
+		out->verb = COMMAND_RUN;
+		if (!nextWord(parser, &word)) return fail(parser, out->line, error, error_size, "expected a file name", NULL);
+		out->file = word.text;
+		out->file_length = word.length;
+		return expectEnd(parser, out, error, error_size);
+	}
+	if (isWord(word, "metrics")) {
+		out->verb = COMMAND_METRICS;
+		const char* option = parser.cursor;
+		if (nextWord(parser, &word)) {
+			if (isWord(word, "reset")) out->verb = COMMAND_METRICS_RESET;
+			else if (isWord(word, "dump")) out->verb = COMMAND_METRICS_DUMP;
+			else parser.cursor = option;
+		}
+		return expectEnd(parser, out, error, error_size);
+	}
+	return fail(parser, out->line, error, error_size, "unknown command", &word);
+}
+
+bool commandNextId(command_ids& ids, uint64* id) {
+	command_parser parser = command_parser{ ids.cursor, ids.end, 0 };
+	command_word word;
+	if (!nextWord(parser, &word)) return false;
+	ids.cursor = parser.cursor;
+	return parseId(word, id);
+}
+
+bool commandNextChannel(command_ids& ids, command_channel* channel) {
+	command_parser parser = command_parser{ ids.cursor, ids.end, 0 };
+	command_word word;
+	if (!nextWord(parser, &word)) return false;
+	ids.cursor = parser.cursor;
+	return parseChannel(word, channel);
+}
@@ -0,0 +1,191 @@
+/*
+ * The /jat command language.
+ *
+ * A batch is one or more commands separated by ';' or new lines, '#' starts a comment that runs to the end of the
+ * line. Ids are separated by spaces or commas. A channel is given by its id or by its name in double quotes, the name
+ * is looked up on the server the batch runs on:
+ *
+ *   lock <client db id>...              lock clients in the channel they are in now
+ *   lock group <server group id>...     lock the members of server groups, now and later ones
+ *   lock channelgroup <channel group id>...
+ *   unlock <client db id>... | all
+ *   unlock group <server group id>... | unlock channelgroup <channel group id>...
+ *   move <client id>... to <channel>
+ *   move channel <channel>... to <channel>    the clients of the channels
+ *   move tree <channel>... to <channel>       the clients of the channels and their sub-channels
+ *   move ... to <channel> where <filter>...   only the clients that pass every filter:
+ *                                                   nonadmin, silent (not talking), idle <minutes>
+ *   admins <server group id>...         the groups 'where nonadmin' leaves behind
+ *   layout <channel> <client db id>...  clients that belong in a channel, the layout commands of a batch
+ *                                       replace the layout: clients are moved where it wants them and held there
+ *   layout others <channel>             where all other clients belong
+ *   layout clear
+ *   afk <channel> <idle minutes> [away <seconds>]
+ *                                       move clients idle this long to the channel and back once they are active
+ *                                       again, clients away or with their speakers muted after the away time
+ *   afk off
+ *   loudness <dB> [hold <ms>] [mute]    report clients whose voice stays above -<dB> dBFS RMS or clips for the
+ *                                       hold time (500 ms by default), mute them locally with 'mute'
+ *   loudness off
+ *   chatfilter [words <file>] [rate <messages> <seconds>] [kick | lock <minutes>]
+ *                                       hide channel and server chat messages with a word of the list (a file in
+ *                                       the ts3 config folder, one word per line) or over the rate, kick the
+ *                                       sender or lock it in its channel
+ *   chatfilter off
+ *   bans [every <minutes>]              keep a copy of the server's ban list and kick banned clients as they join,
+ *                                       fetched again every 10 minutes or as given and when someone is banned
+ *   bans off
+ *   follow <client id>...               follow the first client in view, the others take over in order
+ *   unfollow [<client id>...]
+ *   follow window <ms>                  coalesce the follow target's hops within the window, 0 follows every hop
+ *   scheduler [rate <moves/s>] [burst <moves>] [window <moves>] [retries <n>]
+ *                                       pace the moves sent to each server, moves of a mass move in flight and
+ *                                       their retries, shows the settings without options
+ *   backup [delta] | restore
+ *   run <file>                          batch from a file in the ts3 config folder
+ *   metrics [reset | dump]
+ *
+ * A batch that starts with the word 'all' runs on every connected server, each server on its own. Channels are best
+ * given by name there, their ids differ from server to server.
+ *
+ * The parser works on the text in place and never allocates, a parsed command points into the text it came from. Id
+ * lists are checked while parsing and read again with commandNextId, so they have no length limit.
+ */
+
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <stddef.h>
+#include "teamspeak/public_definitions.h"
+
+#define COMMAND_ERROR_BUFSIZE 128
+#define COMMAND_SCRIPT_BUFSIZE 65536
+#define COMMAND_IDLE_MAX_MINUTES 10080
+#define COMMAND_AWAY_MAX_SECONDS 3600
+#define COMMAND_LOUDNESS_MAX_DB 60
+#define COMMAND_HOLD_DEFAULT_MS 500
+#define COMMAND_HOLD_MAX_MS 10000
+#define COMMAND_RATE_MAX_MESSAGES 32
+#define COMMAND_RATE_MAX_SECONDS 3600
+#define COMMAND_BANS_DEFAULT_MINUTES 10
+#define COMMAND_MOVE_RATE_MAX 1000
+#define COMMAND_MOVE_BURST_MAX 1000
+#define COMMAND_MOVE_WINDOW_MAX 256
+#define COMMAND_MOVE_RETRIES_MAX 10
+
+enum command_verb {
+	COMMAND_LOCK,
+	COMMAND_UNLOCK,
+	COMMAND_UNLOCK_ALL,
+	COMMAND_LOCK_SERVER_GROUPS,
+	COMMAND_LOCK_CHANNEL_GROUPS,
+	COMMAND_UNLOCK_SERVER_GROUPS,
+	COMMAND_UNLOCK_CHANNEL_GROUPS,
+	COMMAND_MOVE_CLIENTS,
+	COMMAND_MOVE_CHANNELS,
+	COMMAND_MOVE_TREES,
+	COMMAND_FOLLOW,
+	COMMAND_FOLLOW_WINDOW,
+	COMMAND_UNFOLLOW,
+	COMMAND_UNFOLLOW_CLIENTS,
+	COMMAND_ADMIN_GROUPS,
+	COMMAND_LAYOUT,
+	COMMAND_LAYOUT_OTHERS,
+	COMMAND_LAYOUT_CLEAR,
+	COMMAND_AFK,
+	COMMAND_AFK_OFF,
+	COMMAND_LOUDNESS,
+	COMMAND_LOUDNESS_MUTE,
+	COMMAND_LOUDNESS_OFF,
+	COMMAND_CHAT_FILTER,
+	COMMAND_CHAT_FILTER_KICK,
+	COMMAND_CHAT_FILTER_LOCK,
+	COMMAND_CHAT_FILTER_OFF,
+	COMMAND_BANS,
+	COMMAND_BANS_OFF,
+	COMMAND_SCHEDULER,
+	COMMAND_BACKUP,
+	COMMAND_DELTA_BACKUP,
+	COMMAND_RESTORE,
+	COMMAND_RUN,
+	COMMAND_METRICS,
+	COMMAND_METRICS_RESET,
+	COMMAND_METRICS_DUMP,
+};
+
+enum command_result {
+	COMMAND_OK,     // a command was parsed
+	COMMAND_END,    // no commands left
+	COMMAND_ERROR,  // syntax error, the parser stays at the end of the broken command
+};
+
+/* Filters of a move, bits of command.filters */
+enum command_filter {
+	COMMAND_FILTER_NON_ADMINS = 1,
+	COMMAND_FILTER_SILENT = 2,
+};
+
+/* Settings given to scheduler, bits of command.settings */
+enum command_setting {
+	COMMAND_SET_MOVE_RATE = 1,
+	COMMAND_SET_MOVE_BURST = 2,
+	COMMAND_SET_MOVE_WINDOW = 4,
+	COMMAND_SET_MOVE_RETRIES = 8,
+};
+
+/* A channel of a command, by id or by name */
+struct command_channel {
+	uint64 id;         // 0 = by name
+	const char* name;  // without the quotes, not terminated
+	size_t name_length;
+};
+
+/* Id list of a parsed command */
+struct command_ids {
+	const char* cursor;
+	const char* end;
+};
+
+struct command {
+	command_verb verb;
+	command_ids ids;
+	unsigned int id_count;
+	command_channel target;  // channel the moves go to, channel of a layout, AFK channel
+	uint64 value;      // follow window in ms, AFK away time in seconds, loudness hold time in ms, chat lock or ban
+	                   // list refresh minutes
+	unsigned int level_db;      // loudness threshold in dB below full scale
+	unsigned int rate_messages; // chat filter rate limit, 0 = none
+	unsigned int rate_seconds;
+	unsigned int filters;       // command_filter bits of a move
+	unsigned int idle_minutes;  // move only clients idle this long, 0 = any. Idle time of afk.
+	unsigned int settings;      // command_setting bits of the scheduler values that were given
+	unsigned int move_rate;     // scheduler moves per second
+	unsigned int move_burst;
+	unsigned int move_window;   // mass move requests in flight per server
+	unsigned int move_retries;  // mass move retries per move
+	const char* file;  // run and the chat filter's word list, not terminated
+	size_t file_length;
+	unsigned int line;
+};
+
+struct command_parser {
+	const char* cursor;
+	const char* end;
+	unsigned int line;
+};
+
+void commandParserInit(command_parser& parser, const char* text, size_t length);
+
+/* True if the batch starts with 'all', text and length are moved past it */
+bool commandBroadcast(const char** text, size_t* length);
+
+/* Parses the next command of the batch into out, on COMMAND_ERROR error describes what is wrong and where */
+command_result commandNext(command_parser& parser, command* out, char* error, size_t error_size);
+
+/* Reads the next id of a list, false after the last one. Iterate over a copy to read the list again. */
+bool commandNextId(command_ids& ids, uint64* id);
+
+/* Reads the next channel of a list, which may have names, false after the last one */
+bool commandNextChannel(command_ids& ids, command_channel* channel);
+
+#endif
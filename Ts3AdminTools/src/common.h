@@ -0,0 +1,54 @@
+/*
+ * Shared between the plugin translation units: client lib function table, plugin id, logging and the error handling macros.
+ */
+
+#ifndef COMMON_H
+#define COMMON_H
+
+#include <stdio.h>
+#include <string.h>
+#include "teamspeak/public_errors.h"
+#include "teamspeak/public_errors_rare.h"
+#include "teamspeak/public_definitions.h"
+#include "teamspeak/public_rare_definitions.h"
+#include "teamspeak/clientlib_publicdefinitions.h"
+#include "ts3_functions.h"
+#include "logging.h"
+
+extern struct TS3Functions ts3Functions;
+extern char* pluginID;
+
+#ifdef _WIN32
+#define _strcpy(dest, destSize, src) strcpy_s(dest, destSize, src)
+#define snprintf sprintf_s
+#else
+#define _strcpy(dest, destSize, src) { strncpy(dest, src, destSize-1); (dest)[destSize-1] = '\0'; }
+#endif
+
+#define PATH_BUFSIZE 512
+#define COMMAND_BUFSIZE 128
+#define INFODATA_BUFSIZE 128
+#define SERVERINFO_BUFSIZE 256
+#define CHANNELINFO_BUFSIZE 512
+#define RETURNCODE_BUFSIZE 128
+
+
+/*********************************** My Macros ************************************/
+/*
+ *
+ */
+#ifdef AT_RELEASE
+#define ASSERT(x, msg)
+#define R_ASSERT(x, msg) if (!(x)) {return;}
+#define CALL(x, msg) {(void)(x);}
+#define R_CALL(x, msg) {unsigned int r = x; if (r != ERROR_ok) {return;}}
+#define RV_CALL(x, msg, rv) {unsigned int r = x; if (r != ERROR_ok) {return rv;}}
+#else
+#define ASSERT(x, msg) if (!(x)) LOG_ERROR(0, msg)
+#define R_ASSERT(x, msg) if (!(x)) {LOG_ERROR(0, msg); return;}
+#define CALL(x, msg) {unsigned int r = x; if (r != ERROR_ok) {LOG_ERROR(0, "Error %u at '%s'", r, msg);}}
+#define R_CALL(x, msg) {unsigned int r = x; if (r != ERROR_ok) {LOG_ERROR(0, "Error %u at '%s'", r, msg); return;}}
+#define RV_CALL(x, msg, rv) {unsigned int r = x; if (r != ERROR_ok) {LOG_ERROR(0, "Error %u at '%s'", r, msg); return rv;}}
+#endif
+
+#endif
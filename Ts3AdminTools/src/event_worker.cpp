@@ -0,0 +1,202 @@
+#include "event_worker.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "common.h"
+
+#define EVENT_WORKER_SPIN 256  // polls of an empty ring before the worker goes to sleep
+
+static event_worker_config config = event_worker_config{ 4096, true };
+static move_event_handler handler = NULL;
+
+/*
+ * The producer writes slots at head and publishes them by advancing head, the worker reads at tail and frees
+ * slots by advancing tail. Both only ever advance, the slot is index & mask. Head and tail live on their own
+ * cache lines so producer and worker don't invalidate each others line on every event.
+ */
+static std::vector<move_event> slots = std::vector<move_event>();
+static size_t mask = 0;
+alignas(64) static std::atomic<size_t> head(0);
+alignas(64) static std::atomic<size_t> tail(0);
+alignas(64) static size_t cached_tail = 0;     // the producers last look at tail, saves reading the workers line
+alignas(64) static std::atomic<size_t> handled(0);  // events the handler returned from
+
+static std::atomic<uint64> pushed(0);
+static std::atomic<uint64> dropped(0);
+static std::atomic<uint64> processed(0);
+static std::atomic<size_t> max_depth(0);
+
+// Servers that lost events since the handler was last told, dropped is counted under the same lock
+static std::mutex lost_mutex;
+static std::vector<uint64> lost_servers = std::vector<uint64>();
+
+static std::atomic<bool> running(false);
+static std::atomic<bool> sleeping(false);
+static std::mutex wakeup_mutex;
+static std::condition_variable wakeup;
+static std::thread worker;
+
+void eventWorkerSetConfig(const event_worker_config& c) {
+	config = c;
+	if (config.capacity < 2) config.capacity = 2;
+}
+
+event_worker_config eventWorkerGetConfig() {
+	return config;
+}
+
+/*** Worker ***/
+
+static bool ringEmpty() {
+	return head.load(std::memory_order_acquire) == tail.load(std::memory_order_relaxed);
+}
+
+static void idle() {
+	for (int i = 0; i < EVENT_WORKER_SPIN && ringEmpty(); i++) {
+		std::this_thread::yield();
+	}
+	if (!ringEmpty()) return;
+
+	std::unique_lock<std::mutex> lock(wakeup_mutex);
+	sleeping.store(true, std::memory_order_seq_cst);
+	// the producer checks sleeping after publishing, so either it sees the flag or this sees the event
+	if (head.load(std::memory_order_seq_cst) == tail.load(std::memory_order_relaxed) && running.load()) {
+		wakeup.wait_for(lock, std::chrono::milliseconds(100));
+	}
+	sleeping.store(false, std::memory_order_relaxed);
+}
+
+/* Hands the handler a MOVE_EVENT_LOST for every server that dropped events since the last call */
+static void reportLost(uint64* reported_drops) {
+	if (dropped.load(std::memory_order_relaxed) == *reported_drops) return;
+	std::vector<uint64> lost;
+	{
+		std::lock_guard<std::mutex> lock(lost_mutex);
+		*reported_drops = dropped.load(std::memory_order_relaxed);
+		lost.swap(lost_servers);
+	}
+	LOG_WARN(0, "Move event ring full, %llu events dropped so far", (unsigned long long)*reported_drops);
+	for (uint64 serverConnectionHandlerID : lost) handler(move_event{ serverConnectionHandlerID, 0, 0, 0, MOVE_EVENT_LOST });
+}
+
+static void run() {
+	uint64 reported_drops = 0;
+	for (;;) {
+		size_t t = tail.load(std::memory_order_relaxed);
+		const size_t h = head.load(std::memory_order_acquire);
+		if (t == h) {
+			reportLost(&reported_drops);
+			if (!running.load()) break;
+			idle();
+			continue;
+		}
+
+		const size_t depth = h - t;
+		if (depth > max_depth.load(std::memory_order_relaxed)) max_depth.store(depth, std::memory_order_relaxed);
+		for (; t != h; t++) {
+			// copy out and free the slot before handling, the producer can reuse it meanwhile
+			const move_event e = slots[t & mask];
+			tail.store(t + 1, std::memory_order_release);
+			handler(e);
+			processed.fetch_add(1, std::memory_order_relaxed);
+			handled.store(t + 1, std::memory_order_release);
+		}
+		reportLost(&reported_drops);
+	}
+}
+
+void eventWorkerStart(move_event_handler h) {
+	if (running.load()) return;
+
+	size_t capacity = 1;
+	while (capacity < config.capacity) capacity <<= 1;
+	slots.assign(capacity, move_event());
+	mask = capacity - 1;
+	head.store(0);
+	tail.store(0);
+	handled.store(0);
+	cached_tail = 0;
+	lost_servers.clear();
+	handler = h;
+
+	if (config.worker_thread) {
+		running.store(true);
+		worker = std::thread(run);
+	}
+}
+
+void eventWorkerStop() {
+	if (running.exchange(false)) {
+		{
+			std::lock_guard<std::mutex> lock(wakeup_mutex);
+			wakeup.notify_one();
+		}
+		// the worker handles what is left before it exits
+		worker.join();
+	}
+	handler = NULL;
+}
+
+/*** Producer ***/
+
+bool eventWorkerPush(const move_event& e) {
+	if (!handler) return false;
+	if (!running.load(std::memory_order_relaxed)) {
+		pushed.fetch_add(1, std::memory_order_relaxed);
+		handler(e);
+		processed.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	const size_t h = head.load(std::memory_order_relaxed);
+	if (h - cached_tail > mask) {
+		cached_tail = tail.load(std::memory_order_acquire);
+		if (h - cached_tail > mask) {
+			std::lock_guard<std::mutex> lock(lost_mutex);
+			if (std::find(lost_servers.begin(), lost_servers.end(), e.serverConnectionHandlerID) == lost_servers.end()) {
+				lost_servers.push_back(e.serverConnectionHandlerID);
+			}
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+	}
+	slots[h & mask] = e;
+	head.store(h + 1, std::memory_order_release);
+	pushed.fetch_add(1, std::memory_order_relaxed);
+
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (sleeping.load(std::memory_order_relaxed)) {
+		std::lock_guard<std::mutex> lock(wakeup_mutex);
+		wakeup.notify_one();
+	}
+	return true;
+}
+
+void eventWorkerDrain() {
+	if (!running.load()) return;
+	const size_t target = head.load(std::memory_order_relaxed);
+	while (handled.load(std::memory_order_acquire) < target) {
+		std::this_thread::sleep_for(std::chrono::microseconds(50));
+	}
+}
+
+/*** Stats ***/
+
+void eventWorkerGetStats(event_worker_stats* stats) {
+	stats->pushed = pushed.load();
+	stats->dropped = dropped.load();
+	stats->processed = processed.load();
+	stats->max_depth = max_depth.load();
+}
+
+void eventWorkerResetStats() {
+	pushed.store(0);
+	dropped.store(0);
+	processed.store(0);
+	max_depth.store(0);
+}
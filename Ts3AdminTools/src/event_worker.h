@@ -0,0 +1,71 @@
+/*
+ * Client move event worker.
+ *
+ * The move callbacks only copy the event into a bounded lock-free ring (one producer: the client's callback thread,
+ * one consumer: the worker thread) and return. The worker thread takes events out in order and runs the handler,
+ * so client lib lookups and move requests no longer stall the client's event delivery. If the ring is full the
+ * event is dropped and counted, and once the worker caught up the handler gets a MOVE_EVENT_LOST for every server
+ * that lost events, so it can read again what it tracked from them. Without the worker thread events are handled
+ * right away on the calling thread.
+ *
+ * The handler runs on the worker thread, everything it touches has to be shared with the client thread safely.
+ * Callbacks the client thread still handles itself (client updates, talk status, group and client id events) can
+ * run before the queued moves of the same client: a client's update may be seen before its join is.
+ */
+
+#ifndef EVENT_WORKER_H
+#define EVENT_WORKER_H
+
+#include <stddef.h>
+#include "teamspeak/public_definitions.h"
+
+enum move_event_type {
+	MOVE_EVENT_SELF = 0,      // client switched channel itself, joined or left
+	MOVE_EVENT_TIMEOUT,
+	MOVE_EVENT_MOVED,         // moved by someone else
+	MOVE_EVENT_KICK_CHANNEL,
+	MOVE_EVENT_KICK_SERVER,
+	MOVE_EVENT_SUBSCRIPTION,  // client came into or went out of view, a channel was (un)subscribed
+	MOVE_EVENT_LOST,          // events of the server were dropped, only serverConnectionHandlerID is set
+};
+
+struct move_event {
+	uint64 serverConnectionHandlerID;
+	uint64 oldChannelID;
+	uint64 newChannelID;
+	anyID clientID;
+	unsigned char type;  // move_event_type
+};
+
+typedef void (*move_event_handler)(const move_event& e);
+
+struct event_worker_config {
+	unsigned int capacity;  // events the ring holds, rounded up to a power of two
+	bool worker_thread;     // handle events on a worker thread, else on the calling thread
+};
+
+struct event_worker_stats {
+	uint64 pushed;     // events accepted
+	uint64 dropped;    // events lost because the ring was full
+	uint64 processed;  // events handled
+	size_t max_depth;  // most events waiting at once, seen by the worker
+};
+
+/* Takes effect on the next eventWorkerStart */
+void eventWorkerSetConfig(const event_worker_config& config);
+event_worker_config eventWorkerGetConfig();
+
+/* Starts / stops the worker thread (if enabled), stopping handles the events still waiting */
+void eventWorkerStart(move_event_handler handler);
+void eventWorkerStop();
+
+/* Hands an event to the worker. Only ever called from one thread. False if it was dropped. */
+bool eventWorkerPush(const move_event& e);
+
+/* Waits until every event pushed so far has been handled */
+void eventWorkerDrain();
+
+void eventWorkerGetStats(event_worker_stats* stats);
+void eventWorkerResetStats();
+
+#endif
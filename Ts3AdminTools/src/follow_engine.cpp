@@ -0,0 +1,172 @@
+#include "follow_engine.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "common.h"
+#include "metrics.h"
+
+typedef std::chrono::steady_clock clock_type;
+
+struct pending_follow {
+	uint64 channelID;
+	clock_type::time_point first_hop;
+	clock_type::time_point due;
+};
+
+struct flushed_follow {
+	uint64 serverConnectionHandlerID;
+	uint64 channelID;
+};
+
+static follow_engine_config config = follow_engine_config{ 300, 1000, true };
+static std::unordered_map<uint64, pending_follow> pending = std::unordered_map<uint64, pending_follow>();
+static follow_engine_stats stats = follow_engine_stats();
+static follow_flush_handler flush_handler = NULL;
+
+static std::mutex follow_mutex;
+static std::condition_variable follow_wakeup;
+static std::thread timer_thread;
+static bool timer_running = false;
+
+/*** Pending moves ***/
+
+/* Takes the moves that are due out of pending. Returns the earliest due time left, or false if nothing is left. */
+static bool takeDue(std::vector<flushed_follow>& out, clock_type::time_point now, clock_type::time_point* next) {
+	bool waiting = false;
+	for (auto it = pending.begin(); it != pending.end();) {
+		if (it->second.due <= now) {
+			out.push_back(flushed_follow{ it->first, it->second.channelID });
+			stats.flushed++;
+			it = pending.erase(it);
+			continue;
+		}
+		if (!waiting || it->second.due < *next) *next = it->second.due;
+		waiting = true;
+		++it;
+	}
+	return waiting;
+}
+
+/* Hands flushed moves to the handler, must be called without holding the engine lock */
+static void flushMoves(const std::vector<flushed_follow>& moves, follow_flush_handler handler) {
+	if (!handler) return;
+	for (const flushed_follow& f : moves) {
+		handler(f.serverConnectionHandlerID, f.channelID);
+	}
+}
+
+/*** Timer thread ***/
+
+static void timerLoop() {
+	std::vector<flushed_follow> out;
+	std::unique_lock<std::mutex> lock(follow_mutex);
+	while (timer_running) {
+		out.clear();
+		clock_type::time_point next;
+		const bool waiting = takeDue(out, clock_type::now(), &next);
+		if (!out.empty()) {
+			const follow_flush_handler handler = flush_handler;
+			lock.unlock();
+			flushMoves(out, handler);
+			lock.lock();
+			continue;
+		}
+		if (waiting) follow_wakeup.wait_until(lock, next);
+		else follow_wakeup.wait(lock);
+	}
+}
+
+void followEngineStart(follow_flush_handler handler) {
+	std::lock_guard<std::mutex> lock(follow_mutex);
+	flush_handler = handler;
+	if (!config.timer_thread || timer_running) return;
+	timer_running = true;
+	timer_thread = std::thread(timerLoop);
+}
+
+void followEngineStop() {
+	{
+		std::lock_guard<std::mutex> lock(follow_mutex);
+		timer_running = false;
+	}
+	follow_wakeup.notify_all();
+	if (timer_thread.joinable()) timer_thread.join();
+
+	std::lock_guard<std::mutex> lock(follow_mutex);
+	stats.dropped += pending.size();
+	pending.clear();
+	flush_handler = NULL;
+}
+
+/*** Engine ***/
+
+void followEngineSetConfig(const follow_engine_config& c) {
+	std::lock_guard<std::mutex> lock(follow_mutex);
+	config = c;
+	if (config.window_ms > FOLLOW_WINDOW_MAX_MS) config.window_ms = FOLLOW_WINDOW_MAX_MS;
+	if (config.max_delay_ms < config.window_ms) config.max_delay_ms = config.window_ms;
+}
+
+follow_engine_config followEngineGetConfig() {
+	std::lock_guard<std::mutex> lock(follow_mutex);
+	return config;
+}
+
+bool followEngineSchedule(uint64 serverConnectionHandlerID, uint64 channelID) {
+	std::lock_guard<std::mutex> lock(follow_mutex);
+	stats.scheduled++;
+	if (config.window_ms == 0) return true;
+
+	const clock_type::time_point now = clock_type::now();
+	const clock_type::time_point quiet = now + std::chrono::milliseconds(config.window_ms);
+	const auto it = pending.find(serverConnectionHandlerID);
+	if (it == pending.end()) {
+		pending.emplace(serverConnectionHandlerID, pending_follow{ channelID, now, quiet });
+	}
+	else {
+		// the target moved on before we followed, only its last channel counts
+		stats.coalesced++;
+		metricsCount(METRIC_FOLLOWS_COALESCED);
+		const clock_type::time_point latest = it->second.first_hop + std::chrono::milliseconds(config.max_delay_ms);
+		it->second.channelID = channelID;
+		it->second.due = quiet < latest ? quiet : latest;
+	}
+	if (timer_running) follow_wakeup.notify_one();
+	return false;
+}
+
+void followEnginePoll() {
+	std::vector<flushed_follow> out;
+	follow_flush_handler handler;
+	{
+		std::lock_guard<std::mutex> lock(follow_mutex);
+		clock_type::time_point next;
+		takeDue(out, clock_type::now(), &next);
+		handler = flush_handler;
+	}
+	flushMoves(out, handler);
+}
+
+size_t followEnginePending() {
+	std::lock_guard<std::mutex> lock(follow_mutex);
+	return pending.size();
+}
+
+void followEngineGetStats(follow_engine_stats* s) {
+	std::lock_guard<std::mutex> lock(follow_mutex);
+	*s = stats;
+}
+
+void followEngineResetStats() {
+	std::lock_guard<std::mutex> lock(follow_mutex);
+	stats = follow_engine_stats();
+}
+
+void followEngineDropConnection(uint64 serverConnectionHandlerID) {
+	std::lock_guard<std::mutex> lock(follow_mutex);
+	stats.dropped += pending.erase(serverConnectionHandlerID);
+}
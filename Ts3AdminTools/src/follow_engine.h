@@ -0,0 +1,58 @@
+/*
+ * Coalescing follow timer.
+ *
+ * A follow target clicking through several channels would otherwise make us send one move per hop, most of them
+ * overtaken by the next hop before they arrive and all of them counting against the server's anti flood. Every hop
+ * of the followed client is handed to the engine instead, which keeps one pending move per server connection: the
+ * first hop opens it, later hops only replace its channel. The move is flushed to the handler once the target stayed
+ * put for the window, or at the latest max_delay after the first hop, so a target that never stops still gets
+ * followed. Flushes run on a timer thread, or from followEnginePoll without one.
+ */
+
+#ifndef FOLLOW_ENGINE_H
+#define FOLLOW_ENGINE_H
+
+#include <stddef.h>
+#include "teamspeak/public_definitions.h"
+
+#define FOLLOW_WINDOW_MAX_MS 10000
+
+struct follow_engine_config {
+	unsigned int window_ms;     // quiet time after the last hop before we move, 0 moves on every hop
+	unsigned int max_delay_ms;  // longest a move waits after the first hop it coalesces
+	bool timer_thread;          // flush from a background thread, else only from followEnginePoll
+};
+
+struct follow_engine_stats {
+	uint64 scheduled;  // hops handed to the engine
+	uint64 coalesced;  // hops that replaced a pending move
+	uint64 flushed;    // moves handed to the handler
+	uint64 dropped;    // pending moves dropped by unfollow or disconnect
+};
+
+/* Called without the engine lock held, on the timer thread or the thread calling followEnginePoll */
+typedef void (*follow_flush_handler)(uint64 serverConnectionHandlerID, uint64 channelID);
+
+void followEngineSetConfig(const follow_engine_config& config);
+follow_engine_config followEngineGetConfig();
+
+/* Starts / stops the timer thread (if enabled), stopping drops the pending moves */
+void followEngineStart(follow_flush_handler handler);
+void followEngineStop();
+
+/* Records a hop of the followed client. False if the move waits for the window, true if the caller moves now. */
+bool followEngineSchedule(uint64 serverConnectionHandlerID, uint64 channelID);
+
+/* Flushes the moves whose window ran out. Done by the timer thread when it runs. */
+void followEnginePoll();
+
+/* Pending moves on all connections */
+size_t followEnginePending();
+
+void followEngineGetStats(follow_engine_stats* stats);
+void followEngineResetStats();
+
+/* Drops the pending move of a connection (unfollow, disconnect) */
+void followEngineDropConnection(uint64 serverConnectionHandlerID);
+
+#endif
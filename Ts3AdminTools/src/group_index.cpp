@@ -0,0 +1,164 @@
+#include "group_index.h"
+
+#include <stdlib.h>
+#include <algorithm>
+#include "common.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static unsigned int lowestBit(uint64 mask) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, mask);
+	return (unsigned int)index;
+#else
+	return (unsigned int)__builtin_ctzll(mask);
+#endif
+}
+
+static bool isMember(const group_member& member, const group_lock& lock) {
+	if (lock.type == GROUP_CHANNEL) return member.channel_group == lock.groupID;
+	return std::binary_search(member.server_groups.begin(), member.server_groups.end(), lock.groupID);
+}
+
+/* Mask of the locked groups the client is in, only called when memberships or locks change */
+static void updateLocks(const group_index& index, group_member& member) {
+	uint64 locks = 0;
+	for (uint64 used = index.used; used; used &= used - 1) {
+		const unsigned int bit = lowestBit(used);
+		if (isMember(member, index.locks[bit])) locks |= 1ull << bit;
+	}
+	if (!member.locks && locks) member.locked_channel = 0;
+	member.locks = locks;
+}
+
+static group_member& getMember(group_index& index, anyID clientID) {
+	if (index.clients.size() <= clientID) {
+		index.clients.resize((size_t)clientID + 1, group_member{ std::vector<uint64>(), 0, 0, 0 });
+	}
+	return index.clients[clientID];
+}
+
+/* CLIENT_SERVERGROUPS holds the group ids separated by commas */
+static void parseServerGroups(const char* text, std::vector<uint64>& groups) {
+	groups.clear();
+	for (const char* c = text; *c;) {
+		char* end;
+		const uint64 id = strtoull(c, &end, 10);
+		if (end == c) {
+			c++;
+			continue;
+		}
+		groups.push_back(id);
+		c = end;
+	}
+	std::sort(groups.begin(), groups.end());
+}
+
+static unsigned int queryClient(group_index& index, uint64 serverConnectionHandlerID, anyID clientID) {
+	char* text;
+	unsigned int r = ts3Functions.getClientVariableAsString(serverConnectionHandlerID, clientID, CLIENT_SERVERGROUPS, &text);
+	if (r != ERROR_ok) return r;
+	group_member& member = getMember(index, clientID);
+	parseServerGroups(text, member.server_groups);
+	ts3Functions.freeMemory(text);
+
+	uint64 channel_group;
+	r = ts3Functions.getClientVariableAsUInt64(serverConnectionHandlerID, clientID, CLIENT_CHANNEL_GROUP_ID, &channel_group);
+	if (r != ERROR_ok) return r;
+	member.channel_group = channel_group;
+	return ERROR_ok;
+}
+
+unsigned int groupIndexSeed(group_index& index, uint64 serverConnectionHandlerID) {
+	anyID* clients;
+	unsigned int r = ts3Functions.getClientList(serverConnectionHandlerID, &clients);
+	if (r != ERROR_ok) return r;
+
+	index.clients.clear();
+	for (const anyID* c = clients; *c; c++) {
+		r = queryClient(index, serverConnectionHandlerID, *c);
+		if (r != ERROR_ok) break;
+		updateLocks(index, index.clients[*c]);
+	}
+	ts3Functions.freeMemory(clients);
+
+	index.seeded = r == ERROR_ok;
+	if (!index.seeded) index.clients.clear();
+	return r;
+}
+
+unsigned int groupIndexAddClient(group_index& index, uint64 serverConnectionHandlerID, anyID clientID, uint64 channelID) {
+	const unsigned int r = queryClient(index, serverConnectionHandlerID, clientID);
+	if (r != ERROR_ok) return r;
+	group_member& member = index.clients[clientID];
+	member.locks = 0;
+	updateLocks(index, member);
+	member.locked_channel = member.locks ? channelID : 0;
+	return ERROR_ok;
+}
+
+void groupIndexRemoveClient(group_index& index, anyID clientID) {
+	if (clientID >= index.clients.size()) return;
+	index.clients[clientID] = group_member{ std::vector<uint64>(), 0, 0, 0 };
+}
+
+void groupIndexSetServerGroup(group_index& index, anyID clientID, uint64 serverGroupID, bool member) {
+	if (!index.seeded) return;
+	group_member& m = getMember(index, clientID);
+	const auto it = std::lower_bound(m.server_groups.begin(), m.server_groups.end(), serverGroupID);
+	const bool found = it != m.server_groups.end() && *it == serverGroupID;
+	if (member && !found) m.server_groups.insert(it, serverGroupID);
+	else if (!member && found) m.server_groups.erase(it);
+	updateLocks(index, m);
+}
+
+void groupIndexSetChannelGroup(group_index& index, anyID clientID, uint64 channelGroupID) {
+	if (!index.seeded) return;
+	group_member& m = getMember(index, clientID);
+	m.channel_group = channelGroupID;
+	updateLocks(index, m);
+}
+
+static int findLock(const group_index& index, group_type type, uint64 groupID) {
+	for (uint64 used = index.used; used; used &= used - 1) {
+		const unsigned int bit = lowestBit(used);
+		if (index.locks[bit].type == type && index.locks[bit].groupID == groupID) return (int)bit;
+	}
+	return -1;
+}
+
+bool groupIndexLock(group_index& index, group_type type, uint64 groupID) {
+	if (findLock(index, type, groupID) >= 0) return true;
+	if (index.used == ~0ull) return false;
+
+	const unsigned int bit = lowestBit(~index.used);
+	index.locks[bit] = group_lock{ type, groupID };
+	index.used |= 1ull << bit;
+	for (group_member& member : index.clients) {
+		if (!isMember(member, index.locks[bit])) continue;
+		if (!member.locks) member.locked_channel = 0;
+		member.locks |= 1ull << bit;
+	}
+	return true;
+}
+
+bool groupIndexUnlock(group_index& index, group_type type, uint64 groupID) {
+	const int bit = findLock(index, type, groupID);
+	if (bit < 0) return false;
+	index.used &= ~(1ull << bit);
+	if (!index.used) {
+		groupIndexUnlockAll(index);
+		return true;
+	}
+	for (group_member& member : index.clients) member.locks &= ~(1ull << bit);
+	return true;
+}
+
+void groupIndexUnlockAll(group_index& index) {
+	index.used = 0;
+	index.clients.clear();
+	index.seeded = false;
+}
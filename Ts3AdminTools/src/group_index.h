@@ -0,0 +1,73 @@
+/*
+ * Server and channel group membership of the clients in view, and the groups whose members are locked.
+ *
+ * Every locked group owns one bit of a 64 bit mask. Each client keeps the mask of the locked groups it is in, which is
+ * updated when a group is locked or unlocked and when the client's memberships change. Telling whether a moving
+ * client is locked is then one array lookup, however many groups are locked. The index is seeded from the client
+ * variables when the first group is locked, kept up to date from the group events while groups are locked and
+ * dropped with the last lock.
+ */
+
+#ifndef GROUP_INDEX_H
+#define GROUP_INDEX_H
+
+#include <stddef.h>
+#include <vector>
+#include "teamspeak/public_definitions.h"
+
+#define GROUP_LOCK_MAX 64
+
+enum group_type {
+	GROUP_SERVER,
+	GROUP_CHANNEL,
+};
+
+struct group_member {
+	std::vector<uint64> server_groups;  // sorted
+	uint64 channel_group;
+	uint64 locks;           // bits of the locked groups the client is in
+	uint64 locked_channel;  // channel the client is held in, 0 = the one it leaves with its next own move
+};
+
+struct group_lock {
+	group_type type;
+	uint64 groupID;
+};
+
+struct group_index {
+	bool seeded = false;
+	std::vector<group_member> clients = std::vector<group_member>();  // indexed by client id
+	group_lock locks[GROUP_LOCK_MAX];
+	uint64 used = 0;  // bits of the entries in locks that are in use
+};
+
+/* Reads the groups of every client in view from the client lib, replacing what was there */
+unsigned int groupIndexSeed(group_index& index, uint64 serverConnectionHandlerID);
+
+/* Reads the groups of a client that joined channelID */
+unsigned int groupIndexAddClient(group_index& index, uint64 serverConnectionHandlerID, anyID clientID, uint64 channelID);
+
+void groupIndexRemoveClient(group_index& index, anyID clientID);
+
+void groupIndexSetServerGroup(group_index& index, anyID clientID, uint64 serverGroupID, bool member);
+void groupIndexSetChannelGroup(group_index& index, anyID clientID, uint64 channelGroupID);
+
+/* Locks the members of a group where they are, false if GROUP_LOCK_MAX groups are locked already */
+bool groupIndexLock(group_index& index, group_type type, uint64 groupID);
+
+/* False if the group was not locked. Unlocking the last group drops the index. */
+bool groupIndexUnlock(group_index& index, group_type type, uint64 groupID);
+void groupIndexUnlockAll(group_index& index);
+
+inline bool groupIndexActive(const group_index& index) {
+	return index.used != 0;
+}
+
+/* The client if a group it is in is locked, NULL otherwise */
+inline group_member* groupIndexLocked(group_index& index, anyID clientID) {
+	if (clientID >= index.clients.size()) return NULL;
+	group_member& member = index.clients[clientID];
+	return member.locks ? &member : NULL;
+}
+
+#endif
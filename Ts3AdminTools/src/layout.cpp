@@ -0,0 +1,24 @@
+#include "layout.h"
+
+#include <algorithm>
+
+size_t layoutPlan(const channel_layout& layout, const std::vector<layout_client>& clients, std::vector<layout_move>& moves) {
+	if (!layout.active) return 0;
+	size_t count = 0;
+	for (const layout_client& c : clients) {
+		const uint64 target = layoutTarget(layout, c.clientID, c.db_id);
+		if (target == 0 || target == c.channelID) continue;
+		moves.push_back(layout_move{ c.clientID, target });
+		count++;
+	}
+	return count;
+}
+
+size_t layoutChannelCount(const channel_layout& layout) {
+	std::vector<uint64> channels;
+	channels.reserve(layout.assigned.size() + 1);
+	for (const auto& a : layout.assigned) channels.push_back(a.second);
+	if (layout.others) channels.push_back(layout.others);
+	std::sort(channels.begin(), channels.end());
+	return (size_t)(std::unique(channels.begin(), channels.end()) - channels.begin());
+}
@@ -0,0 +1,49 @@
+/*
+ * Channel layout of a server connection: which clients belong in which channel.
+ *
+ * A layout names channels for client database ids and optionally one channel for everyone else. Planning compares it
+ * with where the clients are and yields one move per client that is somewhere else, clients already in place are
+ * never moved. The plugin plans once when a layout is set and afterwards holds every client of the layout in its
+ * channel the way a lock does, so the layout stays in place as clients drift, leave and come back.
+ */
+
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <stddef.h>
+#include <unordered_map>
+#include <vector>
+#include "teamspeak/public_definitions.h"
+
+struct channel_layout {
+	bool active = false;
+	std::unordered_map<uint64, uint64> assigned = std::unordered_map<uint64, uint64>();  // client database id -> channel
+	uint64 others = 0;     // channel of everyone not assigned, 0 = they stay where they are
+	anyID own_client = 0;  // never moved into others
+};
+
+struct layout_client {
+	anyID clientID;
+	uint64 db_id;
+	uint64 channelID;
+};
+
+struct layout_move {
+	anyID clientID;
+	uint64 channelID;
+};
+
+/* Channel the layout wants a client in, 0 if it has no say */
+inline uint64 layoutTarget(const channel_layout& layout, anyID clientID, uint64 clientDBID) {
+	const auto it = layout.assigned.find(clientDBID);
+	if (it != layout.assigned.end()) return it->second;
+	return clientID == layout.own_client ? 0 : layout.others;
+}
+
+/* Appends a move for every client that is not in the channel the layout wants it in, returns how many */
+size_t layoutPlan(const channel_layout& layout, const std::vector<layout_client>& clients, std::vector<layout_move>& moves);
+
+/* Channels the layout names, others included */
+size_t layoutChannelCount(const channel_layout& layout);
+
+#endif
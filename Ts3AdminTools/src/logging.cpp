@@ -0,0 +1,377 @@
+#include "logging.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <time.h>
+#include "common.h"
+
+#define LOG_RECORD_STRINGS 384  // bytes for the string arguments of one record, a record takes 512 bytes
+#define LOG_LINE_BUFSIZE 512
+#define LOG_FILE_NAME "jat.log"
+#define LOG_FLUSH_INTERVAL_MS 50
+
+struct log_record {
+	uint64 time_us;  // system clock
+	uint64 serverConnectionHandlerID;
+	const char* format;
+	unsigned char level;
+	unsigned char count;
+	unsigned char types[LOG_MAX_ARGS];
+	unsigned long long values[LOG_MAX_ARGS];  // raw argument bits, offset into strings for strings
+	char strings[LOG_RECORD_STRINGS];
+};
+
+/* Bounded multi producer ring: a slot is free for position p when its sequence is p, filled when it is p + 1 */
+struct log_slot {
+	std::atomic<size_t> sequence;
+	log_record record;
+};
+
+#ifdef AT_RELEASE
+static log_config config = log_config{ LOG_LEVEL_INFO, 2048, true, false, false };
+#else
+static log_config config = log_config{ LOG_LEVEL_TRACE, 2048, true, false, true };
+#endif
+static std::atomic<int> runtime_level(config.level);
+
+static log_slot* slots = NULL;
+static size_t mask = 0;
+alignas(64) static std::atomic<size_t> enqueue_pos(0);
+alignas(64) static size_t dequeue_pos = 0;
+alignas(64) static std::atomic<size_t> written_pos(0);  // records before this are written
+
+static std::atomic<uint64> written(0);
+static std::atomic<uint64> dropped(0);
+
+static std::atomic<bool> running(false);
+static std::mutex flush_mutex;
+static std::condition_variable flush_wakeup;
+static std::thread flusher;
+
+static std::mutex sink_mutex;  // the flush thread or, while it is not running, the logging thread
+static FILE* file = NULL;
+
+void logSetConfig(const log_config& c) {
+	config = c;
+	if (config.capacity < 2) config.capacity = 2;
+	runtime_level.store(config.level);
+}
+
+log_config logGetConfig() {
+	return config;
+}
+
+/*** Formatting ***/
+
+static const char* levelName(unsigned char level) {
+	static const char* names[] = { "TRACE", "DEBUG", "INFO", "WARN", "ERROR" };
+	return level < LOG_LEVEL_OFF ? names[level] : "?";
+}
+
+static LogLevel clientLevel(unsigned char level) {
+	switch (level) {
+	case LOG_LEVEL_TRACE: return LogLevel_DEVEL;
+	case LOG_LEVEL_DEBUG: return LogLevel_DEBUG;
+	case LOG_LEVEL_INFO: return LogLevel_INFO;
+	case LOG_LEVEL_WARN: return LogLevel_WARNING;
+	default: return LogLevel_ERROR;
+	}
+}
+
+static size_t append(char* out, size_t size, size_t len, const char* text, size_t n) {
+	if (len + 1 >= size) return len;
+	if (n > size - 1 - len) n = size - 1 - len;
+	memcpy(out + len, text, n);
+	out[len + n] = '\0';
+	return len + n;
+}
+
+/* Formats one conversion with the length modifier of the stored argument, whatever the format said */
+static int formatArg(char* out, size_t size, const char* spec, size_t spec_len, char conversion, const log_record& r, int i) {
+	static const char* lengths[] = { "", "", "l", "l", "ll", "ll", "", "", "" };
+	char f[32];
+	if (spec_len + 4 > sizeof(f)) return 0;
+	memcpy(f, spec, spec_len);
+	size_t n = spec_len;
+	const char* length = lengths[r.types[i]];
+	while (*length) f[n++] = *length++;
+	f[n++] = conversion;
+	f[n] = '\0';
+
+	const unsigned long long v = r.values[i];
+	switch (r.types[i]) {
+	case LOG_ARG_INT: return snprintf(out, size, f, (int)(long long)v);
+	case LOG_ARG_UINT: return snprintf(out, size, f, (unsigned int)v);
+	case LOG_ARG_LONG: return snprintf(out, size, f, (long)(long long)v);
+	case LOG_ARG_ULONG: return snprintf(out, size, f, (unsigned long)v);
+	case LOG_ARG_LLONG: return snprintf(out, size, f, (long long)v);
+	case LOG_ARG_ULLONG: return snprintf(out, size, f, v);
+	case LOG_ARG_DOUBLE: {
+		double d;
+		memcpy(&d, &v, sizeof(d));
+		return snprintf(out, size, f, d);
+	}
+	case LOG_ARG_STRING: return snprintf(out, size, f, r.strings + v);
+	default: return snprintf(out, size, f, (const void*)(size_t)v);
+	}
+}
+
+static bool matches(unsigned char type, char conversion) {
+	switch (conversion) {
+	case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+		return type <= LOG_ARG_ULLONG;
+	case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+		return type == LOG_ARG_DOUBLE;
+	case 's':
+		return type == LOG_ARG_STRING;
+	case 'p':
+		return type == LOG_ARG_POINTER;
+	default:
+		return false;
+	}
+}
+
+/* printf on the stored arguments, conversions without a fitting argument print as '?' */
+static size_t formatMessage(char* out, size_t size, const log_record& r) {
+	size_t len = 0;
+	out[0] = '\0';
+	int arg = 0;
+	const char* p = r.format;
+	while (*p) {
+		const char* next = strchr(p, '%');
+		if (!next) {
+			len = append(out, size, len, p, strlen(p));
+			break;
+		}
+		len = append(out, size, len, p, (size_t)(next - p));
+		if (next[1] == '%') {
+			len = append(out, size, len, "%", 1);
+			p = next + 2;
+			continue;
+		}
+
+		// %[flags][width][.precision][length]conversion, the length is replaced by the one of the argument
+		const char* s = next + 1;
+		while (*s && strchr("-+ #0", *s)) s++;
+		while (*s >= '0' && *s <= '9') s++;
+		if (*s == '.') {
+			s++;
+			while (*s >= '0' && *s <= '9') s++;
+		}
+		const size_t spec_len = (size_t)(s - next);
+		while (*s && strchr("hlzjtL", *s)) s++;
+		if (!*s) break;
+		const char conversion = *s;
+		p = s + 1;
+
+		if (arg < r.count && matches(r.types[arg], conversion)) {
+			if (len + 1 < size) {
+				const int n = formatArg(out + len, size - len, next, spec_len, conversion, r, arg);
+				if (n > 0) len = len + (size_t)n < size ? len + (size_t)n : size - 1;
+			}
+		}
+		else {
+			len = append(out, size, len, "?", 1);
+		}
+		arg++;
+	}
+	// messages used to come with their own line break
+	while (len > 0 && out[len - 1] == '\n') out[--len] = '\0';
+	return len;
+}
+
+/*** Sinks ***/
+
+static void writeRecord(const log_record& r) {
+	char message[LOG_LINE_BUFSIZE];
+	formatMessage(message, sizeof(message), r);
+
+	if (file || config.console) {
+		const time_t seconds = (time_t)(r.time_us / 1000000);
+		struct tm t;
+#ifdef _WIN32
+		localtime_s(&t, &seconds);
+#else
+		localtime_r(&seconds, &t);
+#endif
+		char stamp[32];
+		strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &t);
+
+		char line[LOG_LINE_BUFSIZE + 64];
+		if (r.serverConnectionHandlerID) {
+			snprintf(line, sizeof(line), "%s.%03u %-5s [%llu] %s\n", stamp, (unsigned int)(r.time_us / 1000 % 1000), levelName(r.level),
+				(unsigned long long)r.serverConnectionHandlerID, message);
+		}
+		else {
+			snprintf(line, sizeof(line), "%s.%03u %-5s %s\n", stamp, (unsigned int)(r.time_us / 1000 % 1000), levelName(r.level), message);
+		}
+		if (file) fputs(line, file);
+		if (config.console) fputs(line, stdout);
+	}
+	if (config.client_log && ts3Functions.logMessage) {
+		ts3Functions.logMessage(message, clientLevel(r.level), "jAdminTools", r.serverConnectionHandlerID);
+	}
+	written.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void flushSinks() {
+	if (file) fflush(file);
+	if (config.console) fflush(stdout);
+}
+
+/*** Ring ***/
+
+/* Writes the records that are complete, returns how many */
+static size_t drain() {
+	std::lock_guard<std::mutex> lock(sink_mutex);
+	size_t n = 0;
+	log_record r;
+	while (slots) {
+		log_slot& slot = slots[dequeue_pos & mask];
+		if (slot.sequence.load(std::memory_order_acquire) != dequeue_pos + 1) break;
+		r = slot.record;
+		slot.sequence.store(dequeue_pos + mask + 1, std::memory_order_release);
+		dequeue_pos++;
+		writeRecord(r);
+		n++;
+	}
+	if (n) {
+		flushSinks();
+		written_pos.store(dequeue_pos, std::memory_order_release);
+	}
+	return n;
+}
+
+static void fill(log_record& r, log_level level, uint64 serverConnectionHandlerID, const char* format, const log_arg* args, int count) {
+	r.time_us = (uint64)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	r.serverConnectionHandlerID = serverConnectionHandlerID;
+	r.format = format;
+	r.level = (unsigned char)level;
+	r.count = (unsigned char)count;
+	size_t used = 0;
+	for (int i = 0; i < count; i++) {
+		r.types[i] = args[i].type;
+		if (args[i].type != LOG_ARG_STRING) {
+			r.values[i] = args[i].u;
+			continue;
+		}
+		// copy the string, an empty one if there is no room left
+		const char* s = args[i].s ? args[i].s : "(null)";
+		size_t n = strlen(s);
+		if (used >= LOG_RECORD_STRINGS) used = LOG_RECORD_STRINGS - 1;
+		if (n > LOG_RECORD_STRINGS - 1 - used) n = LOG_RECORD_STRINGS - 1 - used;
+		memcpy(r.strings + used, s, n);
+		r.strings[used + n] = '\0';
+		r.values[i] = used;
+		used += n + 1;
+	}
+}
+
+void logPush(log_level level, uint64 serverConnectionHandlerID, const char* format, const log_arg* args, int count) {
+	if ((int)level < runtime_level.load(std::memory_order_relaxed)) return;
+
+	if (!running.load(std::memory_order_acquire)) {
+		log_record r;
+		fill(r, level, serverConnectionHandlerID, format, args, count);
+		std::lock_guard<std::mutex> lock(sink_mutex);
+		writeRecord(r);
+		flushSinks();
+		return;
+	}
+
+	size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+	log_slot* slot;
+	for (;;) {
+		slot = &slots[pos & mask];
+		const intptr_t diff = (intptr_t)slot->sequence.load(std::memory_order_acquire) - (intptr_t)pos;
+		if (diff == 0) {
+			if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+		}
+		else if (diff < 0) {
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		else {
+			pos = enqueue_pos.load(std::memory_order_relaxed);
+		}
+	}
+	fill(slot->record, level, serverConnectionHandlerID, format, args, count);
+	slot->sequence.store(pos + 1, std::memory_order_release);
+
+	// half the ring filled since the last look, don't wait for the interval
+	if ((pos & (mask >> 1)) == 0 || level >= LOG_LEVEL_ERROR) flush_wakeup.notify_one();
+}
+
+/*** Flush thread ***/
+
+static void run() {
+	for (;;) {
+		const bool stop = !running.load();
+		drain();
+		if (stop) break;
+		std::unique_lock<std::mutex> lock(flush_mutex);
+		flush_wakeup.wait_for(lock, std::chrono::milliseconds(LOG_FLUSH_INTERVAL_MS));
+	}
+}
+
+void logStart(const char* directory) {
+	if (running.load()) return;
+
+	if (config.file && directory && *directory) {
+		std::string path = std::string(directory) + LOG_FILE_NAME;
+		file = fopen(path.c_str(), "a");
+	}
+
+	size_t capacity = 2;
+	while (capacity < config.capacity) capacity <<= 1;
+	slots = new log_slot[capacity];
+	for (size_t i = 0; i < capacity; i++) slots[i].sequence.store(i, std::memory_order_relaxed);
+	mask = capacity - 1;
+	enqueue_pos.store(0);
+	dequeue_pos = 0;
+	written_pos.store(0);
+
+	running.store(true, std::memory_order_release);
+	flusher = std::thread(run);
+}
+
+void logStop() {
+	if (!running.exchange(false)) return;
+	flush_wakeup.notify_one();
+	flusher.join();
+	// records that made it into the ring while the flush thread was finishing
+	drain();
+
+	std::lock_guard<std::mutex> lock(sink_mutex);
+	delete[] slots;
+	slots = NULL;
+	if (file) {
+		fclose(file);
+		file = NULL;
+	}
+}
+
+void logFlush() {
+	if (!running.load()) return;
+	const size_t target = enqueue_pos.load();
+	while (written_pos.load(std::memory_order_acquire) < target) {
+		flush_wakeup.notify_one();
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+}
+
+/*** Stats ***/
+
+void logGetStats(log_stats* stats) {
+	stats->written = written.load();
+	stats->dropped = dropped.load();
+}
+
+void logResetStats() {
+	written.store(0);
+	dropped.store(0);
+}
@@ -0,0 +1,128 @@
+/*
+ * Logging.
+ *
+ * LOG_TRACE .. LOG_ERROR take the server tab the message is about (0 if none), a printf style format string literal
+ * and its arguments. Levels below LOG_MIN_LEVEL are compiled out (Release builds keep INFO and up), levels below the
+ * one set at runtime return right away. Nothing is formatted on the calling thread: the call stores the level, the
+ * time, the format pointer and the raw arguments (strings are copied and cut to fit) in a fixed size record of a
+ * bounded lock-free ring, any thread can log. A flush thread formats the records and writes them to jat.log in the
+ * ts3 config folder, the client log (ts3Functions.logMessage) and / or stdout. If the ring is full the record is
+ * dropped and counted.
+ */
+
+#ifndef LOGGING_H
+#define LOGGING_H
+
+#include <stddef.h>
+#include "teamspeak/public_definitions.h"
+
+enum log_level {
+	LOG_LEVEL_TRACE = 0,  // every event, only for debugging the plugin
+	LOG_LEVEL_DEBUG,
+	LOG_LEVEL_INFO,
+	LOG_LEVEL_WARN,
+	LOG_LEVEL_ERROR,
+	LOG_LEVEL_OFF,
+};
+
+#ifndef LOG_MIN_LEVEL
+#ifdef AT_RELEASE
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#else
+#define LOG_MIN_LEVEL LOG_LEVEL_TRACE
+#endif
+#endif
+
+#define LOG_MAX_ARGS 8
+
+struct log_config {
+	log_level level;        // takes effect right away
+	unsigned int capacity;  // records the ring holds, rounded up to a power of two
+	bool file;              // append to jat.log in the directory given to logStart
+	bool client_log;        // ts3Functions.logMessage
+	bool console;           // stdout
+};
+
+struct log_stats {
+	uint64 written;  // records handed to the sinks
+	uint64 dropped;  // records lost because the ring was full
+};
+
+enum log_arg_type {
+	LOG_ARG_INT = 0,
+	LOG_ARG_UINT,
+	LOG_ARG_LONG,
+	LOG_ARG_ULONG,
+	LOG_ARG_LLONG,
+	LOG_ARG_ULLONG,
+	LOG_ARG_DOUBLE,
+	LOG_ARG_STRING,
+	LOG_ARG_POINTER,
+};
+
+struct log_arg {
+	unsigned char type;  // log_arg_type
+	union {
+		long long i;
+		unsigned long long u;
+		double d;
+		const char* s;
+		const void* p;
+	};
+};
+
+/* Sinks and capacity take effect on the next logStart */
+void logSetConfig(const log_config& config);
+log_config logGetConfig();
+
+/*
+ * Starts the flush thread, the log file goes to directory (NULL for none). Stopping writes what is left.
+ * No other thread may log while the logger starts or stops.
+ */
+void logStart(const char* directory);
+void logStop();
+
+/* Waits until every record logged so far is written */
+void logFlush();
+
+void logGetStats(log_stats* stats);
+void logResetStats();
+
+/* Stores a record, use the LOG_* macros. Before logStart and after logStop the record is written right away. */
+void logPush(log_level level, uint64 serverConnectionHandlerID, const char* format, const log_arg* args, int count);
+
+/*** Argument packing, promoted like printf arguments ***/
+
+inline log_arg logArg(int v) { log_arg a; a.type = LOG_ARG_INT; a.i = v; return a; }
+inline log_arg logArg(unsigned int v) { log_arg a; a.type = LOG_ARG_UINT; a.u = v; return a; }
+inline log_arg logArg(long v) { log_arg a; a.type = LOG_ARG_LONG; a.i = v; return a; }
+inline log_arg logArg(unsigned long v) { log_arg a; a.type = LOG_ARG_ULONG; a.u = v; return a; }
+inline log_arg logArg(long long v) { log_arg a; a.type = LOG_ARG_LLONG; a.i = v; return a; }
+inline log_arg logArg(unsigned long long v) { log_arg a; a.type = LOG_ARG_ULLONG; a.u = v; return a; }
+inline log_arg logArg(double v) { log_arg a; a.type = LOG_ARG_DOUBLE; a.d = v; return a; }
+inline log_arg logArg(const char* v) { log_arg a; a.type = LOG_ARG_STRING; a.s = v; return a; }
+inline log_arg logArg(char* v) { return logArg((const char*)v); }
+inline log_arg logArg(const void* v) { log_arg a; a.type = LOG_ARG_POINTER; a.p = v; return a; }
+inline log_arg logArg(bool v) { return logArg((int)v); }
+inline log_arg logArg(char v) { return logArg((int)v); }
+inline log_arg logArg(unsigned char v) { return logArg((int)v); }
+inline log_arg logArg(short v) { return logArg((int)v); }
+inline log_arg logArg(unsigned short v) { return logArg((int)v); }
+inline log_arg logArg(float v) { return logArg((double)v); }
+
+template <typename... Args>
+inline void logWrite(log_level level, uint64 serverConnectionHandlerID, const char* format, Args... args) {
+	static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "Too many log arguments");
+	const log_arg packed[sizeof...(Args) + 1] = { logArg(args)... };
+	logPush(level, serverConnectionHandlerID, format, packed, (int)sizeof...(Args));
+}
+
+/* The format has to be a literal, only its address is stored */
+#define LOG_AT(level, sch, fmt, ...) do { if ((level) >= LOG_MIN_LEVEL) logWrite(level, sch, "" fmt, ##__VA_ARGS__); } while (0)
+#define LOG_TRACE(sch, fmt, ...) LOG_AT(LOG_LEVEL_TRACE, sch, fmt, ##__VA_ARGS__)
+#define LOG_DEBUG(sch, fmt, ...) LOG_AT(LOG_LEVEL_DEBUG, sch, fmt, ##__VA_ARGS__)
+#define LOG_INFO(sch, fmt, ...) LOG_AT(LOG_LEVEL_INFO, sch, fmt, ##__VA_ARGS__)
+#define LOG_WARN(sch, fmt, ...) LOG_AT(LOG_LEVEL_WARN, sch, fmt, ##__VA_ARGS__)
+#define LOG_ERROR(sch, fmt, ...) LOG_AT(LOG_LEVEL_ERROR, sch, fmt, ##__VA_ARGS__)
+
+#endif
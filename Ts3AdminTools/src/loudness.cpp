@@ -0,0 +1,254 @@
+#include "loudness.h"
+
+#include <math.h>
+#include <atomic>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LOUDNESS_SSE2
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define LOUDNESS_AVX2_TARGET
+#else
+#define LOUDNESS_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+// vector iterations between two reads of the 16 bit clip counters, they can't overflow before
+#define LOUDNESS_CLIP_BLOCK 4096
+
+typedef void (*measure_function)(const short* samples, size_t count, loudness_frame* out);
+
+static const char* kernel_names[LOUDNESS_KERNEL_COUNT] = { "scalar", "sse2", "avx2" };
+
+/*** Kernels ***/
+
+static void measureScalar(const short* samples, size_t count, loudness_frame* out) {
+	uint64 energy = 0;
+	int high = 0;
+	int low = 0;
+	unsigned int clipped = 0;
+	for (size_t i = 0; i < count; i++) {
+		const int x = samples[i];
+		energy += (uint64)(x * x);
+		if (x > high) high = x;
+		if (x < low) low = x;
+		clipped += x >= LOUDNESS_CLIP_LEVEL || x <= -LOUDNESS_CLIP_LEVEL;
+	}
+	out->energy = energy;
+	out->peak = (unsigned int)(high > -low ? high : -low);
+	out->clipped = clipped;
+}
+
+/* Adds the tail the vector loop left over */
+static void addScalarTail(const short* samples, size_t count, loudness_frame* out) {
+	if (count == 0) return;
+	loudness_frame tail;
+	measureScalar(samples, count, &tail);
+	out->energy += tail.energy;
+	if (tail.peak > out->peak) out->peak = tail.peak;
+	out->clipped += tail.clipped;
+}
+
+#ifdef LOUDNESS_SSE2
+/*
+ * madd squares pairs of samples into 32 bit lanes. Two squares reach 2^31 at most, read unsigned that fits, so the
+ * lanes are widened with zeros into the 64 bit sums.
+ */
+static void measureSse2(const short* samples, size_t count, loudness_frame* out) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i clip_high = _mm_set1_epi16(LOUDNESS_CLIP_LEVEL - 1);
+	const __m128i clip_low = _mm_set1_epi16(-(LOUDNESS_CLIP_LEVEL - 1));
+	__m128i energy = zero;
+	__m128i high = zero;
+	__m128i low = zero;
+	unsigned int clipped = 0;
+	size_t i = 0;
+	while (count - i >= 8) {
+		size_t block = (count - i) / 8;
+		if (block > LOUDNESS_CLIP_BLOCK) block = LOUDNESS_CLIP_BLOCK;
+		__m128i clips = zero;
+		for (const size_t end = i + block * 8; i < end; i += 8) {
+			const __m128i x = _mm_loadu_si128((const __m128i*)(samples + i));
+			const __m128i square = _mm_madd_epi16(x, x);
+			energy = _mm_add_epi64(energy, _mm_unpacklo_epi32(square, zero));
+			energy = _mm_add_epi64(energy, _mm_unpackhi_epi32(square, zero));
+			high = _mm_max_epi16(high, x);
+			low = _mm_min_epi16(low, x);
+			// compare masks are -1, subtracting counts them
+			clips = _mm_sub_epi16(clips, _mm_or_si128(_mm_cmpgt_epi16(x, clip_high), _mm_cmplt_epi16(x, clip_low)));
+		}
+		alignas(16) unsigned short lanes[8];
+		_mm_store_si128((__m128i*)lanes, clips);
+		for (unsigned short lane : lanes) clipped += lane;
+	}
+
+	alignas(16) uint64 sums[2];
+	alignas(16) short highs[8];
+	alignas(16) short lows[8];
+	_mm_store_si128((__m128i*)sums, energy);
+	_mm_store_si128((__m128i*)highs, high);
+	_mm_store_si128((__m128i*)lows, low);
+	int peak = 0;
+	for (int lane = 0; lane < 8; lane++) {
+		if (highs[lane] > peak) peak = highs[lane];
+		if (-lows[lane] > peak) peak = -lows[lane];
+	}
+	out->energy = sums[0] + sums[1];
+	out->peak = (unsigned int)peak;
+	out->clipped = clipped;
+	addScalarTail(samples + i, count - i, out);
+}
+
+/* measureSse2 on 16 samples at a time */
+LOUDNESS_AVX2_TARGET static void measureAvx2(const short* samples, size_t count, loudness_frame* out) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i clip_high = _mm256_set1_epi16(LOUDNESS_CLIP_LEVEL - 1);
+	const __m256i clip_low = _mm256_set1_epi16(-(LOUDNESS_CLIP_LEVEL - 1));
+	__m256i energy = zero;
+	__m256i high = zero;
+	__m256i low = zero;
+	unsigned int clipped = 0;
+	size_t i = 0;
+	while (count - i >= 16) {
+		size_t block = (count - i) / 16;
+		if (block > LOUDNESS_CLIP_BLOCK) block = LOUDNESS_CLIP_BLOCK;
+		__m256i clips = zero;
+		for (const size_t end = i + block * 16; i < end; i += 16) {
+			const __m256i x = _mm256_loadu_si256((const __m256i*)(samples + i));
+			const __m256i square = _mm256_madd_epi16(x, x);
+			energy = _mm256_add_epi64(energy, _mm256_unpacklo_epi32(square, zero));
+			energy = _mm256_add_epi64(energy, _mm256_unpackhi_epi32(square, zero));
+			high = _mm256_max_epi16(high, x);
+			low = _mm256_min_epi16(low, x);
+			clips = _mm256_sub_epi16(clips, _mm256_or_si256(_mm256_cmpgt_epi16(x, clip_high), _mm256_cmpgt_epi16(clip_low, x)));
+		}
+		alignas(32) unsigned short lanes[16];
+		_mm256_store_si256((__m256i*)lanes, clips);
+		for (unsigned short lane : lanes) clipped += lane;
+	}
+
+	alignas(32) uint64 sums[4];
+	alignas(32) short highs[16];
+	alignas(32) short lows[16];
+	_mm256_store_si256((__m256i*)sums, energy);
+	_mm256_store_si256((__m256i*)highs, high);
+	_mm256_store_si256((__m256i*)lows, low);
+	int peak = 0;
+	for (int lane = 0; lane < 16; lane++) {
+		if (highs[lane] > peak) peak = highs[lane];
+		if (-lows[lane] > peak) peak = -lows[lane];
+	}
+	out->energy = sums[0] + sums[1] + sums[2] + sums[3];
+	out->peak = (unsigned int)peak;
+	out->clipped = clipped;
+	addScalarTail(samples + i, count - i, out);
+}
+
+static bool cpuHasAvx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+	// the OS has to save the ymm registers too
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6) return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+/*** Dispatch ***/
+
+static measure_function kernelFunction(loudness_kernel kernel) {
+#ifdef LOUDNESS_SSE2
+	if (kernel == LOUDNESS_KERNEL_AVX2) return measureAvx2;
+	if (kernel == LOUDNESS_KERNEL_SSE2) return measureSse2;
+#endif
+	return measureScalar;
+}
+
+static std::atomic<measure_function> measure(NULL);
+
+loudness_kernel loudnessBestKernel() {
+#ifdef LOUDNESS_SSE2
+	static const loudness_kernel best = cpuHasAvx2() ? LOUDNESS_KERNEL_AVX2 : LOUDNESS_KERNEL_SSE2;
+	return best;
+#else
+	return LOUDNESS_KERNEL_SCALAR;
+#endif
+}
+
+const char* loudnessKernelName(loudness_kernel kernel) {
+	return kernel < LOUDNESS_KERNEL_COUNT ? kernel_names[kernel] : "unknown";
+}
+
+void loudnessSetKernel(loudness_kernel kernel) {
+	if (kernel > loudnessBestKernel()) kernel = loudnessBestKernel();
+	measure.store(kernelFunction(kernel), std::memory_order_relaxed);
+}
+
+void loudnessMeasure(const short* samples, size_t count, loudness_frame* out) {
+	measure_function f = measure.load(std::memory_order_relaxed);
+	if (!f) {
+		f = kernelFunction(loudnessBestKernel());
+		measure.store(f, std::memory_order_relaxed);
+	}
+	f(samples, count, out);
+}
+
+/*** Meter ***/
+
+void loudnessEnable(loudness_meter& meter, const loudness_config& config) {
+	meter.config = config;
+	// full scale RMS squared, lowered by the threshold: 10^(-dB/10)
+	meter.threshold_square = (uint64)(32767.0 * 32767.0 * pow(10.0, -(double)config.threshold_db / 10.0));
+	meter.clients.clear();
+}
+
+void loudnessTrack(loudness_meter& meter, anyID clientID, bool in_view) {
+	if (clientID >= meter.clients.size()) {
+		if (!in_view) return;
+		meter.clients.resize((size_t)clientID + 1, loudness_client{ 0, false, false, false });
+	}
+	meter.clients[clientID] = loudness_client{ 0, in_view, false, false };
+}
+
+bool loudnessFeed(loudness_meter& meter, anyID clientID, const loudness_frame& frame, size_t count, int channels) {
+	if (clientID >= meter.clients.size() || count == 0 || channels <= 0) return false;
+	loudness_client& c = meter.clients[clientID];
+	if (!c.tracked) return false;
+
+	const unsigned int frame_ms = (unsigned int)(count / (size_t)channels * 1000 / LOUDNESS_SAMPLE_RATE);
+	const bool loud = frame.energy >= meter.threshold_square * count || (uint64)frame.clipped * 100 >= (uint64)count * LOUDNESS_CLIP_PERCENT;
+	if (loud) {
+		// capped at the hold time, so a client that stops drains within it
+		c.loud_ms += frame_ms;
+		if (c.loud_ms > meter.config.hold_ms) c.loud_ms = meter.config.hold_ms;
+	}
+	else {
+		c.loud_ms = c.loud_ms > frame_ms ? c.loud_ms - frame_ms : 0;
+		if (c.loud_ms == 0) c.reported = false;
+	}
+	if (!loud || c.reported || c.loud_ms < meter.config.hold_ms) return false;
+	c.reported = true;
+	c.pending = true;
+	meter.pending = true;
+	return true;
+}
+
+size_t loudnessTakeReports(loudness_meter& meter, std::vector<anyID>& clients) {
+	if (!meter.pending) return 0;
+	meter.pending = false;
+	size_t taken = 0;
+	for (size_t id = 0; id < meter.clients.size(); id++) {
+		if (!meter.clients[id].pending) continue;
+		meter.clients[id].pending = false;
+		clients.push_back((anyID)id);
+		taken++;
+	}
+	return taken;
+}
@@ -0,0 +1,82 @@
+/*
+ * Loudness and clipping meter for the voice data of a server connection.
+ *
+ * The playback callback hands every client's 20 ms frames to loudnessMeasure, which sums the squares of the samples,
+ * finds the peak and counts clipped samples in one pass. The pass is an AVX2 or SSE2 kernel picked once from what the
+ * CPU supports, with a scalar fallback. A frame is loud when its RMS reaches the threshold or enough of it clips.
+ * Loud frames fill a client's bucket by their length and quiet ones drain it, a client whose bucket reaches the hold
+ * time is reported once, until it drained again. Short bangs and laughs stay below the hold time, a soundboard
+ * blasting at full scale does not.
+ *
+ * Nothing here allocates once the clients are tracked: loudnessTrack sizes the client table when a client comes into
+ * view, loudnessFeed only looks clients up and flags the ones that reached the hold time, so it is safe on the audio
+ * thread. The flagged clients are taken with loudnessTakeReports on another thread, which reports and mutes them.
+ */
+
+#ifndef LOUDNESS_H
+#define LOUDNESS_H
+
+#include <stddef.h>
+#include <vector>
+#include "teamspeak/public_definitions.h"
+
+#define LOUDNESS_SAMPLE_RATE 48000     // playback voice data is always 48 kHz
+#define LOUDNESS_CLIP_LEVEL 32700      // samples at or beyond this are clipped
+#define LOUDNESS_CLIP_PERCENT 5        // a frame with this share of clipped samples is loud whatever its RMS
+
+enum loudness_kernel {
+	LOUDNESS_KERNEL_SCALAR,
+	LOUDNESS_KERNEL_SSE2,
+	LOUDNESS_KERNEL_AVX2,
+	LOUDNESS_KERNEL_COUNT
+};
+
+struct loudness_frame {
+	uint64 energy;         // sum of the squared samples
+	unsigned int peak;     // largest absolute sample, 32768 for -32768
+	unsigned int clipped;  // samples at or beyond LOUDNESS_CLIP_LEVEL either way
+};
+
+struct loudness_config {
+	unsigned int threshold_db;  // RMS threshold in dB below full scale, 0 = off
+	unsigned int hold_ms;
+	bool mute;                  // mute loud clients, otherwise they are only reported
+};
+
+struct loudness_client {
+	unsigned int loud_ms;  // bucket, filled by loud frames and drained by quiet ones
+	bool tracked;          // in view, frames of other clients are ignored
+	bool reported;         // reached the hold time, reported again only after the bucket drained
+	bool pending;          // reached the hold time, not taken by loudnessTakeReports yet
+};
+
+struct loudness_meter {
+	loudness_config config = loudness_config{ 0, 0, false };
+	uint64 threshold_square = 0;  // mean square at the threshold, see loudnessEnable
+	std::vector<loudness_client> clients = std::vector<loudness_client>();  // indexed by client id
+	bool pending = false;  // some client is pending
+};
+
+/* Fastest kernel the CPU supports, picked on first use */
+loudness_kernel loudnessBestKernel();
+const char* loudnessKernelName(loudness_kernel kernel);
+
+/* Overrides the kernel loudnessMeasure uses, the bench compares them. Kernels the CPU lacks fall back to the best one. */
+void loudnessSetKernel(loudness_kernel kernel);
+
+/* Energy, peak and clipping of count interleaved samples */
+void loudnessMeasure(const short* samples, size_t count, loudness_frame* out);
+
+/* Starts over with a new config, clients are added with loudnessTrack */
+void loudnessEnable(loudness_meter& meter, const loudness_config& config);
+
+/* A client came into view (true) or left it (false) */
+void loudnessTrack(loudness_meter& meter, anyID clientID, bool in_view);
+
+/* A measured frame of count samples over channels. True once a client reaches the hold time, it is pending then. */
+bool loudnessFeed(loudness_meter& meter, anyID clientID, const loudness_frame& frame, size_t count, int channels);
+
+/* Appends the pending clients to clients and clears them. Returns how many. */
+size_t loudnessTakeReports(loudness_meter& meter, std::vector<anyID>& clients);
+
+#endif
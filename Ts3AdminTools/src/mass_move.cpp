@@ -0,0 +1,198 @@
+#include "mass_move.h"
+
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "common.h"
+#include "metrics.h"
+#include "move_scheduler.h"
+
+struct move_request {
+	uint64 job;
+	anyID clientID;
+	uint64 channelID;
+	unsigned int attempts;
+};
+
+struct move_job {
+	unsigned int total;
+	unsigned int done;
+	unsigned int succeeded;
+	unsigned int failed;
+	unsigned int retries;
+	std::chrono::steady_clock::time_point started;
+};
+
+struct move_pipeline {
+	std::deque<move_request> pending;
+	std::unordered_map<std::string, move_request> in_flight;
+	std::unordered_map<uint64, move_job> jobs;
+	double window;  // current window, between 1 and max_window
+	bool has_result;
+	mass_move_result last_result;
+};
+
+static mass_move_config config = mass_move_config{ 16, 3 };
+static std::unordered_map<uint64, move_pipeline> pipelines = std::unordered_map<uint64, move_pipeline>();
+static uint64 next_job = 1;
+
+// moves refused when sent from the scheduler thread are completed from there
+static std::recursive_mutex pipeline_mutex;
+
+void massMoveSetConfig(const mass_move_config& c) {
+	std::lock_guard<std::recursive_mutex> lock(pipeline_mutex);
+	config = c;
+	if (config.max_window < 1) config.max_window = 1;
+	for (auto& p : pipelines) {
+		if (p.second.window > config.max_window) p.second.window = config.max_window;
+	}
+}
+
+mass_move_config massMoveGetConfig() {
+	std::lock_guard<std::recursive_mutex> lock(pipeline_mutex);
+	return config;
+}
+
+static void finishJob(uint64 serverConnectionHandlerID, move_pipeline& pipeline, uint64 jobID) {
+	const auto it = pipeline.jobs.find(jobID);
+	if (it == pipeline.jobs.end()) return;
+	const move_job& job = it->second;
+
+	mass_move_result& result = pipeline.last_result;
+	result.serverConnectionHandlerID = serverConnectionHandlerID;
+	result.total = job.total;
+	result.succeeded = job.succeeded;
+	result.failed = job.failed;
+	result.retries = job.retries;
+	result.duration_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - job.started).count();
+	pipeline.has_result = true;
+	pipeline.jobs.erase(it);
+
+	const double per_second = result.duration_ms > 0 ? result.succeeded * 1000.0 / result.duration_ms : 0.0;
+	char msg[256];
+	snprintf(msg, sizeof(msg), "Mass move done: %u/%u moved, %u failed, %u retries in %.0f ms (%.0f moves/s)",
+		result.succeeded, result.total, result.failed, result.retries, result.duration_ms, per_second);
+	LOG_INFO(serverConnectionHandlerID, "%s", msg);
+	ts3Functions.printMessage(serverConnectionHandlerID, msg, PLUGIN_MESSAGE_TARGET_SERVER);
+}
+
+static void completeRequest(uint64 serverConnectionHandlerID, move_pipeline& pipeline, const move_request& request, bool succeeded) {
+	move_job& job = pipeline.jobs[request.job];
+	job.done++;
+	if (succeeded) {
+		job.succeeded++;
+	}
+	else {
+		job.failed++;
+	}
+	if (job.done == job.total) {
+		finishJob(serverConnectionHandlerID, pipeline, request.job);
+	}
+}
+
+static bool onAnswer(uint64 serverConnectionHandlerID, const char* returnCode, unsigned int error, bool from_server);
+
+/* The scheduler counted the failure already */
+static void onMoveRejected(uint64 serverConnectionHandlerID, const char* returnCode, unsigned int error) {
+	onAnswer(serverConnectionHandlerID, returnCode, error, false);
+}
+
+/* Sends queued moves until the window is full, moves waiting in the scheduler count as in flight */
+static void fillWindow(uint64 serverConnectionHandlerID, move_pipeline& pipeline) {
+	while (!pipeline.pending.empty() && pipeline.in_flight.size() < (size_t)pipeline.window) {
+		move_request request = pipeline.pending.front();
+		pipeline.pending.pop_front();
+
+		char returnCode[RETURNCODE_BUFSIZE];
+		ts3Functions.createReturnCode(pluginID, returnCode, RETURNCODE_BUFSIZE);
+		request.attempts++;
+
+		// insert first, the answer might be delivered before requestClientMove returns
+		pipeline.in_flight[returnCode] = request;
+		const unsigned int r = moveSchedulerRequest(serverConnectionHandlerID, request.clientID, request.channelID, MOVE_PRIORITY_BULK, returnCode, onMoveRejected);
+		if (r != ERROR_ok) {
+			// rejected locally (e.g. client already gone), no answer will come
+			LOG_WARN(serverConnectionHandlerID, "Error %u moving client %d", r, request.clientID);
+			pipeline.in_flight.erase(returnCode);
+			completeRequest(serverConnectionHandlerID, pipeline, request, false);
+		}
+	}
+}
+
+void massMoveStart(uint64 serverConnectionHandlerID, const anyID* clients, uint64 channelID) {
+	std::lock_guard<std::recursive_mutex> lock(pipeline_mutex);
+	move_pipeline& pipeline = pipelines[serverConnectionHandlerID];
+	if (pipeline.window < 1) pipeline.window = config.max_window;
+
+	const uint64 jobID = next_job++;
+	move_job job = move_job{ 0, 0, 0, 0, 0, std::chrono::steady_clock::now() };
+	for (const anyID* c = clients; *c != (anyID)NULL; c++) {
+		pipeline.pending.push_back(move_request{ jobID, *c, channelID, 0 });
+		job.total++;
+	}
+	if (job.total == 0) return;
+
+	pipeline.jobs[jobID] = job;
+	fillWindow(serverConnectionHandlerID, pipeline);
+}
+
+static bool onAnswer(uint64 serverConnectionHandlerID, const char* returnCode, unsigned int error, bool from_server) {
+	std::lock_guard<std::recursive_mutex> lock(pipeline_mutex);
+	const auto p = pipelines.find(serverConnectionHandlerID);
+	if (p == pipelines.end()) return false;
+	move_pipeline& pipeline = p->second;
+
+	const auto it = pipeline.in_flight.find(returnCode);
+	if (it == pipeline.in_flight.end()) return false;
+	const move_request request = it->second;
+	pipeline.in_flight.erase(it);
+	if (from_server) metricsCount(error == ERROR_ok || error == ERROR_channel_already_in ? METRIC_MOVES_SUCCEEDED : METRIC_MOVES_FAILED);
+
+	if (error == ERROR_ok || error == ERROR_channel_already_in) {
+		// additive increase, about one more move in flight per window worth of successes
+		pipeline.window += 1.0 / pipeline.window;
+		if (pipeline.window > config.max_window) pipeline.window = config.max_window;
+		completeRequest(serverConnectionHandlerID, pipeline, request, true);
+	}
+	else if (error == ERROR_client_invalid_id || request.attempts > config.max_retries) {
+		// client left, retrying won't help
+		completeRequest(serverConnectionHandlerID, pipeline, request, false);
+	}
+	else {
+		if (error == ERROR_client_is_flooding) {
+			// multiplicative decrease, the server is dropping moves
+			pipeline.window /= 2;
+			if (pipeline.window < 1) pipeline.window = 1;
+		}
+		pipeline.jobs[request.job].retries++;
+		pipeline.pending.push_back(request);
+	}
+
+	fillWindow(serverConnectionHandlerID, pipeline);
+	return true;
+}
+
+bool massMoveOnServerError(uint64 serverConnectionHandlerID, const char* returnCode, unsigned int error) {
+	return onAnswer(serverConnectionHandlerID, returnCode, error, true);
+}
+
+bool massMoveBusy(uint64 serverConnectionHandlerID) {
+	std::lock_guard<std::recursive_mutex> lock(pipeline_mutex);
+	const auto it = pipelines.find(serverConnectionHandlerID);
+	return it != pipelines.end() && (!it->second.pending.empty() || !it->second.in_flight.empty());
+}
+
+bool massMoveLastResult(uint64 serverConnectionHandlerID, mass_move_result* result) {
+	std::lock_guard<std::recursive_mutex> lock(pipeline_mutex);
+	const auto it = pipelines.find(serverConnectionHandlerID);
+	if (it == pipelines.end() || !it->second.has_result) return false;
+	*result = it->second.last_result;
+	return true;
+}
+
+void massMoveDropConnection(uint64 serverConnectionHandlerID) {
+	std::lock_guard<std::recursive_mutex> lock(pipeline_mutex);
+	pipelines.erase(serverConnectionHandlerID);
+}
@@ -0,0 +1,48 @@
+/*
+ * Mass move pipeline.
+ *
+ * Every move of a mass move is tagged with a return code and completed through ts3plugin_onServerErrorEvent.
+ * Only a window of moves is in flight per server connection at a time; the window shrinks when the server
+ * reports flooding and grows back while moves succeed. Failed moves are retried, and once all moves of a
+ * mass move are done the result (moved / failed / retries, duration and throughput) is reported to the tab.
+ * Moves are sent through the move scheduler at bulk priority.
+ */
+
+#ifndef MASS_MOVE_H
+#define MASS_MOVE_H
+
+#include "teamspeak/public_definitions.h"
+
+struct mass_move_config {
+	unsigned int max_window;   // moves in flight per server connection
+	unsigned int max_retries;  // retries per move before it counts as failed
+};
+
+struct mass_move_result {
+	uint64 serverConnectionHandlerID;
+	unsigned int total;
+	unsigned int succeeded;
+	unsigned int failed;
+	unsigned int retries;
+	double duration_ms;
+};
+
+void massMoveSetConfig(const mass_move_config& config);
+mass_move_config massMoveGetConfig();
+
+/* Queues a move of all clients (zero terminated array) into channelID and starts sending */
+void massMoveStart(uint64 serverConnectionHandlerID, const anyID* clients, uint64 channelID);
+
+/* Completes the move tagged with returnCode. Returns false if the return code does not belong to a mass move. */
+bool massMoveOnServerError(uint64 serverConnectionHandlerID, const char* returnCode, unsigned int error);
+
+/* True while moves of this connection are queued or in flight */
+bool massMoveBusy(uint64 serverConnectionHandlerID);
+
+/* Result of the last finished mass move on this connection, false if there is none */
+bool massMoveLastResult(uint64 serverConnectionHandlerID, mass_move_result* result);
+
+/* Drops queued and in flight moves of a connection (on disconnect) */
+void massMoveDropConnection(uint64 serverConnectionHandlerID);
+
+#endif
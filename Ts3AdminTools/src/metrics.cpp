@@ -0,0 +1,261 @@
+#include "metrics.h"
+
+#include <atomic>
+#include <chrono>
+#include <type_traits>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include "common.h"
+#include "move_scheduler.h"
+
+struct metric_histogram {
+	std::atomic<uint64> buckets[METRIC_BUCKETS];
+	std::atomic<uint64> count;
+	std::atomic<uint64> sum_ns;
+	std::atomic<uint64> max_ns;
+	std::atomic<uint64> errors;
+};
+
+static std::atomic<bool> enabled(true);
+static std::atomic<uint64> counters[METRIC_COUNTER_COUNT];
+static metric_histogram callbacks[METRIC_CALLBACK_COUNT];
+static metric_histogram lib_functions[METRIC_LIB_COUNT];
+
+static TS3Functions wrapped;  // the functions called by the timed copies
+
+static const char* counter_names[METRIC_COUNTER_COUNT] = {
+	"moves issued", "moves succeeded", "moves failed", "moves deduplicated", "locks enforced", "follows triggered",
+	"follows coalesced", "layout moves", "afk moves", "afk returns", "loud clients",
+	"voice frames skipped", "chat messages blocked", "chat actions",
+	"banned clients kicked",
+};
+
+static const char* callback_names[METRIC_CALLBACK_COUNT] = {
+	"move event", "move handler", "info data", "menu item", "hotkey", "server error", "channel event", "client event",
+	"group event", "list event", "connect status", "voice data",
+	"text message",
+};
+
+static const char* priority_names[MOVE_PRIORITY_COUNT] = { "lock moves", "follow moves", "bulk moves" };
+
+static const char* lib_names[METRIC_LIB_COUNT] = {
+#define METRIC_LIB_NAME(name) #name,
+	METRIC_LIB_FUNCTIONS(METRIC_LIB_NAME)
+#undef METRIC_LIB_NAME
+};
+
+void metricsSetEnabled(bool e) {
+	enabled.store(e);
+}
+
+bool metricsEnabled() {
+	return enabled.load(std::memory_order_relaxed);
+}
+
+/*** Recording ***/
+
+uint64 metricsNow() {
+	if (!enabled.load(std::memory_order_relaxed)) return 0;
+	return (uint64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* Number of bits of ns, so bucket b holds [2^(b-1), 2^b) */
+static unsigned int bucketOf(uint64 ns) {
+	if (ns == 0) return 0;
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, ns);
+	const unsigned int bits = (unsigned int)index + 1;
+#else
+	const unsigned int bits = 64 - (unsigned int)__builtin_clzll(ns);
+#endif
+	return bits < METRIC_BUCKETS ? bits : METRIC_BUCKETS - 1;
+}
+
+static void record(metric_histogram& h, uint64 start) {
+	if (start == 0) return;
+	const uint64 ns = metricsNow() - start;
+	h.buckets[bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+	h.count.fetch_add(1, std::memory_order_relaxed);
+	h.sum_ns.fetch_add(ns, std::memory_order_relaxed);
+	uint64 max = h.max_ns.load(std::memory_order_relaxed);
+	while (ns > max && !h.max_ns.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {}
+}
+
+void metricsCount(metric_counter counter, uint64 n) {
+	if (enabled.load(std::memory_order_relaxed)) counters[counter].fetch_add(n, std::memory_order_relaxed);
+}
+
+uint64 metricsCounter(metric_counter counter) {
+	return counters[counter].load(std::memory_order_relaxed);
+}
+
+void metricsRecordCallback(metric_callback callback, uint64 start) {
+	record(callbacks[callback], start);
+}
+
+/*** Timed client lib functions ***/
+
+template <typename F, F TS3Functions::*Member, metric_lib Id>
+struct timed_function;
+
+template <typename R, typename... A, R (*TS3Functions::*Member)(A...), metric_lib Id>
+struct timed_function<R (*)(A...), Member, Id> {
+	static R call(A... args) {
+		const uint64 start = metricsNow();
+		if constexpr (std::is_void<R>::value) {
+			(wrapped.*Member)(args...);
+			record(lib_functions[Id], start);
+		}
+		else {
+			const R r = (wrapped.*Member)(args...);
+			record(lib_functions[Id], start);
+			// functions returning unsigned int return an error code
+			if constexpr (std::is_same<R, unsigned int>::value) {
+				if (start && r != ERROR_ok) lib_functions[Id].errors.fetch_add(1, std::memory_order_relaxed);
+			}
+			return r;
+		}
+	}
+};
+
+TS3Functions metricsWrapFunctions(const TS3Functions& funcs) {
+	wrapped = funcs;
+	TS3Functions f = funcs;
+#define METRIC_LIB_WRAP(name) if (funcs.name) f.name = timed_function<decltype(f.name), &TS3Functions::name, METRIC_LIB_##name>::call;
+	METRIC_LIB_FUNCTIONS(METRIC_LIB_WRAP)
+#undef METRIC_LIB_WRAP
+	return f;
+}
+
+/*** Reports ***/
+
+static void summarize(const metric_histogram& h, metric_summary* s) {
+	s->count = h.count.load(std::memory_order_relaxed);
+	s->errors = h.errors.load(std::memory_order_relaxed);
+	s->mean_ns = s->count ? (double)h.sum_ns.load(std::memory_order_relaxed) / (double)s->count : 0.0;
+	s->max_ns = (double)h.max_ns.load(std::memory_order_relaxed);
+	s->p50_ns = 0;
+	s->p99_ns = 0;
+
+	uint64 seen = 0;
+	bool p50 = false;
+	for (unsigned int b = 0; b < METRIC_BUCKETS && s->count; b++) {
+		seen += h.buckets[b].load(std::memory_order_relaxed);
+		const double upper = b == METRIC_BUCKETS - 1 ? s->max_ns : (double)(1ull << b);
+		if (!p50 && seen * 2 >= s->count) {
+			s->p50_ns = upper < s->max_ns ? upper : s->max_ns;
+			p50 = true;
+		}
+		if (seen * 100 >= s->count * 99) {
+			s->p99_ns = upper < s->max_ns ? upper : s->max_ns;
+			break;
+		}
+	}
+}
+
+void metricsCallbackSummary(metric_callback callback, metric_summary* summary) {
+	summarize(callbacks[callback], summary);
+}
+
+void metricsLibSummary(metric_lib function, metric_summary* summary) {
+	summarize(lib_functions[function], summary);
+}
+
+const char* metricsCounterName(metric_counter counter) {
+	return counter_names[counter];
+}
+
+const char* metricsCallbackName(metric_callback callback) {
+	return callback_names[callback];
+}
+
+const char* metricsLibName(metric_lib function) {
+	return lib_names[function];
+}
+
+void metricsShortReport(char* out, size_t size) {
+	metric_summary move;
+	metricsCallbackSummary(METRIC_CB_MOVE_EVENT, &move);
+	snprintf(out, size, "moves %llu issued, %llu ok, %llu failed, %llu dedup | locks %llu | follows %llu (%llu coalesced) | layout %llu | afk %llu (%llu back) | loud %llu | chat %llu blocked | bans %llu kicked | move event p99 %.1f us",
+		(unsigned long long)metricsCounter(METRIC_MOVES_ISSUED), (unsigned long long)metricsCounter(METRIC_MOVES_SUCCEEDED),
+		(unsigned long long)metricsCounter(METRIC_MOVES_FAILED), (unsigned long long)metricsCounter(METRIC_MOVES_DEDUPLICATED),
+		(unsigned long long)metricsCounter(METRIC_LOCKS_ENFORCED), (unsigned long long)metricsCounter(METRIC_FOLLOWS_TRIGGERED),
+		(unsigned long long)metricsCounter(METRIC_FOLLOWS_COALESCED), (unsigned long long)metricsCounter(METRIC_LAYOUT_MOVES),
+		(unsigned long long)metricsCounter(METRIC_AFK_MOVES), (unsigned long long)metricsCounter(METRIC_AFK_RETURNS),
+		(unsigned long long)metricsCounter(METRIC_LOUD_CLIENTS),
+		(unsigned long long)metricsCounter(METRIC_CHAT_BLOCKED), (unsigned long long)metricsCounter(METRIC_BAN_KICKS), move.p99_ns / 1000.0);
+}
+
+static void appendLine(std::string& out, const char* name, const metric_summary& s, bool errors) {
+	char line[160];
+	snprintf(line, sizeof(line), "  %-36s %10llu %12.0f %12.0f %12.0f %12.0f",
+		name, (unsigned long long)s.count, s.mean_ns, s.p50_ns, s.p99_ns, s.max_ns);
+	out += line;
+	if (errors) {
+		snprintf(line, sizeof(line), " %8llu", (unsigned long long)s.errors);
+		out += line;
+	}
+	out += "\n";
+}
+
+std::string metricsReport() {
+	std::string out = "Counters\n";
+	char line[160];
+	for (int c = 0; c < METRIC_COUNTER_COUNT; c++) {
+		snprintf(line, sizeof(line), "  %-36s %10llu\n", counter_names[c], (unsigned long long)metricsCounter((metric_counter)c));
+		out += line;
+	}
+
+	snprintf(line, sizeof(line), "Callbacks (ns)\n  %-36s %10s %12s %12s %12s %12s\n", "", "count", "mean", "p50", "p99", "max");
+	out += line;
+	for (int c = 0; c < METRIC_CALLBACK_COUNT; c++) {
+		metric_summary s;
+		metricsCallbackSummary((metric_callback)c, &s);
+		if (s.count) appendLine(out, callback_names[c], s, false);
+	}
+
+	snprintf(line, sizeof(line), "Client lib functions (ns)\n  %-36s %10s %12s %12s %12s %12s %8s\n", "", "calls", "mean", "p50", "p99", "max", "errors");
+	out += line;
+	for (int f = 0; f < METRIC_LIB_COUNT; f++) {
+		metric_summary s;
+		metricsLibSummary((metric_lib)f, &s);
+		if (s.count) appendLine(out, lib_names[f], s, true);
+	}
+
+	move_scheduler_stats moves;
+	moveSchedulerGetStats(&moves);
+	snprintf(line, sizeof(line), "Move scheduler\n  %-36s %10s %10s %10s %10s %12s %12s\n", "", "queued", "max", "sent", "rejected", "mean wait ms", "max wait ms");
+	out += line;
+	for (int p = 0; p < MOVE_PRIORITY_COUNT; p++) {
+		snprintf(line, sizeof(line), "  %-36s %10llu %10llu %10llu %10llu %12.1f %12.1f\n", priority_names[p],
+			(unsigned long long)moves.queued[p], (unsigned long long)moves.max_queued[p], (unsigned long long)moves.sent[p],
+			(unsigned long long)moves.rejected[p], moves.sent[p] ? moves.total_wait_ms[p] / moves.sent[p] : 0.0, moves.max_wait_ms[p]);
+		out += line;
+	}
+	return out;
+}
+
+bool metricsDump(const char* path) {
+	FILE* f = fopen(path, "w");
+	if (!f) return false;
+	const std::string report = metricsReport();
+	const bool ok = fwrite(report.data(), 1, report.size(), f) == report.size();
+	return fclose(f) == 0 && ok;
+}
+
+static void resetHistogram(metric_histogram& h) {
+	for (auto& b : h.buckets) b.store(0, std::memory_order_relaxed);
+	h.count.store(0, std::memory_order_relaxed);
+	h.sum_ns.store(0, std::memory_order_relaxed);
+	h.max_ns.store(0, std::memory_order_relaxed);
+	h.errors.store(0, std::memory_order_relaxed);
+}
+
+void metricsReset() {
+	for (auto& c : counters) c.store(0, std::memory_order_relaxed);
+	for (auto& h : callbacks) resetHistogram(h);
+	for (auto& h : lib_functions) resetHistogram(h);
+	moveSchedulerResetStats();
+}
@@ -0,0 +1,146 @@
+/*
+ * Plugin metrics.
+ *
+ * Counters for what the plugin did with moves, and latency histograms of the plugin callbacks and of the client lib
+ * functions it calls. The client lib functions are timed by a wrapped copy of the function table (see
+ * metricsWrapFunctions), which also counts the calls that returned an error, including the ones the Release CALL /
+ * R_CALL macros drop. Everything is fixed size and updated with relaxed atomics, so any thread can record.
+ *
+ * Histograms have one bucket per power of two nanoseconds, percentiles are the upper bound of their bucket.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string>
+#include "teamspeak/public_definitions.h"
+#include "ts3_functions.h"
+
+enum metric_counter {
+	METRIC_MOVES_ISSUED = 0,   // requestClientMove calls
+	METRIC_MOVES_SUCCEEDED,    // answered ok by the server
+	METRIC_MOVES_FAILED,       // refused by the client lib or the server
+	METRIC_MOVES_DEDUPLICATED, // events dropped as repeats or echoes and moves not sent because the same one is pending
+	METRIC_LOCKS_ENFORCED,     // locked clients moved back
+	METRIC_FOLLOWS_TRIGGERED,  // own client moved after the follow target
+	METRIC_FOLLOWS_COALESCED,  // follow target hops merged into a move still waiting for its window
+	METRIC_LAYOUT_MOVES,       // clients moved into the channel the layout wants them in
+	METRIC_AFK_MOVES,          // idle clients moved to the AFK channel
+	METRIC_AFK_RETURNS,        // clients moved back from the AFK channel when they became active
+	METRIC_LOUD_CLIENTS,       // clients whose voice stayed above the loudness threshold for the hold time
+	METRIC_VOICE_FRAMES_SKIPPED, // voice frames not metered because the plugin state was busy
+	METRIC_CHAT_BLOCKED,       // chat messages hidden by the chat filter
+	METRIC_CHAT_ACTIONS,       // senders reported, kicked or locked by the chat filter
+	METRIC_BAN_KICKS,          // joining clients kicked by the ban list cache
+	METRIC_COUNTER_COUNT
+};
+
+enum metric_callback {
+	METRIC_CB_MOVE_EVENT = 0,  // move callbacks on the client thread
+	METRIC_CB_MOVE_HANDLER,    // move events on the event worker
+	METRIC_CB_INFO_DATA,
+	METRIC_CB_MENU_ITEM,
+	METRIC_CB_HOTKEY,
+	METRIC_CB_SERVER_ERROR,    // server error and permission error events
+	METRIC_CB_CHANNEL_EVENT,   // channel created, deleted or moved
+	METRIC_CB_CLIENT_EVENT,    // client updated and client id events
+	METRIC_CB_GROUP_EVENT,     // server and channel group membership events
+	METRIC_CB_LIST_EVENT,      // group, permission and ban list rows
+	METRIC_CB_CONNECT_STATUS,
+	METRIC_CB_VOICE_DATA,      // playback voice frames on the audio thread
+	METRIC_CB_TEXT_MESSAGE,
+	METRIC_CALLBACK_COUNT
+};
+
+/* Client lib functions that are timed */
+#define METRIC_LIB_FUNCTIONS(X) \
+	X(getClientID) \
+	X(getChannelOfClient) \
+	X(getClientList) \
+	X(getChannelClientList) \
+	X(getClientVariableAsUInt64) \
+	X(getClientVariableAsString) \
+	X(getConnectionVariableAsString) \
+	X(getChannelList) \
+	X(getParentChannelOfChannel) \
+	X(getChannelVariableAsInt) \
+	X(getChannelVariableAsUInt64) \
+	X(getChannelVariableAsString) \
+	X(getServerVariableAsString) \
+	X(getCurrentServerConnectionHandlerID) \
+	X(requestClientMove) \
+	X(requestMuteClients) \
+	X(requestClientKickFromServer) \
+	X(setPluginMenuEnabled) \
+	X(printMessage) \
+	X(createReturnCode) \
+	X(requestServerGroupList) \
+	X(requestChannelGroupList) \
+	X(requestServerGroupPermList) \
+	X(requestChannelGroupPermList) \
+	X(requestChannelPermList) \
+	X(requestBanList) \
+	X(requestServerGroupAddPerm) \
+	X(requestChannelGroupAddPerm) \
+	X(requestChannelAddPerm)
+
+enum metric_lib {
+#define METRIC_LIB_ENUM(name) METRIC_LIB_##name,
+	METRIC_LIB_FUNCTIONS(METRIC_LIB_ENUM)
+#undef METRIC_LIB_ENUM
+	METRIC_LIB_COUNT
+};
+
+#define METRIC_BUCKETS 40  // bucket b holds durations below 2^b ns, the last one everything longer
+
+struct metric_summary {
+	uint64 count;
+	uint64 errors;  // client lib functions only
+	double mean_ns;
+	double p50_ns;
+	double p99_ns;
+	double max_ns;
+};
+
+/* Copy of funcs where the functions in METRIC_LIB_FUNCTIONS are timed, the others are left as they are */
+TS3Functions metricsWrapFunctions(const TS3Functions& funcs);
+
+/* Switched off, nothing is counted or timed */
+void metricsSetEnabled(bool enabled);
+bool metricsEnabled();
+
+void metricsCount(metric_counter counter, uint64 n = 1);
+uint64 metricsCounter(metric_counter counter);
+
+uint64 metricsNow();
+void metricsRecordCallback(metric_callback callback, uint64 start);
+
+void metricsCallbackSummary(metric_callback callback, metric_summary* summary);
+void metricsLibSummary(metric_lib function, metric_summary* summary);
+
+const char* metricsCounterName(metric_counter counter);
+const char* metricsCallbackName(metric_callback callback);
+const char* metricsLibName(metric_lib function);
+
+/* One line for the info panel */
+void metricsShortReport(char* out, size_t size);
+/* Counters, every histogram that recorded something and the move scheduler's queues, one per line */
+std::string metricsReport();
+bool metricsDump(const char* path);
+
+/* Resets the move scheduler's statistics as well */
+void metricsReset();
+
+/* Times the rest of the enclosing scope as callback */
+struct metric_scope {
+	metric_callback callback;
+	uint64 start;
+	metric_scope(metric_callback cb) : callback(cb), start(metricsNow()) {}
+	~metric_scope() { metricsRecordCallback(callback, start); }
+};
+
+#define METRIC_TIME(callback) metric_scope metric_scope_(callback)
+
+#endif
@@ -0,0 +1,126 @@
+#include "move_history.h"
+
+#include "teamspeak/public_errors.h"
+
+typedef std::chrono::steady_clock clock_type;
+
+static unsigned int window_ms = 1000;
+static move_history_stats stats = move_history_stats();
+
+void moveHistorySetWindow(unsigned int w) {
+	window_ms = w;
+}
+
+unsigned int moveHistoryGetWindow() {
+	return window_ms;
+}
+
+static client_move_history* findHistory(move_histories& histories, anyID clientID) {
+	return clientID < histories.size() ? &histories[clientID] : NULL;
+}
+
+static client_move_history& getHistory(move_histories& histories, anyID clientID) {
+	if (histories.size() <= clientID) {
+		histories.resize((size_t)clientID + 1, client_move_history());
+	}
+	return histories[clientID];
+}
+
+static bool isExpired(const move_transition& t, clock_type::time_point now) {
+	return t.sent && now - t.at > std::chrono::milliseconds(window_ms);
+}
+
+static void push(client_move_history& history, const move_transition& t) {
+	history.ring[history.head] = t;
+	history.head = (history.head + 1) % MOVE_HISTORY_SIZE;
+	if (history.count < MOVE_HISTORY_SIZE) history.count++;
+}
+
+/* i = 0 is the newest entry */
+static move_transition& entry(client_move_history& history, unsigned int i) {
+	return history.ring[(history.head + MOVE_HISTORY_SIZE - 1 - i) % MOVE_HISTORY_SIZE];
+}
+
+move_verdict moveHistoryObserve(move_histories& histories, anyID clientID, uint64 oldChannelID, uint64 newChannelID, bool was_moved) {
+	stats.observed++;
+	if (window_ms == 0) return MOVE_VERDICT_NEW;
+
+	const clock_type::time_point now = clock_type::now();
+	const move_cause cause = was_moved ? MOVE_CAUSE_MOVED : MOVE_CAUSE_SELF;
+	client_move_history& history = getHistory(histories, clientID);
+
+	bool seen_last = false;
+	for (unsigned int i = 0; i < history.count; i++) {
+		// a move that waited in the scheduler can still be pending behind expired entries
+		move_transition& t = entry(history, i);
+		if (isExpired(t, now)) continue;
+
+		if (t.pending) {
+			if (t.newChannelID == newChannelID) {
+				t.pending = false;
+				t.oldChannelID = oldChannelID;
+				stats.echoes++;
+				return MOVE_VERDICT_ECHO;
+			}
+		}
+		else if (!seen_last) {
+			// only the last transition can repeat, any other move of the client lies in between
+			seen_last = true;
+			if (t.oldChannelID == oldChannelID && t.newChannelID == newChannelID && t.cause == cause) {
+				stats.duplicates++;
+				return MOVE_VERDICT_DUPLICATE;
+			}
+		}
+	}
+
+	push(history, move_transition{ oldChannelID, newChannelID, cause, false, true, now });
+	return MOVE_VERDICT_NEW;
+}
+
+void moveHistoryExpect(move_histories& histories, anyID clientID, uint64 channelID) {
+	if (window_ms == 0) return;
+	push(getHistory(histories, clientID), move_transition{ 0, channelID, MOVE_CAUSE_PLUGIN, true, false, clock_type::now() });
+}
+
+void moveHistorySent(move_histories& histories, anyID clientID, uint64 channelID, unsigned int error) {
+	client_move_history* history = findHistory(histories, clientID);
+	if (!history) return;
+	// the oldest waiting one, the scheduler sends a client's moves in the order they were requested
+	for (unsigned int i = history->count; i-- > 0;) {
+		move_transition& t = entry(*history, i);
+		if (!t.pending || t.sent || t.newChannelID != channelID) continue;
+		t.sent = true;
+		// no event will come for a refused move, it expires right away
+		t.at = error == ERROR_ok ? clock_type::now() : clock_type::time_point();
+		return;
+	}
+}
+
+bool moveHistoryPending(move_histories& histories, anyID clientID, uint64 channelID) {
+	client_move_history* history = findHistory(histories, clientID);
+	if (window_ms == 0 || !history) return false;
+
+	const clock_type::time_point now = clock_type::now();
+	for (unsigned int i = 0; i < history->count; i++) {
+		const move_transition& t = entry(*history, i);
+		if (isExpired(t, now)) continue;
+		if (t.pending && t.newChannelID == channelID) {
+			stats.suppressed_requests++;
+			return true;
+		}
+	}
+	return false;
+}
+
+void moveHistoryForget(move_histories& histories, anyID clientID) {
+	client_move_history* history = findHistory(histories, clientID);
+	if (history) *history = client_move_history();
+}
+
+void moveHistoryGetStats(move_history_stats* s) {
+	*s = stats;
+}
+
+void moveHistoryResetStats() {
+	stats = move_history_stats();
+}
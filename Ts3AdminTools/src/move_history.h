@@ -0,0 +1,79 @@
+/*
+ * Recent channel transitions per client.
+ *
+ * The client can deliver the same move event more than once, and the moves the plugin requests itself come back as
+ * move events. Every client keeps a small ring of its recent transitions (old channel, new channel, cause) plus the
+ * moves the plugin requested for it; entries older than the window are ignored. A move event is a duplicate if it
+ * repeats the last transition seen for that client, and an echo if it completes a move the plugin requested.
+ * A requested move can wait in the move scheduler's queue for seconds, so its window only starts once it is sent.
+ */
+
+#ifndef MOVE_HISTORY_H
+#define MOVE_HISTORY_H
+
+#include <chrono>
+#include <vector>
+#include "teamspeak/public_definitions.h"
+
+#define MOVE_HISTORY_SIZE 4
+
+enum move_cause {
+	MOVE_CAUSE_SELF,    // client switched channel
+	MOVE_CAUSE_MOVED,   // moved, kicked or timed out
+	MOVE_CAUSE_PLUGIN,  // requested by the plugin
+};
+
+enum move_verdict {
+	MOVE_VERDICT_NEW,
+	MOVE_VERDICT_DUPLICATE,
+	MOVE_VERDICT_ECHO,
+};
+
+struct move_transition {
+	uint64 oldChannelID;
+	uint64 newChannelID;
+	move_cause cause;
+	bool pending;  // requested by the plugin, event not seen yet
+	bool sent;     // false while a pending move waits in the scheduler, it does not age until then
+	std::chrono::steady_clock::time_point at;
+};
+
+struct client_move_history {
+	move_transition ring[MOVE_HISTORY_SIZE];
+	unsigned int head;   // next slot to write
+	unsigned int count;
+};
+
+struct move_history_stats {
+	uint64 observed;
+	uint64 duplicates;
+	uint64 echoes;
+	uint64 suppressed_requests;  // moves not requested because the same move was still in flight
+};
+
+/* Client histories of a server connection, indexed by client id */
+typedef std::vector<client_move_history> move_histories;
+
+/* How long transitions are remembered, 0 disables duplicate and echo detection */
+void moveHistorySetWindow(unsigned int window_ms);
+unsigned int moveHistoryGetWindow();
+
+/* Classifies a move event and records it */
+move_verdict moveHistoryObserve(move_histories& histories, anyID clientID, uint64 oldChannelID, uint64 newChannelID, bool was_moved);
+
+/* Records a move the plugin requested, its event will be reported as an echo. It ages from moveHistorySent. */
+void moveHistoryExpect(move_histories& histories, anyID clientID, uint64 channelID);
+
+/* The expected move was handed to the client lib with result error, a move it refused is forgotten */
+void moveHistorySent(move_histories& histories, anyID clientID, uint64 channelID, unsigned int error);
+
+/* True if a move of the client into channelID requested by the plugin is still in flight, counts it as suppressed */
+bool moveHistoryPending(move_histories& histories, anyID clientID, uint64 channelID);
+
+/* Drops the history of a client (join / leave, the client id can be reused) */
+void moveHistoryForget(move_histories& histories, anyID clientID);
+
+void moveHistoryGetStats(move_history_stats* stats);
+void moveHistoryResetStats();
+
+#endif
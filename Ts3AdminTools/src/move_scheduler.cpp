@@ -0,0 +1,294 @@
+#include "move_scheduler.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "common.h"
+#include "metrics.h"
+
+typedef std::chrono::steady_clock clock_type;
+
+struct scheduled_move {
+	anyID clientID;
+	uint64 channelID;
+	std::string returnCode;
+	move_rejected_handler onRejected;
+	move_sent_handler onSent;
+	bool tracked;  // the return code is the scheduler's own, settled in moveSchedulerOnServerError
+	clock_type::time_point queued;
+};
+
+struct move_bucket {
+	double tokens;
+	clock_type::time_point refilled;
+	std::deque<scheduled_move> queues[MOVE_PRIORITY_COUNT];
+};
+
+struct outgoing_move {
+	uint64 serverConnectionHandlerID;
+	move_priority priority;
+	scheduled_move move;
+};
+
+static move_scheduler_config config = move_scheduler_config{ 50.0, 25.0, true };
+static std::unordered_map<uint64, move_bucket> buckets = std::unordered_map<uint64, move_bucket>();
+static move_scheduler_stats stats = move_scheduler_stats();
+static std::unordered_map<std::string, uint64> tracked_codes = std::unordered_map<std::string, uint64>();  // own return code -> connection
+
+static std::mutex scheduler_mutex;
+static std::condition_variable scheduler_wakeup;
+static std::thread dispatch_thread;
+static bool dispatch_running = false;
+
+/*** Token bucket ***/
+
+static move_bucket& getBucket(uint64 serverConnectionHandlerID, clock_type::time_point now) {
+	const auto it = buckets.find(serverConnectionHandlerID);
+	if (it != buckets.end()) return it->second;
+	move_bucket& bucket = buckets[serverConnectionHandlerID];
+	bucket.tokens = config.burst;
+	bucket.refilled = now;
+	return bucket;
+}
+
+static void refill(move_bucket& bucket, clock_type::time_point now) {
+	const double elapsed = std::chrono::duration<double>(now - bucket.refilled).count();
+	bucket.refilled = now;
+	bucket.tokens += elapsed * config.rate;
+	if (bucket.tokens > config.burst) bucket.tokens = config.burst;
+}
+
+static bool isEmpty(const move_bucket& bucket) {
+	for (const auto& queue : bucket.queues) {
+		if (!queue.empty()) return false;
+	}
+	return true;
+}
+
+static void recordSent(move_priority priority, clock_type::time_point queued, clock_type::time_point now) {
+	const double wait_ms = std::chrono::duration<double, std::milli>(now - queued).count();
+	stats.sent[priority]++;
+	stats.total_wait_ms[priority] += wait_ms;
+	if (wait_ms > stats.max_wait_ms[priority]) stats.max_wait_ms[priority] = wait_ms;
+}
+
+/* Takes the moves the buckets allow out of the queues, highest priority first. Returns the time until the next token. */
+static double takeReady(std::vector<outgoing_move>& out, clock_type::time_point now) {
+	double next_ms = -1;
+	for (auto& b : buckets) {
+		move_bucket& bucket = b.second;
+		if (isEmpty(bucket)) continue;
+		refill(bucket, now);
+
+		for (int p = 0; p < MOVE_PRIORITY_COUNT && bucket.tokens >= 1; p++) {
+			auto& queue = bucket.queues[p];
+			while (!queue.empty() && bucket.tokens >= 1) {
+				bucket.tokens -= 1;
+				stats.queued[p]--;
+				recordSent((move_priority)p, queue.front().queued, now);
+				out.push_back(outgoing_move{ b.first, (move_priority)p, std::move(queue.front()) });
+				queue.pop_front();
+			}
+		}
+
+		if (!isEmpty(bucket)) {
+			const double wait_ms = (1 - bucket.tokens) * 1000.0 / config.rate;
+			if (next_ms < 0 || wait_ms < next_ms) next_ms = wait_ms;
+		}
+	}
+	return next_ms;
+}
+
+/* Sends moves taken out of the queues, must be called without holding the scheduler lock */
+static void sendMoves(const std::vector<outgoing_move>& moves) {
+	for (const outgoing_move& m : moves) {
+		const char* returnCode = m.move.returnCode.empty() ? NULL : m.move.returnCode.c_str();
+		const unsigned int r = ts3Functions.requestClientMove(m.serverConnectionHandlerID, m.move.clientID, m.move.channelID, "", returnCode);
+		metricsCount(METRIC_MOVES_ISSUED);
+		if (m.move.onSent) m.move.onSent(m.serverConnectionHandlerID, m.move.clientID, m.move.channelID, r);
+		if (r == ERROR_ok) continue;
+
+		metricsCount(METRIC_MOVES_FAILED);
+		LOG_WARN(m.serverConnectionHandlerID, "Error %u moving client %d", r, m.move.clientID);
+		{
+			std::lock_guard<std::mutex> lock(scheduler_mutex);
+			stats.rejected[m.priority]++;
+			if (m.move.tracked) tracked_codes.erase(m.move.returnCode);
+		}
+		if (m.move.onRejected && returnCode) {
+			m.move.onRejected(m.serverConnectionHandlerID, returnCode, r);
+		}
+	}
+}
+
+/*** Dispatch thread ***/
+
+static void dispatchLoop() {
+	std::vector<outgoing_move> out;
+	std::unique_lock<std::mutex> lock(scheduler_mutex);
+	while (dispatch_running) {
+		out.clear();
+		const double next_ms = takeReady(out, clock_type::now());
+		if (!out.empty()) {
+			lock.unlock();
+			sendMoves(out);
+			lock.lock();
+			continue;
+		}
+		if (next_ms < 0) {
+			scheduler_wakeup.wait(lock);
+		}
+		else {
+			scheduler_wakeup.wait_for(lock, std::chrono::duration<double, std::milli>(next_ms));
+		}
+	}
+}
+
+void moveSchedulerStart() {
+	std::lock_guard<std::mutex> lock(scheduler_mutex);
+	if (!config.dispatch_thread || dispatch_running) return;
+	dispatch_running = true;
+	dispatch_thread = std::thread(dispatchLoop);
+}
+
+void moveSchedulerStop() {
+	{
+		std::lock_guard<std::mutex> lock(scheduler_mutex);
+		dispatch_running = false;
+	}
+	scheduler_wakeup.notify_all();
+	if (dispatch_thread.joinable()) dispatch_thread.join();
+
+	std::lock_guard<std::mutex> lock(scheduler_mutex);
+	buckets.clear();
+	tracked_codes.clear();
+	for (auto& q : stats.queued) q = 0;
+}
+
+/*** Scheduler ***/
+
+void moveSchedulerSetConfig(const move_scheduler_config& c) {
+	std::lock_guard<std::mutex> lock(scheduler_mutex);
+	config = c;
+	if (config.rate <= 0) config.rate = 1;
+	if (config.burst < 1) config.burst = 1;
+	for (auto& b : buckets) {
+		if (b.second.tokens > config.burst) b.second.tokens = config.burst;
+	}
+}
+
+move_scheduler_config moveSchedulerGetConfig() {
+	std::lock_guard<std::mutex> lock(scheduler_mutex);
+	return config;
+}
+
+unsigned int moveSchedulerRequest(uint64 serverConnectionHandlerID, anyID clientID, uint64 channelID, move_priority priority, const char* returnCode,
+	move_rejected_handler onRejected, move_sent_handler onSent, bool* queued) {
+	// moves without a caller's return code get one of the scheduler, so the server's answer is counted
+	char ownCode[RETURNCODE_BUFSIZE];
+	const bool tracked = returnCode == NULL;
+	if (tracked) {
+		ts3Functions.createReturnCode(pluginID, ownCode, RETURNCODE_BUFSIZE);
+		returnCode = ownCode;
+	}
+
+	const clock_type::time_point now = clock_type::now();
+	{
+		std::lock_guard<std::mutex> lock(scheduler_mutex);
+		// registered first, the answer might be delivered before requestClientMove returns
+		if (tracked) tracked_codes[ownCode] = serverConnectionHandlerID;
+		move_bucket& bucket = getBucket(serverConnectionHandlerID, now);
+		refill(bucket, now);
+
+		const bool wait = !isEmpty(bucket) || bucket.tokens < 1;
+		if (queued) *queued = wait;
+		if (wait) {
+			bucket.queues[priority].push_back(scheduled_move{ clientID, channelID, returnCode, onRejected, onSent, tracked, now });
+			if (++stats.queued[priority] > stats.max_queued[priority]) stats.max_queued[priority] = stats.queued[priority];
+			if (dispatch_running) scheduler_wakeup.notify_one();
+			return ERROR_ok;
+		}
+
+		bucket.tokens -= 1;
+		recordSent(priority, now, now);
+	}
+
+	// nothing waiting and a token left, send right away so the caller gets the client lib result
+	const unsigned int r = ts3Functions.requestClientMove(serverConnectionHandlerID, clientID, channelID, "", returnCode);
+	metricsCount(METRIC_MOVES_ISSUED);
+	if (r != ERROR_ok) {
+		metricsCount(METRIC_MOVES_FAILED);
+		std::lock_guard<std::mutex> lock(scheduler_mutex);
+		stats.rejected[priority]++;
+		if (tracked) tracked_codes.erase(ownCode);
+	}
+	return r;
+}
+
+bool moveSchedulerOnServerError(uint64 serverConnectionHandlerID, const char* returnCode, unsigned int error) {
+	{
+		std::lock_guard<std::mutex> lock(scheduler_mutex);
+		const auto it = tracked_codes.find(returnCode);
+		if (it == tracked_codes.end() || it->second != serverConnectionHandlerID) return false;
+		tracked_codes.erase(it);
+	}
+	if (error == ERROR_ok || error == ERROR_channel_already_in) {
+		metricsCount(METRIC_MOVES_SUCCEEDED);
+	}
+	else {
+		metricsCount(METRIC_MOVES_FAILED);
+		LOG_DEBUG(serverConnectionHandlerID, "Server refused a move with error %u", error);
+	}
+	return true;
+}
+
+void moveSchedulerPoll() {
+	std::vector<outgoing_move> out;
+	{
+		std::lock_guard<std::mutex> lock(scheduler_mutex);
+		takeReady(out, clock_type::now());
+	}
+	sendMoves(out);
+}
+
+size_t moveSchedulerQueued() {
+	std::lock_guard<std::mutex> lock(scheduler_mutex);
+	size_t queued = 0;
+	for (const auto& q : stats.queued) queued += (size_t)q;
+	return queued;
+}
+
+void moveSchedulerGetStats(move_scheduler_stats* s) {
+	std::lock_guard<std::mutex> lock(scheduler_mutex);
+	*s = stats;
+}
+
+void moveSchedulerResetStats() {
+	std::lock_guard<std::mutex> lock(scheduler_mutex);
+	const move_scheduler_stats old = stats;
+	stats = move_scheduler_stats();
+	for (int p = 0; p < MOVE_PRIORITY_COUNT; p++) {
+		stats.queued[p] = old.queued[p];
+		stats.max_queued[p] = old.queued[p];
+	}
+}
+
+void moveSchedulerDropConnection(uint64 serverConnectionHandlerID) {
+	std::lock_guard<std::mutex> lock(scheduler_mutex);
+	const auto it = buckets.find(serverConnectionHandlerID);
+	if (it == buckets.end()) return;
+	for (int p = 0; p < MOVE_PRIORITY_COUNT; p++) {
+		stats.queued[p] -= it->second.queues[p].size();
+	}
+	buckets.erase(it);
+	// no answers will come for the moves in flight
+	for (auto c = tracked_codes.begin(); c != tracked_codes.end();) {
+		if (c->second == serverConnectionHandlerID) c = tracked_codes.erase(c);
+		else ++c;
+	}
+}
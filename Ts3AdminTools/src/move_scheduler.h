@@ -0,0 +1,78 @@
+/*
+ * Outbound move scheduler.
+ *
+ * All client moves the plugin issues go through here. Each server connection has a token bucket that limits the
+ * moves sent to the server (set it to match the servers anti flood settings) and one queue per priority, so lock
+ * enforcement is sent before follow moves and follow moves before mass moves. Moves are sent right away while
+ * tokens are left, otherwise they wait in their queue until a background thread can send them.
+ *
+ * Moves sent without a return code get one of the scheduler, so the server's answer to every move is counted as
+ * succeeded or failed in the metrics (moveSchedulerOnServerError).
+ */
+
+#ifndef MOVE_SCHEDULER_H
+#define MOVE_SCHEDULER_H
+
+#include <stddef.h>
+#include "teamspeak/public_definitions.h"
+
+enum move_priority {
+	MOVE_PRIORITY_LOCK = 0,  // lock enforcement
+	MOVE_PRIORITY_FOLLOW,    // follow / join
+	MOVE_PRIORITY_BULK,      // mass moves
+	MOVE_PRIORITY_COUNT
+};
+
+struct move_scheduler_config {
+	double rate;           // moves per second per server connection
+	double burst;          // moves that can be sent at once after being idle
+	bool dispatch_thread;  // send queued moves from a background thread, else only from moveSchedulerPoll
+};
+
+struct move_scheduler_stats {
+	uint64 queued[MOVE_PRIORITY_COUNT];      // waiting right now
+	uint64 max_queued[MOVE_PRIORITY_COUNT];  // highest queue depth seen
+	uint64 sent[MOVE_PRIORITY_COUNT];
+	uint64 rejected[MOVE_PRIORITY_COUNT];    // refused by the client lib when sent
+	double total_wait_ms[MOVE_PRIORITY_COUNT];
+	double max_wait_ms[MOVE_PRIORITY_COUNT];
+};
+
+/* Called when a queued move that carried a return code is refused by the client lib, no server answer will follow */
+typedef void (*move_rejected_handler)(uint64 serverConnectionHandlerID, const char* returnCode, unsigned int error);
+
+/* Called when a queued move was handed to the client lib, error is its result. From the thread that sent it. */
+typedef void (*move_sent_handler)(uint64 serverConnectionHandlerID, anyID clientID, uint64 channelID, unsigned int error);
+
+void moveSchedulerSetConfig(const move_scheduler_config& config);
+move_scheduler_config moveSchedulerGetConfig();
+
+/* Starts / stops the dispatch thread (if enabled), stopping drops all queued moves */
+void moveSchedulerStart();
+void moveSchedulerStop();
+
+/*
+ * Sends or queues a move. Returns the client lib result if the move was sent right away, ERROR_ok if it was queued.
+ * returnCode may be NULL, the scheduler then tags the move itself. A caller's return code is settled by the caller.
+ * queued (if given) tells which it was, only a queued move gets onSent. Both handlers run without the scheduler's
+ * lock, moves dropped with the connection or on stop get neither.
+ */
+unsigned int moveSchedulerRequest(uint64 serverConnectionHandlerID, anyID clientID, uint64 channelID, move_priority priority, const char* returnCode,
+	move_rejected_handler onRejected = NULL, move_sent_handler onSent = NULL, bool* queued = NULL);
+
+/* Counts the server's answer to a move the scheduler tagged. False if the return code is not one of those. */
+bool moveSchedulerOnServerError(uint64 serverConnectionHandlerID, const char* returnCode, unsigned int error);
+
+/* Sends queued moves the token buckets allow. Done by the dispatch thread when it runs. */
+void moveSchedulerPoll();
+
+/* Moves waiting on all connections */
+size_t moveSchedulerQueued();
+
+void moveSchedulerGetStats(move_scheduler_stats* stats);
+void moveSchedulerResetStats();
+
+/* Drops queued moves of a connection (on disconnect) */
+void moveSchedulerDropConnection(uint64 serverConnectionHandlerID);
+
+#endif
@@ -0,0 +1,184 @@
+#include "occupancy.h"
+
+#include <stdlib.h>
+#include <chrono>
+#include "common.h"
+
+static occupant& getOccupant(channel_occupancy& index, anyID clientID) {
+	if (index.clients.size() <= clientID) {
+		index.clients.resize((size_t)clientID + 1, occupant{ 0, 0, 0, 0, false });
+	}
+	return index.clients[clientID];
+}
+
+/* Takes the client out of the client list of its channel */
+static void detach(channel_occupancy& index, anyID clientID) {
+	occupant& o = index.clients[clientID];
+	if (o.channelID == 0) return;
+	const auto it = index.channels.find(o.channelID);
+	if (it != index.channels.end()) {
+		std::vector<anyID>& list = it->second;
+		const anyID last = list.back();
+		list[o.slot] = last;
+		index.clients[last].slot = o.slot;
+		list.pop_back();
+		if (list.empty()) index.channels.erase(it);
+	}
+	o.channelID = 0;
+}
+
+static void attach(channel_occupancy& index, anyID clientID, uint64 channelID) {
+	occupant& o = index.clients[clientID];
+	o.channelID = channelID;
+	if (channelID == 0) return;
+	std::vector<anyID>& list = index.channels[channelID];
+	o.slot = list.size();
+	list.push_back(clientID);
+}
+
+static int adminGroupBit(const channel_occupancy& index, uint64 serverGroupID) {
+	for (size_t i = 0; i < index.admin_groups.size(); i++) {
+		if (index.admin_groups[i] == serverGroupID) return (int)i;
+	}
+	return -1;
+}
+
+/* CLIENT_SERVERGROUPS holds the group ids separated by commas, only the admin groups are kept */
+static uint64 parseAdminGroups(const channel_occupancy& index, const char* text) {
+	uint64 mask = 0;
+	for (const char* c = text; *c;) {
+		char* end;
+		const uint64 id = strtoull(c, &end, 10);
+		if (end == c) {
+			c++;
+			continue;
+		}
+		const int bit = adminGroupBit(index, id);
+		if (bit >= 0) mask |= 1ull << bit;
+		c = end;
+	}
+	return mask;
+}
+
+/* Reads a client's admin groups, and its talk status if it was there before us (a client that just joined is not talking) */
+static unsigned int queryClient(channel_occupancy& index, uint64 serverConnectionHandlerID, anyID clientID, uint64 channelID, bool joined, uint64 now_ms) {
+	char* text;
+	unsigned int r = ts3Functions.getClientVariableAsString(serverConnectionHandlerID, clientID, CLIENT_SERVERGROUPS, &text);
+	if (r != ERROR_ok) return r;
+	const uint64 admin_groups = parseAdminGroups(index, text);
+	ts3Functions.freeMemory(text);
+
+	int talking = 0;
+	if (!joined) {
+		r = ts3Functions.getClientVariableAsInt(serverConnectionHandlerID, clientID, CLIENT_FLAG_TALKING, &talking);
+		if (r != ERROR_ok) return r;
+	}
+
+	occupant& o = getOccupant(index, clientID);
+	detach(index, clientID);
+	o.admin_groups = admin_groups;
+	o.talking = talking == STATUS_TALKING;
+	o.last_active_ms = now_ms;
+	attach(index, clientID, channelID);
+	return ERROR_ok;
+}
+
+uint64 occupancyClock() {
+	return (uint64)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+unsigned int occupancySeed(channel_occupancy& index, uint64 serverConnectionHandlerID, uint64 now_ms) {
+	anyID* clients;
+	unsigned int r = ts3Functions.getClientList(serverConnectionHandlerID, &clients);
+	if (r != ERROR_ok) return r;
+
+	index.clients.clear();
+	index.channels.clear();
+	for (const anyID* c = clients; *c; c++) {
+		uint64 channelID;
+		r = ts3Functions.getChannelOfClient(serverConnectionHandlerID, *c, &channelID);
+		if (r != ERROR_ok) break;
+		r = queryClient(index, serverConnectionHandlerID, *c, channelID, false, now_ms);
+		if (r != ERROR_ok) break;
+	}
+	ts3Functions.freeMemory(clients);
+
+	index.seeded = r == ERROR_ok;
+	if (!index.seeded) {
+		index.clients.clear();
+		index.channels.clear();
+	}
+	return r;
+}
+
+void occupancySetAdminGroups(channel_occupancy& index, const std::vector<uint64>& groups) {
+	index.admin_groups.clear();
+	for (uint64 g : groups) {
+		if (index.admin_groups.size() == OCCUPANCY_ADMIN_GROUPS_MAX) break;
+		if (adminGroupBit(index, g) < 0) index.admin_groups.push_back(g);
+	}
+	occupancyForget(index);
+}
+
+void occupancyForget(channel_occupancy& index) {
+	index.seeded = false;
+	index.clients.clear();
+	index.channels.clear();
+}
+
+unsigned int occupancyAddClient(channel_occupancy& index, uint64 serverConnectionHandlerID, anyID clientID, uint64 channelID, uint64 now_ms) {
+	if (!index.seeded) return ERROR_ok;
+	return queryClient(index, serverConnectionHandlerID, clientID, channelID, true, now_ms);
+}
+
+void occupancyMoveClient(channel_occupancy& index, anyID clientID, uint64 channelID, uint64 now_ms) {
+	if (!index.seeded) return;
+	occupant& o = getOccupant(index, clientID);
+	o.last_active_ms = now_ms;
+	if (o.channelID == channelID) return;
+	detach(index, clientID);
+	attach(index, clientID, channelID);
+	if (channelID == 0) index.clients[clientID] = occupant{ 0, 0, 0, 0, false };
+}
+
+void occupancySetTalking(channel_occupancy& index, anyID clientID, bool talking, uint64 now_ms) {
+	if (!index.seeded || clientID >= index.clients.size()) return;
+	occupant& o = index.clients[clientID];
+	o.talking = talking;
+	o.last_active_ms = now_ms;
+}
+
+void occupancySetServerGroup(channel_occupancy& index, anyID clientID, uint64 serverGroupID, bool member) {
+	if (!index.seeded || clientID >= index.clients.size()) return;
+	const int bit = adminGroupBit(index, serverGroupID);
+	if (bit < 0) return;
+	if (member) index.clients[clientID].admin_groups |= 1ull << bit;
+	else index.clients[clientID].admin_groups &= ~(1ull << bit);
+}
+
+bool occupancyMatches(const channel_occupancy& index, anyID clientID, const occupancy_filter& filter, uint64 now_ms) {
+	if (clientID >= index.clients.size()) return false;
+	const occupant& o = index.clients[clientID];
+	if (o.channelID == 0) return false;
+	if (filter.non_admins && o.admin_groups) return false;
+	if (filter.silent && o.talking) return false;
+	if (filter.idle_minutes && (now_ms < o.last_active_ms || now_ms - o.last_active_ms < (uint64)filter.idle_minutes * 60000)) return false;
+	return true;
+}
+
+size_t occupancyCollect(const channel_occupancy& index, uint64 channelID, const occupancy_filter& filter, uint64 now_ms, std::vector<anyID>& result) {
+	const auto it = index.channels.find(channelID);
+	if (it == index.channels.end()) return 0;
+	const bool all = !filter.non_admins && !filter.silent && !filter.idle_minutes;
+	if (all) {
+		result.insert(result.end(), it->second.begin(), it->second.end());
+		return it->second.size();
+	}
+	size_t count = 0;
+	for (anyID clientID : it->second) {
+		if (!occupancyMatches(index, clientID, filter, now_ms)) continue;
+		result.push_back(clientID);
+		count++;
+	}
+	return count;
+}
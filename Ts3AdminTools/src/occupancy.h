@@ -0,0 +1,74 @@
+/*
+ * Clients of every channel of a server connection, with what the filtered mass moves ask about them.
+ *
+ * Seeded once from getClientList and the client variables, then kept up to date from the move, talk status and
+ * server group events, so a mass move reads the clients of a channel from here instead of asking the client lib
+ * for a channel client list. Removing a client from its channel swaps the last client of the channel into its
+ * slot, every event is O(1).
+ *
+ * Whether a client is an admin is a bit mask of the admin server groups it is in, the same way group_index tracks
+ * locked groups: changing the admin groups reseeds the index. Idle time is the time since the client's last move,
+ * join or talk status change seen here; clients already there when the index was seeded count from the seeding.
+ */
+
+#ifndef OCCUPANCY_H
+#define OCCUPANCY_H
+
+#include <stddef.h>
+#include <unordered_map>
+#include <vector>
+#include "teamspeak/public_definitions.h"
+
+#define OCCUPANCY_ADMIN_GROUPS_MAX 64
+#define OCCUPANCY_DEFAULT_ADMIN_GROUP 6  // "Server Admin" on a new server
+
+struct occupant {
+	uint64 channelID;       // 0 = not in view
+	size_t slot;            // position in the channel's client list
+	uint64 admin_groups;    // bits of the admin groups the client is in
+	uint64 last_active_ms;  // occupancyClock of the last move, join or talk status change
+	bool talking;
+};
+
+struct channel_occupancy {
+	bool seeded = false;
+	std::vector<occupant> clients = std::vector<occupant>();  // indexed by client id
+	std::unordered_map<uint64, std::vector<anyID>> channels = std::unordered_map<uint64, std::vector<anyID>>();
+	std::vector<uint64> admin_groups = std::vector<uint64>(1, OCCUPANCY_DEFAULT_ADMIN_GROUP);
+};
+
+/* Which clients of a channel a mass move takes, all of them by default */
+struct occupancy_filter {
+	bool non_admins;            // only clients in none of the admin groups
+	bool silent;                // skip clients that are talking
+	unsigned int idle_minutes;  // only clients idle at least this long, 0 = any
+};
+
+/* Milliseconds of a steady clock, what last_active_ms and the now arguments are measured in */
+uint64 occupancyClock();
+
+/* Reads every client in view from the client lib, replacing what was there */
+unsigned int occupancySeed(channel_occupancy& index, uint64 serverConnectionHandlerID, uint64 now_ms);
+
+/* Replaces the admin groups (at most OCCUPANCY_ADMIN_GROUPS_MAX), the index is seeded again on next use */
+void occupancySetAdminGroups(channel_occupancy& index, const std::vector<uint64>& groups);
+
+/* Forgets every client, the index is seeded again on next use */
+void occupancyForget(channel_occupancy& index);
+
+/* Reads the server groups of a client that joined channelID */
+unsigned int occupancyAddClient(channel_occupancy& index, uint64 serverConnectionHandlerID, anyID clientID, uint64 channelID, uint64 now_ms);
+
+/* The client is in channelID now, 0 if it left. Repeating a move changes nothing. */
+void occupancyMoveClient(channel_occupancy& index, anyID clientID, uint64 channelID, uint64 now_ms);
+
+void occupancySetTalking(channel_occupancy& index, anyID clientID, bool talking, uint64 now_ms);
+void occupancySetServerGroup(channel_occupancy& index, anyID clientID, uint64 serverGroupID, bool member);
+
+/* True if a client in view passes the filter */
+bool occupancyMatches(const channel_occupancy& index, anyID clientID, const occupancy_filter& filter, uint64 now_ms);
+
+/* Appends the clients of a channel that pass the filter, returns how many */
+size_t occupancyCollect(const channel_occupancy& index, uint64 channelID, const occupancy_filter& filter, uint64 now_ms, std::vector<anyID>& result);
+
+#endif
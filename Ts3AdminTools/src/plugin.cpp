@@ -13,34 +13,40 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
-#include "teamspeak/public_errors.h"
-#include "teamspeak/public_errors_rare.h"
-#include "teamspeak/public_definitions.h"
-#include "teamspeak/public_rare_definitions.h"
-#include "teamspeak/clientlib_publicdefinitions.h"
-#include "ts3_functions.h"
+#include "common.h"
 #include "plugin.h"
+#include "mass_move.h"
+#include "move_scheduler.h"
+#include "move_history.h"
+#include "channel_tree.h"
+#include "group_index.h"
+#include "occupancy.h"
+#include "layout.h"
+#include "afk.h"
+#include "loudness.h"
+#include "chat_filter.h"
+#include "ban_cache.h"
+#include "follow_engine.h"
+#include "state_store.h"
+#include "server_backup.h"
+#include "server_restore.h"
+#include "event_worker.h"
+#include "metrics.h"
+#include "command.h"
+#include "actions.h"
+#include <atomic>
+#include <mutex>
+#include <string>
 #include <vector>
+#include <unordered_map>
+#include <ctime>
+#include <algorithm>
 
-static struct TS3Functions ts3Functions;
-
-#ifdef _WIN32
-#define _strcpy(dest, destSize, src) strcpy_s(dest, destSize, src)
-#define snprintf sprintf_s
-#else
-#define _strcpy(dest, destSize, src) { strncpy(dest, src, destSize-1); (dest)[destSize-1] = '\0'; }
-#endif
+struct TS3Functions ts3Functions;
 
 #define PLUGIN_API_VERSION 23
 
-#define PATH_BUFSIZE 512
-#define COMMAND_BUFSIZE 128
-#define INFODATA_BUFSIZE 128
-#define SERVERINFO_BUFSIZE 256
-#define CHANNELINFO_BUFSIZE 512
-#define RETURNCODE_BUFSIZE 128
-
-static char* pluginID = NULL;
+char* pluginID = NULL;
 
 #ifdef _WIN32
 /* Helper function to convert wchar_T to Utf-8 encoded strings on Windows */
@@ -56,64 +62,218 @@ static int wcharToUtf8(const wchar_t* str, char** result) {
 #endif
 
 
-/*********************************** My Macros ************************************/
+/*********************************** Server connection state ************************************/
 /*
- *
+ * Everything the plugin tracks about a server tab. Each server connection handler gets its own state, so a lock or
+ * follow on one server never matches a client on another one and a tab's events only touch its own state.
  */
-#ifdef AT_RELEASE
-#define ASSERT(x, msg)
-#define R_ASSERT(x, msg) if (!(x)) {return;}
-#define CALL(x, msg) {unsigned int r = x;}
-#define R_CALL(x, msg) {unsigned int r = x; if (r != ERROR_ok) {return;}}
-#define RV_CALL(x, msg, rv) {unsigned int r = x; if (r != ERROR_ok) {return rv;}}
-#else
-#define ASSERT(x, msg) if (!(x)) printf(msg)
-#define R_ASSERT(x, msg) if (!(x)) {printf(msg); return;}
-#define CALL(x, msg) {unsigned int r = x; if (r != ERROR_ok) {printf("Error %d at '%s'\n", r, msg);}}
-#define R_CALL(x, msg) {unsigned int r = x; if (r != ERROR_ok) {printf("Error %d at '%s'\n", r, msg); return;}}
-#define RV_CALL(x, msg, rv) {unsigned int r = x; if (r != ERROR_ok) {printf("Error %d at '%s'\n", r, msg); return rv;}}
-#endif
+struct follow_target {
+	uint64 db_id;
+	anyID clientID;  // 0 = not in view
+};
 
+struct server_state {
+	// UI
+	bool channel_selected = false;
+	uint64 selected_channel = 0;
+	bool user_selected = false;
+	anyID selected_user = 0;
 
- /*********************************** UI Variables ************************************/
- /*
-  *
-  */
-static bool channel_selected = false;
-static uint64 selected_channel = 0;
-static bool user_selected = false;
-static anyID selected_user = 0;
+	// Followed clients in priority order, the first one in view is followed
+	std::vector<follow_target> follow_targets = std::vector<follow_target>();
 
+	// Locked users, client database id -> channel the client is locked in
+	std::unordered_map<uint64, uint64> locked_users = std::unordered_map<uint64, uint64>();
 
-/*********************************** Follow variables ************************************/
-/*
- *
- */
-static bool follow_enable = false;
-static uint64 follow_target_db_id = 0;
+	// Client database ids of the clients in view, indexed by client id (0 = unknown).
+	// Filled from join, update and client id events, cleared when the client leaves.
+	std::vector<uint64> client_db_ids = std::vector<uint64>();
+
+	// Recent moves per client, used to skip repeated events and the echoes of our own moves
+	move_histories move_history = move_histories();
+
+	// Channel tree, seeded on first use and kept up to date from channel events
+	channel_tree channels = channel_tree();
+
+	// Group memberships and locked groups, seeded when the first group is locked
+	group_index groups = group_index();
+
+	// Clients of every channel, seeded on the first mass move and kept up to date from move, talk and group events
+	channel_occupancy occupancy = channel_occupancy();
+
+	// Channels clients are held in by /jat layout
+	channel_layout layout = channel_layout();
+
+	// Idle clients moved to the AFK channel by /jat afk, off until it is set
+	afk_tracker afk = afk_tracker();
+
+	// Voice levels of the clients in view, /jat loudness
+	loudness_meter loudness = loudness_meter();
+
+	// Blocked words and rate limit of the channel and server chat, /jat chatfilter
+	chat_filter chat = chat_filter();
+
+	// Locks the chat filter set, database id -> chatClock when they end. Not saved, a restart ends them.
+	std::unordered_map<uint64, uint64> chat_locks = std::unordered_map<uint64, uint64>();
+
+	// Copy of the ban list, joining clients are checked against it. Off until /jat bans.
+	ban_cache bans = ban_cache();
+
+	// Virtual server unique identifier, the key of the saved state. Looked up on first use.
+	std::string uid = std::string();
+};
+
+static std::unordered_map<uint64, server_state> server_states = std::unordered_map<uint64, server_state>();
+
+// Move events are handled on the event worker thread, everything else on the client thread. Both hold this while they touch server_states.
+static std::mutex state_mutex;
+
+// Servers with the loudness meter on, so the playback callback measures nothing while all are off
+static std::atomic<unsigned int> loudness_meters(0);
+
+static void onMoveEvent(const move_event& e);
+static void onFollowFlush(uint64 serverConnectionHandlerID, uint64 channelID);
+static void onTimerTick();
+static void saveServerState(uint64 serverConnectionHandlerID);
+static void restoreServerState(uint64 serverConnectionHandlerID);
+static void runCommandLine(uint64 serverConnectionHandlerID, const char* command);
+static bool banListAnswered(uint64 serverConnectionHandlerID, const char* returnCode, unsigned int error);
+
+/* Recounts loudness_meters after a meter was turned on or off, with state_mutex held */
+static void countLoudnessMeters() {
+	unsigned int meters = 0;
+	for (const auto& s : server_states) meters += s.second.loudness.config.threshold_db != 0;
+	loudness_meters.store(meters, std::memory_order_relaxed);
+}
+
+/* State of a server tab, created on first use if the plugin was loaded while already connected */
+static server_state& getServerState(uint64 serverConnectionHandlerID) {
+	return server_states[serverConnectionHandlerID];
+}
 
+static unsigned int queryClientDBID(server_state& state, uint64 serverConnectionHandlerID, anyID clientID, uint64* result) {
+	const unsigned int r = ts3Functions.getClientVariableAsUInt64(serverConnectionHandlerID, clientID, CLIENT_DATABASE_ID, result);
+	if (r == ERROR_ok) {
+		if (state.client_db_ids.size() <= clientID) {
+			state.client_db_ids.resize((size_t)clientID + 1, 0);
+		}
+		state.client_db_ids[clientID] = *result;
+	}
+	return r;
+}
+
+static std::vector<follow_target>::iterator findFollowTarget(server_state& state, uint64 clientDBID) {
+	auto it = state.follow_targets.begin();
+	while (it != state.follow_targets.end() && it->db_id != clientDBID) ++it;
+	return it;
+}
+
+static bool isClientDBIDCached(const server_state& state, anyID clientID) {
+	return clientID < state.client_db_ids.size() && state.client_db_ids[clientID] != 0;
+}
+
+/* Cached lookup of a clients database id, only asks the client lib on a miss */
+static unsigned int getClientDBID(server_state& state, uint64 serverConnectionHandlerID, anyID clientID, uint64* result) {
+	if (isClientDBIDCached(state, clientID)) {
+		*result = state.client_db_ids[clientID];
+		return ERROR_ok;
+	}
+	return queryClientDBID(state, serverConnectionHandlerID, clientID, result);
+}
+
+static void forgetClientDBID(server_state& state, anyID clientID) {
+	if (clientID < state.client_db_ids.size()) {
+		state.client_db_ids[clientID] = 0;
+	}
+}
+
+/* Channel tree of a server tab, NULL if it could not be seeded */
+static channel_tree* getChannelTree(server_state& state, uint64 serverConnectionHandlerID) {
+	if (!state.channels.seeded) {
+		RV_CALL(channelTreeSeed(state.channels, serverConnectionHandlerID), "Error seeding channel tree!", NULL);
+	}
+	return &state.channels;
+}
+
+/* Channel occupancy of a server tab, NULL if it could not be seeded */
+static channel_occupancy* getOccupancy(server_state& state, uint64 serverConnectionHandlerID) {
+	if (!state.occupancy.seeded) {
+		RV_CALL(occupancySeed(state.occupancy, serverConnectionHandlerID, occupancyClock()), "Error seeding channel occupancy!", NULL);
+	}
+	return &state.occupancy;
+}
+
+/* The afk_flag bits of a client, read from the client lib */
+static unsigned char queryAfkFlags(uint64 serverConnectionHandlerID, anyID clientID) {
+	static const struct { size_t variable; unsigned char flag; } variables[] = {
+		{ CLIENT_AWAY, AFK_FLAG_AWAY }, { CLIENT_OUTPUT_MUTED, AFK_FLAG_OUTPUT_MUTED }, { CLIENT_INPUT_MUTED, AFK_FLAG_INPUT_MUTED },
+	};
+	unsigned char flags = 0;
+	for (const auto& v : variables) {
+		int value;
+		if (ts3Functions.getClientVariableAsInt(serverConnectionHandlerID, clientID, v.variable, &value) == ERROR_ok && value) flags |= v.flag;
+	}
+	return flags;
+}
+
+/* Runs on the thread that sent a queued move, its expectation ages from now */
+static void onExpectedMoveSent(uint64 serverConnectionHandlerID, anyID clientID, uint64 channelID, unsigned int error) {
+	std::lock_guard<std::mutex> lock(state_mutex);
+	const auto it = server_states.find(serverConnectionHandlerID);
+	if (it != server_states.end()) moveHistorySent(it->second.move_history, clientID, channelID, error);
+}
 
-/*********************************** Locked user variables ************************************/
 /*
- *
+ * Sends a move through the scheduler and expects its echo. The expectation starts aging when the move is sent, not
+ * while it waits in the queue, so a long mass move still recognizes its echoes and suppresses repeated requests.
  */
-static std::vector<uint64> locked_users = std::vector<uint64>();
-static std::vector<uint64> locked_user_channels = std::vector<uint64>();
+static void requestExpectedMove(server_state& state, uint64 serverConnectionHandlerID, anyID clientID, uint64 channelID, move_priority priority) {
+	moveHistoryExpect(state.move_history, clientID, channelID);
+	bool queued = false;
+	const unsigned int r = moveSchedulerRequest(serverConnectionHandlerID, clientID, channelID, priority, NULL, NULL, onExpectedMoveSent, &queued);
+	if (!queued) moveHistorySent(state.move_history, clientID, channelID, r);
+	CALL(r, "Error moving client!");
+}
+
+/* Moves a client that became active again back to the channel the AFK mover took it from */
+static void returnFromAfk(server_state& state, uint64 serverConnectionHandlerID, anyID clientID, uint64 home) {
+	if (moveHistoryPending(state.move_history, clientID, home)) {
+		metricsCount(METRIC_MOVES_DEDUPLICATED);
+		return;
+	}
+	metricsCount(METRIC_AFK_RETURNS);
+	requestExpectedMove(state, serverConnectionHandlerID, clientID, home, MOVE_PRIORITY_FOLLOW);
+}
+
+/* A client stayed too loud for the hold time, reported in the tab and muted for us if asked to. Not on the audio thread. */
+static void reportLoudClient(uint64 serverConnectionHandlerID, anyID clientID, bool mute) {
+	metricsCount(METRIC_LOUD_CLIENTS);
+	char* name = NULL;
+	const bool named = ts3Functions.getClientVariableAsString(serverConnectionHandlerID, clientID, CLIENT_NICKNAME, &name) == ERROR_ok;
+	char msg[TS3_MAX_SIZE_CLIENT_NICKNAME + 64];
+	snprintf(msg, sizeof(msg), "Client %u (%s) is too loud%s", (unsigned int)clientID, named ? name : "?", mute ? ", muted" : "");
+	if (named) ts3Functions.freeMemory(name);
+	LOG_INFO(serverConnectionHandlerID, "%s", msg);
+	ts3Functions.printMessage(serverConnectionHandlerID, msg, PLUGIN_MESSAGE_TARGET_SERVER);
+	if (mute) {
+		const anyID clients[2] = { clientID, 0 };
+		CALL(ts3Functions.requestMuteClients(serverConnectionHandlerID, clients, NULL), "Error muting client!");
+	}
+}
 
-/*********************************** Menu Item Ids ************************************/
+/*********************************** Menu states ************************************/
 /*
- *
+ * Enabled state of the menu items as last set, one bit per action. Menu items are the same for every tab, the info
+ * frame sets them for each item shown and most of the time nothing changes, only changes reach the client.
  */
-enum {
-	MENU_ID_CHANNEL_FROM,
-	MENU_ID_CHANNEL_TO,
-	MENU_ID_CLIENT_FOLLOW,
-	MENU_ID_CLIENT_UNFOLLOW,
-	MENU_ID_CLIENT_LOCK_MOVEMENT,
-	MENU_ID_CLIENT_UNLOCK_MOVEMENT,
-	MENU_ID_GLOBAL_UNFOLLOW,
-	MENU_ID_GLOBAL_UNLOCK_MOVEMENT,
-};
+static uint32_t menu_enabled = 0;
+
+static void setMenuEnabled(action_id id, bool enabled) {
+	const uint32_t bit = 1u << id;
+	if (((menu_enabled & bit) != 0) == enabled) return;
+	menu_enabled ^= bit;
+	ts3Functions.setPluginMenuEnabled(pluginID, id, enabled ? 1 : 0);
+}
 
 /*********************************** Required functions ************************************/
 /*
@@ -161,7 +321,8 @@ const char* ts3plugin_description() {
 
 /* Set TeamSpeak 3 callback functions */
 void ts3plugin_setFunctionPointers(const struct TS3Functions funcs) {
-    ts3Functions = funcs;
+    // every client lib call the plugin makes is timed
+    ts3Functions = metricsWrapFunctions(funcs);
 }
 
 /*
@@ -174,9 +335,6 @@ int ts3plugin_init() {
     char configPath[PATH_BUFSIZE];
 	char pluginPath[PATH_BUFSIZE];
 
-    /* Your plugin init code here */
-    printf("PLUGIN: init\n");
-
     /* Example on how to query application, resources and configuration paths from client */
     /* Note: Console client returns empty string for app and resources path */
     ts3Functions.getAppPath(appPath, PATH_BUFSIZE);
@@ -184,7 +342,31 @@ int ts3plugin_init() {
     ts3Functions.getConfigPath(configPath, PATH_BUFSIZE);
 	ts3Functions.getPluginPath(pluginPath, PATH_BUFSIZE, pluginID);
 
-	printf("PLUGIN: App path: %s\nResources path: %s\nConfig path: %s\nPlugin path: %s\n", appPath, resourcesPath, configPath, pluginPath);
+	// everything logged from here on is written by the flush thread
+	logStart(configPath);
+	LOG_INFO(0, "PLUGIN: init");
+	LOG_DEBUG(0, "PLUGIN: App path: %s, Resources path: %s", appPath, resourcesPath);
+	LOG_DEBUG(0, "PLUGIN: Config path: %s, Plugin path: %s", configPath, pluginPath);
+
+	moveSchedulerStart();
+	followEngineStart(onFollowFlush);
+	eventWorkerStart(onMoveEvent);
+	afkTimerStart(onTimerTick);
+
+	// locks and follows saved before the restart, tabs connected already get theirs now, the others when they connect
+	if (stateStoreOpen(configPath)) {
+		uint64* handlers;
+		if (ts3Functions.getServerConnectionHandlerList(&handlers) == ERROR_ok) {
+			std::lock_guard<std::mutex> lock(state_mutex);
+			for (const uint64* it = handlers; *it; it++) {
+				int status;
+				if (ts3Functions.getConnectionStatus(*it, &status) == ERROR_ok && status == STATUS_CONNECTION_ESTABLISHED) {
+					restoreServerState(*it);
+				}
+			}
+			ts3Functions.freeMemory(handlers);
+		}
+	}
 
     return 0;  /* 0 = success, 1 = failure, -2 = failure but client will not show a "failed to load" warning */
 	/* -2 is a very special case and should only be used if a plugin displays a dialog (e.g. overlay) asking the user to disable
@@ -195,7 +377,15 @@ int ts3plugin_init() {
 /* Custom code called right before the plugin is unloaded */
 void ts3plugin_shutdown() {
     /* Your plugin cleanup code here */
-    printf("PLUGIN: shutdown\n");
+    LOG_INFO(0, "PLUGIN: shutdown");
+
+	// handles the move events still waiting, these may still hand moves to the scheduler
+	afkTimerStop();
+	eventWorkerStop();
+	followEngineStop();
+	moveSchedulerStop();
+	stateStoreClose();
+	logStop();
 
 	/*
 	 * Note:
@@ -217,7 +407,7 @@ void ts3plugin_shutdown() {
 
 /* Tell client if plugin offers a configuration window. If this function is not implemented, it's an assumed "does not offer" (PLUGIN_OFFERS_NO_CONFIGURE). */
 int ts3plugin_offersConfigure() {
-	printf("PLUGIN: offersConfigure\n");
+	LOG_DEBUG(0, "PLUGIN: offersConfigure");
 	/*
 	 * Return values:
 	 * PLUGIN_OFFERS_NO_CONFIGURE         - Plugin does not implement ts3plugin_configure
@@ -229,7 +419,7 @@ int ts3plugin_offersConfigure() {
 
 /* Plugin might offer a configuration window. If ts3plugin_offersConfigure returns 0, this function does not need to be implemented. */
 void ts3plugin_configure(void* handle, void* qParentWidget) {
-    printf("PLUGIN: configure\n");
+    LOG_DEBUG(0, "PLUGIN: configure");
 }
 
 /*
@@ -241,12 +431,12 @@ void ts3plugin_registerPluginID(const char* id) {
 	const size_t sz = strlen(id) + 1;
 	pluginID = (char*)malloc(sz * sizeof(char));
 	_strcpy(pluginID, sz, id);  /* The id buffer will invalidate after exiting this function */
-	printf("PLUGIN: registerPluginID: %s\n", pluginID);
+	LOG_DEBUG(0, "PLUGIN: registerPluginID: %s", pluginID);
 }
 
 /* Plugin command keyword. Return NULL or "" if not used. */
 const char* ts3plugin_commandKeyword() {
-	return NULL;
+	return "jat";
 }
 
 static void print_and_free_bookmarks_list(struct PluginBookmarkList* list)
@@ -256,7 +446,9 @@ static void print_and_free_bookmarks_list(struct PluginBookmarkList* list)
 
 /* Plugin processes console command. Return 0 if plugin handled the command, 1 if not handled. */
 int ts3plugin_processCommand(uint64 serverConnectionHandlerID, const char* command) {
-	return 1;
+	LOG_DEBUG(serverConnectionHandlerID, "PLUGIN: processCommand: %s", command);
+	runCommandLine(serverConnectionHandlerID, command);
+	return 0;
 }
 
 /* Client changed current server connection handler */
@@ -279,6 +471,15 @@ const char* ts3plugin_infoTitle() {
  * "data" to NULL to have the client ignore the info data.
  */
 void ts3plugin_infoData(uint64 serverConnectionHandlerID, uint64 id, enum PluginItemType type, char** data) {
+	METRIC_TIME(METRIC_CB_INFO_DATA);
+	if (type == PLUGIN_SERVER) {
+		*data = (char*)malloc(SERVERINFO_BUFSIZE * sizeof(char));
+		metricsShortReport(*data, SERVERINFO_BUFSIZE);
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(state_mutex);
+	server_state& state = getServerState(serverConnectionHandlerID);
 	if (type == PLUGIN_CHANNEL) {
 		anyID clientID;
 		R_CALL(ts3Functions.getClientID(serverConnectionHandlerID, &clientID), "Error retrieving client id!");
@@ -287,16 +488,16 @@ void ts3plugin_infoData(uint64 serverConnectionHandlerID, uint64 id, enum Plugin
 		R_CALL(ts3Functions.getChannelOfClient(serverConnectionHandlerID, clientID, &clientChannelID), "Error retrieving client channel!");
 
 		if (clientChannelID == id) { // channel is clients channel -> disable move menu items
-			ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CHANNEL_FROM, 0);
-			ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CHANNEL_TO, 0);
-			selected_channel = 0;
-			channel_selected = false;
+			setMenuEnabled(ACTION_MOVE_TO_OWN_CHANNEL, false);
+			setMenuEnabled(ACTION_MOVE_TO_SELECTED_CHANNEL, false);
+			state.selected_channel = 0;
+			state.channel_selected = false;
 		}
 		else {
-			ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CHANNEL_FROM, 1);
-			ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CHANNEL_TO, 1);
-			selected_channel = id;
-			channel_selected = true;
+			setMenuEnabled(ACTION_MOVE_TO_OWN_CHANNEL, true);
+			setMenuEnabled(ACTION_MOVE_TO_SELECTED_CHANNEL, true);
+			state.selected_channel = id;
+			state.channel_selected = true;
 		}
 	}
 	
@@ -305,36 +506,36 @@ void ts3plugin_infoData(uint64 serverConnectionHandlerID, uint64 id, enum Plugin
 		R_CALL(ts3Functions.getClientID(serverConnectionHandlerID, &myClientID), "Error retrieving client id!");
 
 		if (myClientID == id) { // is myself -> disable follow menu items
-			ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_FOLLOW, 0);
-			ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_UNFOLLOW, 0);
-			ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_LOCK_MOVEMENT, 0);
-			ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_UNLOCK_MOVEMENT, 0);
-			user_selected = false;
-			selected_user = 0;
+			setMenuEnabled(ACTION_FOLLOW, false);
+			setMenuEnabled(ACTION_UNFOLLOW, false);
+			setMenuEnabled(ACTION_LOCK_MOVEMENT, false);
+			setMenuEnabled(ACTION_UNLOCK_MOVEMENT, false);
+			state.user_selected = false;
+			state.selected_user = 0;
 		}
 		else {
-			user_selected = true;
-			selected_user = id;
+			state.user_selected = true;
+			state.selected_user = (anyID)id;
 
 			uint64 clientDBID;
-			R_CALL(ts3Functions.getClientVariableAsUInt64(serverConnectionHandlerID, selected_user, CLIENT_DATABASE_ID, &clientDBID), "Error retreiving client db id!");
+			R_CALL(getClientDBID(state, serverConnectionHandlerID, state.selected_user, &clientDBID), "Error retreiving client db id!");
 
-			if (follow_enable && follow_target_db_id == clientDBID) {
-				ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_FOLLOW, 0);
-				ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_UNFOLLOW, 1);
+			if (findFollowTarget(state, clientDBID) != state.follow_targets.end()) {
+				setMenuEnabled(ACTION_FOLLOW, false);
+				setMenuEnabled(ACTION_UNFOLLOW, true);
 			}
 			else {
-				ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_FOLLOW, 1);
-				ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_UNFOLLOW, 0);
+				setMenuEnabled(ACTION_FOLLOW, true);
+				setMenuEnabled(ACTION_UNFOLLOW, false);
 			}
 
-			if (!locked_users.empty() && std::find(locked_users.begin(), locked_users.end(), clientDBID) != locked_users.cend()) {
-				ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_LOCK_MOVEMENT, 0);
-				ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_UNLOCK_MOVEMENT, 1);
+			if (!state.locked_users.empty() && state.locked_users.find(clientDBID) != state.locked_users.cend()) {
+				setMenuEnabled(ACTION_LOCK_MOVEMENT, false);
+				setMenuEnabled(ACTION_UNLOCK_MOVEMENT, true);
 			}
 			else {
-				ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_LOCK_MOVEMENT, 1);
-				ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_UNLOCK_MOVEMENT, 0);
+				setMenuEnabled(ACTION_LOCK_MOVEMENT, true);
+				setMenuEnabled(ACTION_UNLOCK_MOVEMENT, false);
 			}
 		}
 		
@@ -365,11 +566,6 @@ static struct PluginMenuItem* createMenuItem(enum PluginMenuType type, int id, c
 	return menuItem;
 }
 
-/* Some makros to make the code to create menu items a bit more readable */
-#define BEGIN_CREATE_MENUS(x) const size_t sz = x + 1; size_t n = 0; *menuItems = (struct PluginMenuItem**)malloc(sizeof(struct PluginMenuItem*) * sz);
-#define CREATE_MENU_ITEM(a, b, c, d) (*menuItems)[n++] = createMenuItem(a, b, c, d);
-#define END_CREATE_MENUS (*menuItems)[n++] = NULL; assert(n == sz);
-
 /*
  * Initialize plugin menus.
  * This function is called after ts3plugin_init and ts3plugin_registerPluginID. A pluginID is required for plugin menus to work.
@@ -377,22 +573,16 @@ static struct PluginMenuItem* createMenuItem(enum PluginMenuType type, int id, c
  * If plugin menus are not used by a plugin, do not implement this function or return NULL.
  */
 void ts3plugin_initMenus(struct PluginMenuItem*** menuItems, char** menuIcon) {
-	BEGIN_CREATE_MENUS(8);  /* IMPORTANT: Number of menu items must be correct! */
-	CREATE_MENU_ITEM(PLUGIN_MENU_TYPE_CHANNEL, MENU_ID_CHANNEL_FROM, "Move all users from this channel to your channel", "1.png");
-	CREATE_MENU_ITEM(PLUGIN_MENU_TYPE_CHANNEL, MENU_ID_CHANNEL_TO, "Move all users from your channel to this channel", "2.png");
-	CREATE_MENU_ITEM(PLUGIN_MENU_TYPE_CLIENT, MENU_ID_CLIENT_FOLLOW, "Follow", "3.png");
-	CREATE_MENU_ITEM(PLUGIN_MENU_TYPE_CLIENT, MENU_ID_CLIENT_UNFOLLOW, "Unfollow", "4.png");
-	CREATE_MENU_ITEM(PLUGIN_MENU_TYPE_CLIENT, MENU_ID_CLIENT_LOCK_MOVEMENT, "Lock movement", "5.png");
-	CREATE_MENU_ITEM(PLUGIN_MENU_TYPE_CLIENT, MENU_ID_CLIENT_UNLOCK_MOVEMENT, "Unlock movement", "6.png");
-	CREATE_MENU_ITEM(PLUGIN_MENU_TYPE_GLOBAL, MENU_ID_GLOBAL_UNFOLLOW, "Unfollow", "7.png");
-	CREATE_MENU_ITEM(PLUGIN_MENU_TYPE_GLOBAL, MENU_ID_GLOBAL_UNLOCK_MOVEMENT, "Unlock all client movement", "8.png");
-	END_CREATE_MENUS;  /* Includes an assert checking if the number of menu items matched */
-
-	// disable 'reverse actions'
-	ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_UNFOLLOW, 0);
-	ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_UNLOCK_MOVEMENT, 0);
-	ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_GLOBAL_UNFOLLOW, 0);
-	ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_GLOBAL_UNLOCK_MOVEMENT, 0);
+	*menuItems = (struct PluginMenuItem**)malloc(sizeof(struct PluginMenuItem*) * (ACTION_COUNT + 1));
+	for (size_t i = 0; i < ACTION_COUNT; i++) {
+		const plugin_action& a = plugin_actions[i];
+		(*menuItems)[i] = createMenuItem(a.menu_type, a.id, a.menu_text, a.icon);
+	}
+	(*menuItems)[ACTION_COUNT] = NULL;
+
+	// the client creates the items enabled, then 'reverse actions' are disabled
+	menu_enabled = UINT32_MAX >> (32 - ACTION_COUNT);
+	for (const plugin_action& a : plugin_actions) setMenuEnabled(a.id, a.enabled);
 }
 
 /* Helper function to create a hotkey */
@@ -403,11 +593,6 @@ static struct PluginHotkey* createHotkey(const char* keyword, const char* descri
 	return hotkey;
 }
 
-/* Some makros to make the code to create hotkeys a bit more readable */
-#define BEGIN_CREATE_HOTKEYS(x) const size_t sz = x + 1; size_t n = 0; *hotkeys = (struct PluginHotkey**)malloc(sizeof(struct PluginHotkey*) * sz);
-#define CREATE_HOTKEY(a, b) (*hotkeys)[n++] = createHotkey(a, b);
-#define END_CREATE_HOTKEYS (*hotkeys)[n++] = NULL; assert(n == sz);
-
 /*
  * Initialize plugin hotkeys. If your plugin does not use this feature, this function can be omitted.
  * Hotkeys require ts3plugin_registerPluginID and ts3plugin_freeMemory to be implemented.
@@ -417,16 +602,12 @@ void ts3plugin_initHotkeys(struct PluginHotkey*** hotkeys) {
 	/* Register hotkeys giving a keyword and a description.
 	 * The keyword will be later passed to ts3plugin_onHotkeyEvent to identify which hotkey was triggered.
 	 * The description is shown in the clients hotkey dialog. */
-	
-	BEGIN_CREATE_HOTKEYS(7);  // Create hotkeys. Size must be correct for allocating memory.
-	CREATE_HOTKEY("MoveToOwnChannel", "Move clients from selected channel to my channel");
-	CREATE_HOTKEY("MoveToSelectedChannel", "Move clients from my channel to selected channel");
-	CREATE_HOTKEY("Follow", "Follow user");
-	CREATE_HOTKEY("Unfollow", "Unfollow user");
-	CREATE_HOTKEY("LockMovement", "Lock user movement");
-	CREATE_HOTKEY("UnlockMovement", "Unlock user movement");
-	CREATE_HOTKEY("UnlockAllMovement", "Unlock all users movement");
-	END_CREATE_HOTKEYS;
+	*hotkeys = (struct PluginHotkey**)malloc(sizeof(struct PluginHotkey*) * (actionHotkeyCount() + 1));
+	size_t n = 0;
+	for (const plugin_action& a : plugin_actions) {
+		if (a.keyword) (*hotkeys)[n++] = createHotkey(a.keyword, a.description);
+	}
+	(*hotkeys)[n] = NULL;
 
 	/* The client will call ts3plugin_freeMemory to release all allocated memory */
 }
@@ -438,6 +619,69 @@ void ts3plugin_initHotkeys(struct PluginHotkey*** hotkeys) {
  */
 
 /* Clientlib */
+/* Runs an action of a menu item or hotkey on the channel or client it was given */
+static void runAction(uint64 serverConnectionHandlerID, action_id id, uint64 selectedItemID) {
+	server_state& state = getServerState(serverConnectionHandlerID);
+	switch (id) {
+	case ACTION_MOVE_TO_OWN_CHANNEL:
+		moveClientsToOwnChannel(serverConnectionHandlerID, selectedItemID);
+		break;
+	case ACTION_MOVE_TO_SELECTED_CHANNEL:
+		moveClientsToSelectedChannel(serverConnectionHandlerID, selectedItemID);
+		break;
+	case ACTION_MOVE_TREE_TO_OWN_CHANNEL:
+		moveSubtreeToOwnChannel(serverConnectionHandlerID, selectedItemID);
+		break;
+	case ACTION_MOVE_TREE_TO_SELECTED_CHANNEL:
+		moveSubtreeToSelectedChannel(serverConnectionHandlerID, selectedItemID);
+		break;
+	case ACTION_FOLLOW:
+		setMenuEnabled(ACTION_FOLLOW, false);
+		setMenuEnabled(ACTION_UNFOLLOW, true);
+		enableFollow(serverConnectionHandlerID, (anyID)selectedItemID);
+		break;
+	case ACTION_UNFOLLOW:
+		setMenuEnabled(ACTION_FOLLOW, true);
+		setMenuEnabled(ACTION_UNFOLLOW, false);
+		removeFollow(serverConnectionHandlerID, (anyID)selectedItemID);
+		break;
+	case ACTION_LOCK_MOVEMENT:
+		setMenuEnabled(ACTION_LOCK_MOVEMENT, false);
+		setMenuEnabled(ACTION_UNLOCK_MOVEMENT, true);
+		lockUser(serverConnectionHandlerID, (anyID)selectedItemID);
+		break;
+	case ACTION_UNLOCK_MOVEMENT:
+		setMenuEnabled(ACTION_LOCK_MOVEMENT, true);
+		setMenuEnabled(ACTION_UNLOCK_MOVEMENT, false);
+		unlockUser(serverConnectionHandlerID, (anyID)selectedItemID);
+		break;
+	case ACTION_UNFOLLOW_ALL:
+		setMenuEnabled(ACTION_FOLLOW, true);
+		setMenuEnabled(ACTION_UNFOLLOW, false);
+		disableFollow(serverConnectionHandlerID);
+		break;
+	case ACTION_UNLOCK_ALL_MOVEMENT:
+		state.locked_users.clear();
+		groupIndexUnlockAll(state.groups);
+		saveServerState(serverConnectionHandlerID);
+		setMenuEnabled(ACTION_UNLOCK_ALL_MOVEMENT, false);
+		setMenuEnabled(ACTION_LOCK_MOVEMENT, true);
+		setMenuEnabled(ACTION_UNLOCK_MOVEMENT, false);
+		break;
+	case ACTION_BACKUP:
+		backupServer(serverConnectionHandlerID, false);
+		break;
+	case ACTION_DELTA_BACKUP:
+		backupServer(serverConnectionHandlerID, true);
+		break;
+	case ACTION_RESTORE:
+		restoreServer(serverConnectionHandlerID);
+		break;
+	case ACTION_COUNT:
+		break;
+	}
+}
+
 /*
  * Called when a plugin menu item (see ts3plugin_initMenus) is triggered. Optional function, when not using plugin menus, do not implement this.
  *
@@ -448,86 +692,33 @@ void ts3plugin_initHotkeys(struct PluginHotkey*** hotkeys) {
  * - selectedItemID: Channel or Client ID in the case of PLUGIN_MENU_TYPE_CHANNEL and PLUGIN_MENU_TYPE_CLIENT. 0 for PLUGIN_MENU_TYPE_GLOBAL.
  */
 void ts3plugin_onMenuItemEvent(uint64 serverConnectionHandlerID, enum PluginMenuType type, int menuItemID, uint64 selectedItemID) {
-	printf("PLUGIN: onMenuItemEvent: serverConnectionHandlerID=%llu, type=%d, menuItemID=%d, selectedItemID=%llu\n", (long long unsigned int)serverConnectionHandlerID, type, menuItemID, (long long unsigned int)selectedItemID);
-	switch (menuItemID) {
-	case MENU_ID_CHANNEL_FROM:
-		// Menu channel 1 was triggered (move users to yours)
-		moveClientsToOwnChannel(serverConnectionHandlerID, selectedItemID);
-		break;
-	case MENU_ID_CHANNEL_TO:
-		// Menu channel 2 was triggered (move users to target)
-		moveClientsToSelectedChannel(serverConnectionHandlerID, selectedItemID);
-		break;
-	case MENU_ID_CLIENT_FOLLOW:
-		ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_FOLLOW, 0);
-		ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_UNFOLLOW, 1);
-		enableFollow(serverConnectionHandlerID, selectedItemID);
-		break;
-	case MENU_ID_CLIENT_UNFOLLOW:
-		ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_FOLLOW, 1);
-		ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_UNFOLLOW, 0);
-		disableFollow();
-		break;
-	case MENU_ID_CLIENT_LOCK_MOVEMENT:
-		ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_LOCK_MOVEMENT, 0);
-		ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_UNLOCK_MOVEMENT, 1);
-		lockUser(serverConnectionHandlerID, selectedItemID);
-		break;
-	case MENU_ID_CLIENT_UNLOCK_MOVEMENT:
-		ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_LOCK_MOVEMENT, 1);
-		ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_UNLOCK_MOVEMENT, 0);
-		unlockUser(serverConnectionHandlerID, selectedItemID);
-		break;
-	case MENU_ID_GLOBAL_UNFOLLOW:
-		disableFollow();
-	case MENU_ID_GLOBAL_UNLOCK_MOVEMENT:
-		locked_users.clear();
-		locked_user_channels.clear();
-		ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_GLOBAL_UNLOCK_MOVEMENT, 0);
-		ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_LOCK_MOVEMENT, 1);
-		ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_UNLOCK_MOVEMENT, 0);
-	}
-	
+	METRIC_TIME(METRIC_CB_MENU_ITEM);
+	LOG_DEBUG(serverConnectionHandlerID, "PLUGIN: onMenuItemEvent: type=%d, menuItemID=%d, selectedItemID=%llu", type, menuItemID, (long long unsigned int)selectedItemID);
+	if (menuItemID < 0 || menuItemID >= ACTION_COUNT) return;
+	std::lock_guard<std::mutex> lock(state_mutex);
+	runAction(serverConnectionHandlerID, (action_id)menuItemID, selectedItemID);
 }
 
 /* This function is called if a plugin hotkey was pressed. Omit if hotkeys are unused. */
 void ts3plugin_onHotkeyEvent(const char* keyword) {
-	printf("PLUGIN: Hotkey event: %s\n", keyword);
-	/* Identify the hotkey by keyword ("keyword_1", "keyword_2" or "keyword_3" in this example) and handle here... */
-	if (strncmp(keyword, "MoveToOwnChannel", strlen(keyword)) == 0 && channel_selected) {
-		printf("Moving to own channel!\n");
-		moveClientsToOwnChannel(ts3Functions.getCurrentServerConnectionHandlerID(), selected_channel);
-	}
-	else if (strncmp(keyword, "MoveToSelectedChannel", strlen(keyword)) == 0 && channel_selected) {
-		printf("Moving to selected channel!\n");
-		moveClientsToSelectedChannel(ts3Functions.getCurrentServerConnectionHandlerID(), selected_channel);
-	}
-	else if (strncmp(keyword, "Follow", strlen(keyword)) == 0 && user_selected) {
-		ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_FOLLOW, 0);
-		ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_UNFOLLOW, 1);
-		enableFollow(ts3Functions.getCurrentServerConnectionHandlerID(), selected_user);
-	}
-	else if (strncmp(keyword, "Unfollow", strlen(keyword)) == 0 && follow_enable) {
-		ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_FOLLOW, 1);
-		ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_UNFOLLOW, 0);
-		disableFollow();
-	}
-	else if (strncmp(keyword, "LockMovement", strlen(keyword)) == 0 && user_selected) {
-		ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_LOCK_MOVEMENT, 0);
-		ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_UNLOCK_MOVEMENT, 1);
-		lockUser(ts3Functions.getCurrentServerConnectionHandlerID(), selected_user);
-	}
-	else if (strncmp(keyword, "UnlockLockMovement", strlen(keyword)) == 0 && user_selected) {
-		ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_LOCK_MOVEMENT, 1);
-		ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_UNLOCK_MOVEMENT, 0);
-		unlockUser(ts3Functions.getCurrentServerConnectionHandlerID(), selected_user);
-	}
-	else if (strncmp(keyword, "UnlockAllLockMovement", strlen(keyword)) == 0 && user_selected) {
-		locked_users.clear();
-		locked_user_channels.clear();
-		ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_GLOBAL_UNLOCK_MOVEMENT, 0);
-		ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_LOCK_MOVEMENT, 1);
-		ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_CLIENT_UNLOCK_MOVEMENT, 0);
+	METRIC_TIME(METRIC_CB_HOTKEY);
+	LOG_DEBUG(0, "PLUGIN: Hotkey event: %s", keyword);
+	const action_id id = actionByKeyword(keyword);
+	if (id == ACTION_COUNT) return;
+	const uint64 serverConnectionHandlerID = ts3Functions.getCurrentServerConnectionHandlerID();
+	std::lock_guard<std::mutex> lock(state_mutex);
+	const server_state& state = getServerState(serverConnectionHandlerID);
+	// hotkeys work on the channel or client shown in the info frame last
+	switch (plugin_actions[id].target) {
+	case ACTION_TARGET_CHANNEL:
+		if (state.channel_selected) runAction(serverConnectionHandlerID, id, state.selected_channel);
+		break;
+	case ACTION_TARGET_CLIENT:
+		if (state.user_selected) runAction(serverConnectionHandlerID, id, state.selected_user);
+		break;
+	case ACTION_TARGET_NONE:
+		runAction(serverConnectionHandlerID, id, 0);
+		break;
 	}
 }
 
@@ -553,186 +744,1770 @@ const char* ts3plugin_keyPrefix() {
 	return "JAT";
 }
 
-void ts3plugin_onClientMoveEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, const char* moveMessage) {
-	printf("Client moved (Self)! clid=%d, oCid=%llu, nCid=%llu\n", clientID, oldChannelID, newChannelID);
-	onClientMoved(serverConnectionHandlerID, clientID, oldChannelID, newChannelID, false, "Changed channel");
+void ts3plugin_onConnectStatusChangeEvent(uint64 serverConnectionHandlerID, int newStatus, unsigned int errorNumber) {
+	METRIC_TIME(METRIC_CB_CONNECT_STATUS);
+	if (newStatus == STATUS_CONNECTING) {
+		std::lock_guard<std::mutex> lock(state_mutex);
+		server_states[serverConnectionHandlerID] = server_state();
+	}
+	else if (newStatus == STATUS_CONNECTION_ESTABLISHED) {
+		std::lock_guard<std::mutex> lock(state_mutex);
+		restoreServerState(serverConnectionHandlerID);
+	}
+	else if (newStatus == STATUS_DISCONNECTED) {
+		// let the worker finish the moves of this tab first, they would bring its state back
+		eventWorkerDrain();
+		{
+			std::lock_guard<std::mutex> lock(state_mutex);
+			server_states.erase(serverConnectionHandlerID);
+			countLoudnessMeters();
+		}
+		massMoveDropConnection(serverConnectionHandlerID);
+		followEngineDropConnection(serverConnectionHandlerID);
+		moveSchedulerDropConnection(serverConnectionHandlerID);
+		backupDropConnection(serverConnectionHandlerID);
+		restoreDropConnection(serverConnectionHandlerID);
+	}
 }
 
-void ts3plugin_onClientMoveTimeoutEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, const char* timeoutMessage) {
-	printf("Client moved (Timeout)! clid=%d, oCid=%llu, nCid=%llu\n", clientID, oldChannelID, newChannelID);
-	onClientMoved(serverConnectionHandlerID, clientID, oldChannelID, newChannelID, true, "Timouted");
+/* Return 1 if the return code belongs to the plugin, so the client does not show the error */
+int ts3plugin_onServerErrorEvent(uint64 serverConnectionHandlerID, const char* errorMessage, unsigned int error, const char* returnCode, const char* extraMessage) {
+	METRIC_TIME(METRIC_CB_SERVER_ERROR);
+	if (returnCode && (moveSchedulerOnServerError(serverConnectionHandlerID, returnCode, error) || massMoveOnServerError(serverConnectionHandlerID, returnCode, error) || backupOnServerError(serverConnectionHandlerID, returnCode, error) || restoreOnServerError(serverConnectionHandlerID, returnCode, error) || banListAnswered(serverConnectionHandlerID, returnCode, error))) {
+		return 1;
+	}
+	return 0;
 }
 
-void ts3plugin_onClientMoveMovedEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, anyID moverID, const char* moverName, const char* moverUniqueIdentifier, const char* moveMessage) {
-	printf("Client moved (Got moved)! clid=%d, oCid=%llu, nCid=%llu\n", clientID, oldChannelID, newChannelID);
-	onClientMoved(serverConnectionHandlerID, clientID, oldChannelID, newChannelID, true, "Got moved");
+int ts3plugin_onServerPermissionErrorEvent(uint64 serverConnectionHandlerID, const char* errorMessage, unsigned int error, const char* returnCode, unsigned int failedPermissionID) {
+	METRIC_TIME(METRIC_CB_SERVER_ERROR);
+	if (returnCode && (moveSchedulerOnServerError(serverConnectionHandlerID, returnCode, error) || massMoveOnServerError(serverConnectionHandlerID, returnCode, error) || backupOnServerError(serverConnectionHandlerID, returnCode, error) || restoreOnServerError(serverConnectionHandlerID, returnCode, error) || banListAnswered(serverConnectionHandlerID, returnCode, error))) {
+		return 1;
+	}
+	return 0;
 }
 
-void ts3plugin_onClientKickFromChannelEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, anyID kickerID, const char* kickerName, const char* kickerUniqueIdentifier, const char* kickMessage) {
-	printf("Client moved (Kick from channel! clid=%d, oCid=%llu, nCid=%llu\n", clientID, oldChannelID, newChannelID);
-	onClientMoved(serverConnectionHandlerID, clientID, oldChannelID, newChannelID, true, "Channel kick");
+void ts3plugin_onNewChannelEvent(uint64 serverConnectionHandlerID, uint64 channelID, uint64 channelParentID) {
+	METRIC_TIME(METRIC_CB_CHANNEL_EVENT);
+	std::lock_guard<std::mutex> lock(state_mutex);
+	server_state& state = getServerState(serverConnectionHandlerID);
+	if (state.channels.seeded) channelTreeAdd(state.channels, channelID, channelParentID);
 }
 
-void ts3plugin_onClientKickFromServerEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, anyID kickerID, const char* kickerName, const char* kickerUniqueIdentifier, const char* kickMessage) {
-	printf("Client moved (Kick from server)! clid=%d, oCid=%llu, nCid=%llu\n", clientID, oldChannelID, newChannelID);
-	onClientMoved(serverConnectionHandlerID, clientID, oldChannelID, newChannelID, true, "Server kick");
+void ts3plugin_onNewChannelCreatedEvent(uint64 serverConnectionHandlerID, uint64 channelID, uint64 channelParentID, anyID invokerID, const char* invokerName, const char* invokerUniqueIdentifier) {
+	METRIC_TIME(METRIC_CB_CHANNEL_EVENT);
+	std::lock_guard<std::mutex> lock(state_mutex);
+	server_state& state = getServerState(serverConnectionHandlerID);
+	if (state.channels.seeded) channelTreeAdd(state.channels, channelID, channelParentID);
 }
 
+void ts3plugin_onDelChannelEvent(uint64 serverConnectionHandlerID, uint64 channelID, anyID invokerID, const char* invokerName, const char* invokerUniqueIdentifier) {
+	METRIC_TIME(METRIC_CB_CHANNEL_EVENT);
+	std::lock_guard<std::mutex> lock(state_mutex);
+	server_state& state = getServerState(serverConnectionHandlerID);
+	if (state.channels.seeded) channelTreeRemove(state.channels, channelID);
+}
 
-void moveClientsToSelectedChannel(uint64 serverConnectionHandlerID, uint64 channelID) {
-	anyID clientID;
-	R_CALL(ts3Functions.getClientID(serverConnectionHandlerID, &clientID), "Error retrieving client id!");
-
-	uint64 clientChannelID;
-	R_CALL(ts3Functions.getChannelOfClient(serverConnectionHandlerID, clientID, &clientChannelID), "Error retrieving client channel!");
+void ts3plugin_onChannelMoveEvent(uint64 serverConnectionHandlerID, uint64 channelID, uint64 newChannelParentID, anyID invokerID, const char* invokerName, const char* invokerUniqueIdentifier) {
+	METRIC_TIME(METRIC_CB_CHANNEL_EVENT);
+	std::lock_guard<std::mutex> lock(state_mutex);
+	server_state& state = getServerState(serverConnectionHandlerID);
+	if (state.channels.seeded) channelTreeMove(state.channels, channelID, newChannelParentID);
+}
 
-	anyID *clients;
-	R_CALL(ts3Functions.getChannelClientList(serverConnectionHandlerID, clientChannelID, &clients), "Error retrieving channel client list!");
+void ts3plugin_onServerGroupListEvent(uint64 serverConnectionHandlerID, uint64 serverGroupID, const char* name, int type, int iconID, int saveDB) {
+	METRIC_TIME(METRIC_CB_LIST_EVENT);
+	backupOnServerGroup(serverConnectionHandlerID, serverGroupID, name, type, iconID, saveDB);
+}
 
+void ts3plugin_onServerGroupPermListEvent(uint64 serverConnectionHandlerID, uint64 serverGroupID, unsigned int permissionID, int permissionValue, int permissionNegated, int permissionSkip) {
+	METRIC_TIME(METRIC_CB_LIST_EVENT);
+	backupOnServerGroupPerm(serverConnectionHandlerID, serverGroupID, permissionID, permissionValue, permissionNegated, permissionSkip);
+}
 
-	for (anyID* c = clients; *c != (anyID) NULL; c++) {
-		printf("Moving client %hu\n", *c);
-		CALL(ts3Functions.requestClientMove(serverConnectionHandlerID, *c, channelID, "", NULL), "Error moving client!");
-	}
+void ts3plugin_onChannelGroupListEvent(uint64 serverConnectionHandlerID, uint64 channelGroupID, const char* name, int type, int iconID, int saveDB) {
+	METRIC_TIME(METRIC_CB_LIST_EVENT);
+	backupOnChannelGroup(serverConnectionHandlerID, channelGroupID, name, type, iconID, saveDB);
 }
 
-void moveClientsToOwnChannel(uint64 serverConnectionHandlerID, uint64 channelID) {
-	anyID clientID;
-	R_CALL(ts3Functions.getClientID(serverConnectionHandlerID, &clientID), "Error retrieving client id!");
+void ts3plugin_onChannelGroupPermListEvent(uint64 serverConnectionHandlerID, uint64 channelGroupID, unsigned int permissionID, int permissionValue, int permissionNegated, int permissionSkip) {
+	METRIC_TIME(METRIC_CB_LIST_EVENT);
+	backupOnChannelGroupPerm(serverConnectionHandlerID, channelGroupID, permissionID, permissionValue, permissionNegated, permissionSkip);
+}
 
-	uint64 clientChannelID;
-	R_CALL(ts3Functions.getChannelOfClient(serverConnectionHandlerID, clientID, &clientChannelID), "Error retrieving client channel!");
+void ts3plugin_onChannelPermListEvent(uint64 serverConnectionHandlerID, uint64 channelID, unsigned int permissionID, int permissionValue, int permissionNegated, int permissionSkip) {
+	METRIC_TIME(METRIC_CB_LIST_EVENT);
+	backupOnChannelPerm(serverConnectionHandlerID, channelID, permissionID, permissionValue, permissionNegated, permissionSkip);
+}
 
-	anyID *clients;
-	R_CALL(ts3Functions.getChannelClientList(serverConnectionHandlerID, channelID, &clients), "Error retrieving channel client list!");
+void ts3plugin_onBanListEvent(uint64 serverConnectionHandlerID, uint64 banid, const char* ip, const char* name, const char* uid, uint64 creationTime, uint64 durationTime, const char* invokerName, uint64 invokercldbid, const char* invokeruid, const char* reason, int numberOfEnforcements, const char* lastNickName) {
+	METRIC_TIME(METRIC_CB_LIST_EVENT);
+	backupOnBan(serverConnectionHandlerID, banid, ip, name, uid, creationTime, durationTime, invokerName, invokercldbid, invokeruid, reason, numberOfEnforcements, lastNickName);
+	std::lock_guard<std::mutex> lock(state_mutex);
+	server_state& state = getServerState(serverConnectionHandlerID);
+	// rows of a backup's request are as good as the cache's own
+	if (state.bans.enabled) banCacheAdd(state.bans, banid, ip, name, uid, creationTime, durationTime);
+}
 
-	for (anyID* c = clients; *c != (anyID) NULL; c++) {
-		printf("Moving client %hu\n", *c);
-		CALL(ts3Functions.requestClientMove(serverConnectionHandlerID, *c, clientChannelID, "", NULL), "Error moving client!");
+void ts3plugin_onUpdateClientEvent(uint64 serverConnectionHandlerID, anyID clientID, anyID invokerID, const char* invokerName, const char* invokerUniqueIdentifier) {
+	METRIC_TIME(METRIC_CB_CLIENT_EVENT);
+	std::lock_guard<std::mutex> lock(state_mutex);
+	server_state& state = getServerState(serverConnectionHandlerID);
+	if (!isClientDBIDCached(state, clientID)) {
+		uint64 clientDBID;
+		queryClientDBID(state, serverConnectionHandlerID, clientID, &clientDBID);
+	}
+	if (state.afk.config.channelID) {
+		uint64 home;
+		if (afkSetFlags(state.afk, clientID, queryAfkFlags(serverConnectionHandlerID, clientID), afkClock(), &home)) {
+			returnFromAfk(state, serverConnectionHandlerID, clientID, home);
+		}
 	}
-	ts3Functions.freeMemory(clients);
-
 }
 
-struct move_data {
-	uint64 serverConnectionHandlerID;
-	anyID clientID;
-	uint64 oldChannelID;
-	uint64 newChannelID;
-	bool was_moved;
-};
+void ts3plugin_onClientIDsEvent(uint64 serverConnectionHandlerID, const char* uniqueClientIdentifier, anyID clientID, const char* clientName) {
+	METRIC_TIME(METRIC_CB_CLIENT_EVENT);
+	std::lock_guard<std::mutex> lock(state_mutex);
+	server_state& state = getServerState(serverConnectionHandlerID);
+	if (!isClientDBIDCached(state, clientID)) {
+		uint64 clientDBID;
+		queryClientDBID(state, serverConnectionHandlerID, clientID, &clientDBID);
+	}
+}
 
-void onClientMoved(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, bool was_moved, const char* moveType) {
-	static move_data last_move = move_data{ 0, 0, 0, 0, false };
-	if (newChannelID == 0) {
-		// client left server
-		printf("Client %d left server\n", clientID);
+void ts3plugin_onTalkStatusChangeEvent(uint64 serverConnectionHandlerID, int status, int isReceivedWhisper, anyID clientID) {
+	METRIC_TIME(METRIC_CB_CLIENT_EVENT);
+	std::lock_guard<std::mutex> lock(state_mutex);
+	server_state& state = getServerState(serverConnectionHandlerID);
+	occupancySetTalking(state.occupancy, clientID, status == STATUS_TALKING, occupancyClock());
+	uint64 home;
+	if (state.afk.config.channelID && status == STATUS_TALKING && afkActivity(state.afk, clientID, afkClock(), &home)) {
+		returnFromAfk(state, serverConnectionHandlerID, clientID, home);
 	}
+}
 
-	printf("Client move ('%s'), clid=%d, oCid=%llu, nCid=%llu, was_moved=%d\n", moveType, clientID, oldChannelID, newChannelID, was_moved);
-	if (last_move.clientID == clientID && last_move.oldChannelID == oldChannelID && last_move.newChannelID == newChannelID && last_move.was_moved == was_moved) {
-		printf("Repeatmove, skipping\n");
-		last_move = move_data{ 0, 0, 0, 0, false };
+/*
+ * Audio thread, every client's playback frames. The frame is measured before the plugin state is touched, and the
+ * callback never waits for the state: the client thread holds it through whole batches, so a frame that comes while
+ * the state is busy is counted as skipped and not metered, the next one follows 20 ms later. Nothing here allocates
+ * or calls the client lib.
+ */
+void ts3plugin_onEditPlaybackVoiceDataEvent(uint64 serverConnectionHandlerID, anyID clientID, short* samples, int sampleCount, int channels) {
+	METRIC_TIME(METRIC_CB_VOICE_DATA);
+	if (loudness_meters.load(std::memory_order_relaxed) == 0) return;
+	const size_t count = (size_t)sampleCount * (size_t)channels;
+	loudness_frame frame;
+	loudnessMeasure(samples, count, &frame);
+	std::unique_lock<std::mutex> lock(state_mutex, std::try_to_lock);
+	if (!lock.owns_lock()) {
+		metricsCount(METRIC_VOICE_FRAMES_SKIPPED);
 		return;
 	}
-	last_move = move_data{ serverConnectionHandlerID, clientID, oldChannelID, newChannelID, was_moved };
+	const auto it = server_states.find(serverConnectionHandlerID);
+	if (it == server_states.end() || it->second.loudness.config.threshold_db == 0) return;
+	// a client that reaches the hold time is only flagged, reportLoudClients reports and mutes it on the timer thread
+	loudnessFeed(it->second.loudness, clientID, frame, count, channels);
+}
+
+/* Members of the admin groups (see /jat admins), the chat filter and the ban list leave them alone */
+static bool isAdminClient(server_state& state, uint64 serverConnectionHandlerID, anyID clientID) {
+	const channel_occupancy* index = getOccupancy(state, serverConnectionHandlerID);
+	return index && !occupancyMatches(*index, clientID, occupancy_filter{ true, false, 0 }, occupancyClock());
+}
 
+/* Locks the client in its channel until the chat lock ends, a lock it already had stays as it is */
+static bool chatLockClient(server_state& state, uint64 serverConnectionHandlerID, anyID clientID, unsigned int minutes) {
 	uint64 clientDBID;
-	R_CALL(ts3Functions.getClientVariableAsUInt64(serverConnectionHandlerID, clientID, CLIENT_DATABASE_ID, &clientDBID), "Error retreiving client db id!");
+	uint64 channelID;
+	if (getClientDBID(state, serverConnectionHandlerID, clientID, &clientDBID) != ERROR_ok) return false;
+	if (ts3Functions.getChannelOfClient(serverConnectionHandlerID, clientID, &channelID) != ERROR_ok) return false;
+	if (!state.locked_users.emplace(clientDBID, channelID).second && !state.chat_locks.count(clientDBID)) return true;
+	state.chat_locks[clientDBID] = chatClock() + (uint64)minutes * 60000;
+	setMenuEnabled(ACTION_UNLOCK_ALL_MOVEMENT, true);
+	return true;
+}
 
-	if (follow_enable) {
-		if (follow_target_db_id == clientDBID) {
-			follow(serverConnectionHandlerID, newChannelID);
-		}
+/* Reports the sender of a blocked message and kicks or locks it */
+static void punishChatSender(server_state& state, uint64 serverConnectionHandlerID, anyID clientID, const char* name, chat_verdict verdict, int word) {
+	const chat_filter& chat = state.chat;
+	metricsCount(METRIC_CHAT_ACTIONS);
+	char msg[TS3_MAX_SIZE_CLIENT_NICKNAME + 192];
+	int length;
+	if (verdict == CHAT_VERDICT_BLOCKED_WORD) {
+		length = snprintf(msg, sizeof(msg), "Chat filter: %s said '%.64s'", name, chat.matcher.words[word].c_str());
+	}
+	else {
+		length = snprintf(msg, sizeof(msg), "Chat filter: %s sent more than %u messages in %u s", name, chat.config.messages, chat.config.seconds);
 	}
+	if (length < 0 || (size_t)length >= sizeof(msg)) length = (int)sizeof(msg) - 1;
 
-	if (!locked_users.empty()) {
-		const auto it = std::find(locked_users.begin(), locked_users.end(), clientDBID);
-		if (it != locked_users.cend()) {
-			const int ndx = std::distance(locked_users.begin(), it);
-			if (!was_moved) {
-				printf("Restricting user movement clid=%d\n", clientID);
-				const uint64 locked_channel = locked_user_channels[ndx];
-				if (newChannelID != locked_channel) {
-					CALL(ts3Functions.requestClientMove(serverConnectionHandlerID, clientID, locked_channel, "", NULL), "Error moving client!");
-				}
-			}
-			else {
-				printf("Updating movement restricted user channel clid=%d, cid=%llu\n", clientID, newChannelID);
-				locked_user_channels[ndx] = newChannelID;
-			}
+	switch (chat.config.action) {
+	case CHAT_ACTION_REPORT:
+		break;
+	case CHAT_ACTION_KICK:
+		snprintf(msg + length, sizeof(msg) - length, ", kicked");
+		CALL(ts3Functions.requestClientKickFromServer(serverConnectionHandlerID, clientID, "Chat filter", NULL), "Error kicking client!");
+		break;
+	case CHAT_ACTION_LOCK:
+		if (chatLockClient(state, serverConnectionHandlerID, clientID, chat.config.lock_minutes)) {
+			snprintf(msg + length, sizeof(msg) - length, ", locked in the channel for %u minutes", chat.config.lock_minutes);
 		}
+		break;
 	}
+	LOG_INFO(serverConnectionHandlerID, "%s", msg);
+	ts3Functions.printMessage(serverConnectionHandlerID, msg, PLUGIN_MESSAGE_TARGET_SERVER);
 }
 
-void lockUser(uint64 serverConnectionHandlerID, anyID userID) {
-	uint64 userChannel;
-	R_CALL(ts3Functions.getChannelOfClient(serverConnectionHandlerID, userID, &userChannel), "Error retrieving client channel!");
+/* Channel and server chat through the chat filter, returning 1 hides a message */
+int ts3plugin_onTextMessageEvent(uint64 serverConnectionHandlerID, anyID targetMode, anyID toID, anyID fromID, const char* fromName, const char* fromUniqueIdentifier, const char* message, int ffIgnored) {
+	METRIC_TIME(METRIC_CB_TEXT_MESSAGE);
+	if (targetMode == TextMessageTarget_CLIENT) return 0;
+	std::lock_guard<std::mutex> lock(state_mutex);
+	server_state& state = getServerState(serverConnectionHandlerID);
+	if (!state.chat.enabled || fromID == state.chat.own_client) return 0;
+
+	int word = -1;
+	const chat_verdict verdict = chatFilterCheck(state.chat, fromID, message, chatClock(), &word);
+	if (verdict == CHAT_VERDICT_OK || isAdminClient(state, serverConnectionHandlerID, fromID)) return 0;
+	metricsCount(METRIC_CHAT_BLOCKED);
+	// a flood is dealt with on its first message
+	if (verdict != CHAT_VERDICT_FLOODING) punishChatSender(state, serverConnectionHandlerID, fromID, fromName, verdict, word);
+	return 1;
+}
 
-	uint64 clientDBID;
-	R_CALL(ts3Functions.getClientVariableAsUInt64(serverConnectionHandlerID, userID, CLIENT_DATABASE_ID, &clientDBID), "Error retreiving client db id!");
+/* Fetches the ban list into the cache, rows that do not come again are dropped when the answer arrives */
+static void refreshBans(server_state& state, uint64 serverConnectionHandlerID) {
+	char returnCode[RETURNCODE_BUFSIZE];
+	ts3Functions.createReturnCode(pluginID, returnCode, RETURNCODE_BUFSIZE);
+	ban_cache& bans = state.bans;
+	bans.refresh_code = returnCode;
+	bans.refreshed_at = (uint64)time(NULL);
+	banCacheBeginRefresh(bans);
+	const unsigned int r = ts3Functions.requestBanList(serverConnectionHandlerID, returnCode);
+	if (r != ERROR_ok) {
+		LOG_WARN(serverConnectionHandlerID, "Error %u requesting the ban list, keeping the %zu cached bans", r, bans.live);
+		bans.refresh_code.clear();
+	}
+}
 
-	R_ASSERT(std::find(locked_users.begin(), locked_users.end(), clientDBID) == locked_users.cend(), "Error trying to lock already locked user!");
-	locked_users.push_back(clientDBID);
-	locked_user_channels.push_back(userChannel);
-	ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_GLOBAL_UNLOCK_MOVEMENT, 1);
+/* Kicks the client if the cached ban list has a ban on it. Only the fields some ban uses are read. */
+static bool kickIfBanned(server_state& state, uint64 serverConnectionHandlerID, anyID clientID) {
+	const ban_cache& bans = state.bans;
+	if (clientID == bans.own_client || bans.live == 0) return false;
+	char* uid = NULL;
+	char* ip = NULL;
+	char* name = NULL;
+	if (bans.rules[BAN_FIELD_UID] && ts3Functions.getClientVariableAsString(serverConnectionHandlerID, clientID, CLIENT_UNIQUE_IDENTIFIER, &uid) != ERROR_ok) uid = NULL;
+	// only known once the connection info was requested, the server checks the others
+	if (bans.rules[BAN_FIELD_IP] && ts3Functions.getConnectionVariableAsString(serverConnectionHandlerID, clientID, CONNECTION_CLIENT_IP, &ip) != ERROR_ok) ip = NULL;
+	if (bans.rules[BAN_FIELD_NAME] && ts3Functions.getClientVariableAsString(serverConnectionHandlerID, clientID, CLIENT_NICKNAME, &name) != ERROR_ok) name = NULL;
+
+	ban_field field;
+	const ban_entry* ban = banCacheFind(bans, uid, ip, name, (uint64)time(NULL), &field);
+	if (ban && !isAdminClient(state, serverConnectionHandlerID, clientID)) {
+		static const char* fields[] = { "uid", "ip", "name" };
+		const char* value = field == BAN_FIELD_UID ? uid : (field == BAN_FIELD_IP ? ip : name);
+		char msg[256];
+		snprintf(msg, sizeof(msg), "Ban list: client %d (%s '%.64s') is banned by ban %llu, kicked", clientID, fields[field], value, (unsigned long long)ban->id);
+		LOG_INFO(serverConnectionHandlerID, "%s", msg);
+		ts3Functions.printMessage(serverConnectionHandlerID, msg, PLUGIN_MESSAGE_TARGET_SERVER);
+		metricsCount(METRIC_BAN_KICKS);
+		CALL(ts3Functions.requestClientKickFromServer(serverConnectionHandlerID, clientID, "Banned", NULL), "Error kicking client!");
+	}
+	else {
+		ban = NULL;
+	}
+	if (uid) ts3Functions.freeMemory(uid);
+	if (ip) ts3Functions.freeMemory(ip);
+	if (name) ts3Functions.freeMemory(name);
+	return ban != NULL;
 }
 
-void unlockUser(uint64 serverConnectionHandlerID, anyID userID) {
-	uint64 clientDBID;
-	R_CALL(ts3Functions.getClientVariableAsUInt64(serverConnectionHandlerID, userID, CLIENT_DATABASE_ID, &clientDBID), "Error retreiving client db id!");
-
-	R_ASSERT(!locked_users.empty(), "Error trying to unlock user but no users locked!");
-	const auto it = std::find(locked_users.begin(), locked_users.end(), clientDBID);
-	R_ASSERT(it != locked_users.cend(), "Error trying to unlock non-locked user!");
-	const int ndx = std::distance(locked_users.begin(), it);
-	locked_users.erase(it);
-	locked_user_channels.erase(locked_user_channels.begin() + ndx);
-	
-	if (locked_users.empty()) {
-		ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_GLOBAL_UNLOCK_MOVEMENT, 1);
+/* A joining client, checked before anything else looks at it. The cache is refreshed once it is old enough. */
+static bool checkJoiningClient(server_state& state, uint64 serverConnectionHandlerID, anyID clientID) {
+	ban_cache& bans = state.bans;
+	if (bans.refresh_code.empty() && (uint64)time(NULL) - bans.refreshed_at >= (uint64)bans.refresh_minutes * 60) {
+		refreshBans(state, serverConnectionHandlerID);
 	}
+	return kickIfBanned(state, serverConnectionHandlerID, clientID);
 }
 
-void join(uint64 serverConnectionHandlerID, anyID targetClientID) {
-	anyID myClientID;
-	R_CALL(ts3Functions.getClientID(serverConnectionHandlerID, &myClientID), "Error retrieving client id!");
+/* Answer to the cache's requestBanList. Clients already in view are checked against bans that are new. */
+static bool banListAnswered(uint64 serverConnectionHandlerID, const char* returnCode, unsigned int error) {
+	std::lock_guard<std::mutex> lock(state_mutex);
+	const auto it = server_states.find(serverConnectionHandlerID);
+	if (it == server_states.end()) return false;
+	server_state& state = it->second;
+	ban_cache& bans = state.bans;
+	if (bans.refresh_code.empty() || bans.refresh_code != returnCode) return false;
+	bans.refresh_code.clear();
+	if (error != ERROR_ok && error != ERROR_database_empty_result) {
+		LOG_WARN(serverConnectionHandlerID, "Error %u refreshing the ban list, keeping the %zu cached bans", error, bans.live);
+		if (bans.generation == 1) ts3Functions.printMessage(serverConnectionHandlerID, "Ban list: could not read the ban list of the server", PLUGIN_MESSAGE_TARGET_SERVER);
+		return true;
+	}
+	const size_t dropped = banCacheEndRefresh(bans);
+	char msg[192];
+	snprintf(msg, sizeof(msg), "Ban list: %zu bans cached (%zu new, %zu dropped), %zu rules left to the server",
+		bans.live, bans.added, dropped, bans.unindexed);
+	LOG_DEBUG(serverConnectionHandlerID, "%s", msg);
+	if (bans.generation == 1) ts3Functions.printMessage(serverConnectionHandlerID, msg, PLUGIN_MESSAGE_TARGET_SERVER);
+
+	anyID* clients;
+	if (bans.added == 0 || ts3Functions.getClientList(serverConnectionHandlerID, &clients) != ERROR_ok) return true;
+	for (const anyID* c = clients; *c != (anyID)NULL; c++) kickIfBanned(state, serverConnectionHandlerID, *c);
+	ts3Functions.freeMemory(clients);
+	return true;
+}
 
-	uint64 myChannelID;
-	R_CALL(ts3Functions.getChannelOfClient(serverConnectionHandlerID, myClientID, &myChannelID), "Error retrieving client channel!");
+/* Answer to requestServerGroupsByClientID, one event per group */
+void ts3plugin_onServerGroupByClientIDEvent(uint64 serverConnectionHandlerID, const char* name, uint64 serverGroupList, uint64 clientDatabaseID) {
+	METRIC_TIME(METRIC_CB_GROUP_EVENT);
+	std::lock_guard<std::mutex> lock(state_mutex);
+	server_state& state = getServerState(serverConnectionHandlerID);
+	if (!state.groups.seeded) return;
+	// the group belongs to the database id, every connection of that client is a member
+	for (size_t clientID = 0; clientID < state.client_db_ids.size(); clientID++) {
+		if (state.client_db_ids[clientID] == clientDatabaseID) groupIndexSetServerGroup(state.groups, (anyID)clientID, serverGroupList, true);
+	}
+}
 
-	uint64 targetChannelId;
-	R_CALL(ts3Functions.getChannelOfClient(serverConnectionHandlerID, targetClientID, &targetChannelId), "Error retrieving target channel!");
+void ts3plugin_onServerGroupClientAddedEvent(uint64 serverConnectionHandlerID, anyID clientID, const char* clientName, const char* clientUniqueIdentity, uint64 serverGroupID, anyID invokerClientID, const char* invokerName, const char* invokerUniqueIdentity) {
+	METRIC_TIME(METRIC_CB_GROUP_EVENT);
+	std::lock_guard<std::mutex> lock(state_mutex);
+	server_state& state = getServerState(serverConnectionHandlerID);
+	groupIndexSetServerGroup(state.groups, clientID, serverGroupID, true);
+	occupancySetServerGroup(state.occupancy, clientID, serverGroupID, true);
+}
 
-	if (myChannelID != targetChannelId) {
-		CALL(ts3Functions.requestClientMove(serverConnectionHandlerID, myClientID, targetChannelId, "", NULL), "Error moving client!");
-	}
+void ts3plugin_onServerGroupClientDeletedEvent(uint64 serverConnectionHandlerID, anyID clientID, const char* clientName, const char* clientUniqueIdentity, uint64 serverGroupID, anyID invokerClientID, const char* invokerName, const char* invokerUniqueIdentity) {
+	METRIC_TIME(METRIC_CB_GROUP_EVENT);
+	std::lock_guard<std::mutex> lock(state_mutex);
+	server_state& state = getServerState(serverConnectionHandlerID);
+	groupIndexSetServerGroup(state.groups, clientID, serverGroupID, false);
+	occupancySetServerGroup(state.occupancy, clientID, serverGroupID, false);
 }
 
-void enableFollow(uint64 serverConnectionHandlerID, anyID targetID) {
-	uint64 clientDBID;
-	R_CALL(ts3Functions.getClientVariableAsUInt64(serverConnectionHandlerID, targetID, CLIENT_DATABASE_ID, &clientDBID), "Error retreiving client db id!");
-	ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_GLOBAL_UNFOLLOW, 1);
-	
-	follow_enable = true;
-	follow_target_db_id = clientDBID;
-	join(serverConnectionHandlerID, targetID);
+void ts3plugin_onClientChannelGroupChangedEvent(uint64 serverConnectionHandlerID, uint64 channelGroupID, uint64 channelID, anyID clientID, anyID invokerClientID, const char* invokerName, const char* invokerUniqueIdentity) {
+	METRIC_TIME(METRIC_CB_GROUP_EVENT);
+	std::lock_guard<std::mutex> lock(state_mutex);
+	groupIndexSetChannelGroup(getServerState(serverConnectionHandlerID).groups, clientID, channelGroupID);
 }
 
-void disableFollow() {
-	ts3Functions.setPluginMenuEnabled(pluginID, MENU_ID_GLOBAL_UNFOLLOW, 0);
-	follow_enable = false;
-	follow_target_db_id = 0;
+/*
+ * Keeps the occupancy index, the AFK mover and the loudness meter in step with a client that joined, moved, left or
+ * came into or out of view
+ */
+static void trackOccupancy(server_state& state, uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID) {
+	if (state.afk.config.channelID) afkClientMoved(state.afk, clientID, newChannelID, afkClock());
+	if (state.loudness.config.threshold_db && (oldChannelID == 0 || newChannelID == 0)) loudnessTrack(state.loudness, clientID, newChannelID != 0);
+	if (!state.occupancy.seeded) return;
+	if (oldChannelID == 0) {
+		CALL(occupancyAddClient(state.occupancy, serverConnectionHandlerID, clientID, newChannelID, occupancyClock()), "Error retrieving client groups!");
+		return;
+	}
+	occupancyMoveClient(state.occupancy, clientID, newChannelID, occupancyClock());
 }
 
-void follow(uint64 serverConnectionHandlerID, uint64 newChannelID) {
-	anyID myClientID;
-	R_CALL(ts3Functions.getClientID(serverConnectionHandlerID, &myClientID), "Error retrieving client id!");
+/*
+ * Move events of the server were dropped, so what was tracked from them may be wrong. The occupancy index and the
+ * database id cache are seeded again on next use, the group index, AFK and loudness tracking right away from the
+ * client list. The move history is forgotten, echoes of moves still in flight count as new moves.
+ */
+static void resyncServerState(server_state& state, uint64 serverConnectionHandlerID) {
+	state.client_db_ids.clear();
+	state.move_history.clear();
+	occupancyForget(state.occupancy);
+	if (state.groups.seeded || groupIndexActive(state.groups)) {
+		CALL(groupIndexSeed(state.groups, serverConnectionHandlerID), "Error seeding group index!");
+	}
+	if (!state.afk.config.channelID && !state.loudness.config.threshold_db) return;
+
+	anyID* clients;
+	R_CALL(ts3Functions.getClientList(serverConnectionHandlerID, &clients), "Error retrieving client list!");
+	std::vector<uint64> channels;  // indexed by client id, 0 = not in view
+	for (const anyID* it = clients; *it != (anyID)NULL; it++) {
+		uint64 channelID;
+		if (ts3Functions.getChannelOfClient(serverConnectionHandlerID, *it, &channelID) != ERROR_ok) continue;
+		if (channels.size() <= *it) channels.resize((size_t)*it + 1, 0);
+		channels[*it] = channelID;
+	}
+	ts3Functions.freeMemory(clients);
 
-	uint64 myChannelID;
-	R_CALL(ts3Functions.getChannelOfClient(serverConnectionHandlerID, myClientID, &myChannelID), "Error retrieving client channel!");
+	// a client that changed channel or came and went meanwhile is handled like its move had arrived
+	const uint64 now = afkClock();
+	if (state.afk.config.channelID) {
+		for (size_t clientID = 1; clientID < std::max(channels.size(), state.afk.clients.size()); clientID++) {
+			const uint64 channelID = clientID < channels.size() ? channels[clientID] : 0;
+			const uint64 tracked = clientID < state.afk.clients.size() ? state.afk.clients[clientID].channelID : 0;
+			if (channelID != tracked) afkClientMoved(state.afk, (anyID)clientID, channelID, now);
+		}
+	}
+	if (state.loudness.config.threshold_db) {
+		for (size_t clientID = 1; clientID < std::max(channels.size(), state.loudness.clients.size()); clientID++) {
+			const bool in_view = clientID < channels.size() && channels[clientID] != 0;
+			const bool tracked = clientID < state.loudness.clients.size() && state.loudness.clients[clientID].tracked;
+			if (in_view != tracked) loudnessTrack(state.loudness, (anyID)clientID, in_view);
+		}
+	}
+}
 
-	if (myChannelID != newChannelID) {
-		CALL(ts3Functions.requestClientMove(serverConnectionHandlerID, myClientID, newChannelID, "", NULL), "Error moving client!");
+/* Runs on the event worker thread */
+static void onMoveEvent(const move_event& e) {
+	METRIC_TIME(METRIC_CB_MOVE_HANDLER);
+	std::lock_guard<std::mutex> lock(state_mutex);
+	switch (e.type) {
+	case MOVE_EVENT_SELF:
+		LOG_TRACE(e.serverConnectionHandlerID, "Client moved (Self)! clid=%d, oCid=%llu, nCid=%llu", e.clientID, e.oldChannelID, e.newChannelID);
+		onClientMoved(e.serverConnectionHandlerID, e.clientID, e.oldChannelID, e.newChannelID, false, "Changed channel");
+		break;
+	case MOVE_EVENT_TIMEOUT:
+		LOG_TRACE(e.serverConnectionHandlerID, "Client moved (Timeout)! clid=%d, oCid=%llu, nCid=%llu", e.clientID, e.oldChannelID, e.newChannelID);
+		onClientMoved(e.serverConnectionHandlerID, e.clientID, e.oldChannelID, e.newChannelID, true, "Timouted");
+		break;
+	case MOVE_EVENT_MOVED:
+		LOG_TRACE(e.serverConnectionHandlerID, "Client moved (Got moved)! clid=%d, oCid=%llu, nCid=%llu", e.clientID, e.oldChannelID, e.newChannelID);
+		onClientMoved(e.serverConnectionHandlerID, e.clientID, e.oldChannelID, e.newChannelID, true, "Got moved");
+		break;
+	case MOVE_EVENT_KICK_CHANNEL:
+		LOG_TRACE(e.serverConnectionHandlerID, "Client moved (Kick from channel! clid=%d, oCid=%llu, nCid=%llu", e.clientID, e.oldChannelID, e.newChannelID);
+		onClientMoved(e.serverConnectionHandlerID, e.clientID, e.oldChannelID, e.newChannelID, true, "Channel kick");
+		break;
+	case MOVE_EVENT_KICK_SERVER:
+		LOG_TRACE(e.serverConnectionHandlerID, "Client moved (Kick from server)! clid=%d, oCid=%llu, nCid=%llu", e.clientID, e.oldChannelID, e.newChannelID);
+		onClientMoved(e.serverConnectionHandlerID, e.clientID, e.oldChannelID, e.newChannelID, true, "Server kick");
+		break;
+	case MOVE_EVENT_SUBSCRIPTION:
+		// nothing to enforce, the client only came into or went out of view
+		LOG_TRACE(e.serverConnectionHandlerID, "Client moved (Subscription)! clid=%d, oCid=%llu, nCid=%llu", e.clientID, e.oldChannelID, e.newChannelID);
+		trackOccupancy(getServerState(e.serverConnectionHandlerID), e.serverConnectionHandlerID, e.clientID, e.oldChannelID, e.newChannelID);
+		break;
+	case MOVE_EVENT_LOST: {
+		LOG_WARN(e.serverConnectionHandlerID, "Move events dropped, reading the clients again");
+		const auto it = server_states.find(e.serverConnectionHandlerID);
+		// the tab may have been closed meanwhile
+		if (it != server_states.end()) resyncServerState(it->second, e.serverConnectionHandlerID);
+		break;
+	}
 	}
-}
\ No newline at end of file
+}
+
+/* Runs on the follow engine's timer thread */
+static void onFollowFlush(uint64 serverConnectionHandlerID, uint64 channelID) {
+	std::lock_guard<std::mutex> lock(state_mutex);
+	const auto it = server_states.find(serverConnectionHandlerID);
+	// unfollowed or disconnected while the move waited
+	if (it == server_states.end() || it->second.follow_targets.empty()) return;
+	follow(serverConnectionHandlerID, channelID);
+}
+
+/*
+ * The move callbacks only hand the event to the worker, the client thread must not wait for our lookups. The other
+ * client callbacks are still handled where they arrive, so one of them can see a client before its queued join did.
+ */
+static void pushMoveEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, move_event_type type) {
+	METRIC_TIME(METRIC_CB_MOVE_EVENT);
+	eventWorkerPush(move_event{ serverConnectionHandlerID, oldChannelID, newChannelID, clientID, (unsigned char)type });
+}
+
+void ts3plugin_onClientMoveEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, const char* moveMessage) {
+	pushMoveEvent(serverConnectionHandlerID, clientID, oldChannelID, newChannelID, MOVE_EVENT_SELF);
+}
+
+void ts3plugin_onClientMoveSubscriptionEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility) {
+	pushMoveEvent(serverConnectionHandlerID, clientID, oldChannelID, newChannelID, MOVE_EVENT_SUBSCRIPTION);
+}
+
+void ts3plugin_onClientMoveTimeoutEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, const char* timeoutMessage) {
+	pushMoveEvent(serverConnectionHandlerID, clientID, oldChannelID, newChannelID, MOVE_EVENT_TIMEOUT);
+}
+
+void ts3plugin_onClientMoveMovedEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, anyID moverID, const char* moverName, const char* moverUniqueIdentifier, const char* moveMessage) {
+	pushMoveEvent(serverConnectionHandlerID, clientID, oldChannelID, newChannelID, MOVE_EVENT_MOVED);
+}
+
+void ts3plugin_onClientKickFromChannelEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, anyID kickerID, const char* kickerName, const char* kickerUniqueIdentifier, const char* kickMessage) {
+	pushMoveEvent(serverConnectionHandlerID, clientID, oldChannelID, newChannelID, MOVE_EVENT_KICK_CHANNEL);
+}
+
+void ts3plugin_onClientKickFromServerEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, anyID kickerID, const char* kickerName, const char* kickerUniqueIdentifier, const char* kickMessage) {
+	pushMoveEvent(serverConnectionHandlerID, clientID, oldChannelID, newChannelID, MOVE_EVENT_KICK_SERVER);
+}
+
+/* A ban leaves the server like a kick, and the server has a new ban the cache should know before the client is back */
+void ts3plugin_onClientBanFromServerEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, anyID kickerID, const char* kickerName, const char* kickerUniqueIdentifier, uint64 time, const char* kickMessage) {
+	pushMoveEvent(serverConnectionHandlerID, clientID, oldChannelID, newChannelID, MOVE_EVENT_KICK_SERVER);
+	std::lock_guard<std::mutex> lock(state_mutex);
+	server_state& state = getServerState(serverConnectionHandlerID);
+	if (!state.bans.enabled) return;
+	// a refresh in flight may have missed it, the next join asks again
+	if (!state.bans.refresh_code.empty()) state.bans.refreshed_at = 0;
+	else refreshBans(state, serverConnectionHandlerID);
+}
+
+
+static const occupancy_filter all_clients = occupancy_filter{ false, false, 0 };
+
+/* Appends the clients of a channel that pass the filter, read from the occupancy index */
+static unsigned int collectChannelClients(uint64 serverConnectionHandlerID, uint64 channelID, const occupancy_filter& filter, std::vector<anyID>& result) {
+	channel_occupancy* index = getOccupancy(getServerState(serverConnectionHandlerID), serverConnectionHandlerID);
+	if (!index) return ERROR_undefined;
+	occupancyCollect(*index, channelID, filter, occupancyClock(), result);
+	return ERROR_ok;
+}
+
+void moveClientsToSelectedChannel(uint64 serverConnectionHandlerID, uint64 channelID) {
+	anyID clientID;
+	R_CALL(ts3Functions.getClientID(serverConnectionHandlerID, &clientID), "Error retrieving client id!");
+
+	uint64 clientChannelID;
+	R_CALL(ts3Functions.getChannelOfClient(serverConnectionHandlerID, clientID, &clientChannelID), "Error retrieving client channel!");
+
+	std::vector<anyID> clients;
+	R_CALL(collectChannelClients(serverConnectionHandlerID, clientChannelID, all_clients, clients), "Error collecting channel clients!");
+	clients.push_back((anyID)NULL);
+
+	massMoveStart(serverConnectionHandlerID, clients.data(), channelID);
+}
+
+void moveClientsToOwnChannel(uint64 serverConnectionHandlerID, uint64 channelID) {
+	anyID clientID;
+	R_CALL(ts3Functions.getClientID(serverConnectionHandlerID, &clientID), "Error retrieving client id!");
+
+	uint64 clientChannelID;
+	R_CALL(ts3Functions.getChannelOfClient(serverConnectionHandlerID, clientID, &clientChannelID), "Error retrieving client channel!");
+
+	std::vector<anyID> clients;
+	R_CALL(collectChannelClients(serverConnectionHandlerID, channelID, all_clients, clients), "Error collecting channel clients!");
+	clients.push_back((anyID)NULL);
+
+	massMoveStart(serverConnectionHandlerID, clients.data(), clientChannelID);
+}
+
+/* Appends the clients of channelID and all its sub-channels that pass the filter, except the ones in skipChannelID */
+static unsigned int collectSubtreeClients(uint64 serverConnectionHandlerID, uint64 channelID, uint64 skipChannelID, const occupancy_filter& filter, std::vector<anyID>& result) {
+	server_state& state = getServerState(serverConnectionHandlerID);
+	channel_tree* tree = getChannelTree(state, serverConnectionHandlerID);
+	if (!tree) return ERROR_undefined;
+	channel_occupancy* index = getOccupancy(state, serverConnectionHandlerID);
+	if (!index) return ERROR_undefined;
+
+	std::vector<uint64> channels;
+	if (!channelTreeCollect(*tree, channelID, channels)) return ERROR_channel_invalid_id;
+
+	const uint64 now = occupancyClock();
+	for (uint64 c : channels) {
+		if (c == skipChannelID) continue;
+		occupancyCollect(*index, c, filter, now, result);
+	}
+	return ERROR_ok;
+}
+
+void moveSubtreeToOwnChannel(uint64 serverConnectionHandlerID, uint64 channelID) {
+	anyID clientID;
+	R_CALL(ts3Functions.getClientID(serverConnectionHandlerID, &clientID), "Error retrieving client id!");
+
+	uint64 clientChannelID;
+	R_CALL(ts3Functions.getChannelOfClient(serverConnectionHandlerID, clientID, &clientChannelID), "Error retrieving client channel!");
+
+	std::vector<anyID> clients;
+	R_CALL(collectSubtreeClients(serverConnectionHandlerID, channelID, clientChannelID, all_clients, clients), "Error collecting channel tree clients!");
+	clients.push_back((anyID)NULL);
+
+	massMoveStart(serverConnectionHandlerID, clients.data(), clientChannelID);
+}
+
+void moveSubtreeToSelectedChannel(uint64 serverConnectionHandlerID, uint64 channelID) {
+	anyID clientID;
+	R_CALL(ts3Functions.getClientID(serverConnectionHandlerID, &clientID), "Error retrieving client id!");
+
+	uint64 clientChannelID;
+	R_CALL(ts3Functions.getChannelOfClient(serverConnectionHandlerID, clientID, &clientChannelID), "Error retrieving client channel!");
+
+	std::vector<anyID> clients;
+	R_CALL(collectSubtreeClients(serverConnectionHandlerID, clientChannelID, channelID, all_clients, clients), "Error collecting channel tree clients!");
+	clients.push_back((anyID)NULL);
+
+	massMoveStart(serverConnectionHandlerID, clients.data(), channelID);
+}
+
+void backupServer(uint64 serverConnectionHandlerID, bool delta) {
+	char configPath[PATH_BUFSIZE];
+	ts3Functions.getConfigPath(configPath, PATH_BUFSIZE);
+
+	char stamp[32];
+	const time_t now = time(NULL);
+	strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", localtime(&now));
+
+	// deltas build on the last backup of this server in this session
+	std::vector<std::string> chain;
+	if (delta && !backupChain(serverConnectionHandlerID, &chain)) {
+		ts3Functions.printMessage(serverConnectionHandlerID, "No backup of this server yet, doing a full backup", PLUGIN_MESSAGE_TARGET_SERVER);
+		delta = false;
+	}
+
+	char path[PATH_BUFSIZE + 64];
+	const int length = snprintf(path, sizeof(path), "%sjat_backup_%llu_%s%s.jatb", configPath, (unsigned long long)serverConnectionHandlerID, stamp, delta ? "_delta" : "");
+	if (length < 0 || (size_t)length >= sizeof(path)) {
+		LOG_WARN(serverConnectionHandlerID, "Backup path too long in '%s'", configPath);
+		ts3Functions.printMessage(serverConnectionHandlerID, "Backup could not be started (config folder path too long)", PLUGIN_MESSAGE_TARGET_SERVER);
+		return;
+	}
+	if (!backupStart(serverConnectionHandlerID, path, delta ? chain.back().c_str() : NULL)) {
+		LOG_WARN(serverConnectionHandlerID, "Error starting backup to '%s'", path);
+		ts3Functions.printMessage(serverConnectionHandlerID, "Backup could not be started (already running, last backup unreadable or file not writable)", PLUGIN_MESSAGE_TARGET_SERVER);
+	}
+}
+
+void restoreServer(uint64 serverConnectionHandlerID) {
+	std::vector<std::string> chain;
+	if (!backupChain(serverConnectionHandlerID, &chain)) {
+		ts3Functions.printMessage(serverConnectionHandlerID, "No backup of this server to restore from", PLUGIN_MESSAGE_TARGET_SERVER);
+		return;
+	}
+	if (!restoreStart(serverConnectionHandlerID, chain)) {
+		LOG_WARN(serverConnectionHandlerID, "Error starting restore from '%s'", chain.back().c_str());
+		ts3Functions.printMessage(serverConnectionHandlerID, "Restore could not be started (already running or backups unreadable)", PLUGIN_MESSAGE_TARGET_SERVER);
+	}
+}
+
+/*
+ * Moves a locked client back to locked_channel, or makes the channel an admin moved it to its new locked channel.
+ * Clients held by the layout go the same way, counted as layout moves.
+ */
+static void holdClient(server_state& state, uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, bool was_moved, uint64& locked_channel, metric_counter counter) {
+	if (was_moved) {
+		LOG_DEBUG(serverConnectionHandlerID, "Updating movement restricted user channel clid=%d, cid=%llu", clientID, newChannelID);
+		if (newChannelID == 0 || locked_channel == newChannelID) return;
+		locked_channel = newChannelID;
+		saveServerState(serverConnectionHandlerID);
+		return;
+	}
+	// group members locked before their channel was known are held where they were
+	if (locked_channel == 0) locked_channel = oldChannelID;
+
+	LOG_DEBUG(serverConnectionHandlerID, "Restricting user movement clid=%d", clientID);
+	if (newChannelID == 0 || newChannelID == locked_channel) return;
+	if (moveHistoryPending(state.move_history, clientID, locked_channel)) {
+		metricsCount(METRIC_MOVES_DEDUPLICATED);
+		return;
+	}
+	metricsCount(counter);
+	requestExpectedMove(state, serverConnectionHandlerID, clientID, locked_channel, MOVE_PRIORITY_LOCK);
+}
+
+/* The client id might be reused by the next client to join */
+static void forgetClient(server_state& state, anyID clientID) {
+	forgetClientDBID(state, clientID);
+	moveHistoryForget(state.move_history, clientID);
+	groupIndexRemoveClient(state.groups, clientID);
+	chatForgetClient(state.chat, clientID);
+}
+
+/* Index of the target that is followed: the first one in view, follow_targets.size() if none is */
+static size_t activeFollowTarget(const server_state& state) {
+	size_t index = 0;
+	while (index < state.follow_targets.size() && state.follow_targets[index].clientID == 0) index++;
+	return index;
+}
+
+/* Moves after the followed target once its hops settled, right away if the follow window is 0 */
+static void scheduleFollow(uint64 serverConnectionHandlerID, uint64 channelID) {
+	if (followEngineSchedule(serverConnectionHandlerID, channelID)) follow(serverConnectionHandlerID, channelID);
+}
+
+static void followTargetMoved(server_state& state, uint64 serverConnectionHandlerID, anyID clientID, uint64 clientDBID, uint64 newChannelID) {
+	const auto it = findFollowTarget(state, clientDBID);
+	if (it == state.follow_targets.end()) return;
+	const size_t index = (size_t)(it - state.follow_targets.begin());
+	const bool followed = activeFollowTarget(state) >= index;
+	it->clientID = newChannelID ? clientID : 0;
+	if (!followed) return;  // a target before it is in view
+	if (newChannelID != 0) {
+		scheduleFollow(serverConnectionHandlerID, newChannelID);
+		return;
+	}
+
+	// the followed target left, the next one in view takes over
+	for (auto next = it + 1; next != state.follow_targets.end(); ++next) {
+		if (next->clientID == 0) continue;
+		uint64 channelID;
+		if (ts3Functions.getChannelOfClient(serverConnectionHandlerID, next->clientID, &channelID) != ERROR_ok) {
+			next->clientID = 0;
+			continue;
+		}
+		LOG_DEBUG(serverConnectionHandlerID, "Follow target left, following clid=%d", next->clientID);
+		scheduleFollow(serverConnectionHandlerID, channelID);
+		return;
+	}
+}
+
+/*
+ * Channel the layout holds a client in, NULL if it has no say. A client of the others channel gets an entry of its own,
+ * so an admin moving it changes where that client is held and not where everyone else goes.
+ */
+static uint64* layoutChannel(server_state& state, anyID clientID, uint64 clientDBID) {
+	if (!state.layout.active) return NULL;
+	const auto it = state.layout.assigned.find(clientDBID);
+	if (it != state.layout.assigned.end()) return &it->second;
+	if (layoutTarget(state.layout, clientID, clientDBID) == 0) return NULL;
+	return &state.layout.assigned.emplace(clientDBID, state.layout.others).first->second;
+}
+
+/* Lifts the chat filter's locks that ran out */
+static void expireChatLocks(server_state& state) {
+	const uint64 now = chatClock();
+	bool expired = false;
+	for (auto it = state.chat_locks.begin(); it != state.chat_locks.end();) {
+		if (it->second > now) {
+			++it;
+			continue;
+		}
+		state.locked_users.erase(it->first);
+		it = state.chat_locks.erase(it);
+		expired = true;
+	}
+	if (expired) setMenuEnabled(ACTION_UNLOCK_ALL_MOVEMENT, !state.locked_users.empty() || groupIndexActive(state.groups));
+}
+
+void onClientMoved(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, bool was_moved, const char* moveType) {
+	server_state& state = getServerState(serverConnectionHandlerID);
+	if (newChannelID == 0) {
+		// client left server
+		LOG_TRACE(serverConnectionHandlerID, "Client %d left server", clientID);
+	}
+	if (oldChannelID == 0) {
+		// client joined, the client id might have belonged to someone else before
+		forgetClient(state, clientID);
+		if (state.groups.seeded) {
+			CALL(groupIndexAddClient(state.groups, serverConnectionHandlerID, clientID, newChannelID), "Error retrieving client groups!");
+		}
+	}
+	trackOccupancy(state, serverConnectionHandlerID, clientID, oldChannelID, newChannelID);
+	// a banned client is on its way out, nothing to enforce on it
+	if (oldChannelID == 0 && newChannelID != 0 && state.bans.enabled && checkJoiningClient(state, serverConnectionHandlerID, clientID)) return;
+
+	LOG_TRACE(serverConnectionHandlerID, "Client move ('%s'), clid=%d, oCid=%llu, nCid=%llu, was_moved=%d", moveType, clientID, oldChannelID, newChannelID, was_moved);
+	if (!state.chat_locks.empty()) expireChatLocks(state);
+	if (state.follow_targets.empty() && state.locked_users.empty() && !groupIndexActive(state.groups) && !state.layout.active) {
+		// nothing to enforce, don't bother the client lib
+		if (newChannelID == 0) forgetClient(state, clientID);
+		return;
+	}
+	bool echo = false;
+	switch (moveHistoryObserve(state.move_history, clientID, oldChannelID, newChannelID, was_moved)) {
+	case MOVE_VERDICT_DUPLICATE:
+		metricsCount(METRIC_MOVES_DEDUPLICATED);
+		LOG_TRACE(serverConnectionHandlerID, "Repeatmove, skipping");
+		return;
+	case MOVE_VERDICT_ECHO:
+		// one of our moves arrived, the server's answer to it counts it as succeeded. Nothing to enforce, but a follow
+		// target the plugin moved (lock, layout, AFK) is still followed.
+		metricsCount(METRIC_MOVES_DEDUPLICATED);
+		LOG_TRACE(serverConnectionHandlerID, "Own move, only following");
+		echo = true;
+		break;
+	case MOVE_VERDICT_NEW:
+		break;
+	}
+
+	group_member* member = echo ? NULL : groupIndexLocked(state.groups, clientID);
+	uint64* locked_channel = member ? &member->locked_channel : NULL;
+	metric_counter counter = METRIC_LOCKS_ENFORCED;
+
+	// group locks alone are answered by the index, without the database id
+	if (!state.follow_targets.empty() || (!echo && (!state.locked_users.empty() || state.layout.active))) {
+		uint64 clientDBID;
+		const unsigned int db_id_result = getClientDBID(state, serverConnectionHandlerID, clientID, &clientDBID);
+		CALL(db_id_result, "Error retreiving client db id!");
+		if (db_id_result == ERROR_ok && !state.follow_targets.empty()) {
+			followTargetMoved(state, serverConnectionHandlerID, clientID, clientDBID, newChannelID);
+		}
+		if (db_id_result == ERROR_ok && !echo) {
+			// a lock on the client itself wins over the locks of its groups
+			const auto it = state.locked_users.find(clientDBID);
+			if (it != state.locked_users.end()) locked_channel = &it->second;
+			// and locks win over the layout
+			if (!locked_channel && (locked_channel = layoutChannel(state, clientID, clientDBID))) counter = METRIC_LAYOUT_MOVES;
+		}
+	}
+
+	if (locked_channel) holdClient(state, serverConnectionHandlerID, clientID, oldChannelID, newChannelID, was_moved, *locked_channel, counter);
+	if (newChannelID == 0) forgetClient(state, clientID);
+}
+
+void lockUser(uint64 serverConnectionHandlerID, anyID userID) {
+	uint64 userChannel;
+	R_CALL(ts3Functions.getChannelOfClient(serverConnectionHandlerID, userID, &userChannel), "Error retrieving client channel!");
+
+	server_state& state = getServerState(serverConnectionHandlerID);
+	uint64 clientDBID;
+	R_CALL(getClientDBID(state, serverConnectionHandlerID, userID, &clientDBID), "Error retreiving client db id!");
+
+	R_ASSERT(state.locked_users.emplace(clientDBID, userChannel).second, "Error trying to lock already locked user!");
+	state.chat_locks.erase(clientDBID);
+	saveServerState(serverConnectionHandlerID);
+	setMenuEnabled(ACTION_UNLOCK_ALL_MOVEMENT, true);
+}
+
+void unlockUser(uint64 serverConnectionHandlerID, anyID userID) {
+	server_state& state = getServerState(serverConnectionHandlerID);
+	uint64 clientDBID;
+	R_CALL(getClientDBID(state, serverConnectionHandlerID, userID, &clientDBID), "Error retreiving client db id!");
+
+	R_ASSERT(!state.locked_users.empty(), "Error trying to unlock user but no users locked!");
+	R_ASSERT(state.locked_users.erase(clientDBID) == 1, "Error trying to unlock non-locked user!");
+	saveServerState(serverConnectionHandlerID);
+
+	if (state.locked_users.empty()) {
+		setMenuEnabled(ACTION_UNLOCK_ALL_MOVEMENT, false);
+	}
+}
+
+void join(uint64 serverConnectionHandlerID, anyID targetClientID) {
+	anyID myClientID;
+	R_CALL(ts3Functions.getClientID(serverConnectionHandlerID, &myClientID), "Error retrieving client id!");
+
+	uint64 myChannelID;
+	R_CALL(ts3Functions.getChannelOfClient(serverConnectionHandlerID, myClientID, &myChannelID), "Error retrieving client channel!");
+
+	uint64 targetChannelId;
+	R_CALL(ts3Functions.getChannelOfClient(serverConnectionHandlerID, targetClientID, &targetChannelId), "Error retrieving target channel!");
+
+	server_state& state = getServerState(serverConnectionHandlerID);
+	if (myChannelID == targetChannelId) return;
+	if (moveHistoryPending(state.move_history, myClientID, targetChannelId)) {
+		metricsCount(METRIC_MOVES_DEDUPLICATED);
+		return;
+	}
+	metricsCount(METRIC_FOLLOWS_TRIGGERED);
+	requestExpectedMove(state, serverConnectionHandlerID, myClientID, targetChannelId, MOVE_PRIORITY_FOLLOW);
+}
+
+void enableFollow(uint64 serverConnectionHandlerID, anyID targetID) {
+	server_state& state = getServerState(serverConnectionHandlerID);
+	uint64 clientDBID;
+	R_CALL(getClientDBID(state, serverConnectionHandlerID, targetID, &clientDBID), "Error retreiving client db id!");
+	setMenuEnabled(ACTION_UNFOLLOW_ALL, true);
+
+	// new targets come last, after the ones already followed
+	auto it = findFollowTarget(state, clientDBID);
+	if (it == state.follow_targets.end()) {
+		it = state.follow_targets.insert(it, follow_target{ clientDBID, targetID });
+		saveServerState(serverConnectionHandlerID);
+	}
+	else {
+		it->clientID = targetID;
+	}
+	if (activeFollowTarget(state) == (size_t)(it - state.follow_targets.begin())) {
+		followEngineDropConnection(serverConnectionHandlerID);
+		join(serverConnectionHandlerID, targetID);
+	}
+}
+
+void removeFollow(uint64 serverConnectionHandlerID, anyID targetID) {
+	server_state& state = getServerState(serverConnectionHandlerID);
+	uint64 clientDBID;
+	R_CALL(getClientDBID(state, serverConnectionHandlerID, targetID, &clientDBID), "Error retreiving client db id!");
+
+	const auto it = findFollowTarget(state, clientDBID);
+	if (it == state.follow_targets.end()) return;
+	const bool followed = activeFollowTarget(state) == (size_t)(it - state.follow_targets.begin());
+	state.follow_targets.erase(it);
+	saveServerState(serverConnectionHandlerID);
+	if (state.follow_targets.empty()) {
+		disableFollow(serverConnectionHandlerID);
+		return;
+	}
+	if (!followed) return;
+
+	// the next target in view takes over, the move still waiting was after the removed one
+	followEngineDropConnection(serverConnectionHandlerID);
+	const size_t next = activeFollowTarget(state);
+	if (next < state.follow_targets.size()) join(serverConnectionHandlerID, state.follow_targets[next].clientID);
+}
+
+void disableFollow(uint64 serverConnectionHandlerID) {
+	server_state& state = getServerState(serverConnectionHandlerID);
+	setMenuEnabled(ACTION_UNFOLLOW_ALL, false);
+	state.follow_targets.clear();
+	followEngineDropConnection(serverConnectionHandlerID);
+	saveServerState(serverConnectionHandlerID);
+}
+
+void follow(uint64 serverConnectionHandlerID, uint64 newChannelID) {
+	anyID myClientID;
+	R_CALL(ts3Functions.getClientID(serverConnectionHandlerID, &myClientID), "Error retrieving client id!");
+
+	uint64 myChannelID;
+	R_CALL(ts3Functions.getChannelOfClient(serverConnectionHandlerID, myClientID, &myChannelID), "Error retrieving client channel!");
+
+	server_state& state = getServerState(serverConnectionHandlerID);
+	if (myChannelID == newChannelID) return;
+	if (moveHistoryPending(state.move_history, myClientID, newChannelID)) {
+		metricsCount(METRIC_MOVES_DEDUPLICATED);
+		return;
+	}
+	metricsCount(METRIC_FOLLOWS_TRIGGERED);
+	requestExpectedMove(state, serverConnectionHandlerID, myClientID, newChannelID, MOVE_PRIORITY_FOLLOW);
+}
+
+/* True if a lock or the layout holds the client where it is, the AFK mover leaves these alone */
+static bool isClientHeld(server_state& state, uint64 serverConnectionHandlerID, anyID clientID) {
+	if (groupIndexLocked(state.groups, clientID)) return true;
+	if (state.locked_users.empty() && !state.layout.active) return false;
+	uint64 clientDBID;
+	if (getClientDBID(state, serverConnectionHandlerID, clientID, &clientDBID) != ERROR_ok) return true;
+	return state.locked_users.count(clientDBID) || (state.layout.active && layoutTarget(state.layout, clientID, clientDBID));
+}
+
+/* Tick of the AFK timer: moves the clients whose idle time ran out on every server with an AFK channel */
+void moveIdleClients() {
+	std::lock_guard<std::mutex> lock(state_mutex);
+	const uint64 now = afkClock();
+	std::vector<afk_move> moves;
+	for (auto& s : server_states) {
+		server_state& state = s.second;
+		moves.clear();
+		if (afkExpire(state.afk, now, moves) == 0) continue;
+		for (const afk_move& m : moves) {
+			if (isClientHeld(state, s.first, m.clientID)) continue;
+			if (moveHistoryPending(state.move_history, m.clientID, m.channelID)) {
+				metricsCount(METRIC_MOVES_DEDUPLICATED);
+				continue;
+			}
+			metricsCount(METRIC_AFK_MOVES);
+			requestExpectedMove(state, s.first, m.clientID, m.channelID, MOVE_PRIORITY_BULK);
+			afkMovedAway(state.afk, m.clientID);
+		}
+	}
+}
+
+struct loud_report {
+	uint64 serverConnectionHandlerID;
+	anyID clientID;
+	bool mute;
+};
+
+/* Tick of the timer: reports and mutes the clients the playback callback flagged as too loud */
+void reportLoudClients() {
+	std::vector<loud_report> reports;
+	{
+		std::lock_guard<std::mutex> lock(state_mutex);
+		if (loudness_meters.load(std::memory_order_relaxed) == 0) return;
+		std::vector<anyID> clients;
+		for (auto& s : server_states) {
+			clients.clear();
+			if (loudnessTakeReports(s.second.loudness, clients) == 0) continue;
+			for (anyID clientID : clients) reports.push_back(loud_report{ s.first, clientID, s.second.loudness.config.mute });
+		}
+	}
+	// the client lib is called without the state, the audio thread would skip frames meanwhile
+	for (const loud_report& r : reports) reportLoudClient(r.serverConnectionHandlerID, r.clientID, r.mute);
+}
+
+/* The timer thread's tick, every AFK_TICK_MS */
+static void onTimerTick() {
+	moveIdleClients();
+	reportLoudClients();
+}
+
+/*********************************** Saved state ************************************/
+/*
+ * Locks, locked groups and follow targets are saved to the state store (see state_store.h) after every change and
+ * put back when the server connects, or when the plugin is loaded while connected.
+ */
+static const char* serverUid(server_state& state, uint64 serverConnectionHandlerID) {
+	if (state.uid.empty()) {
+		char* uid;
+		if (ts3Functions.getServerVariableAsString(serverConnectionHandlerID, VIRTUALSERVER_UNIQUE_IDENTIFIER, &uid) == ERROR_ok) {
+			state.uid = uid;
+			ts3Functions.freeMemory(uid);
+		}
+	}
+	return state.uid.c_str();
+}
+
+static void saveServerState(uint64 serverConnectionHandlerID) {
+	if (!stateStoreIsOpen()) return;
+	server_state& state = getServerState(serverConnectionHandlerID);
+	const char* uid = serverUid(state, serverConnectionHandlerID);
+	if (!*uid) return;
+	state_record* record = stateStoreBegin(uid);
+	if (!record) return;
+
+	for (const auto& lock : state.locked_users) {
+		if (state.chat_locks.count(lock.first)) continue;
+		if (record->lock_count == STATE_STORE_LOCKS) {
+			LOG_WARN(serverConnectionHandlerID, "Only the first %d locked clients are saved", STATE_STORE_LOCKS);
+			break;
+		}
+		record->locks[record->lock_count++] = state_lock{ lock.first, lock.second };
+	}
+	for (const follow_target& target : state.follow_targets) {
+		if (record->follow_count == STATE_STORE_FOLLOWS) break;
+		record->follows[record->follow_count++] = target.db_id;
+	}
+	for (unsigned int bit = 0; bit < GROUP_LOCK_MAX && record->group_count < STATE_STORE_GROUPS; bit++) {
+		if (!(state.groups.used >> bit & 1)) continue;
+		record->groups[record->group_count++] = state_group_lock{ state.groups.locks[bit].groupID, (uint32_t)state.groups.locks[bit].type, 0 };
+	}
+	stateStoreCommit(record);
+}
+
+/* Puts the saved locks and follows of the server back, clients locked before keep the channel they were locked in */
+static void restoreServerState(uint64 serverConnectionHandlerID) {
+	server_state& state = getServerState(serverConnectionHandlerID);
+	const state_record* record = stateStoreFind(serverUid(state, serverConnectionHandlerID));
+	if (!record) return;
+
+	for (uint32_t i = 0; i < record->lock_count; i++) {
+		state.locked_users.emplace(record->locks[i].db_id, record->locks[i].channelID);
+	}
+	for (uint32_t i = 0; i < record->group_count; i++) {
+		groupIndexLock(state.groups, (group_type)record->groups[i].type, record->groups[i].groupID);
+	}
+	if (groupIndexActive(state.groups) && !state.groups.seeded) {
+		CALL(groupIndexSeed(state.groups, serverConnectionHandlerID), "Error seeding group index!");
+	}
+
+	// the targets in view are found with one pass over the clients, the first of them is joined
+	state.follow_targets.clear();
+	for (uint32_t i = 0; i < record->follow_count; i++) {
+		state.follow_targets.push_back(follow_target{ record->follows[i], 0 });
+	}
+	anyID* clients;
+	if (!state.follow_targets.empty() && ts3Functions.getClientList(serverConnectionHandlerID, &clients) == ERROR_ok) {
+		size_t found = 0;
+		for (const anyID* it = clients; *it != (anyID)NULL && found < state.follow_targets.size(); it++) {
+			uint64 clientDBID;
+			if (getClientDBID(state, serverConnectionHandlerID, *it, &clientDBID) != ERROR_ok) continue;
+			const auto target = findFollowTarget(state, clientDBID);
+			if (target == state.follow_targets.end() || target->clientID != 0) continue;
+			target->clientID = *it;
+			found++;
+		}
+		ts3Functions.freeMemory(clients);
+		for (const follow_target& target : state.follow_targets) {
+			if (target.clientID == 0) continue;
+			join(serverConnectionHandlerID, target.clientID);
+			break;
+		}
+	}
+
+	setMenuEnabled(ACTION_UNLOCK_ALL_MOVEMENT, !state.locked_users.empty() || groupIndexActive(state.groups));
+	setMenuEnabled(ACTION_UNFOLLOW_ALL, !state.follow_targets.empty());
+	LOG_INFO(serverConnectionHandlerID, "Restored %u locked clients, %u locked groups and %u follow targets",
+		record->lock_count, record->group_count, record->follow_count);
+}
+
+/*********************************** Commands ************************************/
+/*
+ * Locks and moves of a batch are collected and sent once the whole batch ran: the locks resolve all their database
+ * ids in one pass over the client list, the moves go out as one mass move per target channel.
+ */
+struct command_batch {
+	std::vector<uint64> lock_db_ids;
+	std::vector<std::pair<uint64, std::vector<anyID>>> moves;  // target channel -> clients
+	unsigned int commands = 0;
+	unsigned int unlocked = 0;
+	unsigned int locked_groups = 0;
+	unsigned int unlocked_groups = 0;
+	unsigned int unresolved = 0;  // channel names not found
+	bool layout = false;  // the batch set a new layout
+	bool channel_names_read = false;
+	std::unordered_map<std::string, uint64> channel_names = std::unordered_map<std::string, uint64>();
+};
+
+struct batch_word_list {
+	chat_matcher matcher;
+	size_t words = 0;
+};
+
+/*
+ * The scripts and word lists a batch names, read and compiled before the batch takes state_mutex. Keyed by where the
+ * command's file name is in the batch text, a file that could not be read has no entry.
+ */
+struct batch_files {
+	std::unordered_map<const char*, std::vector<char>> scripts = std::unordered_map<const char*, std::vector<char>>();
+	std::unordered_map<const char*, batch_word_list> word_lists = std::unordered_map<const char*, batch_word_list>();
+	bool shared = false;  // a broadcast, every server gets a copy of the word lists
+};
+
+/* What a batch did on a server, a broadcast adds up the servers */
+struct batch_result {
+	size_t moves = 0;
+	size_t channels = 0;  // channels the moves go to
+	size_t layout_moves = 0;
+	unsigned int locked = 0;
+	unsigned int missing = 0;  // clients to lock that are not online
+	unsigned int unlocked = 0;
+	unsigned int locked_groups = 0;
+	unsigned int unlocked_groups = 0;
+	unsigned int unresolved = 0;
+};
+
+static std::vector<anyID>& batchMoves(command_batch& batch, uint64 channelID) {
+	for (auto& m : batch.moves) {
+		if (m.first == channelID) return m.second;
+	}
+	batch.moves.emplace_back(channelID, std::vector<anyID>());
+	return batch.moves.back().second;
+}
+
+static void printCommandMessage(uint64 serverConnectionHandlerID, const char* message) {
+	ts3Functions.printMessage(serverConnectionHandlerID, message, PLUGIN_MESSAGE_TARGET_SERVER);
+}
+
+/* Turns the AFK mover on, every client in view gets the full idle time from now */
+static void enableAfk(server_state& state, uint64 serverConnectionHandlerID, const afk_config& config) {
+	anyID own_client;
+	anyID* clients;
+	if (ts3Functions.getClientID(serverConnectionHandlerID, &own_client) != ERROR_ok || ts3Functions.getClientList(serverConnectionHandlerID, &clients) != ERROR_ok) {
+		printCommandMessage(serverConnectionHandlerID, "Could not read the clients of the server, AFK mover not started");
+		return;
+	}
+	const uint64 now = afkClock();
+	afkEnable(state.afk, config, own_client, now);
+	for (const anyID* it = clients; *it != (anyID)NULL; it++) {
+		uint64 channelID;
+		if (ts3Functions.getChannelOfClient(serverConnectionHandlerID, *it, &channelID) != ERROR_ok) continue;
+		afkTrack(state.afk, *it, channelID, queryAfkFlags(serverConnectionHandlerID, *it), now);
+	}
+	ts3Functions.freeMemory(clients);
+
+	char msg[128];
+	snprintf(msg, sizeof(msg), "AFK mover: clients idle %u minutes go to channel %llu", config.idle_minutes, (unsigned long long)config.channelID);
+	if (config.away_seconds) {
+		const size_t length = strlen(msg);
+		snprintf(msg + length, sizeof(msg) - length, ", away or muted %u seconds", config.away_seconds);
+	}
+	LOG_INFO(serverConnectionHandlerID, "%s", msg);
+	printCommandMessage(serverConnectionHandlerID, msg);
+}
+
+/* Turns the loudness meter on for the clients in view, the ones that join later are added as they come */
+static void enableLoudness(server_state& state, uint64 serverConnectionHandlerID, const loudness_config& config) {
+	anyID* clients;
+	if (ts3Functions.getClientList(serverConnectionHandlerID, &clients) != ERROR_ok) {
+		printCommandMessage(serverConnectionHandlerID, "Could not read the clients of the server, loudness meter not started");
+		return;
+	}
+	loudnessEnable(state.loudness, config);
+	for (const anyID* it = clients; *it != (anyID)NULL; it++) loudnessTrack(state.loudness, *it, true);
+	ts3Functions.freeMemory(clients);
+	countLoudnessMeters();
+
+	char msg[128];
+	snprintf(msg, sizeof(msg), "Loudness meter (%s): clients above -%u dBFS for %u ms are %s", loudnessKernelName(loudnessBestKernel()),
+		config.threshold_db, config.hold_ms, config.mute ? "muted" : "reported");
+	LOG_INFO(serverConnectionHandlerID, "%s", msg);
+	printCommandMessage(serverConnectionHandlerID, msg);
+}
+
+static void metricsCommand(uint64 serverConnectionHandlerID, command_verb verb) {
+	if (verb == COMMAND_METRICS) {
+		const std::string report = metricsReport();
+		printCommandMessage(serverConnectionHandlerID, report.c_str());
+	}
+	else if (verb == COMMAND_METRICS_RESET) {
+		metricsReset();
+		printCommandMessage(serverConnectionHandlerID, "Metrics reset");
+	}
+	else {
+		char configPath[PATH_BUFSIZE];
+		ts3Functions.getConfigPath(configPath, PATH_BUFSIZE);
+		char stamp[32];
+		const time_t now = time(NULL);
+		strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", localtime(&now));
+
+		char path[PATH_BUFSIZE + 64];
+		snprintf(path, sizeof(path), "%sjat_metrics_%s.txt", configPath, stamp);
+		char msg[PATH_BUFSIZE + 96];
+		snprintf(msg, sizeof(msg), metricsDump(path) ? "Metrics written to %s" : "Error writing metrics to %s", path);
+		printCommandMessage(serverConnectionHandlerID, msg);
+	}
+}
+
+/*
+ * Reads a file from the config folder into buffer, kind names it in the messages ("script"). False if the name leaves
+ * the folder, the file is unreadable or larger than the buffer.
+ */
+static bool readConfigFile(uint64 serverConnectionHandlerID, const char* kind, const char* name, size_t length, char* buffer, size_t capacity, size_t* size) {
+	char msg[PATH_BUFSIZE + 64];
+	for (size_t i = 0; i < length; i++) {
+		if (name[i] == '/' || name[i] == '\\' || (name[i] == '.' && i + 1 < length && name[i + 1] == '.')) {
+			snprintf(msg, sizeof(msg), "The %s '%.*s' must be a file in the config folder", kind, (int)length, name);
+			printCommandMessage(serverConnectionHandlerID, msg);
+			return false;
+		}
+	}
+
+	char path[PATH_BUFSIZE];
+	ts3Functions.getConfigPath(path, PATH_BUFSIZE);
+	const size_t dir = strlen(path);
+	snprintf(path + dir, PATH_BUFSIZE - dir, "%.*s", (int)length, name);
+
+	FILE* f = fopen(path, "rb");
+	if (!f) {
+		snprintf(msg, sizeof(msg), "Error opening %s %s", kind, path);
+		printCommandMessage(serverConnectionHandlerID, msg);
+		return false;
+	}
+	*size = fread(buffer, 1, capacity, f);
+	const bool truncated = *size == capacity && fgetc(f) != EOF;
+	fclose(f);
+	if (truncated) {
+		snprintf(msg, sizeof(msg), "The %s %s is larger than %zu bytes", kind, path, capacity);
+		printCommandMessage(serverConnectionHandlerID, msg);
+		return false;
+	}
+	return true;
+}
+
+/* Turns the chat filter on with the command's compiled word list, rate limit and action */
+static void enableChatFilter(server_state& state, uint64 serverConnectionHandlerID, const command& c, batch_files& files) {
+	batch_word_list* list = NULL;
+	if (c.file) {
+		const auto it = files.word_lists.find(c.file);
+		if (it == files.word_lists.end()) return;  // reported when it was read
+		list = &it->second;
+	}
+	anyID own_client;
+	R_CALL(ts3Functions.getClientID(serverConnectionHandlerID, &own_client), "Error retrieving client id!");
+
+	chat_filter& chat = state.chat;
+	chat = chat_filter();
+	chat.enabled = true;
+	chat.own_client = own_client;
+	chat.config = chat_filter_config{ c.rate_messages, c.rate_seconds, CHAT_ACTION_REPORT, 0 };
+	if (c.verb == COMMAND_CHAT_FILTER_KICK) chat.config.action = CHAT_ACTION_KICK;
+	if (c.verb == COMMAND_CHAT_FILTER_LOCK) {
+		chat.config.action = CHAT_ACTION_LOCK;
+		chat.config.lock_minutes = (unsigned int)c.value;
+	}
+	if (!list) chatMatcherBuild(chat.matcher, std::vector<std::string>());
+	else if (files.shared) chat.matcher = list->matcher;
+	else chat.matcher = std::move(list->matcher);
+
+	static const char* actions[] = { "reported", "kicked", "locked" };
+	char msg[160];
+	int length = snprintf(msg, sizeof(msg), "Chat filter: %zu words (%zu states)", list ? list->words : 0, chat.matcher.match.size());
+	if (chat.config.messages) length += snprintf(msg + length, sizeof(msg) - length, ", %u messages in %u s", chat.config.messages, chat.config.seconds);
+	snprintf(msg + length, sizeof(msg) - length, ", senders are %s", actions[chat.config.action]);
+	LOG_INFO(serverConnectionHandlerID, "%s", msg);
+	printCommandMessage(serverConnectionHandlerID, msg);
+}
+
+/* Starts the ban list cache, clients are checked once the first refresh is answered */
+static void enableBans(server_state& state, uint64 serverConnectionHandlerID, unsigned int refresh_minutes) {
+	anyID own_client;
+	R_CALL(ts3Functions.getClientID(serverConnectionHandlerID, &own_client), "Error retrieving client id!");
+	state.bans = ban_cache();
+	state.bans.enabled = true;
+	state.bans.own_client = own_client;
+	state.bans.refresh_minutes = refresh_minutes;
+	refreshBans(state, serverConnectionHandlerID);
+
+	char msg[96];
+	snprintf(msg, sizeof(msg), "Ban list: fetching, refreshed every %u minutes", refresh_minutes);
+	LOG_INFO(serverConnectionHandlerID, "%s", msg);
+	printCommandMessage(serverConnectionHandlerID, msg);
+}
+
+/*
+ * Id of a command's channel on this server. The names of all channels are read the first time a batch names a
+ * channel, two channels with the same name under different parents resolve to the first one in the channel list.
+ */
+static bool resolveChannel(uint64 serverConnectionHandlerID, command_batch& batch, const command_channel& channel, uint64* channelID) {
+	if (channel.id) {
+		*channelID = channel.id;
+		return true;
+	}
+	if (!batch.channel_names_read) {
+		batch.channel_names_read = true;
+		uint64* channels;
+		const unsigned int r = ts3Functions.getChannelList(serverConnectionHandlerID, &channels);
+		if (r != ERROR_ok) {
+			LOG_WARN(serverConnectionHandlerID, "Error %u retrieving channel list", r);
+		}
+		else {
+			for (const uint64* it = channels; *it; it++) {
+				char* name;
+				if (ts3Functions.getChannelVariableAsString(serverConnectionHandlerID, *it, CHANNEL_NAME, &name) != ERROR_ok) continue;
+				batch.channel_names.emplace(name, *it);
+				ts3Functions.freeMemory(name);
+			}
+			ts3Functions.freeMemory(channels);
+		}
+	}
+	const auto it = batch.channel_names.find(std::string(channel.name, channel.name_length));
+	if (it != batch.channel_names.end()) {
+		*channelID = it->second;
+		return true;
+	}
+	batch.unresolved++;
+	char msg[96];
+	snprintf(msg, sizeof(msg), "No channel named \"%.*s\"", (int)(channel.name_length > 48 ? 48 : channel.name_length), channel.name);
+	printCommandMessage(serverConnectionHandlerID, msg);
+	return false;
+}
+
+static occupancy_filter commandFilter(const command& c) {
+	return occupancy_filter{ (c.filters & COMMAND_FILTER_NON_ADMINS) != 0, (c.filters & COMMAND_FILTER_SILENT) != 0, c.idle_minutes };
+}
+
+static bool filtered(const occupancy_filter& filter) {
+	return filter.non_admins || filter.silent || filter.idle_minutes;
+}
+
+static bool runBatch(uint64 serverConnectionHandlerID, const char* text, size_t length, bool script, batch_files& files, batch_result* result);
+
+static void runCommand(uint64 serverConnectionHandlerID, const command& c, command_batch& batch, bool script, batch_files& files) {
+	server_state& state = getServerState(serverConnectionHandlerID);
+	command_ids ids = c.ids;
+	uint64 id;
+	command_channel channel;
+	uint64 target = 0;
+	switch (c.verb) {
+	case COMMAND_LOCK:
+		while (commandNextId(ids, &id)) batch.lock_db_ids.push_back(id);
+		break;
+	case COMMAND_UNLOCK:
+		while (commandNextId(ids, &id)) batch.unlocked += (unsigned int)state.locked_users.erase(id);
+		break;
+	case COMMAND_UNLOCK_ALL:
+		batch.unlocked += (unsigned int)state.locked_users.size();
+		state.locked_users.clear();
+		groupIndexUnlockAll(state.groups);
+		break;
+	case COMMAND_LOCK_SERVER_GROUPS:
+	case COMMAND_LOCK_CHANNEL_GROUPS: {
+		if (!state.groups.seeded) {
+			CALL(groupIndexSeed(state.groups, serverConnectionHandlerID), "Error seeding group index!");
+			if (!state.groups.seeded) {
+				printCommandMessage(serverConnectionHandlerID, "Could not read the groups of the clients, no groups locked");
+				break;
+			}
+		}
+		const group_type type = c.verb == COMMAND_LOCK_SERVER_GROUPS ? GROUP_SERVER : GROUP_CHANNEL;
+		while (commandNextId(ids, &id)) {
+			if (groupIndexLock(state.groups, type, id)) {
+				batch.locked_groups++;
+			}
+			else {
+				char msg[96];
+				snprintf(msg, sizeof(msg), "Group %llu not locked, at most %d groups can be locked", (unsigned long long)id, GROUP_LOCK_MAX);
+				printCommandMessage(serverConnectionHandlerID, msg);
+			}
+		}
+		break;
+	}
+	case COMMAND_UNLOCK_SERVER_GROUPS:
+	case COMMAND_UNLOCK_CHANNEL_GROUPS: {
+		const group_type type = c.verb == COMMAND_UNLOCK_SERVER_GROUPS ? GROUP_SERVER : GROUP_CHANNEL;
+		while (commandNextId(ids, &id)) batch.unlocked_groups += groupIndexUnlock(state.groups, type, id) ? 1 : 0;
+		break;
+	}
+	case COMMAND_MOVE_CLIENTS: {
+		const occupancy_filter filter = commandFilter(c);
+		channel_occupancy* index = filtered(filter) ? getOccupancy(state, serverConnectionHandlerID) : NULL;
+		if ((filtered(filter) && !index) || !resolveChannel(serverConnectionHandlerID, batch, c.target, &target)) break;
+		const uint64 now = occupancyClock();
+		std::vector<anyID>& clients = batchMoves(batch, target);
+		while (commandNextId(ids, &id)) {
+			if (id > 0xffff || (index && !occupancyMatches(*index, (anyID)id, filter, now))) continue;
+			clients.push_back((anyID)id);
+		}
+		break;
+	}
+	case COMMAND_MOVE_CHANNELS:
+		if (!resolveChannel(serverConnectionHandlerID, batch, c.target, &target)) break;
+		while (commandNextChannel(ids, &channel)) {
+			if (!resolveChannel(serverConnectionHandlerID, batch, channel, &id) || id == target) continue;
+			CALL(collectChannelClients(serverConnectionHandlerID, id, commandFilter(c), batchMoves(batch, target)), "Error collecting channel clients!");
+		}
+		break;
+	case COMMAND_MOVE_TREES:
+		if (!resolveChannel(serverConnectionHandlerID, batch, c.target, &target)) break;
+		while (commandNextChannel(ids, &channel)) {
+			if (!resolveChannel(serverConnectionHandlerID, batch, channel, &id)) continue;
+			CALL(collectSubtreeClients(serverConnectionHandlerID, id, target, commandFilter(c), batchMoves(batch, target)), "Error collecting channel tree clients!");
+		}
+		break;
+	case COMMAND_LAYOUT:
+	case COMMAND_LAYOUT_OTHERS:
+		// the first layout command of a batch starts the new layout
+		if (!batch.layout) state.layout = channel_layout();
+		batch.layout = true;
+		if (!resolveChannel(serverConnectionHandlerID, batch, c.target, &target)) break;
+		if (c.verb == COMMAND_LAYOUT_OTHERS) state.layout.others = target;
+		while (commandNextId(ids, &id)) state.layout.assigned[id] = target;
+		break;
+	case COMMAND_AFK:
+		if (!resolveChannel(serverConnectionHandlerID, batch, c.target, &target)) break;
+		enableAfk(state, serverConnectionHandlerID, afk_config{ target, c.idle_minutes, (unsigned int)c.value });
+		break;
+	case COMMAND_AFK_OFF:
+		state.afk = afk_tracker();
+		printCommandMessage(serverConnectionHandlerID, "AFK mover off");
+		break;
+	case COMMAND_LOUDNESS:
+	case COMMAND_LOUDNESS_MUTE:
+		enableLoudness(state, serverConnectionHandlerID, loudness_config{ c.level_db, (unsigned int)c.value, c.verb == COMMAND_LOUDNESS_MUTE });
+		break;
+	case COMMAND_LOUDNESS_OFF:
+		state.loudness = loudness_meter();
+		countLoudnessMeters();
+		printCommandMessage(serverConnectionHandlerID, "Loudness meter off");
+		break;
+	case COMMAND_CHAT_FILTER:
+	case COMMAND_CHAT_FILTER_KICK:
+	case COMMAND_CHAT_FILTER_LOCK:
+		enableChatFilter(state, serverConnectionHandlerID, c, files);
+		break;
+	case COMMAND_CHAT_FILTER_OFF:
+		state.chat = chat_filter();
+		printCommandMessage(serverConnectionHandlerID, "Chat filter off");
+		break;
+	case COMMAND_BANS:
+		enableBans(state, serverConnectionHandlerID, (unsigned int)c.value);
+		break;
+	case COMMAND_BANS_OFF:
+		state.bans = ban_cache();
+		printCommandMessage(serverConnectionHandlerID, "Ban list cache off");
+		break;
+	case COMMAND_LAYOUT_CLEAR:
+		state.layout = channel_layout();
+		batch.layout = false;
+		printCommandMessage(serverConnectionHandlerID, "Layout cleared");
+		break;
+	case COMMAND_ADMIN_GROUPS: {
+		std::vector<uint64> groups;
+		while (commandNextId(ids, &id)) groups.push_back(id);
+		occupancySetAdminGroups(state.occupancy, groups);
+		char msg[96];
+		snprintf(msg, sizeof(msg), "%zu admin groups, 'where nonadmin' leaves their members behind", state.occupancy.admin_groups.size());
+		printCommandMessage(serverConnectionHandlerID, msg);
+		break;
+	}
+	case COMMAND_FOLLOW:
+		// the list replaces the targets followed so far, in the order given
+		disableFollow(serverConnectionHandlerID);
+		while (commandNextId(ids, &id)) {
+			if (id <= 0xffff) enableFollow(serverConnectionHandlerID, (anyID)id);
+		}
+		break;
+	case COMMAND_FOLLOW_WINDOW: {
+		follow_engine_config config = followEngineGetConfig();
+		config.window_ms = c.value < FOLLOW_WINDOW_MAX_MS ? (unsigned int)c.value : FOLLOW_WINDOW_MAX_MS;
+		followEngineSetConfig(config);
+		char msg[64];
+		snprintf(msg, sizeof(msg), "Follow window %u ms", followEngineGetConfig().window_ms);
+		printCommandMessage(serverConnectionHandlerID, msg);
+		break;
+	}
+	case COMMAND_SCHEDULER: {
+		move_scheduler_config config = moveSchedulerGetConfig();
+		if (c.settings & COMMAND_SET_MOVE_RATE) config.rate = c.move_rate;
+		if (c.settings & COMMAND_SET_MOVE_BURST) config.burst = c.move_burst;
+		if (c.settings & (COMMAND_SET_MOVE_RATE | COMMAND_SET_MOVE_BURST)) moveSchedulerSetConfig(config);
+		mass_move_config mass = massMoveGetConfig();
+		if (c.settings & COMMAND_SET_MOVE_WINDOW) mass.max_window = c.move_window;
+		if (c.settings & COMMAND_SET_MOVE_RETRIES) mass.max_retries = c.move_retries;
+		if (c.settings & (COMMAND_SET_MOVE_WINDOW | COMMAND_SET_MOVE_RETRIES)) massMoveSetConfig(mass);
+		config = moveSchedulerGetConfig();
+		mass = massMoveGetConfig();
+		char msg[128];
+		snprintf(msg, sizeof(msg), "Move scheduler %.0f moves/s, burst %.0f, mass moves %u in flight, %u retries",
+			config.rate, config.burst, mass.max_window, mass.max_retries);
+		printCommandMessage(serverConnectionHandlerID, msg);
+		break;
+	}
+	case COMMAND_UNFOLLOW:
+		disableFollow(serverConnectionHandlerID);
+		break;
+	case COMMAND_UNFOLLOW_CLIENTS:
+		while (commandNextId(ids, &id)) {
+			if (id <= 0xffff) removeFollow(serverConnectionHandlerID, (anyID)id);
+		}
+		break;
+	case COMMAND_BACKUP:
+	case COMMAND_DELTA_BACKUP:
+		backupServer(serverConnectionHandlerID, c.verb == COMMAND_DELTA_BACKUP);
+		break;
+	case COMMAND_RESTORE:
+		restoreServer(serverConnectionHandlerID);
+		break;
+	case COMMAND_RUN: {
+		if (script) {
+			printCommandMessage(serverConnectionHandlerID, "Scripts can't run other scripts");
+			break;
+		}
+		const auto it = files.scripts.find(c.file);
+		if (it != files.scripts.end()) runBatch(serverConnectionHandlerID, it->second.data(), it->second.size(), true, files, NULL);
+		break;
+	}
+	case COMMAND_METRICS:
+	case COMMAND_METRICS_RESET:
+	case COMMAND_METRICS_DUMP:
+		metricsCommand(serverConnectionHandlerID, c.verb);
+		break;
+	}
+}
+
+/*
+ * Activates the layout and moves every client that is somewhere else than the layout wants, clients already in place
+ * are left alone. Locked clients stay where their lock holds them. The moves go through the scheduler's bulk queue.
+ * Returns how many moves were sent.
+ */
+static size_t applyLayout(server_state& state, uint64 serverConnectionHandlerID) {
+	channel_layout& layout = state.layout;
+	channel_occupancy* index = getOccupancy(state, serverConnectionHandlerID);
+	if (!index || ts3Functions.getClientID(serverConnectionHandlerID, &layout.own_client) != ERROR_ok) {
+		printCommandMessage(serverConnectionHandlerID, "Could not read the clients of the server, layout not applied");
+		layout = channel_layout();
+		return 0;
+	}
+	layout.active = true;
+
+	std::vector<layout_client> clients;
+	for (size_t clientID = 1; clientID < index->clients.size(); clientID++) {
+		const uint64 channelID = index->clients[clientID].channelID;
+		uint64 clientDBID;
+		if (channelID == 0 || getClientDBID(state, serverConnectionHandlerID, (anyID)clientID, &clientDBID) != ERROR_ok) continue;
+		if (state.locked_users.count(clientDBID) || groupIndexLocked(state.groups, (anyID)clientID)) continue;
+		clients.push_back(layout_client{ (anyID)clientID, clientDBID, channelID });
+	}
+
+	std::vector<layout_move> moves;
+	layoutPlan(layout, clients, moves);
+	size_t placed = 0;
+	for (const layout_client& c : clients) placed += layoutTarget(layout, c.clientID, c.db_id) == c.channelID ? 1 : 0;
+	size_t sent = 0;
+	for (const layout_move& m : moves) {
+		if (moveHistoryPending(state.move_history, m.clientID, m.channelID)) {
+			metricsCount(METRIC_MOVES_DEDUPLICATED);
+			continue;
+		}
+		metricsCount(METRIC_LAYOUT_MOVES);
+		requestExpectedMove(state, serverConnectionHandlerID, m.clientID, m.channelID, MOVE_PRIORITY_BULK);
+		sent++;
+	}
+
+	char msg[128];
+	snprintf(msg, sizeof(msg), "Layout of %zu clients in %zu channels: %zu moves, %zu clients already in place",
+		layout.assigned.size(), layoutChannelCount(layout), sent, placed);
+	LOG_INFO(serverConnectionHandlerID, "%s", msg);
+	printCommandMessage(serverConnectionHandlerID, msg);
+	return sent;
+}
+
+/* Locks the clients with the batch's database ids in the channel they are in, ids of clients not online are counted in missing */
+static void lockBatch(uint64 serverConnectionHandlerID, std::vector<uint64>& db_ids, unsigned int* locked, unsigned int* missing) {
+	*locked = 0;
+	*missing = 0;
+	if (db_ids.empty()) return;
+	std::sort(db_ids.begin(), db_ids.end());
+	db_ids.erase(std::unique(db_ids.begin(), db_ids.end()), db_ids.end());
+
+	server_state& state = getServerState(serverConnectionHandlerID);
+	anyID* clients;
+	const unsigned int r = ts3Functions.getClientList(serverConnectionHandlerID, &clients);
+	if (r != ERROR_ok) {
+		LOG_WARN(serverConnectionHandlerID, "Error %u retrieving client list", r);
+		*missing = (unsigned int)db_ids.size();
+		return;
+	}
+	// stops once every id was found, a client connected twice is locked where the first connection in the list is
+	std::vector<bool> matched(db_ids.size(), false);
+	size_t found = 0;
+	for (const anyID* it = clients; *it != (anyID)NULL && found < db_ids.size(); it++) {
+		uint64 clientDBID;
+		if (getClientDBID(state, serverConnectionHandlerID, *it, &clientDBID) != ERROR_ok) continue;
+		const auto id = std::lower_bound(db_ids.begin(), db_ids.end(), clientDBID);
+		if (id == db_ids.end() || *id != clientDBID || matched[id - db_ids.begin()]) continue;
+		uint64 channelID;
+		if (ts3Functions.getChannelOfClient(serverConnectionHandlerID, *it, &channelID) != ERROR_ok) continue;
+		if (state.locked_users.insert_or_assign(clientDBID, channelID).second) (*locked)++;
+		state.chat_locks.erase(clientDBID);
+		matched[id - db_ids.begin()] = true;
+		found++;
+	}
+	ts3Functions.freeMemory(clients);
+	*missing = (unsigned int)(db_ids.size() - found);
+}
+
+static void formatBatchResult(char* buffer, size_t size, const batch_result& r) {
+	snprintf(buffer, size, "%zu moves to %zu channels, %zu layout moves, %u locked (%u not online), %u unlocked, %u groups locked, %u groups unlocked, %u channels not found",
+		r.moves, r.channels, r.layout_moves, r.locked, r.missing, r.unlocked, r.locked_groups, r.unlocked_groups, r.unresolved);
+}
+
+/* Checks the whole batch, prints the first syntax error to the tab */
+static bool checkBatch(uint64 serverConnectionHandlerID, const char* text, size_t length, bool script) {
+	command c;
+	char error[COMMAND_ERROR_BUFSIZE];
+	command_parser parser;
+	command_result result;
+
+	commandParserInit(parser, text, length);
+	while ((result = commandNext(parser, &c, error, sizeof(error))) == COMMAND_OK) {}
+	if (result == COMMAND_ERROR) {
+		char msg[COMMAND_ERROR_BUFSIZE + 32];
+		snprintf(msg, sizeof(msg), "%s %s", script ? "Script error," : "Command error,", error);
+		printCommandMessage(serverConnectionHandlerID, msg);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Reads the scripts and word lists a checked batch names and compiles the word lists, the batch then only swaps them
+ * in. Runs without state_mutex so the disk and the matcher build don't hold up the callbacks. Read errors are printed
+ * here, the command that names the file does nothing.
+ */
+static void prepareBatch(uint64 serverConnectionHandlerID, const char* text, size_t length, bool script, batch_files& files) {
+	command c;
+	char error[COMMAND_ERROR_BUFSIZE];
+	command_parser parser;
+
+	commandParserInit(parser, text, length);
+	while (commandNext(parser, &c, error, sizeof(error)) == COMMAND_OK) {
+		size_t size;
+		if (c.verb == COMMAND_RUN && !script) {
+			// scripts don't nest, the script's own word lists are the only files it adds
+			std::vector<char>& buffer = files.scripts[c.file];
+			buffer.resize(COMMAND_SCRIPT_BUFSIZE);
+			if (!readConfigFile(serverConnectionHandlerID, "script", c.file, c.file_length, buffer.data(), buffer.size(), &size)) {
+				files.scripts.erase(c.file);
+				continue;
+			}
+			buffer.resize(size);
+			prepareBatch(serverConnectionHandlerID, buffer.data(), size, true, files);
+		}
+		else if ((c.verb == COMMAND_CHAT_FILTER || c.verb == COMMAND_CHAT_FILTER_KICK || c.verb == COMMAND_CHAT_FILTER_LOCK) && c.file) {
+			std::vector<char> buffer(CHAT_LIST_BUFSIZE);
+			if (!readConfigFile(serverConnectionHandlerID, "word list", c.file, c.file_length, buffer.data(), buffer.size(), &size)) continue;
+			std::vector<std::string> words;
+			chatParseWords(buffer.data(), size, words);
+			batch_word_list& list = files.word_lists[c.file];
+			list.words = words.size();
+			chatMatcherBuild(list.matcher, words);
+		}
+	}
+}
+
+/* Runs the commands of a checked batch on one server */
+static batch_result executeBatch(uint64 serverConnectionHandlerID, const char* text, size_t length, bool script, batch_files& files) {
+	command c;
+	char error[COMMAND_ERROR_BUFSIZE];
+	command_parser parser;
+
+	command_batch batch;
+	commandParserInit(parser, text, length);
+	while (commandNext(parser, &c, error, sizeof(error)) == COMMAND_OK) {
+		runCommand(serverConnectionHandlerID, c, batch, script, files);
+		batch.commands++;
+	}
+
+	batch_result result;
+	lockBatch(serverConnectionHandlerID, batch.lock_db_ids, &result.locked, &result.missing);
+	saveServerState(serverConnectionHandlerID);
+	server_state& state = getServerState(serverConnectionHandlerID);
+	setMenuEnabled(ACTION_UNLOCK_ALL_MOVEMENT, !state.locked_users.empty() || groupIndexActive(state.groups));
+
+	if (batch.layout) result.layout_moves = applyLayout(state, serverConnectionHandlerID);
+
+	for (auto& m : batch.moves) {
+		if (m.second.empty()) continue;
+		result.moves += m.second.size();
+		result.channels++;
+		m.second.push_back((anyID)NULL);
+		massMoveStart(serverConnectionHandlerID, m.second.data(), m.first);
+	}
+	result.unlocked = batch.unlocked;
+	result.locked_groups = batch.locked_groups;
+	result.unlocked_groups = batch.unlocked_groups;
+	result.unresolved = batch.unresolved;
+
+	if (batch.lock_db_ids.empty() && batch.unlocked == 0 && batch.locked_groups == 0 && batch.unlocked_groups == 0 && result.moves == 0) return result;
+	char summary[256];
+	formatBatchResult(summary, sizeof(summary), result);
+	char msg[288];
+	snprintf(msg, sizeof(msg), "%u commands: %s", batch.commands, summary);
+	LOG_INFO(serverConnectionHandlerID, "%s", msg);
+	printCommandMessage(serverConnectionHandlerID, msg);
+	return result;
+}
+
+/*
+ * Runs the commands in text with the files prepareBatch read for them. The whole batch is checked first, a syntax
+ * error anywhere runs nothing. Callers hold state_mutex.
+ */
+static bool runBatch(uint64 serverConnectionHandlerID, const char* text, size_t length, bool script, batch_files& files, batch_result* result) {
+	if (!checkBatch(serverConnectionHandlerID, text, length, script)) return false;
+	const batch_result r = executeBatch(serverConnectionHandlerID, text, length, script, files);
+	if (result) *result = r;
+	return true;
+}
+
+/*
+ * Runs a batch on every connected server and prints what it did on each to the tab it was typed in. The batch runs
+ * on the servers one after the other, but the moves it starts go to each server's own mass move pipeline and token
+ * bucket and are sent on all servers at the same time. Callers hold state_mutex.
+ */
+static void runBroadcast(uint64 serverConnectionHandlerID, const char* text, size_t length, batch_files& files) {
+	if (!checkBatch(serverConnectionHandlerID, text, length, false)) return;
+	uint64* handlers;
+	R_CALL(ts3Functions.getServerConnectionHandlerList(&handlers), "Error retrieving server connection handlers!");
+
+	batch_result total;
+	size_t servers = 0;
+	char summary[256];
+	char msg[384];
+	for (const uint64* it = handlers; *it; it++) {
+		int status;
+		if (ts3Functions.getConnectionStatus(*it, &status) != ERROR_ok || status != STATUS_CONNECTION_ESTABLISHED) continue;
+		const batch_result r = executeBatch(*it, text, length, false, files);
+		servers++;
+		total.moves += r.moves;
+		total.channels += r.channels;
+		total.layout_moves += r.layout_moves;
+		total.locked += r.locked;
+		total.missing += r.missing;
+		total.unlocked += r.unlocked;
+		total.locked_groups += r.locked_groups;
+		total.unlocked_groups += r.unlocked_groups;
+		total.unresolved += r.unresolved;
+
+		char* name;
+		const bool named = ts3Functions.getServerVariableAsString(*it, VIRTUALSERVER_NAME, &name) == ERROR_ok;
+		formatBatchResult(summary, sizeof(summary), r);
+		snprintf(msg, sizeof(msg), "%.64s: %s", named ? name : "?", summary);
+		if (named) ts3Functions.freeMemory(name);
+		printCommandMessage(serverConnectionHandlerID, msg);
+	}
+	ts3Functions.freeMemory(handlers);
+
+	formatBatchResult(summary, sizeof(summary), total);
+	snprintf(msg, sizeof(msg), "%zu servers: %s", servers, summary);
+	LOG_INFO(serverConnectionHandlerID, "%s", msg);
+	printCommandMessage(serverConnectionHandlerID, msg);
+}
+
+/*
+ * Runs a command line typed in a tab, on that server or broadcast to all. The files it names are read and compiled
+ * first, state_mutex is only held while the batch applies them.
+ */
+static void runCommandLine(uint64 serverConnectionHandlerID, const char* command) {
+	const char* text = command;
+	size_t length = strlen(command);
+	batch_files files;
+	files.shared = commandBroadcast(&text, &length);
+	if (!checkBatch(serverConnectionHandlerID, text, length, false)) return;
+	prepareBatch(serverConnectionHandlerID, text, length, false, files);
+
+	std::lock_guard<std::mutex> lock(state_mutex);
+	if (files.shared) runBroadcast(serverConnectionHandlerID, text, length, files);
+	else runBatch(serverConnectionHandlerID, text, length, false, files, NULL);
+}
@@ -147,13 +147,20 @@ PLUGINS_EXPORTDLL const char* ts3plugin_keyPrefix();
 /* My Functions */
 void moveClientsToOwnChannel(uint64 serverConnectionHandlerID, uint64 channelID);
 void moveClientsToSelectedChannel(uint64 serverConnectionHandlerID, uint64 channelID);
+void moveSubtreeToOwnChannel(uint64 serverConnectionHandlerID, uint64 channelID);
+void moveSubtreeToSelectedChannel(uint64 serverConnectionHandlerID, uint64 channelID);
+void backupServer(uint64 serverConnectionHandlerID, bool delta);
+void restoreServer(uint64 serverConnectionHandlerID);
 
 void onClientMoved(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, bool was_moved, const char* moveType);
 void lockUser(uint64 serverConnectionHandlerID, anyID userID);
 void unlockUser(uint64 serverConnectionHandlerID, anyID userID);
 void join(uint64 serverConnectionHandlerID, anyID targetClientID);
 void enableFollow(uint64 serverConnectionHandlerID, anyID targetID);
-void disableFollow();
+void moveIdleClients();
+void reportLoudClients();
+void removeFollow(uint64 serverConnectionHandlerID, anyID targetID);
+void disableFollow(uint64 serverConnectionHandlerID);
 void follow(uint64 serverConnectionHandlerID, uint64 newChannelID);
 
 #ifdef __cplusplus
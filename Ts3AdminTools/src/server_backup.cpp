@@ -0,0 +1,596 @@
+#include "server_backup.h"
+
+#include <chrono>
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "common.h"
+#include "snapshot.h"
+#include "teamspeak/public_rare_definitions.h"
+#include "teamspeak/public_errors_rare.h"
+
+enum backup_stage {
+	BACKUP_STAGE_SERVER_GROUPS,
+	BACKUP_STAGE_CHANNEL_GROUPS,
+	BACKUP_STAGE_PERMISSIONS,
+	BACKUP_STAGE_BANS,
+	BACKUP_STAGE_DONE,
+};
+
+struct backup_perm {
+	unsigned int id;
+	int value;
+	unsigned int flags;  // SNAPSHOT_PERM_*
+};
+
+struct backup_request {
+	backup_section section;
+	uint64 id;
+	uint64 hash = SNAPSHOT_HASH_INIT;  // over the rows of a permission list received so far
+	std::vector<backup_perm> rows;     // rows held back until the list is complete (delta snapshots)
+};
+
+struct server_backup {
+	snapshot_writer writer;
+	std::string path;
+	std::string uid;
+	backup_stage stage;
+	bool delta;
+	std::unordered_map<uint64, uint64> base;  // index of the base snapshot, entries are removed once seen
+	std::deque<backup_request> pending;  // permission lists still to request
+	std::unordered_map<std::string, backup_request> in_flight;
+	backup_result result;
+	unsigned int last_error[BACKUP_SECTION_COUNT];
+	std::chrono::steady_clock::time_point started;
+};
+
+static backup_config config = backup_config{ 8 };
+static std::unordered_map<uint64, std::unique_ptr<server_backup>> backups = std::unordered_map<uint64, std::unique_ptr<server_backup>>();
+static std::unordered_map<uint64, backup_result> results = std::unordered_map<uint64, backup_result>();
+static std::unordered_map<std::string, std::vector<std::string>> chains = std::unordered_map<std::string, std::vector<std::string>>();  // by server uid
+
+void backupSetConfig(const backup_config& c) {
+	config = c;
+	if (config.max_in_flight < 1) config.max_in_flight = 1;
+}
+
+backup_config backupGetConfig() {
+	return config;
+}
+
+static server_backup* findBackup(uint64 serverConnectionHandlerID) {
+	const auto it = backups.find(serverConnectionHandlerID);
+	return it == backups.end() ? NULL : it->second.get();
+}
+
+static std::string serverString(uint64 serverConnectionHandlerID, size_t flag) {
+	char* value = NULL;
+	if (ts3Functions.getServerVariableAsString(serverConnectionHandlerID, flag, &value) != ERROR_ok) return "";
+	const std::string s = value;
+	ts3Functions.freeMemory(value);
+	return s;
+}
+
+/*** Index ***/
+
+static bool loadIndex(const char* path, std::unordered_map<uint64, uint64>& index, uint64* created) {
+	snapshot_reader r;
+	if (!snapshotOpen(&r, path)) return false;
+	*created = r.created;
+	bool complete = false;
+	while (snapshotNextRecord(&r)) {
+		if (r.type == SNAPSHOT_INDEX) {
+			const uint64 section = snapshotGetUInt(&r);
+			const uint64 id = snapshotGetUInt(&r);
+			index[SNAPSHOT_INDEX_KEY(section, id)] = snapshotGetUInt(&r);
+		}
+		else if (r.type == SNAPSHOT_END) {
+			complete = true;
+		}
+	}
+	// version 1 snapshots have no index, a delta against them would contain everything
+	const bool ok = complete && !r.failed && r.version >= 2;
+	snapshotClose(&r);
+	return ok;
+}
+
+static void writeIndex(server_backup& b, backup_section section, uint64 id, uint64 hash) {
+	snapshotBeginRecord(&b.writer, SNAPSHOT_INDEX);
+	snapshotPutUInt(&b.writer, section);
+	snapshotPutUInt(&b.writer, id);
+	snapshotPutUInt(&b.writer, hash);
+	snapshotEndRecord(&b.writer);
+}
+
+/* True if the entity has to be written, always for full snapshots */
+static bool changed(server_backup& b, backup_section section, uint64 id, uint64 hash) {
+	if (!b.delta) return true;
+	const auto it = b.base.find(SNAPSHOT_INDEX_KEY(section, id));
+	if (it == b.base.end()) return true;
+	const bool different = it->second != hash;
+	b.base.erase(it);
+	if (!different) b.result.unchanged++;
+	return different;
+}
+
+/* Ends the record being built if the entity changed, drops it otherwise, and indexes the entity */
+static void endEntity(server_backup& b, backup_section section, uint64 id) {
+	const uint64 hash = snapshotRecordHash(&b.writer);
+	if (changed(b, section, id, hash)) {
+		snapshotEndRecord(&b.writer);
+		b.result.rows[section]++;
+	}
+	else {
+		snapshotCancelRecord(&b.writer);
+	}
+	writeIndex(b, section, id, hash);
+}
+
+/* The entity could not be read this time, keep what the base knows about it */
+static void carryOver(server_backup& b, backup_section section, uint64 id) {
+	const auto it = b.base.find(SNAPSHOT_INDEX_KEY(section, id));
+	if (it == b.base.end()) return;
+	writeIndex(b, section, id, it->second);
+	b.base.erase(it);
+}
+
+/* True if entities of this section may be missing because the list holding them could not be requested */
+static bool sectionIncomplete(const server_backup& b, backup_section section) {
+	static const backup_section lists[BACKUP_SECTION_COUNT] = {
+		BACKUP_SECTION_CHANNELS,        // channels
+		BACKUP_SECTION_SERVER_GROUPS,   // server groups
+		BACKUP_SECTION_CHANNEL_GROUPS,  // channel groups
+		BACKUP_SECTION_SERVER_GROUPS,   // server group permissions, one list per server group
+		BACKUP_SECTION_CHANNEL_GROUPS,  // channel group permissions, one list per channel group
+		BACKUP_SECTION_CHANNELS,        // channel permissions, one list per channel
+		BACKUP_SECTION_BANS,            // bans
+	};
+	return section >= BACKUP_SECTION_COUNT || b.result.failed_requests[lists[section]] > 0;
+}
+
+/*** Channels ***/
+
+static int channelInt(uint64 serverConnectionHandlerID, uint64 channelID, size_t flag) {
+	int value = 0;
+	ts3Functions.getChannelVariableAsInt(serverConnectionHandlerID, channelID, flag, &value);
+	return value;
+}
+
+static uint64 channelUInt64(uint64 serverConnectionHandlerID, uint64 channelID, size_t flag) {
+	uint64 value = 0;
+	ts3Functions.getChannelVariableAsUInt64(serverConnectionHandlerID, channelID, flag, &value);
+	return value;
+}
+
+static void putChannelString(server_backup& b, uint64 serverConnectionHandlerID, uint64 channelID, size_t flag) {
+	char* value = NULL;
+	if (ts3Functions.getChannelVariableAsString(serverConnectionHandlerID, channelID, flag, &value) == ERROR_ok) {
+		snapshotPutString(&b.writer, value);
+		ts3Functions.freeMemory(value);
+	}
+	else {
+		snapshotPutString(&b.writer, "");
+	}
+}
+
+static void writeChannel(server_backup& b, uint64 serverConnectionHandlerID, uint64 channelID) {
+	static const struct { size_t flag; unsigned int bit; } flags[] = {
+		{ CHANNEL_FLAG_PERMANENT, BACKUP_CHANNEL_PERMANENT },
+		{ CHANNEL_FLAG_SEMI_PERMANENT, BACKUP_CHANNEL_SEMI_PERMANENT },
+		{ CHANNEL_FLAG_DEFAULT, BACKUP_CHANNEL_DEFAULT },
+		{ CHANNEL_FLAG_PASSWORD, BACKUP_CHANNEL_PASSWORD },
+		{ CHANNEL_CODEC_IS_UNENCRYPTED, BACKUP_CHANNEL_UNENCRYPTED },
+		{ CHANNEL_FLAG_MAXCLIENTS_UNLIMITED, BACKUP_CHANNEL_MAXCLIENTS_UNLIMITED },
+		{ CHANNEL_FLAG_MAXFAMILYCLIENTS_UNLIMITED, BACKUP_CHANNEL_MAXFAMILYCLIENTS_UNLIMITED },
+		{ CHANNEL_FLAG_MAXFAMILYCLIENTS_INHERITED, BACKUP_CHANNEL_MAXFAMILYCLIENTS_INHERITED },
+		{ CHANNEL_FLAG_PRIVATE, BACKUP_CHANNEL_PRIVATE },
+	};
+
+	uint64 parent = 0;
+	ts3Functions.getParentChannelOfChannel(serverConnectionHandlerID, channelID, &parent);
+
+	unsigned int channel_flags = 0;
+	for (const auto& f : flags) {
+		if (channelInt(serverConnectionHandlerID, channelID, f.flag)) channel_flags |= f.bit;
+	}
+
+	snapshotBeginRecord(&b.writer, SNAPSHOT_CHANNEL);
+	snapshotPutUInt(&b.writer, channelID);
+	snapshotPutUInt(&b.writer, parent);
+	snapshotPutUInt(&b.writer, channelUInt64(serverConnectionHandlerID, channelID, CHANNEL_ORDER));
+	putChannelString(b, serverConnectionHandlerID, channelID, CHANNEL_NAME);
+	putChannelString(b, serverConnectionHandlerID, channelID, CHANNEL_TOPIC);
+	putChannelString(b, serverConnectionHandlerID, channelID, CHANNEL_NAME_PHONETIC);
+	snapshotPutUInt(&b.writer, (uint64)channelInt(serverConnectionHandlerID, channelID, CHANNEL_CODEC));
+	snapshotPutUInt(&b.writer, (uint64)channelInt(serverConnectionHandlerID, channelID, CHANNEL_CODEC_QUALITY));
+	snapshotPutUInt(&b.writer, (uint64)channelInt(serverConnectionHandlerID, channelID, CHANNEL_CODEC_LATENCY_FACTOR));
+	snapshotPutInt(&b.writer, channelInt(serverConnectionHandlerID, channelID, CHANNEL_MAXCLIENTS));
+	snapshotPutInt(&b.writer, channelInt(serverConnectionHandlerID, channelID, CHANNEL_MAXFAMILYCLIENTS));
+	snapshotPutUInt(&b.writer, channel_flags);
+	snapshotPutInt(&b.writer, channelInt(serverConnectionHandlerID, channelID, CHANNEL_NEEDED_TALK_POWER));
+	snapshotPutUInt(&b.writer, (uint64)channelInt(serverConnectionHandlerID, channelID, CHANNEL_DELETE_DELAY));
+	snapshotPutUInt(&b.writer, channelUInt64(serverConnectionHandlerID, channelID, CHANNEL_ICON_ID));
+	endEntity(b, BACKUP_SECTION_CHANNELS, channelID);
+
+	b.pending.push_back(backup_request{ BACKUP_SECTION_CHANNEL_PERMS, channelID });
+}
+
+static void writeChannels(server_backup& b, uint64 serverConnectionHandlerID) {
+	uint64* channels;
+	const unsigned int r = ts3Functions.getChannelList(serverConnectionHandlerID, &channels);
+	if (r != ERROR_ok) {
+		b.result.failed_requests[BACKUP_SECTION_CHANNELS]++;
+		b.last_error[BACKUP_SECTION_CHANNELS] = r;
+		return;
+	}
+	for (const uint64* c = channels; *c; c++) {
+		writeChannel(b, serverConnectionHandlerID, *c);
+	}
+	ts3Functions.freeMemory(channels);
+}
+
+/*** Requests ***/
+
+static bool isPermList(backup_section section) {
+	return section == BACKUP_SECTION_SERVER_GROUP_PERMS || section == BACKUP_SECTION_CHANNEL_GROUP_PERMS || section == BACKUP_SECTION_CHANNEL_PERMS;
+}
+
+static void recordFailure(server_backup& b, backup_section section, unsigned int error) {
+	b.result.failed_requests[section]++;
+	b.last_error[section] = error;
+}
+
+static void sendRequest(uint64 serverConnectionHandlerID, server_backup& b, const backup_request& request) {
+	char returnCode[RETURNCODE_BUFSIZE];
+	ts3Functions.createReturnCode(pluginID, returnCode, RETURNCODE_BUFSIZE);
+
+	// insert first, the answer might be delivered before the request returns
+	b.in_flight[returnCode] = request;
+	unsigned int r = ERROR_ok;
+	switch (request.section) {
+	case BACKUP_SECTION_SERVER_GROUPS:
+		r = ts3Functions.requestServerGroupList(serverConnectionHandlerID, returnCode);
+		break;
+	case BACKUP_SECTION_CHANNEL_GROUPS:
+		r = ts3Functions.requestChannelGroupList(serverConnectionHandlerID, returnCode);
+		break;
+	case BACKUP_SECTION_SERVER_GROUP_PERMS:
+		r = ts3Functions.requestServerGroupPermList(serverConnectionHandlerID, request.id, returnCode);
+		break;
+	case BACKUP_SECTION_CHANNEL_GROUP_PERMS:
+		r = ts3Functions.requestChannelGroupPermList(serverConnectionHandlerID, request.id, returnCode);
+		break;
+	case BACKUP_SECTION_CHANNEL_PERMS:
+		r = ts3Functions.requestChannelPermList(serverConnectionHandlerID, request.id, returnCode);
+		break;
+	case BACKUP_SECTION_BANS:
+		r = ts3Functions.requestBanList(serverConnectionHandlerID, returnCode);
+		break;
+	default:
+		r = ERROR_parameter_invalid;
+		break;
+	}
+	if (r != ERROR_ok) {
+		LOG_WARN(serverConnectionHandlerID, "Error %u requesting backup list %d of %llu", r, (int)request.section, (unsigned long long)request.id);
+		b.in_flight.erase(returnCode);
+		recordFailure(b, request.section, r);
+		if (isPermList(request.section)) carryOver(b, request.section, request.id);
+	}
+}
+
+/* The list (section, id) if it was requested by the backup and its answer is still outstanding */
+static backup_request* findRequest(server_backup& b, backup_section section, uint64 id) {
+	for (auto& r : b.in_flight) {
+		if (r.second.section == section && r.second.id == id) return &r.second;
+	}
+	return NULL;
+}
+
+static snapshot_record_type permRecordType(backup_section section) {
+	switch (section) {
+	case BACKUP_SECTION_SERVER_GROUP_PERMS:
+		return SNAPSHOT_SERVER_GROUP_PERM;
+	case BACKUP_SECTION_CHANNEL_GROUP_PERMS:
+		return SNAPSHOT_CHANNEL_GROUP_PERM;
+	default:
+		return SNAPSHOT_CHANNEL_PERM;
+	}
+}
+
+static void writePerm(server_backup& b, backup_section section, uint64 ownerID, const backup_perm& perm) {
+	snapshotBeginRecord(&b.writer, permRecordType(section));
+	snapshotPutUInt(&b.writer, ownerID);
+	snapshotPutUInt(&b.writer, perm.id);
+	snapshotPutInt(&b.writer, perm.value);
+	snapshotPutUInt(&b.writer, perm.flags);
+	snapshotEndRecord(&b.writer);
+	b.result.rows[section]++;
+}
+
+/* All rows of a permission list arrived: a delta writes the list if its hash changed, both index it */
+static void completeList(server_backup& b, const backup_request& request) {
+	if (b.delta && changed(b, request.section, request.id, request.hash)) {
+		snapshotBeginRecord(&b.writer, SNAPSHOT_LIST);
+		snapshotPutUInt(&b.writer, request.section);
+		snapshotPutUInt(&b.writer, request.id);
+		snapshotPutUInt(&b.writer, request.rows.size());
+		snapshotEndRecord(&b.writer);
+		for (const backup_perm& perm : request.rows) writePerm(b, request.section, request.id, perm);
+	}
+	writeIndex(b, request.section, request.id, request.hash);
+}
+
+static void finish(uint64 serverConnectionHandlerID, server_backup& b) {
+	// whatever the base has and was not seen again is gone, unless the list it belongs to could not be read
+	for (const auto& e : b.base) {
+		const backup_section section = (backup_section)(e.first >> 56);
+		const uint64 id = e.first & 0x00ffffffffffffffULL;
+		if (sectionIncomplete(b, section)) {
+			writeIndex(b, section, id, e.second);
+			continue;
+		}
+		snapshotBeginRecord(&b.writer, SNAPSHOT_REMOVED);
+		snapshotPutUInt(&b.writer, section);
+		snapshotPutUInt(&b.writer, id);
+		snapshotEndRecord(&b.writer);
+		b.result.removed++;
+	}
+	b.base.clear();
+
+	for (int s = 0; s < BACKUP_SECTION_COUNT; s++) {
+		snapshotBeginRecord(&b.writer, SNAPSHOT_SECTION);
+		snapshotPutUInt(&b.writer, (uint64)s);
+		snapshotPutUInt(&b.writer, b.result.rows[s]);
+		snapshotPutUInt(&b.writer, b.result.failed_requests[s]);
+		snapshotPutUInt(&b.writer, b.last_error[s]);
+		snapshotEndRecord(&b.writer);
+	}
+	const bool written = snapshotFinish(&b.writer);
+
+	backup_result& result = b.result;
+	result.complete = written;
+	result.bytes = b.writer.bytes;
+	result.duration_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - b.started).count();
+	results[serverConnectionHandlerID] = result;
+	if (written && !b.uid.empty()) {
+		std::vector<std::string>& chain = chains[b.uid];
+		if (!b.delta) chain.clear();
+		chain.push_back(b.path);
+	}
+
+	unsigned int failed = 0;
+	for (unsigned int f : result.failed_requests) failed += f;
+	const uint64 perms = result.rows[BACKUP_SECTION_SERVER_GROUP_PERMS] + result.rows[BACKUP_SECTION_CHANNEL_GROUP_PERMS] + result.rows[BACKUP_SECTION_CHANNEL_PERMS];
+
+	char delta[96] = "";
+	if (b.delta) {
+		snprintf(delta, sizeof(delta), " (delta, %llu unchanged, %llu removed)", (unsigned long long)result.unchanged, (unsigned long long)result.removed);
+	}
+	char msg[PATH_BUFSIZE + 320];
+	snprintf(msg, sizeof(msg), "Backup %s%s: %llu channels, %llu groups, %llu permissions, %llu bans, %u failed requests, %llu KiB in %.0f ms -> %s",
+		written ? "done" : "FAILED", delta,
+		(unsigned long long)result.rows[BACKUP_SECTION_CHANNELS],
+		(unsigned long long)(result.rows[BACKUP_SECTION_SERVER_GROUPS] + result.rows[BACKUP_SECTION_CHANNEL_GROUPS]),
+		(unsigned long long)perms, (unsigned long long)result.rows[BACKUP_SECTION_BANS], failed,
+		(unsigned long long)(result.bytes / 1024), result.duration_ms, b.path.c_str());
+	LOG_INFO(serverConnectionHandlerID, "%s", msg);
+	ts3Functions.printMessage(serverConnectionHandlerID, msg, PLUGIN_MESSAGE_TARGET_SERVER);
+}
+
+/* Sends what the current stage still needs and moves on once it is done. Returns true when the backup finished. */
+static bool advance(uint64 serverConnectionHandlerID, server_backup& b) {
+	for (;;) {
+		if (b.stage == BACKUP_STAGE_PERMISSIONS) {
+			while (!b.pending.empty() && b.in_flight.size() < config.max_in_flight) {
+				const backup_request request = b.pending.front();
+				b.pending.pop_front();
+				sendRequest(serverConnectionHandlerID, b, request);
+			}
+		}
+		// permission lists queued by the group stages are only sent in the permission stage
+		if (!b.in_flight.empty() || (b.stage == BACKUP_STAGE_PERMISSIONS && !b.pending.empty())) return false;
+
+		switch (b.stage) {
+		case BACKUP_STAGE_SERVER_GROUPS:
+			b.stage = BACKUP_STAGE_CHANNEL_GROUPS;
+			sendRequest(serverConnectionHandlerID, b, backup_request{ BACKUP_SECTION_CHANNEL_GROUPS, 0 });
+			break;
+		case BACKUP_STAGE_CHANNEL_GROUPS:
+			b.stage = BACKUP_STAGE_PERMISSIONS;
+			break;
+		case BACKUP_STAGE_PERMISSIONS:
+			b.stage = BACKUP_STAGE_BANS;
+			sendRequest(serverConnectionHandlerID, b, backup_request{ BACKUP_SECTION_BANS, 0 });
+			break;
+		case BACKUP_STAGE_BANS:
+		case BACKUP_STAGE_DONE:
+			b.stage = BACKUP_STAGE_DONE;
+			finish(serverConnectionHandlerID, b);
+			return true;
+		}
+	}
+}
+
+/*** Backup ***/
+
+bool backupStart(uint64 serverConnectionHandlerID, const char* path, const char* base) {
+	if (findBackup(serverConnectionHandlerID)) return false;
+
+	std::unique_ptr<server_backup> backup = std::unique_ptr<server_backup>(new server_backup());
+	server_backup& b = *backup;
+	b.delta = base != NULL;
+	uint64 base_created = 0;
+	if (b.delta && !loadIndex(base, b.base, &base_created)) {
+		LOG_ERROR(serverConnectionHandlerID, "Error reading the index of backup '%s'", base);
+		return false;
+	}
+	if (!snapshotCreate(&b.writer, path, (uint64)time(NULL))) return false;
+	b.path = path;
+	b.result = backup_result();
+	b.result.serverConnectionHandlerID = serverConnectionHandlerID;
+	b.result.delta = b.delta;
+	b.result.path = path;
+	for (unsigned int& e : b.last_error) e = ERROR_ok;
+	b.started = std::chrono::steady_clock::now();
+
+	if (b.delta) {
+		snapshotBeginRecord(&b.writer, SNAPSHOT_DELTA);
+		snapshotPutUInt(&b.writer, base_created);
+		snapshotPutString(&b.writer, base);
+		snapshotEndRecord(&b.writer);
+	}
+
+	b.uid = serverString(serverConnectionHandlerID, VIRTUALSERVER_UNIQUE_IDENTIFIER);
+	snapshotBeginRecord(&b.writer, SNAPSHOT_SERVER);
+	snapshotPutString(&b.writer, b.uid.c_str());
+	snapshotPutString(&b.writer, serverString(serverConnectionHandlerID, VIRTUALSERVER_NAME).c_str());
+	snapshotEndRecord(&b.writer);
+
+	// channel properties are known locally, the rest has to be requested from the server
+	writeChannels(b, serverConnectionHandlerID);
+
+	b.stage = BACKUP_STAGE_SERVER_GROUPS;
+	sendRequest(serverConnectionHandlerID, b, backup_request{ BACKUP_SECTION_SERVER_GROUPS, 0 });
+	if (!advance(serverConnectionHandlerID, b)) {
+		backups[serverConnectionHandlerID] = std::move(backup);
+	}
+	return true;
+}
+
+bool backupOnServerError(uint64 serverConnectionHandlerID, const char* returnCode, unsigned int error) {
+	server_backup* b = findBackup(serverConnectionHandlerID);
+	if (!b) return false;
+
+	const auto it = b->in_flight.find(returnCode);
+	if (it == b->in_flight.end()) return false;
+	const backup_request request = std::move(it->second);
+	b->in_flight.erase(it);
+
+	// lists without entries are answered with an empty result error
+	if (error != ERROR_ok && error != ERROR_database_empty_result) {
+		recordFailure(*b, request.section, error);
+		if (isPermList(request.section)) carryOver(*b, request.section, request.id);
+	}
+	else if (isPermList(request.section)) {
+		completeList(*b, request);
+	}
+
+	if (advance(serverConnectionHandlerID, *b)) {
+		backups.erase(serverConnectionHandlerID);
+	}
+	return true;
+}
+
+/*** Rows ***/
+
+static void writeGroup(server_backup& b, backup_section section, snapshot_record_type type, uint64 groupID, const char* name, int groupType, int iconID, int saveDB) {
+	snapshotBeginRecord(&b.writer, type);
+	snapshotPutUInt(&b.writer, groupID);
+	snapshotPutString(&b.writer, name);
+	snapshotPutUInt(&b.writer, (uint64)groupType);
+	snapshotPutInt(&b.writer, iconID);
+	snapshotPutUInt(&b.writer, (uint64)saveDB);
+	endEntity(b, section, groupID);
+}
+
+static void onPerm(uint64 serverConnectionHandlerID, backup_section section, uint64 ownerID, unsigned int permissionID, int permissionValue, int permissionNegated, int permissionSkip) {
+	server_backup* b = findBackup(serverConnectionHandlerID);
+	if (!b) return;
+	backup_request* request = findRequest(*b, section, ownerID);
+	if (!request) return;
+
+	const backup_perm perm = { permissionID, permissionValue, (unsigned int)((permissionNegated ? SNAPSHOT_PERM_NEGATED : 0) | (permissionSkip ? SNAPSHOT_PERM_SKIP : 0)) };
+	request->hash = snapshotHash(request->hash, &perm, sizeof(perm));
+	if (b->delta) {
+		// whether the list changed is only known once it is complete
+		request->rows.push_back(perm);
+	}
+	else {
+		writePerm(*b, section, ownerID, perm);
+	}
+}
+
+void backupOnServerGroup(uint64 serverConnectionHandlerID, uint64 serverGroupID, const char* name, int type, int iconID, int saveDB) {
+	server_backup* b = findBackup(serverConnectionHandlerID);
+	if (!b || !findRequest(*b, BACKUP_SECTION_SERVER_GROUPS, 0)) return;
+	writeGroup(*b, BACKUP_SECTION_SERVER_GROUPS, SNAPSHOT_SERVER_GROUP, serverGroupID, name, type, iconID, saveDB);
+	b->pending.push_back(backup_request{ BACKUP_SECTION_SERVER_GROUP_PERMS, serverGroupID });
+}
+
+void backupOnChannelGroup(uint64 serverConnectionHandlerID, uint64 channelGroupID, const char* name, int type, int iconID, int saveDB) {
+	server_backup* b = findBackup(serverConnectionHandlerID);
+	if (!b || !findRequest(*b, BACKUP_SECTION_CHANNEL_GROUPS, 0)) return;
+	writeGroup(*b, BACKUP_SECTION_CHANNEL_GROUPS, SNAPSHOT_CHANNEL_GROUP, channelGroupID, name, type, iconID, saveDB);
+	b->pending.push_back(backup_request{ BACKUP_SECTION_CHANNEL_GROUP_PERMS, channelGroupID });
+}
+
+void backupOnServerGroupPerm(uint64 serverConnectionHandlerID, uint64 serverGroupID, unsigned int permissionID, int permissionValue, int permissionNegated, int permissionSkip) {
+	onPerm(serverConnectionHandlerID, BACKUP_SECTION_SERVER_GROUP_PERMS, serverGroupID, permissionID, permissionValue, permissionNegated, permissionSkip);
+}
+
+void backupOnChannelGroupPerm(uint64 serverConnectionHandlerID, uint64 channelGroupID, unsigned int permissionID, int permissionValue, int permissionNegated, int permissionSkip) {
+	onPerm(serverConnectionHandlerID, BACKUP_SECTION_CHANNEL_GROUP_PERMS, channelGroupID, permissionID, permissionValue, permissionNegated, permissionSkip);
+}
+
+void backupOnChannelPerm(uint64 serverConnectionHandlerID, uint64 channelID, unsigned int permissionID, int permissionValue, int permissionNegated, int permissionSkip) {
+	onPerm(serverConnectionHandlerID, BACKUP_SECTION_CHANNEL_PERMS, channelID, permissionID, permissionValue, permissionNegated, permissionSkip);
+}
+
+void backupOnBan(uint64 serverConnectionHandlerID, uint64 banid, const char* ip, const char* name, const char* uid, uint64 creationTime, uint64 durationTime, const char* invokerName, uint64 invokercldbid, const char* invokeruid, const char* reason, int numberOfEnforcements, const char* lastNickName) {
+	server_backup* b = findBackup(serverConnectionHandlerID);
+	if (!b || !findRequest(*b, BACKUP_SECTION_BANS, 0)) return;
+
+	snapshot_writer* w = &b->writer;
+	snapshotBeginRecord(w, SNAPSHOT_BAN);
+	snapshotPutUInt(w, banid);
+	snapshotPutString(w, ip);
+	snapshotPutString(w, name);
+	snapshotPutString(w, uid);
+	snapshotPutUInt(w, creationTime);
+	snapshotPutUInt(w, durationTime);
+	snapshotPutString(w, invokerName);
+	snapshotPutUInt(w, invokercldbid);
+	snapshotPutString(w, invokeruid);
+	snapshotPutString(w, reason);
+	// enforcements and last nickname change whenever the ban hits, they would put the ban into every delta
+	const uint64 hash = snapshotRecordHash(w);
+	snapshotPutUInt(w, (uint64)numberOfEnforcements);
+	snapshotPutString(w, lastNickName);
+	if (changed(*b, BACKUP_SECTION_BANS, banid, hash)) {
+		snapshotEndRecord(w);
+		b->result.rows[BACKUP_SECTION_BANS]++;
+	}
+	else {
+		snapshotCancelRecord(w);
+	}
+	writeIndex(*b, BACKUP_SECTION_BANS, banid, hash);
+}
+
+bool backupBusy(uint64 serverConnectionHandlerID) {
+	return findBackup(serverConnectionHandlerID) != NULL;
+}
+
+bool backupLastResult(uint64 serverConnectionHandlerID, backup_result* result) {
+	const auto it = results.find(serverConnectionHandlerID);
+	if (it == results.end()) return false;
+	*result = it->second;
+	return true;
+}
+
+bool backupChain(uint64 serverConnectionHandlerID, std::vector<std::string>* chain) {
+	const auto it = chains.find(serverString(serverConnectionHandlerID, VIRTUALSERVER_UNIQUE_IDENTIFIER));
+	if (it == chains.end() || it->second.empty()) return false;
+	*chain = it->second;
+	return true;
+}
+
+void backupDropConnection(uint64 serverConnectionHandlerID) {
+	server_backup* b = findBackup(serverConnectionHandlerID);
+	if (b) {
+		snapshotAbort(&b->writer);
+		backups.erase(serverConnectionHandlerID);
+	}
+	results.erase(serverConnectionHandlerID);
+}
@@ -0,0 +1,102 @@
+/*
+ * Server backup.
+ *
+ * Walks the channels of a server tab, then requests the server and channel group lists, the permission lists of
+ * every group and channel and finally the ban list. Rows are written to a snapshot file (see snapshot.h) as their
+ * callbacks arrive, nothing is collected in memory except the ids of the lists still to request. Each request is
+ * tagged with a return code and completed through ts3plugin_onServerErrorEvent, a window of permission list
+ * requests is kept in flight.
+ *
+ * Given the snapshot of the previous backup as base, a delta snapshot is written instead: every entity is hashed and
+ * compared against the index of the base, only changed channels, groups, bans and permission lists end up in the file
+ * (see snapshot.h). Permission lists are held back until they are complete for that, at most max_in_flight lists.
+ * The snapshots written on a server in this session form a chain, see backupChain.
+ *
+ * Record payloads besides the ones described in snapshot.h:
+ *   SNAPSHOT_CHANNEL: uint id, uint parent, uint order, string name, string topic, string phonetic name, uint codec,
+ *                     uint codec quality, uint codec latency factor, int max clients, int max family clients,
+ *                     uint flags (BACKUP_CHANNEL_*), int needed talk power, uint delete delay, uint icon id
+ *   SNAPSHOT_BAN:     uint id, string ip, string name, string uid, uint created, uint duration, string invoker name,
+ *                     uint invoker database id, string invoker uid, string reason, uint enforcements,
+ *                     string last nickname
+ */
+
+#ifndef SERVER_BACKUP_H
+#define SERVER_BACKUP_H
+
+#include <string>
+#include <vector>
+#include "teamspeak/public_definitions.h"
+
+enum backup_section {
+	BACKUP_SECTION_CHANNELS = 0,
+	BACKUP_SECTION_SERVER_GROUPS,
+	BACKUP_SECTION_CHANNEL_GROUPS,
+	BACKUP_SECTION_SERVER_GROUP_PERMS,
+	BACKUP_SECTION_CHANNEL_GROUP_PERMS,
+	BACKUP_SECTION_CHANNEL_PERMS,
+	BACKUP_SECTION_BANS,
+	BACKUP_SECTION_COUNT
+};
+
+enum backup_channel_flags {
+	BACKUP_CHANNEL_PERMANENT = 1 << 0,
+	BACKUP_CHANNEL_SEMI_PERMANENT = 1 << 1,
+	BACKUP_CHANNEL_DEFAULT = 1 << 2,
+	BACKUP_CHANNEL_PASSWORD = 1 << 3,
+	BACKUP_CHANNEL_UNENCRYPTED = 1 << 4,
+	BACKUP_CHANNEL_MAXCLIENTS_UNLIMITED = 1 << 5,
+	BACKUP_CHANNEL_MAXFAMILYCLIENTS_UNLIMITED = 1 << 6,
+	BACKUP_CHANNEL_MAXFAMILYCLIENTS_INHERITED = 1 << 7,
+	BACKUP_CHANNEL_PRIVATE = 1 << 8,
+};
+
+struct backup_config {
+	unsigned int max_in_flight;  // permission list requests in flight per server connection
+};
+
+struct backup_result {
+	uint64 serverConnectionHandlerID;
+	bool complete;  // every section written and the file closed without errors
+	bool delta;
+	std::string path;
+	uint64 rows[BACKUP_SECTION_COUNT];  // rows written, in a delta only the changed ones
+	unsigned int failed_requests[BACKUP_SECTION_COUNT];  // e.g. missing permissions, empty lists count as done
+	uint64 unchanged;  // entities left out of a delta
+	uint64 removed;    // entities of the base that are gone
+	uint64 bytes;
+	double duration_ms;
+};
+
+void backupSetConfig(const backup_config& config);
+backup_config backupGetConfig();
+
+/*
+ * Starts a backup of the server tab into path, a delta against base if given. False if one is already running on
+ * that tab, base is not a complete snapshot or the file can't be created.
+ */
+bool backupStart(uint64 serverConnectionHandlerID, const char* path, const char* base = NULL);
+
+/* Completes the request tagged with returnCode. Returns false if the return code does not belong to a backup. */
+bool backupOnServerError(uint64 serverConnectionHandlerID, const char* returnCode, unsigned int error);
+
+/* Rows, ignored unless a backup requested them */
+void backupOnServerGroup(uint64 serverConnectionHandlerID, uint64 serverGroupID, const char* name, int type, int iconID, int saveDB);
+void backupOnChannelGroup(uint64 serverConnectionHandlerID, uint64 channelGroupID, const char* name, int type, int iconID, int saveDB);
+void backupOnServerGroupPerm(uint64 serverConnectionHandlerID, uint64 serverGroupID, unsigned int permissionID, int permissionValue, int permissionNegated, int permissionSkip);
+void backupOnChannelGroupPerm(uint64 serverConnectionHandlerID, uint64 channelGroupID, unsigned int permissionID, int permissionValue, int permissionNegated, int permissionSkip);
+void backupOnChannelPerm(uint64 serverConnectionHandlerID, uint64 channelID, unsigned int permissionID, int permissionValue, int permissionNegated, int permissionSkip);
+void backupOnBan(uint64 serverConnectionHandlerID, uint64 banid, const char* ip, const char* name, const char* uid, uint64 creationTime, uint64 durationTime, const char* invokerName, uint64 invokercldbid, const char* invokeruid, const char* reason, int numberOfEnforcements, const char* lastNickName);
+
+bool backupBusy(uint64 serverConnectionHandlerID);
+
+/* Result of the last finished backup on this connection, false if there is none */
+bool backupLastResult(uint64 serverConnectionHandlerID, backup_result* result);
+
+/* Snapshots to restore the current state of the server from: the last full backup and the deltas on top, oldest first */
+bool backupChain(uint64 serverConnectionHandlerID, std::vector<std::string>* chain);
+
+/* Aborts a running backup (on disconnect), the file is left incomplete */
+void backupDropConnection(uint64 serverConnectionHandlerID);
+
+#endif
@@ -0,0 +1,306 @@
+#include "server_restore.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "common.h"
+#include "server_backup.h"
+#include "snapshot.h"
+
+struct restore_row {
+	backup_section section;
+	uint64 owner;
+	unsigned int id;
+	int value;
+	unsigned int flags;  // SNAPSHOT_PERM_*
+};
+
+struct restore_batch {
+	backup_section section;
+	uint64 owner;
+	std::vector<unsigned int> ids;
+	std::vector<int> values;
+	std::vector<int> negated;
+	std::vector<int> skip;
+};
+
+struct server_restore {
+	std::vector<std::string> chain;
+	size_t file;  // snapshot being read, counts down from chain.size()
+	bool reading;
+	bool file_complete;
+	snapshot_reader reader;
+	std::unordered_map<uint64, size_t> lists;  // list key -> snapshot its rows are taken from
+	restore_batch batch;
+	bool batch_ready;  // the batch has to be sent before more rows are read
+	bool has_held;
+	restore_row held;  // first row of the next batch
+	std::unordered_map<std::string, unsigned int> in_flight;  // return code -> rows
+	restore_result result;
+	std::chrono::steady_clock::time_point started;
+};
+
+static restore_config config = restore_config{ 8, 100 };
+static std::unordered_map<uint64, std::unique_ptr<server_restore>> restores = std::unordered_map<uint64, std::unique_ptr<server_restore>>();
+static std::unordered_map<uint64, restore_result> results = std::unordered_map<uint64, restore_result>();
+
+void restoreSetConfig(const restore_config& c) {
+	config = c;
+	if (config.max_in_flight < 1) config.max_in_flight = 1;
+	if (config.batch_size < 1) config.batch_size = 1;
+}
+
+restore_config restoreGetConfig() {
+	return config;
+}
+
+static server_restore* findRestore(uint64 serverConnectionHandlerID) {
+	const auto it = restores.find(serverConnectionHandlerID);
+	return it == restores.end() ? NULL : it->second.get();
+}
+
+/*** Chain ***/
+
+/* The first snapshot has to be a full one, every following one a delta on top of the one before */
+static bool validChain(const std::vector<std::string>& chain) {
+	uint64 previous = 0;
+	for (size_t i = 0; i < chain.size(); i++) {
+		snapshot_reader r;
+		if (!snapshotOpen(&r, chain[i].c_str())) return false;
+		const bool delta = snapshotNextRecord(&r) && r.type == SNAPSHOT_DELTA;
+		const uint64 base = delta ? snapshotGetUInt(&r) : 0;
+		const uint64 created = r.created;
+		snapshotClose(&r);
+		if (delta != (i > 0) || (delta && base != previous)) return false;
+		previous = created;
+	}
+	return !chain.empty();
+}
+
+/* True if rows of the list belong to the snapshot being read, lists of newer snapshots win */
+static bool claim(server_restore& r, backup_section section, uint64 owner) {
+	const auto it = r.lists.insert({ SNAPSHOT_INDEX_KEY(section, owner), r.file });
+	return it.first->second == r.file;
+}
+
+/*** Requests ***/
+
+static void add(server_restore& r, const restore_row& row) {
+	if (r.batch.ids.empty()) {
+		r.batch.section = row.section;
+		r.batch.owner = row.owner;
+	}
+	r.batch.ids.push_back(row.id);
+	r.batch.values.push_back(row.value);
+	r.batch.negated.push_back((row.flags & SNAPSHOT_PERM_NEGATED) ? 1 : 0);
+	r.batch.skip.push_back((row.flags & SNAPSHOT_PERM_SKIP) ? 1 : 0);
+}
+
+static void sendBatch(uint64 serverConnectionHandlerID, server_restore& r) {
+	restore_batch& batch = r.batch;
+	const int n = (int)batch.ids.size();
+	char returnCode[RETURNCODE_BUFSIZE];
+	ts3Functions.createReturnCode(pluginID, returnCode, RETURNCODE_BUFSIZE);
+
+	// insert first, the answer might be delivered before the request returns
+	r.in_flight[returnCode] = (unsigned int)n;
+	unsigned int e = ERROR_ok;
+	switch (batch.section) {
+	case BACKUP_SECTION_SERVER_GROUP_PERMS:
+		e = ts3Functions.requestServerGroupAddPerm(serverConnectionHandlerID, batch.owner, 1, batch.ids.data(), batch.values.data(), batch.negated.data(), batch.skip.data(), n, returnCode);
+		break;
+	case BACKUP_SECTION_CHANNEL_GROUP_PERMS:
+		e = ts3Functions.requestChannelGroupAddPerm(serverConnectionHandlerID, batch.owner, 1, batch.ids.data(), batch.values.data(), n, returnCode);
+		break;
+	default:
+		// channel permissions can't be negated or skipped
+		e = ts3Functions.requestChannelAddPerm(serverConnectionHandlerID, batch.owner, batch.ids.data(), batch.values.data(), n, returnCode);
+		break;
+	}
+	r.result.requests++;
+	if (e != ERROR_ok) {
+		LOG_WARN(serverConnectionHandlerID, "Error %u requesting permission restore of %llu", e, (unsigned long long)batch.owner);
+		r.in_flight.erase(returnCode);
+		r.result.failed_requests++;
+		r.result.last_error = e;
+	}
+	else {
+		r.result.rows += n;
+	}
+
+	batch.ids.clear();
+	batch.values.clear();
+	batch.negated.clear();
+	batch.skip.clear();
+}
+
+/*** Reading ***/
+
+static backup_section permSection(int type) {
+	switch (type) {
+	case SNAPSHOT_SERVER_GROUP_PERM:
+		return BACKUP_SECTION_SERVER_GROUP_PERMS;
+	case SNAPSHOT_CHANNEL_GROUP_PERM:
+		return BACKUP_SECTION_CHANNEL_GROUP_PERMS;
+	case SNAPSHOT_CHANNEL_PERM:
+		return BACKUP_SECTION_CHANNEL_PERMS;
+	default:
+		return BACKUP_SECTION_COUNT;
+	}
+}
+
+static void readRecord(server_restore& r) {
+	snapshot_reader* reader = &r.reader;
+	switch (reader->type) {
+	case SNAPSHOT_LIST:
+	case SNAPSHOT_REMOVED: {
+		// the list was replaced or deleted, older snapshots must not bring its rows back
+		const backup_section section = (backup_section)snapshotGetUInt(reader);
+		const uint64 owner = snapshotGetUInt(reader);
+		claim(r, section, owner);
+		break;
+	}
+	case SNAPSHOT_SERVER_GROUP_PERM:
+	case SNAPSHOT_CHANNEL_GROUP_PERM:
+	case SNAPSHOT_CHANNEL_PERM: {
+		restore_row row;
+		row.section = permSection(reader->type);
+		row.owner = snapshotGetUInt(reader);
+		row.id = (unsigned int)snapshotGetUInt(reader);
+		row.value = (int)snapshotGetInt(reader);
+		row.flags = (unsigned int)snapshotGetUInt(reader);
+		if (!claim(r, row.section, row.owner)) {
+			r.result.superseded++;
+			break;
+		}
+		if (!r.batch.ids.empty() && (r.batch.section != row.section || r.batch.owner != row.owner || r.batch.ids.size() >= config.batch_size)) {
+			r.held = row;
+			r.has_held = true;
+			r.batch_ready = true;
+			break;
+		}
+		add(r, row);
+		break;
+	}
+	case SNAPSHOT_END:
+		r.file_complete = true;
+		break;
+	default:
+		break;
+	}
+}
+
+static void finish(uint64 serverConnectionHandlerID, server_restore& r) {
+	restore_result& result = r.result;
+	result.duration_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - r.started).count();
+	results[serverConnectionHandlerID] = result;
+
+	char msg[256];
+	snprintf(msg, sizeof(msg), "Restore %s: %llu permissions in %llu requests (%llu superseded by newer backups), %u failed requests, %.0f ms",
+		result.complete ? "done" : "INCOMPLETE", (unsigned long long)result.rows, (unsigned long long)result.requests,
+		(unsigned long long)result.superseded, result.failed_requests, result.duration_ms);
+	LOG_INFO(serverConnectionHandlerID, "%s", msg);
+	ts3Functions.printMessage(serverConnectionHandlerID, msg, PLUGIN_MESSAGE_TARGET_SERVER);
+}
+
+/* Reads and sends until the window is full. Returns true when the restore finished. */
+static bool pump(uint64 serverConnectionHandlerID, server_restore& r) {
+	for (;;) {
+		if (r.batch_ready) {
+			if (r.in_flight.size() >= config.max_in_flight) return false;
+			sendBatch(serverConnectionHandlerID, r);
+			r.batch_ready = false;
+			if (r.has_held) add(r, r.held);
+			r.has_held = false;
+			continue;
+		}
+		if (!r.reading) {
+			if (!r.batch.ids.empty()) {
+				// batches don't span snapshots
+				r.batch_ready = true;
+				continue;
+			}
+			if (r.file == 0) {
+				if (!r.in_flight.empty()) return false;
+				finish(serverConnectionHandlerID, r);
+				return true;
+			}
+			r.file--;
+			r.file_complete = false;
+			r.reading = snapshotOpen(&r.reader, r.chain[r.file].c_str());
+			if (!r.reading) r.result.complete = false;
+			continue;
+		}
+		if (!snapshotNextRecord(&r.reader)) {
+			if (r.reader.failed || !r.file_complete) r.result.complete = false;
+			snapshotClose(&r.reader);
+			r.reading = false;
+			continue;
+		}
+		readRecord(r);
+	}
+}
+
+/*** Restore ***/
+
+bool restoreStart(uint64 serverConnectionHandlerID, const std::vector<std::string>& chain) {
+	if (findRestore(serverConnectionHandlerID) || !validChain(chain)) return false;
+
+	std::unique_ptr<server_restore> restore = std::unique_ptr<server_restore>(new server_restore());
+	server_restore& r = *restore;
+	r.chain = chain;
+	r.file = chain.size();
+	r.reading = false;
+	r.file_complete = false;
+	r.batch_ready = false;
+	r.has_held = false;
+	r.result = restore_result();
+	r.result.serverConnectionHandlerID = serverConnectionHandlerID;
+	r.result.complete = true;
+	r.result.last_error = ERROR_ok;
+	r.started = std::chrono::steady_clock::now();
+
+	if (!pump(serverConnectionHandlerID, r)) {
+		restores[serverConnectionHandlerID] = std::move(restore);
+	}
+	return true;
+}
+
+bool restoreOnServerError(uint64 serverConnectionHandlerID, const char* returnCode, unsigned int error) {
+	server_restore* r = findRestore(serverConnectionHandlerID);
+	if (!r) return false;
+
+	const auto it = r->in_flight.find(returnCode);
+	if (it == r->in_flight.end()) return false;
+	r->in_flight.erase(it);
+	if (error != ERROR_ok) {
+		r->result.failed_requests++;
+		r->result.last_error = error;
+	}
+
+	if (pump(serverConnectionHandlerID, *r)) {
+		restores.erase(serverConnectionHandlerID);
+	}
+	return true;
+}
+
+bool restoreBusy(uint64 serverConnectionHandlerID) {
+	return findRestore(serverConnectionHandlerID) != NULL;
+}
+
+bool restoreLastResult(uint64 serverConnectionHandlerID, restore_result* result) {
+	const auto it = results.find(serverConnectionHandlerID);
+	if (it == results.end()) return false;
+	*result = it->second;
+	return true;
+}
+
+void restoreDropConnection(uint64 serverConnectionHandlerID) {
+	server_restore* r = findRestore(serverConnectionHandlerID);
+	if (r) {
+		if (r->reading) snapshotClose(&r->reader);
+		restores.erase(serverConnectionHandlerID);
+	}
+	results.erase(serverConnectionHandlerID);
+}
@@ -0,0 +1,59 @@
+/*
+ * Permission restore from backup snapshots.
+ *
+ * Reads a chain of snapshots (a full backup and the deltas on top, see server_backup.h) and adds the permissions of
+ * server groups, channel groups and channels back to the server. Rows of the same group or channel are sent as one
+ * requestServerGroupAddPerm / requestChannelGroupAddPerm / requestChannelAddPerm call of up to batch_size
+ * permissions, and up to max_in_flight of these requests are kept in flight, each tagged with a return code and
+ * completed through ts3plugin_onServerErrorEvent. The snapshots are read while requests complete, only one batch
+ * and the ids of the lists seen so far are held in memory.
+ *
+ * The chain is read newest first, a list found in a newer snapshot replaces the same list in the older ones.
+ * Groups and channels are matched by id and have to exist, permissions that were added since the backup are not
+ * removed.
+ */
+
+#ifndef SERVER_RESTORE_H
+#define SERVER_RESTORE_H
+
+#include <string>
+#include <vector>
+#include "teamspeak/public_definitions.h"
+
+struct restore_config {
+	unsigned int max_in_flight;  // add permission requests in flight per server connection
+	unsigned int batch_size;     // permissions per request at most
+};
+
+struct restore_result {
+	uint64 serverConnectionHandlerID;
+	bool complete;             // every snapshot read to its end
+	uint64 rows;               // permissions sent
+	uint64 superseded;         // rows skipped because a newer snapshot replaced their list
+	uint64 requests;
+	unsigned int failed_requests;
+	unsigned int last_error;
+	double duration_ms;
+};
+
+void restoreSetConfig(const restore_config& config);
+restore_config restoreGetConfig();
+
+/*
+ * Starts restoring the permissions in chain (oldest first) to the server tab. False if a restore is already running
+ * on that tab or the chain is not a full snapshot followed by deltas based on each other.
+ */
+bool restoreStart(uint64 serverConnectionHandlerID, const std::vector<std::string>& chain);
+
+/* Completes the request tagged with returnCode. Returns false if the return code does not belong to a restore. */
+bool restoreOnServerError(uint64 serverConnectionHandlerID, const char* returnCode, unsigned int error);
+
+bool restoreBusy(uint64 serverConnectionHandlerID);
+
+/* Result of the last finished restore on this connection, false if there is none */
+bool restoreLastResult(uint64 serverConnectionHandlerID, restore_result* result);
+
+/* Aborts a running restore (on disconnect) */
+void restoreDropConnection(uint64 serverConnectionHandlerID);
+
+#endif
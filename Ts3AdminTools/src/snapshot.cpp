@@ -0,0 +1,240 @@
+#include "snapshot.h"
+
+#include <string.h>
+
+/*** Encoding ***/
+
+static size_t encodeVarint(unsigned char* out, uint64 value) {
+	size_t n = 0;
+	while (value >= 0x80) {
+		out[n++] = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+	out[n++] = (unsigned char)value;
+	return n;
+}
+
+static uint64 zigzag(int64_t value) {
+	return ((uint64)value << 1) ^ (uint64)(value >> 63);
+}
+
+static int64_t unzigzag(uint64 value) {
+	return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static void putLE(unsigned char* out, uint64 value, size_t bytes) {
+	for (size_t i = 0; i < bytes; i++) {
+		out[i] = (unsigned char)(value >> (8 * i));
+	}
+}
+
+static uint64 getLE(const unsigned char* in, size_t bytes) {
+	uint64 value = 0;
+	for (size_t i = 0; i < bytes; i++) {
+		value |= (uint64)in[i] << (8 * i);
+	}
+	return value;
+}
+
+uint64 snapshotHash(uint64 hash, const void* data, size_t size) {
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+/*** Writer ***/
+
+static void flush(snapshot_writer* w) {
+	if (w->buffered && fwrite(w->buffer, 1, w->buffered, w->file) != w->buffered) {
+		w->failed = true;
+	}
+	w->buffered = 0;
+}
+
+static void writeBytes(snapshot_writer* w, const unsigned char* data, size_t size) {
+	if (w->buffered + size > SNAPSHOT_FILE_BUFSIZE) flush(w);
+	memcpy(w->buffer + w->buffered, data, size);
+	w->buffered += size;
+	w->bytes += size;
+}
+
+bool snapshotCreate(snapshot_writer* w, const char* path, uint64 created) {
+	w->file = fopen(path, "wb");
+	w->buffered = 0;
+	w->record_size = 0;
+	w->record_type = -1;
+	w->records = 0;
+	w->bytes = 0;
+	w->failed = false;
+	if (!w->file) return false;
+
+	unsigned char header[SNAPSHOT_HEADER_SIZE] = {};
+	memcpy(header, SNAPSHOT_MAGIC, 4);
+	putLE(header + 4, SNAPSHOT_VERSION, 2);
+	putLE(header + 8, created, 8);
+	writeBytes(w, header, SNAPSHOT_HEADER_SIZE);
+	return true;
+}
+
+void snapshotBeginRecord(snapshot_writer* w, snapshot_record_type type) {
+	w->record_type = type;
+	w->record_size = 0;
+}
+
+static bool reserve(snapshot_writer* w, size_t size) {
+	if (w->record_size + size <= SNAPSHOT_RECORD_BUFSIZE) return true;
+	w->failed = true;
+	return false;
+}
+
+void snapshotPutUInt(snapshot_writer* w, uint64 value) {
+	if (!reserve(w, 10)) return;
+	w->record_size += encodeVarint(w->record + w->record_size, value);
+}
+
+void snapshotPutInt(snapshot_writer* w, int64_t value) {
+	snapshotPutUInt(w, zigzag(value));
+}
+
+void snapshotPutString(snapshot_writer* w, const char* value) {
+	size_t length = value ? strlen(value) : 0;
+	if (length > SNAPSHOT_MAX_STRING) length = SNAPSHOT_MAX_STRING;
+	if (!reserve(w, 10 + length)) return;
+	w->record_size += encodeVarint(w->record + w->record_size, length);
+	memcpy(w->record + w->record_size, value, length);
+	w->record_size += length;
+}
+
+void snapshotEndRecord(snapshot_writer* w) {
+	if (w->record_type < 0 || !w->file) return;
+	unsigned char prefix[11];
+	prefix[0] = (unsigned char)w->record_type;
+	const size_t prefix_size = 1 + encodeVarint(prefix + 1, w->record_size);
+	writeBytes(w, prefix, prefix_size);
+	writeBytes(w, w->record, w->record_size);
+	w->record_type = -1;
+	w->records++;
+}
+
+void snapshotCancelRecord(snapshot_writer* w) {
+	w->record_type = -1;
+	w->record_size = 0;
+}
+
+uint64 snapshotRecordHash(const snapshot_writer* w) {
+	return snapshotHash(SNAPSHOT_HASH_INIT, w->record, w->record_size);
+}
+
+bool snapshotFinish(snapshot_writer* w) {
+	if (!w->file) return false;
+	const uint64 records = w->records;
+	snapshotBeginRecord(w, SNAPSHOT_END);
+	snapshotPutUInt(w, records);
+	snapshotEndRecord(w);
+	flush(w);
+	if (fclose(w->file) != 0) w->failed = true;
+	w->file = NULL;
+	return !w->failed;
+}
+
+void snapshotAbort(snapshot_writer* w) {
+	if (!w->file) return;
+	flush(w);
+	fclose(w->file);
+	w->file = NULL;
+}
+
+/*** Reader ***/
+
+static bool readVarintFromFile(FILE* file, uint64* value) {
+	*value = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		const int c = fgetc(file);
+		if (c == EOF) return false;
+		*value |= (uint64)(c & 0x7f) << shift;
+		if (!(c & 0x80)) return true;
+	}
+	return false;
+}
+
+bool snapshotOpen(snapshot_reader* r, const char* path) {
+	r->file = fopen(path, "rb");
+	r->record_size = 0;
+	r->pos = 0;
+	r->type = -1;
+	r->failed = false;
+	if (!r->file) return false;
+
+	// stdio buffering, the reader pulls the file in SNAPSHOT_FILE_BUFSIZE chunks
+	setvbuf(r->file, NULL, _IOFBF, SNAPSHOT_FILE_BUFSIZE);
+	unsigned char header[SNAPSHOT_HEADER_SIZE];
+	if (fread(header, 1, SNAPSHOT_HEADER_SIZE, r->file) != SNAPSHOT_HEADER_SIZE || memcmp(header, SNAPSHOT_MAGIC, 4) != 0) {
+		snapshotClose(r);
+		return false;
+	}
+	r->version = (unsigned int)getLE(header + 4, 2);
+	r->created = getLE(header + 8, 8);
+	if (r->version > SNAPSHOT_VERSION) {
+		snapshotClose(r);
+		return false;
+	}
+	return true;
+}
+
+bool snapshotNextRecord(snapshot_reader* r) {
+	if (!r->file) return false;
+	const int type = fgetc(r->file);
+	if (type == EOF) return false;
+
+	uint64 size;
+	if (!readVarintFromFile(r->file, &size) || size > SNAPSHOT_RECORD_BUFSIZE || fread(r->record, 1, (size_t)size, r->file) != size) {
+		r->failed = true;
+		return false;
+	}
+	r->type = type;
+	r->record_size = (size_t)size;
+	r->pos = 0;
+	return true;
+}
+
+uint64 snapshotGetUInt(snapshot_reader* r) {
+	uint64 value = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (r->pos >= r->record_size) {
+			// fields missing at the end of a record read as 0, newer writers may append fields
+			return value;
+		}
+		const unsigned char c = r->record[r->pos++];
+		value |= (uint64)(c & 0x7f) << shift;
+		if (!(c & 0x80)) return value;
+	}
+	r->failed = true;
+	return value;
+}
+
+int64_t snapshotGetInt(snapshot_reader* r) {
+	return unzigzag(snapshotGetUInt(r));
+}
+
+size_t snapshotGetString(snapshot_reader* r, char* out, size_t out_size) {
+	const uint64 length = snapshotGetUInt(r);
+	if (length > r->record_size - r->pos) {
+		r->failed = true;
+		if (out_size) out[0] = '\0';
+		return 0;
+	}
+	if (out_size) {
+		const size_t copy = (size_t)length < out_size - 1 ? (size_t)length : out_size - 1;
+		memcpy(out, r->record + r->pos, copy);
+		out[copy] = '\0';
+	}
+	r->pos += (size_t)length;
+	return (size_t)length;
+}
+
+void snapshotClose(snapshot_reader* r) {
+	if (r->file) fclose(r->file);
+	r->file = NULL;
+}
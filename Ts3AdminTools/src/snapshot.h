@@ -0,0 +1,113 @@
+/*
+ * Binary snapshot format used by the server backup.
+ *
+ * A snapshot is a small header followed by records. Every record is a type byte, the payload length as varint and
+ * the payload; unsigned numbers are varints, signed numbers zigzag encoded varints and strings a varint length
+ * followed by the bytes (no terminator). Readers skip record types they don't know, so records can be added without
+ * breaking older readers. A complete snapshot ends with a SNAPSHOT_END record.
+ *
+ * Every snapshot carries SNAPSHOT_INDEX records, a hash per entity (channel, group, ban, permission list of a group or
+ * channel) describing the full server state at the time of the snapshot. A delta snapshot starts with a SNAPSHOT_DELTA
+ * record naming the snapshot it is based on and only contains the entities whose hash changed, permission lists as a
+ * whole (SNAPSHOT_LIST followed by its rows), plus SNAPSHOT_REMOVED for entities that are gone. Comparing against the
+ * index of the previous snapshot is enough to write the next delta, full snapshot and all deltas form a chain.
+ *
+ * Writer and reader only hold one record and one file buffer in memory, no matter how large the snapshot gets.
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "teamspeak/public_definitions.h"
+
+#define SNAPSHOT_MAGIC "JATB"
+#define SNAPSHOT_VERSION 2  // 2: delta snapshots and index records
+#define SNAPSHOT_HEADER_SIZE 16
+
+#define SNAPSHOT_FILE_BUFSIZE 65536
+#define SNAPSHOT_RECORD_BUFSIZE 8192
+#define SNAPSHOT_MAX_STRING 1024  // longer strings are cut
+
+enum snapshot_record_type {
+	SNAPSHOT_END = 0,                 // uint records written before this one
+	SNAPSHOT_SERVER,                  // string unique id, string name
+	SNAPSHOT_CHANNEL,                 // see server_backup.h
+	SNAPSHOT_SERVER_GROUP,            // uint id, string name, uint type, int icon, uint save db
+	SNAPSHOT_CHANNEL_GROUP,           // uint id, string name, uint type, int icon, uint save db
+	SNAPSHOT_SERVER_GROUP_PERM,       // uint group, uint permission, int value, uint flags (SNAPSHOT_PERM_*)
+	SNAPSHOT_CHANNEL_GROUP_PERM,      // uint group, uint permission, int value, uint flags
+	SNAPSHOT_CHANNEL_PERM,            // uint channel, uint permission, int value, uint flags
+	SNAPSHOT_BAN,                     // see server_backup.h
+	SNAPSHOT_SECTION,                 // uint section, uint records, uint failed requests, uint last error
+	SNAPSHOT_DELTA,                   // uint base created, string base path; first record of a delta snapshot
+	SNAPSHOT_LIST,                    // uint section, uint owner, uint rows; in a delta the rows replace the whole list
+	SNAPSHOT_REMOVED,                 // uint section, uint id; entity of the base that no longer exists
+	SNAPSHOT_INDEX,                   // uint section, uint id, uint hash
+};
+
+/* Key of an entity in the index: section (see server_backup.h) in the top byte, id below */
+#define SNAPSHOT_INDEX_KEY(section, id) (((uint64)(section) << 56) | ((uint64)(id) & 0x00ffffffffffffffULL))
+
+/* FNV-1a, used for the entity hashes of the index */
+#define SNAPSHOT_HASH_INIT 0xcbf29ce484222325ULL
+uint64 snapshotHash(uint64 hash, const void* data, size_t size);
+
+enum snapshot_perm_flags {
+	SNAPSHOT_PERM_NEGATED = 1 << 0,
+	SNAPSHOT_PERM_SKIP = 1 << 1,
+};
+
+struct snapshot_writer {
+	FILE* file;
+	unsigned char buffer[SNAPSHOT_FILE_BUFSIZE];
+	size_t buffered;
+	unsigned char record[SNAPSHOT_RECORD_BUFSIZE];
+	size_t record_size;
+	int record_type;
+	uint64 records;
+	uint64 bytes;
+	bool failed;  // a write failed, or a record did not fit
+};
+
+struct snapshot_reader {
+	FILE* file;
+	unsigned int version;
+	uint64 created;  // unix time
+	unsigned char record[SNAPSHOT_RECORD_BUFSIZE];
+	size_t record_size;
+	size_t pos;
+	int type;
+	bool failed;  // truncated or malformed data
+};
+
+/*** Writer ***/
+
+bool snapshotCreate(snapshot_writer* w, const char* path, uint64 created);
+void snapshotBeginRecord(snapshot_writer* w, snapshot_record_type type);
+void snapshotPutUInt(snapshot_writer* w, uint64 value);
+void snapshotPutInt(snapshot_writer* w, int64_t value);
+void snapshotPutString(snapshot_writer* w, const char* value);
+void snapshotEndRecord(snapshot_writer* w);
+/* Drops the record being built, nothing is written */
+void snapshotCancelRecord(snapshot_writer* w);
+/* Hash of the payload of the record being built */
+uint64 snapshotRecordHash(const snapshot_writer* w);
+/* Writes SNAPSHOT_END and closes the file, false if anything could not be written */
+bool snapshotFinish(snapshot_writer* w);
+/* Closes the file without an end record, the snapshot is incomplete */
+void snapshotAbort(snapshot_writer* w);
+
+/*** Reader ***/
+
+bool snapshotOpen(snapshot_reader* r, const char* path);
+/* Loads the next record, false at the end of the file or on malformed data */
+bool snapshotNextRecord(snapshot_reader* r);
+uint64 snapshotGetUInt(snapshot_reader* r);
+int64_t snapshotGetInt(snapshot_reader* r);
+/* Copies the string into out (always terminated), returns its full length */
+size_t snapshotGetString(snapshot_reader* r, char* out, size_t out_size);
+void snapshotClose(snapshot_reader* r);
+
+#endif
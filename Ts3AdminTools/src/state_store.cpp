@@ -0,0 +1,310 @@
+#include "state_store.h"
+
+#include <string.h>
+#include <string>
+#include <vector>
+#include "common.h"
+#include "snapshot.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct state_store_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t record_size;
+	uint32_t servers;
+	uint32_t locks;
+	uint32_t follows;
+	uint32_t groups;
+	uint64 checksum;  // over the fields above
+};
+
+static_assert(sizeof(state_store_header) <= STATE_STORE_HEADER_SIZE, "state store header does not fit");
+static_assert(sizeof(state_record) % 8 == 0, "state records must stay 8 byte aligned");
+
+#define STATE_STORE_RECORDS (STATE_STORE_SERVERS * 2)
+#define STATE_STORE_FILE_SIZE (STATE_STORE_HEADER_SIZE + STATE_STORE_RECORDS * sizeof(state_record))
+
+enum record_check {
+	RECORD_UNCHECKED = 0,
+	RECORD_VALID,
+	RECORD_INVALID,
+};
+
+static bool enabled = true;
+static unsigned char* mapping = NULL;
+static state_record* records = NULL;
+static unsigned char checked[STATE_STORE_RECORDS];  // record_check, records are only checksummed once
+static uint64 sequence = 0;  // highest sequence in the file
+static state_store_stats stats = state_store_stats();
+
+#ifdef _WIN32
+static HANDLE file_handle = INVALID_HANDLE_VALUE;
+static HANDLE mapping_handle = NULL;
+#else
+static int file_descriptor = -1;
+#endif
+
+/*** Mapping ***/
+
+#ifdef _WIN32
+static bool mapFile(const char* path) {
+	file_handle = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file_handle == INVALID_HANDLE_VALUE) return false;
+	mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READWRITE, 0, (DWORD)STATE_STORE_FILE_SIZE, NULL);
+	if (mapping_handle) mapping = (unsigned char*)MapViewOfFile(mapping_handle, FILE_MAP_ALL_ACCESS, 0, 0, STATE_STORE_FILE_SIZE);
+	return mapping != NULL;
+}
+
+static void unmapFile() {
+	if (mapping) {
+		FlushViewOfFile(mapping, STATE_STORE_FILE_SIZE);
+		UnmapViewOfFile(mapping);
+	}
+	if (mapping_handle) CloseHandle(mapping_handle);
+	if (file_handle != INVALID_HANDLE_VALUE) CloseHandle(file_handle);
+	mapping = NULL;
+	mapping_handle = NULL;
+	file_handle = INVALID_HANDLE_VALUE;
+}
+
+static void flushRange(const void* data, size_t size) {
+	FlushViewOfFile(data, size);
+}
+#else
+static bool mapFile(const char* path) {
+	file_descriptor = open(path, O_RDWR | O_CREAT, 0644);
+	if (file_descriptor < 0) return false;
+	// a shorter file (new, or an older layout) is grown with zeroes, the header check then starts it over
+	struct stat st;
+	if (fstat(file_descriptor, &st) != 0) return false;
+	if ((size_t)st.st_size != STATE_STORE_FILE_SIZE && ftruncate(file_descriptor, (off_t)STATE_STORE_FILE_SIZE) != 0) return false;
+	void* m = mmap(NULL, STATE_STORE_FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, file_descriptor, 0);
+	if (m == MAP_FAILED) return false;
+	mapping = (unsigned char*)m;
+	return true;
+}
+
+static void unmapFile() {
+	if (mapping) {
+		msync(mapping, STATE_STORE_FILE_SIZE, MS_SYNC);
+		munmap(mapping, STATE_STORE_FILE_SIZE);
+	}
+	if (file_descriptor >= 0) close(file_descriptor);
+	mapping = NULL;
+	file_descriptor = -1;
+}
+
+static void flushRange(const void* data, size_t size) {
+	// msync wants the start on a page boundary
+	const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+	const uintptr_t start = (uintptr_t)data & ~(page - 1);
+	msync((void*)start, (uintptr_t)data + size - start, MS_ASYNC);
+}
+#endif
+
+/*** Header ***/
+
+static state_store_header expectedHeader() {
+	state_store_header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, STATE_STORE_MAGIC, sizeof(h.magic));
+	h.version = STATE_STORE_VERSION;
+	h.header_size = STATE_STORE_HEADER_SIZE;
+	h.record_size = (uint32_t)sizeof(state_record);
+	h.servers = STATE_STORE_SERVERS;
+	h.locks = STATE_STORE_LOCKS;
+	h.follows = STATE_STORE_FOLLOWS;
+	h.groups = STATE_STORE_GROUPS;
+	h.checksum = snapshotHash(SNAPSHOT_HASH_INIT, &h, offsetof(state_store_header, checksum));
+	return h;
+}
+
+/* Why the header does not match, NULL if it does */
+static const char* headerMismatch(const state_store_header& h, const state_store_header& expected) {
+	if (memcmp(h.magic, expected.magic, sizeof(h.magic)) != 0) return "not a state file";
+	if (h.checksum != snapshotHash(SNAPSHOT_HASH_INIT, &h, offsetof(state_store_header, checksum))) return "header checksum";
+	if (h.version != expected.version) return "version";
+	if (h.header_size != expected.header_size || h.record_size != expected.record_size || h.servers != expected.servers ||
+		h.locks != expected.locks || h.follows != expected.follows || h.groups != expected.groups) {
+		return "layout";
+	}
+	return NULL;
+}
+
+/*** Records ***/
+
+static uint64 recordChecksum(const state_record& r) {
+	uint64 hash = snapshotHash(SNAPSHOT_HASH_INIT, &r.sequence, sizeof(r.sequence));
+	hash = snapshotHash(hash, r.uid, offsetof(state_record, locks) - offsetof(state_record, uid));
+	hash = snapshotHash(hash, r.locks, r.lock_count * sizeof(r.locks[0]));
+	hash = snapshotHash(hash, r.follows, r.follow_count * sizeof(r.follows[0]));
+	return snapshotHash(hash, r.groups, r.group_count * sizeof(r.groups[0]));
+}
+
+static bool isValid(size_t index) {
+	if (checked[index] == RECORD_UNCHECKED) {
+		const state_record& r = records[index];
+		const bool valid = r.sequence != 0 && r.lock_count <= STATE_STORE_LOCKS && r.follow_count <= STATE_STORE_FOLLOWS &&
+			r.group_count <= STATE_STORE_GROUPS && memchr(r.uid, 0, sizeof(r.uid)) != NULL && r.checksum == recordChecksum(r);
+		if (!valid && r.sequence != 0) stats.torn++;
+		checked[index] = valid ? RECORD_VALID : RECORD_INVALID;
+	}
+	return checked[index] == RECORD_VALID;
+}
+
+static bool hasUid(const state_record& r, const char* uid) {
+	return r.sequence != 0 && strncmp(r.uid, uid, sizeof(r.uid)) == 0;
+}
+
+/* Slot holding a record of the server, -1 if there is none. Only the uids are compared, nothing is checksummed. */
+static int findSlot(const char* uid) {
+	for (int s = 0; s < STATE_STORE_SERVERS; s++) {
+		if (hasUid(records[2 * s], uid) || hasUid(records[2 * s + 1], uid)) return s;
+	}
+	return -1;
+}
+
+/* Index of the newest valid record of a slot, -1 if neither is */
+static int newestRecord(int slot) {
+	int newest = -1;
+	for (int i = 2 * slot; i < 2 * slot + 2; i++) {
+		if (isValid((size_t)i) && (newest < 0 || records[i].sequence > records[newest].sequence)) newest = i;
+	}
+	return newest;
+}
+
+static void clearRecord(size_t index) {
+	records[index].sequence = 0;
+	checked[index] = RECORD_INVALID;
+}
+
+/* An empty slot, or the one saved longest ago */
+static int freeSlot() {
+	int oldest = 0;
+	uint64 oldest_sequence = UINT64_MAX;
+	for (int s = 0; s < STATE_STORE_SERVERS; s++) {
+		const uint64 last = records[2 * s].sequence > records[2 * s + 1].sequence ? records[2 * s].sequence : records[2 * s + 1].sequence;
+		if (last == 0) return s;
+		if (last < oldest_sequence) {
+			oldest = s;
+			oldest_sequence = last;
+		}
+	}
+	LOG_INFO(0, "State store full, dropping the saved state of '%s'", records[2 * oldest].sequence ? records[2 * oldest].uid : records[2 * oldest + 1].uid);
+	stats.evicted++;
+	clearRecord((size_t)(2 * oldest));
+	clearRecord((size_t)(2 * oldest + 1));
+	return oldest;
+}
+
+/*** Store ***/
+
+void stateStoreSetEnabled(bool e) {
+	enabled = e;
+}
+
+bool stateStoreEnabled() {
+	return enabled;
+}
+
+bool stateStoreOpen(const char* directory) {
+	if (!enabled || mapping) return mapping != NULL;
+	const std::string path = std::string(directory ? directory : "") + STATE_STORE_FILE_NAME;
+	if (!mapFile(path.c_str())) {
+		LOG_WARN(0, "Could not map state file '%s', locks and follows are not saved", path.c_str());
+		unmapFile();
+		return false;
+	}
+	records = (state_record*)(mapping + STATE_STORE_HEADER_SIZE);
+	memset(checked, RECORD_UNCHECKED, sizeof(checked));
+
+	state_store_header* header = (state_store_header*)mapping;
+	const state_store_header expected = expectedHeader();
+	const char* mismatch = headerMismatch(*header, expected);
+	if (mismatch) {
+		// a new file is all zeroes and not worth a warning
+		const bool fresh = memcmp(header->magic, "\0\0\0\0", sizeof(header->magic)) == 0;
+		if (!fresh) {
+			LOG_WARN(0, "State file '%s' does not match (%s), starting over", path.c_str(), mismatch);
+			stats.resets++;
+		}
+		memset(mapping, 0, STATE_STORE_FILE_SIZE);
+		*header = expected;
+		flushRange(mapping, STATE_STORE_FILE_SIZE);
+	}
+
+	sequence = 0;
+	for (size_t i = 0; i < STATE_STORE_RECORDS; i++) {
+		if (records[i].sequence > sequence) sequence = records[i].sequence;
+	}
+	LOG_DEBUG(0, "State file '%s' mapped, last save %llu", path.c_str(), (unsigned long long)sequence);
+	return true;
+}
+
+void stateStoreClose() {
+	unmapFile();
+	records = NULL;
+}
+
+bool stateStoreIsOpen() {
+	return mapping != NULL;
+}
+
+const state_record* stateStoreFind(const char* uid) {
+	if (!mapping) return NULL;
+	const int slot = findSlot(uid);
+	if (slot < 0) return NULL;
+	const int newest = newestRecord(slot);
+	if (newest < 0 || !hasUid(records[newest], uid)) return NULL;
+	stats.restores++;
+	return &records[newest];
+}
+
+state_record* stateStoreBegin(const char* uid) {
+	if (!mapping) return NULL;
+	int slot = findSlot(uid);
+	if (slot < 0) slot = freeSlot();
+
+	// keep the newest complete save of the server, overwrite the other record
+	const int newest = newestRecord(slot);
+	const size_t index = (size_t)(newest == 2 * slot ? 2 * slot + 1 : 2 * slot);
+	if (newest >= 0 && !hasUid(records[newest], uid)) clearRecord((size_t)newest);
+
+	state_record& r = records[index];
+	// empty until committed, a crash while it is filled leaves the previous save in place
+	clearRecord(index);
+	r.checksum = 0;
+	memset(r.uid, 0, sizeof(r.uid));
+	_strcpy(r.uid, sizeof(r.uid), uid);
+	r.lock_count = 0;
+	r.follow_count = 0;
+	r.group_count = 0;
+	r.reserved = 0;
+	return &r;
+}
+
+void stateStoreCommit(state_record* record) {
+	record->sequence = ++sequence;
+	record->checksum = recordChecksum(*record);
+	checked[record - records] = RECORD_VALID;
+	stats.saves++;
+	flushRange(record, offsetof(state_record, locks) + record->lock_count * sizeof(record->locks[0]));
+	flushRange(record->follows, sizeof(record->follows) + record->group_count * sizeof(record->groups[0]));
+}
+
+void stateStoreGetStats(state_store_stats* s) {
+	*s = stats;
+}
+
+void stateStoreResetStats() {
+	stats = state_store_stats();
+}
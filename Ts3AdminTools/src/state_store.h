@@ -0,0 +1,88 @@
+/*
+ * Lock and follow state that survives restarts.
+ *
+ * The locks, locked groups and follow targets of every server are kept in jat_state.jats in the ts3 config folder,
+ * which is memory mapped: saving a server writes its record straight into the mapping and the OS writes it back,
+ * so a crash of the client loses nothing that was saved. Opening the store only checks the header, a server's
+ * record is validated when the server connects and asks for it, nothing is parsed.
+ *
+ * Layout: a fixed header (magic, version, the sizes and capacities the file was made with, checksum) followed by
+ * STATE_STORE_SERVERS slots of two records each. A save overwrites the older record of the server's slot and gives
+ * it the next sequence number and a checksum over what it holds; a record torn by a crash fails its checksum and
+ * the other record, the previous save, is used. Files of another version or layout are started over.
+ *
+ * Not thread safe, the plugin only calls it while holding state_mutex.
+ */
+
+#ifndef STATE_STORE_H
+#define STATE_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "teamspeak/public_definitions.h"
+
+#define STATE_STORE_FILE_NAME "jat_state.jats"
+#define STATE_STORE_MAGIC "JATS"
+#define STATE_STORE_VERSION 1
+#define STATE_STORE_HEADER_SIZE 64
+
+#define STATE_STORE_SERVERS 16   // servers remembered, the one saved longest ago makes room for a new one
+#define STATE_STORE_LOCKS 1024   // locked clients per server, more are not saved
+#define STATE_STORE_FOLLOWS 16
+#define STATE_STORE_GROUPS 64
+#define STATE_STORE_UID_SIZE 64
+
+struct state_lock {
+	uint64 db_id;
+	uint64 channelID;
+};
+
+struct state_group_lock {
+	uint64 groupID;
+	uint32_t type;  // group_type
+	uint32_t reserved;
+};
+
+/* One save of a server, only the first *_count entries of the arrays are used and covered by the checksum */
+struct state_record {
+	uint64 sequence;  // save number over the whole file, 0 = empty
+	uint64 checksum;
+	char uid[STATE_STORE_UID_SIZE];  // virtual server unique identifier, terminated
+	uint32_t lock_count;
+	uint32_t follow_count;
+	uint32_t group_count;
+	uint32_t reserved;
+	state_lock locks[STATE_STORE_LOCKS];
+	uint64 follows[STATE_STORE_FOLLOWS];  // client database ids in priority order
+	state_group_lock groups[STATE_STORE_GROUPS];
+};
+
+struct state_store_stats {
+	uint64 saves;
+	uint64 restores;      // records found for a server
+	uint64 torn;          // records that failed their checksum
+	uint64 evicted;       // servers dropped to make room
+	uint64 resets;        // files started over because their header did not match
+};
+
+/* Switched off, stateStoreOpen does nothing */
+void stateStoreSetEnabled(bool enabled);
+bool stateStoreEnabled();
+
+/* Maps the store in directory, creating it or starting it over if it does not match. False if it can't be mapped. */
+bool stateStoreOpen(const char* directory);
+void stateStoreClose();
+bool stateStoreIsOpen();
+
+/* The last complete save of a server, NULL if there is none. Points into the mapping, valid until the next save. */
+const state_record* stateStoreFind(const char* uid);
+
+/* Record to fill for the next save of a server, with all counts 0. NULL if the store is not open. */
+state_record* stateStoreBegin(const char* uid);
+/* Seals a record from stateStoreBegin, it replaces the server's previous save */
+void stateStoreCommit(state_record* record);
+
+void stateStoreGetStats(state_store_stats* stats);
+void stateStoreResetStats();
+
+#endif
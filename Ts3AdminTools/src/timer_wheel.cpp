@@ -0,0 +1,95 @@
+#include "timer_wheel.h"
+
+#define TIMER_WHEEL_RANGE ((uint64)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+
+static void unlink(timer_wheel& wheel, uint32_t key) {
+	timer_wheel_node& node = wheel.nodes[key];
+	if (node.prev != TIMER_WHEEL_NONE) wheel.nodes[node.prev].next = node.next;
+	else wheel.heads[node.slot] = node.next;
+	if (node.next != TIMER_WHEEL_NONE) wheel.nodes[node.next].prev = node.prev;
+	node.slot = TIMER_WHEEL_NONE;
+	wheel.armed--;
+}
+
+/* Links the node into the lowest wheel that reaches its deadline, seen from the current tick */
+static void place(timer_wheel& wheel, uint32_t key) {
+	timer_wheel_node& node = wheel.nodes[key];
+	const uint64 delta = node.deadline - wheel.now;
+	unsigned int level = 0;
+	while (level + 1 < TIMER_WHEEL_LEVELS && delta >= ((uint64)1 << (TIMER_WHEEL_BITS * (level + 1)))) level++;
+	node.slot = level * TIMER_WHEEL_SLOTS + (uint32_t)((node.deadline >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1));
+	node.prev = TIMER_WHEEL_NONE;
+	node.next = wheel.heads[node.slot];
+	if (node.next != TIMER_WHEEL_NONE) wheel.nodes[node.next].prev = key;
+	wheel.heads[node.slot] = key;
+	wheel.armed++;
+}
+
+void timerWheelInit(timer_wheel& wheel, uint64 tick_ms, uint64 now_ms) {
+	wheel.tick_ms = tick_ms ? tick_ms : 1;
+	wheel.now = now_ms / wheel.tick_ms;
+	wheel.armed = 0;
+	wheel.nodes.clear();
+	wheel.heads.assign(TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS, TIMER_WHEEL_NONE);
+}
+
+void timerWheelSet(timer_wheel& wheel, uint32_t key, uint64 deadline_ms) {
+	if (key >= wheel.nodes.size()) wheel.nodes.resize((size_t)key + 1, timer_wheel_node{ 0, TIMER_WHEEL_NONE, TIMER_WHEEL_NONE, TIMER_WHEEL_NONE });
+	if (wheel.nodes[key].slot != TIMER_WHEEL_NONE) unlink(wheel, key);
+
+	uint64 deadline = (deadline_ms + wheel.tick_ms - 1) / wheel.tick_ms;
+	if (deadline <= wheel.now) deadline = wheel.now + 1;
+	if (deadline - wheel.now >= TIMER_WHEEL_RANGE) deadline = wheel.now + TIMER_WHEEL_RANGE - 1;
+	wheel.nodes[key].deadline = deadline;
+	place(wheel, key);
+}
+
+void timerWheelCancel(timer_wheel& wheel, uint32_t key) {
+	if (key < wheel.nodes.size() && wheel.nodes[key].slot != TIMER_WHEEL_NONE) unlink(wheel, key);
+}
+
+uint64 timerWheelDeadline(const timer_wheel& wheel, uint32_t key) {
+	if (key >= wheel.nodes.size() || wheel.nodes[key].slot == TIMER_WHEEL_NONE) return 0;
+	return wheel.nodes[key].deadline * wheel.tick_ms;
+}
+
+size_t timerWheelAdvance(timer_wheel& wheel, uint64 now_ms, std::vector<uint32_t>& expired) {
+	const uint64 target = now_ms / wheel.tick_ms;
+	size_t count = 0;
+	while (wheel.now < target) {
+		wheel.now++;
+		if (wheel.armed == 0) {
+			// nothing to move down or expire, jump to the end
+			wheel.now = target;
+			break;
+		}
+		// the wheels above move the timers of the slot they turned to down, a wheel only turns when the one below wrapped
+		for (unsigned int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+			const unsigned int shift = TIMER_WHEEL_BITS * level;
+			if ((wheel.now & (((uint64)1 << shift) - 1)) != 0) break;
+			const uint32_t slot = level * TIMER_WHEEL_SLOTS + (uint32_t)((wheel.now >> shift) & (TIMER_WHEEL_SLOTS - 1));
+			uint32_t key = wheel.heads[slot];
+			wheel.heads[slot] = TIMER_WHEEL_NONE;
+			while (key != TIMER_WHEEL_NONE) {
+				const uint32_t next = wheel.nodes[key].next;
+				wheel.armed--;
+				place(wheel, key);
+				key = next;
+			}
+		}
+
+		const uint32_t slot = (uint32_t)(wheel.now & (TIMER_WHEEL_SLOTS - 1));
+		uint32_t key = wheel.heads[slot];
+		wheel.heads[slot] = TIMER_WHEEL_NONE;
+		while (key != TIMER_WHEEL_NONE) {
+			timer_wheel_node& node = wheel.nodes[key];
+			const uint32_t next = node.next;
+			node.slot = TIMER_WHEEL_NONE;
+			wheel.armed--;
+			expired.push_back(key);
+			count++;
+			key = next;
+		}
+	}
+	return count;
+}
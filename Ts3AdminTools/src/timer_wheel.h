@@ -0,0 +1,55 @@
+/*
+ * Hierarchical timer wheel keyed by small integers (client ids).
+ *
+ * TIMER_WHEEL_LEVELS wheels of TIMER_WHEEL_SLOTS slots, the first one a slot per tick, every further one a slot per
+ * turn of the wheel below. A timer goes into the lowest wheel that reaches its deadline and is moved down a wheel
+ * when the wheel below turns over to its slot, the way the Linux kernel's timer wheel works. Setting, moving and
+ * cancelling a timer is O(1), advancing costs one slot per tick plus the timers that expire or move down.
+ *
+ * Every key has at most one timer. The slots are doubly linked lists through a node per key, indexed by key, so
+ * there is no allocation once the largest key has been seen.
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "teamspeak/public_definitions.h"
+
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4  // 64^4 ticks, 194 days with a tick of a second
+#define TIMER_WHEEL_NONE UINT32_MAX
+
+struct timer_wheel_node {
+	uint64 deadline;  // tick
+	uint32_t prev;
+	uint32_t next;
+	uint32_t slot;    // level * TIMER_WHEEL_SLOTS + slot, TIMER_WHEEL_NONE = no timer
+};
+
+struct timer_wheel {
+	uint64 tick_ms = 1000;
+	uint64 now = 0;  // ticks processed
+	size_t armed = 0;
+	std::vector<timer_wheel_node> nodes = std::vector<timer_wheel_node>();  // indexed by key
+	std::vector<uint32_t> heads = std::vector<uint32_t>(TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS, TIMER_WHEEL_NONE);
+};
+
+/* Empties the wheel, ticks of tick_ms start at now_ms */
+void timerWheelInit(timer_wheel& wheel, uint64 tick_ms, uint64 now_ms);
+
+/* Sets or moves the timer of key. Deadlines in the past expire on the next tick, later than the wheels reach on the last tick they reach. */
+void timerWheelSet(timer_wheel& wheel, uint32_t key, uint64 deadline_ms);
+
+void timerWheelCancel(timer_wheel& wheel, uint32_t key);
+
+/* Deadline of the key's timer in ms, 0 if it has none */
+uint64 timerWheelDeadline(const timer_wheel& wheel, uint32_t key);
+
+/* Runs the ticks up to now_ms, appends the keys whose timers expired and returns how many */
+size_t timerWheelAdvance(timer_wheel& wheel, uint64 now_ms, std::vector<uint32_t>& expired);
+
+#endif
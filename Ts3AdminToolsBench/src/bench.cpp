@@ -0,0 +1,79 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+#include "teamspeak/public_definitions.h"
+#include "ts3_functions.h"
+#include "plugin.h"
+#include "move_scheduler.h"
+#include "follow_engine.h"
+#include "state_store.h"
+#include "event_worker.h"
+#include "logging.h"
+#include "afk.h"
+#include "sim/sim_client.h"
+
+void benchReport(const char* name, uint64 ops, double total_ns, const char* fmt, ...) {
+	char detail[256];
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(detail, sizeof(detail), fmt, args);
+	va_end(args);
+
+	const double per_op = ops ? total_ns / (double)ops : 0.0;
+	fprintf(stderr, "%-48s %10llu ops %12.1f ns/op  %s\n", name, (unsigned long long)ops, per_op, detail);
+}
+
+static void freeMenus(struct PluginMenuItem** items) {
+	for (struct PluginMenuItem** it = items; *it; it++) ts3plugin_freeMemory(*it);
+	ts3plugin_freeMemory(items);
+}
+
+static void freeHotkeys(struct PluginHotkey** hotkeys) {
+	for (struct PluginHotkey** it = hotkeys; *it; it++) ts3plugin_freeMemory(*it);
+	ts3plugin_freeMemory(hotkeys);
+}
+
+void benchLoadPlugin(unsigned int event_worker_capacity) {
+	simReset();
+	// the sim is single threaded and has no clock, scenarios that measure the scheduler configure it themselves
+	moveSchedulerSetConfig(move_scheduler_config{ 1e9, 1e9, false });
+	moveSchedulerResetStats();
+	// follow every hop right away like before the follow window, the follow scenario sets a window and polls itself
+	followEngineSetConfig(follow_engine_config{ 0, 0, false });
+	followEngineResetStats();
+	// the sim is not thread safe either, scenarios that pump it from this thread handle move events inline
+	eventWorkerSetConfig(event_worker_config{ event_worker_capacity ? event_worker_capacity : 4096, event_worker_capacity != 0 });
+	eventWorkerResetStats();
+	// no state file in the working directory either, the state scenario opens its own
+	stateStoreSetEnabled(false);
+	stateStoreResetStats();
+	// the AFK scenario skips the clock and ticks the mover itself
+	afkTimerSetThread(false);
+	// no log file in the working directory, stdout is discarded anyway unless --verbose
+	log_config log = logGetConfig();
+	log.file = false;
+	log.console = true;
+	logSetConfig(log);
+	logResetStats();
+	ts3plugin_setFunctionPointers(simGetFunctions());
+	ts3plugin_registerPluginID("bench");
+	ts3plugin_init();
+
+	struct PluginMenuItem** menus = NULL;
+	char* menu_icon = NULL;
+	ts3plugin_initMenus(&menus, &menu_icon);
+	if (menus) freeMenus(menus);
+
+	struct PluginHotkey** hotkeys = NULL;
+	ts3plugin_initHotkeys(&hotkeys);
+	if (hotkeys) freeHotkeys(hotkeys);
+}
+
+void benchUnloadPlugin() {
+	simPump();
+	ts3plugin_shutdown();
+	simReset();
+}
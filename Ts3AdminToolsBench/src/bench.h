@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+#include "teamspeak/public_definitions.h"
+
+struct bench_config {
+	int clients;
+	int channels;
+	int events;
+	unsigned int seed;
+};
+
+struct bench_timer {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	double elapsedNs() const {
+		return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+};
+
+/* Prints one result line: name, number of operations, ns per operation and a free form detail column */
+void benchReport(const char* name, uint64 ops, double total_ns, const char* fmt = "", ...);
+
+/*
+ * Loads the plugin against a fresh simulated client lib. Move events are handled inline unless event_worker_capacity
+ * is given, then they go through a worker thread with a ring of that size and the sim must not be pumped meanwhile.
+ */
+void benchLoadPlugin(unsigned int event_worker_capacity = 0);
+void benchUnloadPlugin();
+
+/* Scenarios */
+void benchClientMoved(const bench_config& cfg);
+void benchMassMove(const bench_config& cfg);
+void benchInfoData(const bench_config& cfg);
+void benchLockTable(const bench_config& cfg);
+void benchServerTabs(const bench_config& cfg);
+void benchMovePipeline(const bench_config& cfg);
+void benchMoveScheduler(const bench_config& cfg);
+void benchMoveDedup(const bench_config& cfg);
+void benchSubtreeMove(const bench_config& cfg);
+void benchServerBackup(const bench_config& cfg);
+void benchDeltaBackup(const bench_config& cfg);
+void benchServerRestore(const bench_config& cfg);
+void benchEventWorker(const bench_config& cfg);
+void benchLogging(const bench_config& cfg);
+void benchMetrics(const bench_config& cfg);
+void benchCommands(const bench_config& cfg);
+void benchGroupLock(const bench_config& cfg);
+void benchFollow(const bench_config& cfg);
+void benchState(const bench_config& cfg);
+void benchOccupancy(const bench_config& cfg);
+void benchLayout(const bench_config& cfg);
+void benchBroadcast(const bench_config& cfg);
+void benchActions(const bench_config& cfg);
+void benchAfk(const bench_config& cfg);
+void benchLoudness(const bench_config& cfg);
+void benchChat(const bench_config& cfg);
+void benchBans(const bench_config& cfg);
@@ -0,0 +1,46 @@
+#include "bench.h"
+
+#include <string.h>
+#include <vector>
+
+#include "actions.h"
+
+#define ACTIONS_BENCH_ROUNDS 200000
+
+/* Keywords of hotkeys that don't exist: prefixes, longer names and names an older version used */
+static const char* unknown_keywords[] = { "Move", "Unlock", "FollowMe", "UnlockLockMovement", "UnlockAllLockMovement", "" };
+
+/* Linear strcmp over the table, what the dispatch did before the hash */
+static action_id linearLookup(const char* keyword) {
+	for (const plugin_action& a : plugin_actions) {
+		if (a.keyword && strcmp(a.keyword, keyword) == 0) return a.id;
+	}
+	return ACTION_COUNT;
+}
+
+static void runLookup(const char* name, action_id (*lookup)(const char*)) {
+	std::vector<const char*> keywords;
+	for (const plugin_action& a : plugin_actions) {
+		if (a.keyword) keywords.push_back(a.keyword);
+	}
+	for (const char* k : unknown_keywords) keywords.push_back(k);
+
+	int wrong = 0;
+	for (const plugin_action& a : plugin_actions) {
+		if (a.keyword) wrong += lookup(a.keyword) != a.id;
+	}
+	for (const char* k : unknown_keywords) wrong += lookup(k) != ACTION_COUNT;
+
+	unsigned int sum = 0;
+	const bench_timer t;
+	for (int round = 0; round < ACTIONS_BENCH_ROUNDS; round++) {
+		for (const char* k : keywords) sum += (unsigned int)lookup(k);
+	}
+	const double ns = t.elapsedNs();
+	benchReport(name, (uint64)ACTIONS_BENCH_ROUNDS * keywords.size(), ns, "keywords=%zu wrong=%d (sum %u)", keywords.size(), wrong, sum);
+}
+
+void benchActions(const bench_config& cfg) {
+	runLookup("hotkey lookup (perfect hash)", actionByKeyword);
+	runLookup("hotkey lookup (linear strcmp)", linearLookup);
+}
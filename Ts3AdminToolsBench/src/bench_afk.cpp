@@ -0,0 +1,193 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <vector>
+
+#include "teamspeak/public_definitions.h"
+#include "teamspeak/public_rare_definitions.h"
+#include "teamspeak/public_errors.h"
+#include "ts3_functions.h"
+#include "plugin.h"
+#include "afk.h"
+#include "sim/sim_client.h"
+
+#define AFK_BENCH_IDLE_MINUTES 10
+#define AFK_BENCH_AWAY_SECONDS 60
+#define AFK_BENCH_TICKS 600
+
+static uint64 afkChannel(sim_server& server) {
+	return server.channel_ids.back();
+}
+
+static void enableMover(uint64 sch, sim_server& server) {
+	char command[96];
+	snprintf(command, sizeof(command), "afk %llu %d away %d", (unsigned long long)afkChannel(server), AFK_BENCH_IDLE_MINUTES, AFK_BENCH_AWAY_SECONDS);
+	ts3plugin_processCommand(sch, command);
+}
+
+static bool movable(sim_server& server, anyID id) {
+	return id != server.own_client && server.clients[id].connected && server.clients[id].channel != afkChannel(server);
+}
+
+/* Talk and away events, with the mover every one of them moves a deadline */
+static void runEventCost(const bench_config& cfg, bool enabled) {
+	benchLoadPlugin();
+	const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+	sim_server& server = *simGetServer(sch);
+	if (enabled) enableMover(sch, server);
+
+	for (int i = 0; i < cfg.events; i++) {
+		const anyID client = simRandomClient(server);
+		switch (server.rng() % 4) {
+		case 0:
+			simClientUpdate(sch, client, CLIENT_AWAY, !server.clients[client].away);
+			break;
+		case 1:
+			simClientUpdate(sch, client, CLIENT_OUTPUT_MUTED, !server.clients[client].output_muted);
+			break;
+		default:
+			simClientTalk(sch, client, !server.clients[client].talking);
+			break;
+		}
+	}
+	const size_t queued = simPendingEvents();
+
+	const bench_timer t;
+	simPump();
+	const double ns = t.elapsedNs();
+	benchReport(enabled ? "talk/away events (mover on)" : "talk/away events (mover off)", queued, ns);
+	benchUnloadPlugin();
+}
+
+/* What a mover without deadlines does every tick: read every client's state */
+static size_t scanClients(uint64 sch) {
+	const TS3Functions f = simGetFunctions();
+	anyID* clients;
+	if (f.getClientList(sch, &clients) != ERROR_ok) return 0;
+	size_t idle = 0;
+	for (const anyID* it = clients; *it; it++) {
+		int away = 0, muted = 0, talking = 0;
+		f.getClientVariableAsInt(sch, *it, CLIENT_AWAY, &away);
+		f.getClientVariableAsInt(sch, *it, CLIENT_OUTPUT_MUTED, &muted);
+		f.getClientVariableAsInt(sch, *it, CLIENT_FLAG_TALKING, &talking);
+		idle += away || muted || !talking;
+	}
+	f.freeMemory(clients);
+	return idle;
+}
+
+/* Ticks where no deadline runs out, the wheel against a scan of the client list */
+static void runTickCost(const bench_config& cfg) {
+	benchLoadPlugin();
+	const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+	sim_server& server = *simGetServer(sch);
+	enableMover(sch, server);
+
+	simResetCounters();
+	bench_timer t;
+	for (int i = 0; i < AFK_BENCH_TICKS; i++) {
+		afkSkipClock(AFK_TICK_MS);
+		moveIdleClients();
+	}
+	benchReport("idle tick (timer wheel)", AFK_BENCH_TICKS, t.elapsedNs(), "clients=%d lib calls=%llu moves=%llu",
+		cfg.clients, (unsigned long long)simCounters().client_lib_calls, (unsigned long long)simCounters().move_requests);
+
+	simResetCounters();
+	size_t idle = 0;
+	t = bench_timer();
+	for (int i = 0; i < AFK_BENCH_TICKS; i++) idle += scanClients(sch);
+	benchReport("idle tick (client list scan)", AFK_BENCH_TICKS, t.elapsedNs(), "clients=%d lib calls=%llu (idle %zu)",
+		cfg.clients, (unsigned long long)simCounters().client_lib_calls, idle);
+	benchUnloadPlugin();
+}
+
+/*
+ * A quarter of the clients goes away, half of the others talk after 5 minutes. The away ones are moved after the
+ * away time, the quiet ones after the idle time, and everyone in the AFK channel who talks again goes back home.
+ */
+static void runExpiry(const bench_config& cfg) {
+	benchLoadPlugin();
+	const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+	sim_server& server = *simGetServer(sch);
+	const uint64 afk = afkChannel(server);
+	enableMover(sch, server);
+
+	std::vector<uint64> home(server.clients.size(), 0);
+	int expected_away = 0;
+	int expected_idle = 0;
+	for (anyID id = 1; id < server.clients.size(); id++) {
+		if (!movable(server, id)) continue;
+		home[id] = server.clients[id].channel;
+		if (id % 4 == 0) {
+			simClientUpdate(sch, id, CLIENT_AWAY, true);
+			expected_away++;
+		}
+		else if (id % 2 == 0) {
+			expected_idle++;
+		}
+	}
+	simPump();
+
+	// the away clients after the away time
+	afkSkipClock((AFK_BENCH_AWAY_SECONDS + 1) * 1000);
+	simResetCounters();
+	bench_timer t;
+	moveIdleClients();
+	double ns = t.elapsedNs();
+	simPump();
+	int moved = 0;
+	int wrong = 0;
+	for (anyID id = 1; id < server.clients.size(); id++) {
+		if (!home[id] || server.clients[id].channel != afk) continue;
+		moved++;
+		wrong += id % 4 != 0;
+	}
+	benchReport("away clients expire", (uint64)expected_away, ns, "moved=%d/%d wrong=%d", moved, expected_away, wrong);
+
+	// the quiet ones after the idle time
+	afkSkipClock(4 * 60000);
+	for (anyID id = 1; id < server.clients.size(); id++) {
+		if (home[id] && id % 2 == 1) simClientTalk(sch, id, true);
+	}
+	simPump();
+	afkSkipClock((AFK_BENCH_IDLE_MINUTES - 5) * 60000 + 1000);
+	simResetCounters();
+	t = bench_timer();
+	moveIdleClients();
+	ns = t.elapsedNs();
+	simPump();
+	moved = 0;
+	wrong = 0;
+	for (anyID id = 1; id < server.clients.size(); id++) {
+		if (!home[id] || server.clients[id].channel != afk || id % 4 == 0) continue;
+		moved++;
+		wrong += id % 2 != 0;
+	}
+	benchReport("idle clients expire", (uint64)expected_idle, ns, "moved=%d/%d wrong=%d", moved, expected_idle, wrong);
+
+	// everyone in the AFK channel comes back
+	std::vector<anyID> returning;
+	for (anyID id = 1; id < server.clients.size(); id++) {
+		if (home[id] && server.clients[id].channel == afk) returning.push_back(id);
+	}
+	for (anyID id : returning) {
+		if (id % 4 == 0) simClientUpdate(sch, id, CLIENT_AWAY, false);
+		else simClientTalk(sch, id, true);
+	}
+	const size_t queued = simPendingEvents();
+	t = bench_timer();
+	simPump(queued);
+	ns = t.elapsedNs();
+	simPump();
+	int back = 0;
+	for (anyID id : returning) back += server.clients[id].channel == home[id];
+	benchReport("clients return", queued, ns, "back home=%d/%zu", back, returning.size());
+	benchUnloadPlugin();
+}
+
+void benchAfk(const bench_config& cfg) {
+	runEventCost(cfg, false);
+	runEventCost(cfg, true);
+	runTickCost(cfg);
+	runExpiry(cfg);
+}
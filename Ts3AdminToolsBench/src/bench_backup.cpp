@@ -0,0 +1,219 @@
+#include "bench.h"
+
+#include <stdio.h>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include "teamspeak/public_definitions.h"
+#include "server_backup.h"
+#include "server_restore.h"
+#include "snapshot.h"
+#include "sim/sim_client.h"
+
+#define BACKUP_BENCH_FILE "TS3AdminToolsBench_backup.jatb"
+#define BACKUP_BENCH_DELTA_FILE "TS3AdminToolsBench_backup_delta.jatb"
+#define BACKUP_BENCH_CHECK_FILE "TS3AdminToolsBench_backup_check.jatb"
+#define BENCH_RTT_MS 50.0
+
+/* Peak resident set size of the process in KiB, 0 where unknown */
+static long peakRssKb() {
+#ifndef _WIN32
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0) return usage.ru_maxrss;
+#endif
+	return 0;
+}
+
+/* Reads the snapshot back, counts records per type and checks the end record */
+static bool verifySnapshot(const char* path, uint64* records, uint64* perms) {
+	snapshot_reader r;
+	if (!snapshotOpen(&r, path)) return false;
+	*records = 0;
+	*perms = 0;
+	bool complete = false;
+	char text[SNAPSHOT_MAX_STRING + 1];
+	while (snapshotNextRecord(&r)) {
+		switch (r.type) {
+		case SNAPSHOT_END:
+			complete = snapshotGetUInt(&r) == *records;
+			break;
+		case SNAPSHOT_SERVER_GROUP_PERM:
+		case SNAPSHOT_CHANNEL_GROUP_PERM:
+		case SNAPSHOT_CHANNEL_PERM:
+			snapshotGetUInt(&r);
+			snapshotGetUInt(&r);
+			snapshotGetInt(&r);
+			snapshotGetUInt(&r);
+			(*perms)++;
+			break;
+		case SNAPSHOT_CHANNEL:
+			snapshotGetUInt(&r);
+			snapshotGetUInt(&r);
+			snapshotGetUInt(&r);
+			snapshotGetString(&r, text, sizeof(text));
+			break;
+		default:
+			break;
+		}
+		(*records)++;
+	}
+	const bool ok = complete && !r.failed;
+	snapshotClose(&r);
+	return ok;
+}
+
+/* Server with 5000 channels of 10 permissions each, 50 groups of 100 permissions and 1000 bans */
+static uint64 addBackupServer(const bench_config& cfg, unsigned int perms_per_channel) {
+	const uint64 sch = simAddServer(5000, cfg.clients, cfg.seed);
+	sim_server& server = *simGetServer(sch);
+	server.server_groups = 40;
+	server.channel_groups = 10;
+	server.perms_per_group = 100;
+	server.perms_per_channel = perms_per_channel;
+	server.bans = 1000;
+	return sch;
+}
+
+/* Runs a backup to completion, returns the rounds (round trips) it took */
+static uint64 runBackup(uint64 sch, const char* path, const char* base, backup_result* result) {
+	if (!backupStart(sch, path, base)) return 0;
+	uint64 rounds = 0;
+	while (backupBusy(sch) && simPumpRound()) rounds++;
+	*result = backup_result();
+	backupLastResult(sch, result);
+	return rounds;
+}
+
+static uint64 permRows(const backup_result& result) {
+	return result.rows[BACKUP_SECTION_SERVER_GROUP_PERMS] + result.rows[BACKUP_SECTION_CHANNEL_GROUP_PERMS] + result.rows[BACKUP_SECTION_CHANNEL_PERMS];
+}
+
+void benchServerBackup(const bench_config& cfg) {
+	struct backup_case {
+		unsigned int perms_per_channel;
+		unsigned int max_in_flight;
+	};
+	const backup_case cases[] = {
+		{ 10, 1 },
+		{ 10, 8 },
+		{ 10, 32 },
+		{ 100, 8 },
+	};
+
+	for (const backup_case& c : cases) {
+		benchLoadPlugin();
+		backupSetConfig(backup_config{ c.max_in_flight });
+		const uint64 sch = addBackupServer(cfg, c.perms_per_channel);
+
+		simResetCounters();
+		const long rss_before = peakRssKb();
+		backup_result result;
+		bench_timer t;
+		const uint64 rounds = runBackup(sch, BACKUP_BENCH_FILE, NULL, &result);
+		const double ns = t.elapsedNs();
+		const long rss_after = peakRssKb();
+		uint64 rows = 0;
+		for (int s = 0; s < BACKUP_SECTION_COUNT; s++) rows += result.rows[s];
+
+		uint64 records = 0, perms = 0;
+		t = bench_timer();
+		const bool valid = verifySnapshot(BACKUP_BENCH_FILE, &records, &perms);
+		const double read_ns = t.elapsedNs();
+
+		char name[64];
+		snprintf(name, sizeof(name), "backup (5000 channels, %u perms each, window %u)", c.perms_per_channel, c.max_in_flight);
+		benchReport(name, rows, ns, "rounds=%llu bytes=%llu (%.1f B/row) peak rss +%ld KiB complete=%d",
+			(unsigned long long)rounds, (unsigned long long)result.bytes, rows ? (double)result.bytes / rows : 0.0,
+			rss_after - rss_before, result.complete ? 1 : 0);
+		benchReport("  read back", records, read_ns, "perms=%llu valid=%d", (unsigned long long)perms, valid ? 1 : 0);
+
+		remove(BACKUP_BENCH_FILE);
+		benchUnloadPlugin();
+	}
+}
+
+void benchDeltaBackup(const bench_config& cfg) {
+	benchLoadPlugin();
+	backupSetConfig(backup_config{ 32 });
+	const uint64 sch = addBackupServer(cfg, 10);
+	sim_server& server = *simGetServer(sch);
+
+	backup_result full;
+	runBackup(sch, BACKUP_BENCH_FILE, NULL, &full);
+
+	// an hour on a quiet server: a few permission edits, some channels created and deleted
+	for (int i = 0; i < 50; i++) server.perm_offsets[simRandomChannel(server)] += 1 + i;
+	for (int i = 0; i < 10; i++) {
+		// the newest channels are leaves
+		simChannelDelete(sch, server.channel_ids.back());
+		simPump();
+	}
+	for (int i = 0; i < 20; i++) simChannelCreate(sch, simRandomChannel(server));
+	simPump();
+
+	backup_result delta;
+	bench_timer t;
+	const uint64 rounds = runBackup(sch, BACKUP_BENCH_DELTA_FILE, BACKUP_BENCH_FILE, &delta);
+	const double ns = t.elapsedNs();
+	uint64 rows = 0;
+	for (int s = 0; s < BACKUP_SECTION_COUNT; s++) rows += delta.rows[s];
+	benchReport("delta backup (50 lists edited, +20/-10 channels)", rows, ns, "rounds=%llu bytes=%llu vs full %llu, unchanged=%llu removed=%llu complete=%d",
+		(unsigned long long)rounds, (unsigned long long)delta.bytes, (unsigned long long)full.bytes,
+		(unsigned long long)delta.unchanged, (unsigned long long)delta.removed, delta.complete ? 1 : 0);
+
+	// restoring full + delta has to add exactly what a fresh full backup holds
+	backup_result check;
+	runBackup(sch, BACKUP_BENCH_CHECK_FILE, NULL, &check);
+	simResetCounters();
+	const std::vector<std::string> chain = { BACKUP_BENCH_FILE, BACKUP_BENCH_DELTA_FILE };
+	restoreStart(sch, chain);
+	while (restoreBusy(sch) && simPumpRound()) {}
+	restore_result restored = {};
+	restoreLastResult(sch, &restored);
+	benchReport("  restore full + delta", restored.rows, restored.duration_ms * 1e6, "perms added=%llu, fresh full backup has %llu, superseded=%llu",
+		(unsigned long long)simCounters().perms_added, (unsigned long long)permRows(check), (unsigned long long)restored.superseded);
+
+	remove(BACKUP_BENCH_FILE);
+	remove(BACKUP_BENCH_DELTA_FILE);
+	remove(BACKUP_BENCH_CHECK_FILE);
+	benchUnloadPlugin();
+}
+
+void benchServerRestore(const bench_config& cfg) {
+	const restore_config cases[] = {
+		{ 1, 1 },    // one request per permission, one at a time
+		{ 8, 1 },
+		{ 8, 100 },
+		{ 32, 100 },
+	};
+
+	benchLoadPlugin();
+	backupSetConfig(backup_config{ 32 });
+	const uint64 sch = addBackupServer(cfg, 10);
+	backup_result full;
+	runBackup(sch, BACKUP_BENCH_FILE, NULL, &full);
+
+	for (const restore_config& c : cases) {
+		restoreSetConfig(c);
+		simResetCounters();
+		const std::vector<std::string> chain = { BACKUP_BENCH_FILE };
+		bench_timer t;
+		uint64 rounds = 0;
+		restoreStart(sch, chain);
+		while (restoreBusy(sch) && simPumpRound()) rounds++;
+		const double ns = t.elapsedNs();
+		restore_result result = {};
+		restoreLastResult(sch, &result);
+
+		char name[64];
+		snprintf(name, sizeof(name), "restore %llu perms (window %u, batch %u)", (unsigned long long)permRows(full), c.max_in_flight, c.batch_size);
+		benchReport(name, result.rows, ns, "requests=%llu rounds=%llu ~%.1f s at %.0f ms rtt, failed=%u complete=%d",
+			(unsigned long long)simCounters().perm_requests, (unsigned long long)rounds, rounds * BENCH_RTT_MS / 1000.0, BENCH_RTT_MS,
+			result.failed_requests, result.complete ? 1 : 0);
+	}
+
+	remove(BACKUP_BENCH_FILE);
+	benchUnloadPlugin();
+}
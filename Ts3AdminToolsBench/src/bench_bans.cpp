@@ -0,0 +1,273 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "teamspeak/public_definitions.h"
+#include "ts3_functions.h"
+#include "plugin.h"
+#include "ban_cache.h"
+#include "sim/sim_client.h"
+
+#define BANS_BENCH_QUERIES 20000
+#define BANS_BENCH_NAIVE_QUERIES 2000
+#define BANS_BENCH_HIT_PERCENT 5
+#define BANS_BENCH_JOINS 400
+
+/* A generated ban: one field, a literal or a literal prefix, the way the cache reads it */
+struct bench_ban {
+	ban_field field;
+	std::string key;  // names lower case
+	bool prefix;
+};
+
+struct bench_client {
+	std::string uid;
+	std::string ip;
+	std::string name;
+};
+
+static std::string randomUid(std::mt19937& rng) {
+	static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	std::string uid(27, 'A');
+	for (char& c : uid) c = alphabet[rng() % 64];
+	return uid + "=";
+}
+
+static std::string randomIp(std::mt19937& rng, unsigned int first) {
+	return std::to_string(first) + "." + std::to_string(rng() % 256) + "." + std::to_string(rng() % 256) + "." + std::to_string(rng() % 256);
+}
+
+/* Unique identifiers, single addresses, /24 ranges, nicknames and nickname prefixes in equal parts */
+static void generateBans(size_t count, unsigned int seed, std::vector<bench_ban>& bans, ban_cache& cache) {
+	std::mt19937 rng(seed);
+	for (size_t i = 0; i < count; i++) {
+		bench_ban b;
+		std::string ip;
+		std::string name;
+		std::string uid;
+		switch (i % 5) {
+		case 0:
+			b = bench_ban{ BAN_FIELD_UID, randomUid(rng), false };
+			uid = b.key;
+			break;
+		case 1:
+			b = bench_ban{ BAN_FIELD_IP, randomIp(rng, 10), false };
+			ip = b.key;
+			break;
+		case 2: {
+			const std::string range = randomIp(rng, 172);
+			b = bench_ban{ BAN_FIELD_IP, range.substr(0, range.rfind('.') + 1), true };
+			// the way the server shows a range, as an expression
+			for (char c : b.key) ip += c == '.' ? std::string("\\.") : std::string(1, c);
+			ip += ".*";
+			break;
+		}
+		case 3:
+			b = bench_ban{ BAN_FIELD_NAME, "troll" + std::to_string(i), false };
+			name = "Troll" + std::to_string(i);
+			break;
+		default:
+			b = bench_ban{ BAN_FIELD_NAME, "spam" + std::to_string(i) + "_", true };
+			name = "^spam" + std::to_string(i) + "_.*";
+			break;
+		}
+		bans.push_back(b);
+		banCacheAdd(cache, i + 1, ip.c_str(), name.c_str(), uid.c_str(), 0, 0);
+	}
+}
+
+/* Random clients, every one in BANS_BENCH_HIT_PERCENT is caught by one of the bans */
+static std::vector<bench_client> generateClients(const std::vector<bench_ban>& bans, size_t count, unsigned int seed) {
+	std::mt19937 rng(seed);
+	std::vector<bench_client> clients;
+	for (size_t i = 0; i < count; i++) {
+		bench_client c = bench_client{ randomUid(rng), randomIp(rng, rng() % 2 ? 10 : 172), "Player" + std::to_string(rng() % 100000) };
+		if (rng() % 100 < BANS_BENCH_HIT_PERCENT) {
+			const bench_ban& b = bans[rng() % bans.size()];
+			std::string value = b.prefix ? b.key + std::to_string(rng() % 256) : b.key;
+			if (b.field == BAN_FIELD_UID) c.uid = value;
+			else if (b.field == BAN_FIELD_IP) c.ip = value;
+			else c.name = value;
+		}
+		clients.push_back(c);
+	}
+	return clients;
+}
+
+static bool matches(const bench_ban& b, const std::string& value) {
+	return b.prefix ? value.compare(0, b.key.size(), b.key) == 0 : value == b.key;
+}
+
+/* Every ban against the client, what a plugin without an index does with the list */
+static bool naiveFind(const std::vector<bench_ban>& bans, const bench_client& c) {
+	std::string name = c.name;
+	std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+	for (const bench_ban& b : bans) {
+		if (matches(b, b.field == BAN_FIELD_UID ? c.uid : (b.field == BAN_FIELD_IP ? c.ip : name))) return true;
+	}
+	return false;
+}
+
+static void runLookup(const bench_config& cfg, size_t count) {
+	std::vector<bench_ban> bans;
+	ban_cache cache;
+	bench_timer t;
+	generateBans(count, cfg.seed, bans, cache);
+	const double build_ns = t.elapsedNs();
+	const std::vector<bench_client> clients = generateClients(bans, BANS_BENCH_QUERIES, cfg.seed + 1);
+
+	ban_field field;
+	int wrong = 0;
+	for (size_t i = 0; i < BANS_BENCH_NAIVE_QUERIES; i++) {
+		const bench_client& c = clients[i];
+		wrong += (banCacheFind(cache, c.uid.c_str(), c.ip.c_str(), c.name.c_str(), 0, &field) != NULL) != naiveFind(bans, c);
+	}
+
+	int found = 0;
+	t = bench_timer();
+	for (const bench_client& c : clients) found += banCacheFind(cache, c.uid.c_str(), c.ip.c_str(), c.name.c_str(), 0, &field) != NULL;
+	const double ns = t.elapsedNs();
+	char name[64];
+	snprintf(name, sizeof(name), "ban lookup (index, %zu bans)", count);
+	benchReport(name, clients.size(), ns, "banned=%d wrong=%d trie nodes=%zu+%zu build=%.1f ms unindexed=%zu",
+		found, wrong, cache.ip_trie.size(), cache.name_trie.size(), build_ns / 1e6, cache.unindexed);
+
+	int naive_found = 0;
+	t = bench_timer();
+	for (size_t i = 0; i < BANS_BENCH_NAIVE_QUERIES; i++) naive_found += naiveFind(bans, clients[i]);
+	snprintf(name, sizeof(name), "ban lookup (scan, %zu bans)", count);
+	benchReport(name, BANS_BENCH_NAIVE_QUERIES, t.elapsedNs(), "banned=%d", naive_found);
+}
+
+/* A refresh of 100000 bans where the 100 oldest were lifted, 100 added and about 100 edited, against building the cache anew */
+static void runRefresh(const bench_config& cfg) {
+	const size_t count = 100000;
+	const int rounds = 10;
+	std::vector<std::string> uids(count + rounds * 100);
+	std::mt19937 rng(cfg.seed);
+	for (std::string& uid : uids) uid = randomUid(rng);
+	ban_cache cache;
+	for (size_t i = 0; i < count; i++) banCacheAdd(cache, i + 1, "", "", uids[i].c_str(), 0, 0);
+
+	const bench_timer t;
+	size_t dropped = 0;
+	size_t added = 0;
+	for (int round = 0; round < rounds; round++) {
+		banCacheBeginRefresh(cache);
+		const size_t first = (size_t)(round + 1) * 100;
+		for (size_t i = first; i < first + count; i++) {
+			const bool edited = i % 1000 == (size_t)round;
+			banCacheAdd(cache, i + 1, "", edited ? "edited" : "", uids[i].c_str(), 0, 0);
+		}
+		dropped += banCacheEndRefresh(cache);
+		added += cache.added;
+	}
+	const double ns = t.elapsedNs();
+	benchReport("ban list refresh (100000 rows)", rounds, ns, "dropped=%zu new or edited=%zu per refresh, live=%zu dead=%zu",
+		dropped / rounds, added / rounds, cache.live, cache.dead);
+
+	const bench_timer full;
+	for (int round = 0; round < rounds; round++) {
+		ban_cache fresh;
+		for (size_t i = 0; i < count; i++) banCacheAdd(fresh, i + 1, "", "", uids[i].c_str(), 0, 0);
+	}
+	benchReport("ban list rebuild (100000 rows)", rounds, full.elapsedNs());
+}
+
+static bool isAdmin(const sim_client& client) {
+	return std::find(client.server_groups.begin(), client.server_groups.end(), (uint64)SIM_ADMIN_GROUP) != client.server_groups.end();
+}
+
+/*
+ * The plugin with /jat bans on a server with 2000 listed bans and a few ranges and name patterns. Clients leave and
+ * come back, some of them with a banned identity, then a client is banned while the cache is up and comes back.
+ */
+static void runJoins(const bench_config& cfg) {
+	benchLoadPlugin();
+	const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+	sim_server& server = *simGetServer(sch);
+	server.bans = 2000;
+	server.ban_rules.push_back(sim_ban{ 3001, "172\\.16\\.5\\..*", "", "", 0 });
+	server.ban_rules.push_back(sim_ban{ 3002, "", "^spammer.*", "", 0 });
+	server.ban_rules.push_back(sim_ban{ 3003, "", "(?i).*idiot.*", "", 0 });  // an expression the cache leaves alone
+	server.ban_rules.push_back(sim_ban{ 3004, "", "", "expired=", 60 });
+	ts3plugin_processCommand(sch, "bans every 10");
+	simPump();
+
+	std::mt19937 rng(cfg.seed);
+	std::vector<anyID> joiners;
+	for (anyID id = 2; id < server.clients.size() && joiners.size() < BANS_BENCH_JOINS; id++) {
+		if (id != server.own_client && !isAdmin(server.clients[id])) joiners.push_back(id);
+	}
+	int expected = 0;
+	for (size_t i = 0; i < joiners.size(); i++) {
+		sim_client& client = server.clients[joiners[i]];
+		switch (i % 20) {
+		case 0:  // an odd generated ban, the even ones ran out
+			client.uid = "uid" + std::to_string(1 + 2 * (rng() % 1000)) + "=";
+			expected++;
+			break;
+		case 1:
+			client.ip = "10.0." + std::to_string(rng() % 7) + "." + std::to_string(1 + 2 * (rng() % 128));
+			expected++;
+			break;
+		case 2:
+			client.ip = "172.16.5." + std::to_string(rng() % 256);
+			expected++;
+			break;
+		case 3:
+			client.nickname = "SpammerBot" + std::to_string(i);
+			expected++;
+			break;
+		case 4:
+			client.nickname = "the idiot";  // left to the server
+			break;
+		case 5:
+			client.uid = "expired=";  // not yet
+			expected++;
+			break;
+		default:
+			break;
+		}
+		simClientLeave(sch, joiners[i]);
+	}
+	simPump();
+	simResetCounters();
+
+	const bench_timer t;
+	for (anyID id : joiners) simClientJoin(sch, id, simRandomChannel(server));
+	simPump();
+	const double ns = t.elapsedNs();
+	const uint64 kicks = simCounters().kick_requests;
+	uint64 gone = 0;
+	for (anyID id : joiners) gone += !server.clients[id].connected;
+	benchReport("join with ban check", joiners.size(), ns, "kicked=%llu/%d gone=%llu", (unsigned long long)kicks, expected, (unsigned long long)gone);
+
+	// banned while the cache is up: the ban event refreshes it before the client is back
+	const anyID banned = joiners[joiners.size() - 1];
+	server.ban_rules.push_back(sim_ban{ 3005, "", "", "client" + std::to_string(banned) + "=", 0 });
+	simClientLeave(sch, banned);
+	simPump();
+	ts3plugin_onClientBanFromServerEvent(sch, banned, 0, 0, 0, 1, "sim", "sim=", 0, "");
+	simPump();
+	simResetCounters();
+	const bench_timer rejoin;
+	simClientJoin(sch, banned, simRandomChannel(server));
+	simPump();
+	benchReport("join after a new ban", 1, rejoin.elapsedNs(), "kicked=%llu/1", (unsigned long long)simCounters().kick_requests);
+	benchUnloadPlugin();
+}
+
+void benchBans(const bench_config& cfg) {
+	runLookup(cfg, 1000);
+	runLookup(cfg, 10000);
+	runLookup(cfg, 100000);
+	runRefresh(cfg);
+	runJoins(cfg);
+}
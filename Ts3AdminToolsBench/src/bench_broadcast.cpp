@@ -0,0 +1,130 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "teamspeak/public_definitions.h"
+#include "ts3_functions.h"
+#include "plugin.h"
+#include "move_scheduler.h"
+#include "mass_move.h"
+#include "sim/sim_client.h"
+
+#define BROADCAST_BENCH_SERVERS 4
+#define BROADCAST_BENCH_CLIENTS 250
+#define BROADCAST_BENCH_FLOOD_LIMIT 10
+#define BROADCAST_BENCH_ROUND_MS 5
+
+static const char* broadcast_command = "all move channel \"Lobby\" to \"Stage\"";
+
+/* The lobby and the stage have different ids on every server, everyone but the own client waits in the lobby */
+static std::vector<uint64> addServers(const bench_config& cfg, std::vector<uint64>& stages) {
+	std::vector<uint64> servers;
+	const int clients = cfg.clients / BROADCAST_BENCH_SERVERS < BROADCAST_BENCH_CLIENTS ? cfg.clients / BROADCAST_BENCH_SERVERS : BROADCAST_BENCH_CLIENTS;
+	for (int i = 0; i < BROADCAST_BENCH_SERVERS; i++) {
+		const uint64 sch = simAddServer(cfg.channels, clients, cfg.seed + i);
+		sim_server& server = *simGetServer(sch);
+		server.flood_limit = BROADCAST_BENCH_FLOOD_LIMIT;
+		const uint64 lobby = 2 + i;
+		const uint64 stage = 10 + 2 * i;
+		server.channels[lobby].name = "Lobby";
+		server.channels[stage].name = "Stage";
+		for (anyID id = 1; id < server.clients.size(); id++) {
+			if (id != server.own_client) simPlaceClient(sch, id, lobby);
+		}
+		servers.push_back(sch);
+		stages.push_back(stage);
+	}
+	return servers;
+}
+
+/* Rounds of the server until nothing is left to send or answer */
+static int pumpUntilDone() {
+	int rounds = 0;
+	while (simPendingEvents() > 0 || moveSchedulerQueued() > 0) {
+		const auto round_start = std::chrono::steady_clock::now();
+		simPumpRound();
+		moveSchedulerPoll();
+		rounds++;
+		while (std::chrono::steady_clock::now() - round_start < std::chrono::milliseconds(BROADCAST_BENCH_ROUND_MS)) {
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+		}
+	}
+	return rounds;
+}
+
+static void countStages(const std::vector<uint64>& servers, const std::vector<uint64>& stages, size_t* moved, size_t* clients) {
+	*moved = 0;
+	*clients = 0;
+	for (size_t i = 0; i < servers.size(); i++) {
+		const sim_server& server = *simGetServer(servers[i]);
+		*clients += server.clients.size() - 2;
+		for (anyID id : server.channels.at(stages[i]).clients) *moved += id != server.own_client;
+	}
+}
+
+/*
+ * The same mass move on every server, typed once with 'all' or once per tab with each tab waiting for the one before.
+ * With 'all' the servers' token buckets drain side by side, so it takes the round trips of one server instead of the sum.
+ */
+static void runMassMove(const bench_config& cfg, bool broadcast) {
+	benchLoadPlugin();
+	const double rate = 0.8 * BROADCAST_BENCH_FLOOD_LIMIT * 1000.0 / BROADCAST_BENCH_ROUND_MS;
+	moveSchedulerSetConfig(move_scheduler_config{ rate, 0.8 * BROADCAST_BENCH_FLOOD_LIMIT, false });
+	std::vector<uint64> stages;
+	const std::vector<uint64> servers = addServers(cfg, stages);
+	simResetCounters();
+
+	const bench_timer t;
+	int rounds = 0;
+	if (broadcast) {
+		ts3plugin_processCommand(servers[0], broadcast_command);
+		rounds = pumpUntilDone();
+	}
+	else {
+		for (uint64 sch : servers) {
+			// without 'all' the command runs on its own tab only
+			ts3plugin_processCommand(sch, broadcast_command + 4);
+			rounds += pumpUntilDone();
+		}
+	}
+	const double ns = t.elapsedNs();
+
+	size_t moved, clients;
+	countStages(servers, stages, &moved, &clients);
+	char name[64];
+	snprintf(name, sizeof(name), "%s (%d servers, flood limit=%d)", broadcast ? "all servers at once" : "one tab at a time",
+		BROADCAST_BENCH_SERVERS, BROADCAST_BENCH_FLOOD_LIMIT);
+	benchReport(name, (uint64)clients, ns, "round trips=%d moved=%zu/%zu flooded=%llu", rounds, moved, clients,
+		(unsigned long long)simCounters().move_requests_failed);
+	benchUnloadPlugin();
+}
+
+/* Cost of the broadcast itself: checking the batch once, resolving the names and planning the moves on every server */
+static void runDispatch(const bench_config& cfg) {
+	benchLoadPlugin();
+	std::vector<uint64> stages;
+	const std::vector<uint64> servers = addServers(cfg, stages);
+	simResetCounters();
+
+	const bench_timer t;
+	ts3plugin_processCommand(servers[0], broadcast_command);
+	const double ns = t.elapsedNs();
+	const uint64 lib_calls = simCounters().client_lib_calls - simCounters().move_requests;
+	simPump();
+
+	size_t moved, clients;
+	countStages(servers, stages, &moved, &clients);
+	benchReport("broadcast dispatch (unthrottled)", (uint64)servers.size(), ns, "lib calls=%llu moved=%zu/%zu",
+		(unsigned long long)lib_calls, moved, clients);
+	benchUnloadPlugin();
+}
+
+void benchBroadcast(const bench_config& cfg) {
+	runDispatch(cfg);
+	runMassMove(cfg, false);
+	runMassMove(cfg, true);
+}
@@ -0,0 +1,702 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <string>
+
+#include "teamspeak/public_definitions.h"
+#include "ts3_functions.h"
+#include "plugin.h"
+#include "mass_move.h"
+#include "move_scheduler.h"
+#include "move_history.h"
+#include "event_worker.h"
+#include "metrics.h"
+#include "sim/sim_client.h"
+
+/*
+ * Queues a realistic storm on server sch: mostly clients switching channels themselves, some being
+ * moved around by another admin and a few reconnecting.
+ */
+static void queueStorm(uint64 sch, int events) {
+	sim_server& server = *simGetServer(sch);
+	for (int i = 0; i < events; i++) {
+		const anyID client = simRandomClient(server);
+		const unsigned int roll = server.rng() % 100;
+		if (roll < 85) {
+			simClientSwitchChannel(sch, client, simRandomChannel(server));
+		}
+		else if (roll < 95) {
+			simClientMovedBy(sch, client, simRandomChannel(server), simRandomClient(server));
+		}
+		else {
+			simClientLeave(sch, client);
+			simClientJoin(sch, client, simRandomChannel(server));
+		}
+	}
+}
+
+static void runStorm(const bench_config& cfg, int locked, bool follow) {
+	benchLoadPlugin();
+	const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+	sim_server& server = *simGetServer(sch);
+
+	for (int i = 0; i < locked && i + 2 < cfg.clients; i++) {
+		lockUser(sch, (anyID)(i + 2));
+	}
+	if (follow) {
+		enableFollow(sch, simRandomClient(server));
+	}
+	simPump();
+
+	queueStorm(sch, cfg.events);
+	const size_t queued = simPendingEvents();
+	simResetCounters();
+
+	const bench_timer t;
+	const size_t delivered = simPump();
+	const double ns = t.elapsedNs();
+
+	const sim_counters& c = simCounters();
+	char name[64];
+	snprintf(name, sizeof(name), "onClientMoved storm (locked=%d%s)", locked, follow ? ", follow" : "");
+	benchReport(name, queued, ns, "lib calls/ev=%.2f moves=%llu reactions=%llu",
+		(double)c.client_lib_calls / (double)queued, (unsigned long long)c.move_requests, (unsigned long long)(delivered - queued));
+
+	for (int i = 0; i < locked && i + 2 < cfg.clients; i++) {
+		unlockUser(sch, (anyID)(i + 2));
+	}
+	disableFollow(sch);
+	benchUnloadPlugin();
+}
+
+void benchClientMoved(const bench_config& cfg) {
+	runStorm(cfg, 0, false);
+	runStorm(cfg, 0, true);
+	runStorm(cfg, 10, false);
+	runStorm(cfg, 100, true);
+	runStorm(cfg, 500, true);
+}
+
+void benchMassMove(const bench_config& cfg) {
+	benchLoadPlugin();
+	const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+	sim_server& server = *simGetServer(sch);
+
+	for (int group : { 10, 50, 200, 1000 }) {
+		if (group >= cfg.clients) break;
+
+		// own client sits alone in channel 1, the group gathers in channel 2, everyone else waits in channel 3
+		for (anyID id = 2; id < server.clients.size(); id++) {
+			simPlaceClient(sch, id, id < group + 2 ? 2 : 3);
+		}
+		simPlaceClient(sch, server.own_client, 1);
+		simResetCounters();
+
+		double request_ns = 0;
+		double event_ns = 0;
+		const int rounds = 20;
+		for (int r = 0; r < rounds; r++) {
+			bench_timer t;
+			if (r % 2 == 0) {
+				moveClientsToOwnChannel(sch, 2);
+			}
+			else {
+				moveClientsToSelectedChannel(sch, 2);
+			}
+			request_ns += t.elapsedNs();
+
+			t = bench_timer();
+			simPump();
+			event_ns += t.elapsedNs();
+
+			// moving to the selected channel takes the own client along, go back for the next round
+			simClientSwitchChannel(sch, server.own_client, 1);
+			simPump();
+		}
+
+		const sim_counters& c = simCounters();
+		char name[64];
+		snprintf(name, sizeof(name), "mass move requests (group=%d)", group);
+		benchReport(name, (uint64)group * rounds, request_ns, "moves=%llu leaked arrays=%lld",
+			(unsigned long long)c.move_requests, (long long)(c.allocations - c.frees));
+		snprintf(name, sizeof(name), "mass move echo events (group=%d)", group);
+		benchReport(name, (uint64)group * rounds, event_ns, "events=%llu", (unsigned long long)c.events_delivered);
+	}
+
+	benchUnloadPlugin();
+}
+
+void benchInfoData(const bench_config& cfg) {
+	for (int locked : { 0, 100, 500 }) {
+		benchLoadPlugin();
+		const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+		sim_server& server = *simGetServer(sch);
+		for (int i = 0; i < locked && i + 2 < cfg.clients; i++) {
+			lockUser(sch, (anyID)(i + 2));
+		}
+		simResetCounters();
+
+		const int calls = cfg.events / 4;
+		const bench_timer t;
+		for (int i = 0; i < calls; i++) {
+			char* data = NULL;
+			if (i % 2 == 0) {
+				ts3plugin_infoData(sch, simRandomChannel(server), PLUGIN_CHANNEL, &data);
+			}
+			else {
+				ts3plugin_infoData(sch, simRandomClient(server), PLUGIN_CLIENT, &data);
+			}
+			if (data) ts3plugin_freeMemory(data);
+		}
+		const double ns = t.elapsedNs();
+
+		const sim_counters& c = simCounters();
+		char name[64];
+		snprintf(name, sizeof(name), "infoData (locked=%d)", locked);
+		benchReport(name, calls, ns, "lib calls/op=%.2f menu updates/op=%.2f",
+			(double)c.client_lib_calls / calls, (double)c.menu_updates / calls);
+
+		for (int i = 0; i < locked && i + 2 < cfg.clients; i++) {
+			unlockUser(sch, (anyID)(i + 2));
+		}
+		benchUnloadPlugin();
+	}
+}
+
+/*
+ * Per event cost of the lock lookup while the number of locked users grows. The storm only moves clients
+ * that are not locked, so no enforcement moves are mixed into the numbers.
+ */
+void benchLockTable(const bench_config& cfg) {
+	const int max_locked = 10000;
+	const int clients = max_locked + cfg.clients;
+
+	for (int locked : { 0, 10, 100, 1000, max_locked }) {
+		benchLoadPlugin();
+		const uint64 sch = simAddServer(cfg.channels, clients, cfg.seed);
+		sim_server& server = *simGetServer(sch);
+
+		bench_timer t;
+		for (int i = 0; i < locked; i++) {
+			lockUser(sch, (anyID)(i + 2));
+		}
+		const double lock_ns = t.elapsedNs();
+
+		for (int i = 0; i < cfg.events; i++) {
+			const anyID client = (anyID)(max_locked + 2 + server.rng() % (cfg.clients - 1));
+			simClientSwitchChannel(sch, client, simRandomChannel(server));
+		}
+		const size_t queued = simPendingEvents();
+		simResetCounters();
+
+		t = bench_timer();
+		simPump();
+		const double ns = t.elapsedNs();
+
+		char name[64];
+		snprintf(name, sizeof(name), "lock lookup per move (locked=%d)", locked);
+		benchReport(name, queued, ns, "moves=%llu", (unsigned long long)simCounters().move_requests);
+
+		t = bench_timer();
+		for (int i = 0; i < locked; i++) {
+			unlockUser(sch, (anyID)(i + 2));
+		}
+		const double unlock_ns = t.elapsedNs();
+		if (locked > 0) {
+			snprintf(name, sizeof(name), "lock + unlock (locked=%d)", locked);
+			benchReport(name, locked, lock_ns + unlock_ns);
+		}
+		benchUnloadPlugin();
+	}
+}
+
+/*
+ * Several server tabs with the same database ids. Users are only locked on the first tab, so every move
+ * request issued on another tab would be a lock leaking across servers.
+ */
+void benchServerTabs(const bench_config& cfg) {
+	for (int tabs : { 1, 3, 5 }) {
+		benchLoadPlugin();
+		std::vector<uint64> schs;
+		for (int i = 0; i < tabs; i++) {
+			schs.push_back(simAddServer(cfg.channels, cfg.clients, cfg.seed + i));
+		}
+		for (int i = 0; i < 100 && i + 2 < cfg.clients; i++) {
+			lockUser(schs[0], (anyID)(i + 2));
+		}
+		simPump();
+
+		for (int i = 0; i < cfg.events; i++) {
+			const uint64 sch = schs[i % tabs];
+			sim_server& server = *simGetServer(sch);
+			simClientSwitchChannel(sch, simRandomClient(server), simRandomChannel(server));
+		}
+		const size_t queued = simPendingEvents();
+		simResetCounters();
+		for (uint64 sch : schs) simGetServer(sch)->move_requests = 0;
+
+		const bench_timer t;
+		simPump();
+		const double ns = t.elapsedNs();
+
+		uint64 foreign_moves = 0;
+		for (size_t i = 1; i < schs.size(); i++) foreign_moves += simGetServer(schs[i])->move_requests;
+
+		char name[64];
+		snprintf(name, sizeof(name), "move storm over %d tabs (100 locked on tab 1)", tabs);
+		benchReport(name, queued, ns, "lib calls/ev=%.2f moves tab 1=%llu moves other tabs=%llu",
+			(double)simCounters().client_lib_calls / queued, (unsigned long long)simGetServer(schs[0])->move_requests, (unsigned long long)foreign_moves);
+
+		for (uint64 sch : schs) simRemoveServer(sch);
+		benchUnloadPlugin();
+	}
+}
+
+/*
+ * Mass move of 200 clients through the move pipeline with different windows, with and without server flood
+ * protection. Every sim round is one round trip to the server.
+ */
+void benchMovePipeline(const bench_config& cfg) {
+	const int group = cfg.clients > 201 ? 200 : cfg.clients - 1;
+	const mass_move_config defaults = massMoveGetConfig();
+
+	for (unsigned int flood_limit : { 0u, 10u }) {
+		for (unsigned int window : { 1u, 4u, 16u, 64u }) {
+			benchLoadPlugin();
+			massMoveSetConfig(mass_move_config{ window, defaults.max_retries });
+			const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+			sim_server& server = *simGetServer(sch);
+			for (anyID id = 2; id < server.clients.size(); id++) {
+				simPlaceClient(sch, id, id < group + 2 ? 2 : 3);
+			}
+			simPlaceClient(sch, server.own_client, 1);
+			server.flood_limit = flood_limit;
+			simResetCounters();
+
+			const bench_timer t;
+			moveClientsToOwnChannel(sch, 2);
+			int rounds = 0;
+			while (simPendingEvents() > 0) {
+				simPumpRound();
+				rounds++;
+			}
+			const double ns = t.elapsedNs();
+
+			mass_move_result result = mass_move_result{};
+			massMoveLastResult(sch, &result);
+			char name[64];
+			snprintf(name, sizeof(name), "move pipeline (window=%u, flood limit=%u)", window, flood_limit);
+			benchReport(name, group, ns, "round trips=%d moved=%u failed=%u retries=%u requests=%llu",
+				rounds, result.succeeded, result.failed, result.retries, (unsigned long long)simCounters().move_requests);
+			benchUnloadPlugin();
+		}
+	}
+	massMoveSetConfig(defaults);
+}
+
+/*
+ * A mass move running while locked users keep trying to leave their channel, on a server that drops moves above
+ * flood_limit per round trip. Unthrottled, the mass move and the lock enforcement flood the server and locked users
+ * get away; through the token bucket (set just below the servers limit) lock moves go first and nothing is dropped.
+ */
+void benchMoveScheduler(const bench_config& cfg) {
+	const int group = cfg.clients > 201 ? 200 : cfg.clients - 1;
+	const int locked = cfg.clients > group + 22 ? 20 : 0;
+	const unsigned int flood_limit = 10;
+	const int round_ms = 5;
+	const int storm_rounds = 30;
+	const double rate = 0.8 * flood_limit * 1000.0 / round_ms;
+
+	for (bool throttled : { false, true }) {
+		benchLoadPlugin();
+		if (throttled) {
+			moveSchedulerSetConfig(move_scheduler_config{ rate, 0.8 * flood_limit, false });
+		}
+		const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+		sim_server& server = *simGetServer(sch);
+		for (anyID id = 2; id < server.clients.size(); id++) {
+			simPlaceClient(sch, id, id < group + 2 ? 2 : 3);
+		}
+		simPlaceClient(sch, server.own_client, 1);
+		for (int i = 0; i < locked; i++) {
+			lockUser(sch, (anyID)(group + 2 + i));
+		}
+		server.flood_limit = flood_limit;
+		simResetCounters();
+		moveSchedulerResetStats();
+
+		const bench_timer t;
+		moveClientsToOwnChannel(sch, 2);
+		int rounds = 0;
+		while (rounds < storm_rounds || simPendingEvents() > 0 || moveSchedulerQueued() > 0 || massMoveBusy(sch)) {
+			const auto round_start = std::chrono::steady_clock::now();
+			if (rounds < storm_rounds && locked > 0) {
+				for (int i = 0; i < 4; i++) {
+					simClientSwitchChannel(sch, (anyID)(group + 2 + server.rng() % locked), simRandomChannel(server));
+				}
+			}
+			simPumpRound();
+			moveSchedulerPoll();
+			rounds++;
+			while (std::chrono::steady_clock::now() - round_start < std::chrono::milliseconds(round_ms)) {
+				std::this_thread::sleep_for(std::chrono::microseconds(200));
+			}
+		}
+		const double ns = t.elapsedNs();
+
+		int escaped = 0;
+		for (int i = 0; i < locked; i++) {
+			if (server.clients[group + 2 + i].channel != 3) escaped++;
+		}
+		mass_move_result result = mass_move_result{};
+		massMoveLastResult(sch, &result);
+		move_scheduler_stats stats;
+		moveSchedulerGetStats(&stats);
+		const auto avgWait = [&stats](int p) { return stats.sent[p] ? stats.total_wait_ms[p] / stats.sent[p] : 0.0; };
+
+		char name[64];
+		snprintf(name, sizeof(name), "move scheduler (%s, flood limit=%u)", throttled ? "token bucket" : "unthrottled", flood_limit);
+		benchReport(name, group, ns, "round trips=%d moved=%u retries=%u flooded=%llu locked escaped=%d/%d",
+			rounds, result.succeeded, result.retries, (unsigned long long)simCounters().move_requests_failed, escaped, locked);
+		benchReport("  lock moves", stats.sent[MOVE_PRIORITY_LOCK], 0, "avg wait=%.2f ms max wait=%.2f ms max queued=%llu",
+			avgWait(MOVE_PRIORITY_LOCK), stats.max_wait_ms[MOVE_PRIORITY_LOCK], (unsigned long long)stats.max_queued[MOVE_PRIORITY_LOCK]);
+		benchReport("  bulk moves", stats.sent[MOVE_PRIORITY_BULK], 0, "avg wait=%.2f ms max wait=%.2f ms max queued=%llu",
+			avgWait(MOVE_PRIORITY_BULK), stats.max_wait_ms[MOVE_PRIORITY_BULK], (unsigned long long)stats.max_queued[MOVE_PRIORITY_BULK]);
+
+		for (int i = 0; i < locked; i++) {
+			unlockUser(sch, (anyID)(group + 2 + i));
+		}
+		benchUnloadPlugin();
+	}
+}
+
+/*
+ * Locked users trying to leave while the rest of the server moves around, with a share of the channel changes
+ * delivered twice (the copy interleaved with other clients' events). Without duplicate and echo detection every
+ * repeated event of a locked user costs another requestClientMove.
+ */
+void benchMoveDedup(const bench_config& cfg) {
+	const int locked = cfg.clients > 102 ? 100 : cfg.clients / 2;
+	const int rounds = cfg.events / 100 > 0 ? cfg.events / 100 : 1;
+	const unsigned int window = moveHistoryGetWindow();
+	uint64 requests_without = 0;
+
+	for (unsigned int w : { 0u, window }) {
+		benchLoadPlugin();
+		moveHistorySetWindow(w);
+		const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+		sim_server& server = *simGetServer(sch);
+		for (int i = 0; i < locked; i++) {
+			lockUser(sch, (anyID)(i + 2));
+		}
+		simPump();
+		server.duplicate_percent = 30;
+		simResetCounters();
+		moveHistoryResetStats();
+
+		const bench_timer t;
+		for (int r = 0; r < rounds; r++) {
+			for (int i = 0; i < 100; i++) {
+				const anyID client = i < 10 ? (anyID)(2 + server.rng() % locked) : simRandomClient(server);
+				simClientSwitchChannel(sch, client, simRandomChannel(server));
+			}
+			simPumpRound();
+		}
+		simPump();
+		const double ns = t.elapsedNs();
+
+		const sim_counters& c = simCounters();
+		move_history_stats stats;
+		moveHistoryGetStats(&stats);
+		if (w == 0) requests_without = c.move_requests;
+
+		char name[64];
+		snprintf(name, sizeof(name), "move dedup (window=%u ms, duplicates=30%%)", w);
+		benchReport(name, c.events_delivered, ns, "moves=%llu saved=%lld dups=%llu echoes=%llu suppressed=%llu",
+			(unsigned long long)c.move_requests, (long long)requests_without - (long long)c.move_requests,
+			(unsigned long long)stats.duplicates, (unsigned long long)stats.echoes, (unsigned long long)stats.suppressed_requests);
+
+		for (int i = 0; i < locked; i++) {
+			unlockUser(sch, (anyID)(i + 2));
+		}
+		benchUnloadPlugin();
+	}
+	moveHistorySetWindow(window);
+}
+
+/* Channels of the sims server below channelID, including it */
+static std::vector<uint64> simSubtree(const sim_server& server, uint64 channelID) {
+	std::vector<uint64> result = { channelID };
+	for (size_t i = 0; i < result.size(); i++) {
+		for (const auto& c : server.channels) {
+			if (c.second.parent == result[i]) result.push_back(c.first);
+		}
+	}
+	return result;
+}
+
+static bool isBelow(const sim_server& server, uint64 channelID, uint64 ancestorID) {
+	for (uint64 c = channelID; c != 0; c = server.channels.at(c).parent) {
+		if (c == ancestorID) return true;
+	}
+	return false;
+}
+
+/*
+ * Subtree mass moves after the channel tree went through create / move / delete churn. The lib calls per move
+ * should follow the size of the subtree, not the size of the server, and every client of the subtree must arrive.
+ */
+void benchSubtreeMove(const bench_config& cfg) {
+	benchLoadPlugin();
+	const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+	sim_server& server = *simGetServer(sch);
+	simPlaceClient(sch, server.own_client, 1);
+
+	// first use seeds the tree from the client lib
+	simResetCounters();
+	bench_timer t;
+	moveSubtreeToOwnChannel(sch, 1);
+	benchReport("channel tree seed", server.channels.size(), t.elapsedNs(), "lib calls=%llu", (unsigned long long)simCounters().client_lib_calls);
+	simPump();
+
+	// churn, applied incrementally from the channel events
+	const int churn = cfg.channels;
+	for (int i = 0; i < churn; i++) {
+		const unsigned int roll = server.rng() % 100;
+		const uint64 channel = simRandomChannel(server);
+		if (roll < 40) {
+			simChannelCreate(sch, roll < 10 ? 0 : channel);
+		}
+		else if (roll < 80) {
+			simChannelMove(sch, channel, roll < 50 ? 0 : simRandomChannel(server));
+		}
+		else if (!isBelow(server, 1, channel)) {
+			// our own channel stays
+			simChannelDelete(sch, channel);
+		}
+		simPump();
+	}
+
+	// largest, a mid sized and a single channel subtree not containing our own channel
+	std::vector<std::pair<size_t, uint64>> candidates;
+	for (uint64 c : server.channel_ids) {
+		if (isBelow(server, 1, c)) continue;
+		candidates.push_back({ simSubtree(server, c).size(), c });
+	}
+	std::sort(candidates.begin(), candidates.end());
+	if (candidates.empty()) {
+		benchUnloadPlugin();
+		return;
+	}
+	const uint64 roots[] = { candidates.back().second, candidates[candidates.size() * 9 / 10].second, candidates.front().second };
+
+	for (uint64 root : roots) {
+		const std::vector<uint64> subtree = simSubtree(server, root);
+		size_t expected = 0;
+		for (uint64 c : subtree) expected += server.channels[c].clients.size();
+
+		simResetCounters();
+		t = bench_timer();
+		moveSubtreeToOwnChannel(sch, root);
+		const double ns = t.elapsedNs();
+		const uint64 lib_calls = simCounters().client_lib_calls - simCounters().move_requests;
+		simPump();
+
+		size_t left = 0;
+		for (uint64 c : subtree) left += server.channels[c].clients.size();
+
+		char name[64];
+		snprintf(name, sizeof(name), "subtree move (%zu of %zu channels)", subtree.size(), server.channels.size());
+		benchReport(name, subtree.size(), ns, "lib calls=%llu clients=%zu moved=%zu",
+			(unsigned long long)lib_calls, expected, expected - left);
+	}
+	benchUnloadPlugin();
+}
+
+struct generated_move {
+	anyID client;
+	uint64 old_channel;
+	uint64 new_channel;
+	bool moved;
+};
+
+static double percentile(const std::vector<double>& sorted, double p) {
+	return sorted.empty() ? 0.0 : sorted[std::min(sorted.size() - 1, (size_t)(p * (double)sorted.size()))];
+}
+
+/*
+ * Calls the move callbacks back to back the way the client thread delivers a storm and times every call, the
+ * lookups and move requests of the handler cost delay_ns each. Events come in bursts of burst events (a mass move
+ * or a reconnect wave), the next burst comes after the worker caught up. With a worker the sim is only touched by
+ * the worker until it is stopped, the echoes of its moves are never delivered.
+ */
+static void runCallbackLatency(const bench_config& cfg, unsigned int capacity, unsigned int delay_ns, int events, int burst) {
+	benchLoadPlugin(capacity);
+	const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+	sim_server& server = *simGetServer(sch);
+	for (int i = 0; i < 100 && i + 2 < cfg.clients; i++) {
+		lockUser(sch, (anyID)(i + 2));
+	}
+	enableFollow(sch, simRandomClient(server));
+
+	std::vector<uint64> channel_of(server.clients.size(), 0);
+	for (const sim_client& c : server.clients) channel_of[c.id] = c.channel;
+	std::vector<generated_move> moves;
+	moves.reserve(events);
+	for (int i = 0; i < events; i++) {
+		const anyID client = simRandomClient(server);
+		const uint64 channel = simRandomChannel(server);
+		moves.push_back(generated_move{ client, channel_of[client], channel, server.rng() % 100 < 15 });
+		channel_of[client] = channel;
+	}
+
+	simSetCallDelay(delay_ns);
+	simResetCounters();
+	eventWorkerResetStats();
+	std::vector<double> latency;
+	latency.reserve(events);
+	double total_ns = 0;
+	for (size_t i = 0; i < moves.size(); i++) {
+		const generated_move& m = moves[i];
+		const bench_timer t;
+		if (m.moved) {
+			ts3plugin_onClientMoveMovedEvent(sch, m.client, m.old_channel, m.new_channel, ENTER_VISIBILITY, 2, "admin", "admin", "");
+		}
+		else {
+			ts3plugin_onClientMoveEvent(sch, m.client, m.old_channel, m.new_channel, ENTER_VISIBILITY, "");
+		}
+		const double ns = t.elapsedNs();
+		latency.push_back(ns);
+		total_ns += ns;
+		if ((i + 1) % burst == 0) eventWorkerDrain();
+	}
+	eventWorkerDrain();
+	eventWorkerStop();
+
+	event_worker_stats stats;
+	eventWorkerGetStats(&stats);
+	const uint64 lib_calls = simCounters().client_lib_calls;
+	std::sort(latency.begin(), latency.end());
+	char name[64];
+	if (capacity) snprintf(name, sizeof(name), "move callback (worker, ring=%u, delay=%uns)", capacity, delay_ns);
+	else snprintf(name, sizeof(name), "move callback (inline, delay=%uns)", delay_ns);
+	benchReport(name, (uint64)events, total_ns, "p50=%.0f p99=%.0f max=%.0f ns lib calls/ev=%.2f handled=%llu dropped=%llu depth=%zu",
+		percentile(latency, 0.5), percentile(latency, 0.99), latency.back(), (double)lib_calls / (double)events,
+		(unsigned long long)stats.processed, (unsigned long long)stats.dropped, stats.max_depth);
+
+	simSetCallDelay(0);
+	benchUnloadPlugin();
+}
+
+void benchEventWorker(const bench_config& cfg) {
+	const int events = std::min(cfg.events, 50000);
+	for (unsigned int delay : { 0u, 5000u }) {
+		runCallbackLatency(cfg, 0, delay, events, 2000);
+		runCallbackLatency(cfg, 4096, delay, events, 2000);
+	}
+	// a burst larger than the ring overflows it, the rest of the burst is dropped and counted
+	runCallbackLatency(cfg, 256, 5000, events, 2000);
+}
+
+/* The storm with 100 locked clients and follow, with metrics switched off and on, then the report the client shows */
+void benchMetrics(const bench_config& cfg) {
+	for (bool enabled : { false, true }) {
+		benchLoadPlugin();
+		metricsSetEnabled(enabled);
+		const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+		sim_server& server = *simGetServer(sch);
+		for (int i = 0; i < 100 && i + 2 < cfg.clients; i++) {
+			lockUser(sch, (anyID)(i + 2));
+		}
+		enableFollow(sch, simRandomClient(server));
+		simPump();
+
+		queueStorm(sch, cfg.events);
+		const size_t queued = simPendingEvents();
+		metricsReset();
+
+		const bench_timer t;
+		simPump();
+		const double ns = t.elapsedNs();
+
+		benchReport(enabled ? "onClientMoved storm (metrics on)" : "onClientMoved storm (metrics off)", queued, ns,
+			"issued=%llu locks=%llu follows=%llu dedup=%llu", (unsigned long long)metricsCounter(METRIC_MOVES_ISSUED),
+			(unsigned long long)metricsCounter(METRIC_LOCKS_ENFORCED), (unsigned long long)metricsCounter(METRIC_FOLLOWS_TRIGGERED),
+			(unsigned long long)metricsCounter(METRIC_MOVES_DEDUPLICATED));
+
+		if (enabled) {
+			char line[256];
+			metricsShortReport(line, sizeof(line));
+			fprintf(stderr, "%s\n%s", line, metricsReport().c_str());
+		}
+		disableFollow(sch);
+		benchUnloadPlugin();
+	}
+	metricsSetEnabled(true);
+}
+
+/*
+ * Storm while the members of some team groups are locked, once by locking every member on its own and once by
+ * locking the groups, then the cost of group membership changes while groups are locked.
+ */
+void benchGroupLock(const bench_config& cfg) {
+	for (int teams : { 1, 4, SIM_TEAMS }) {
+		for (bool groups : { false, true }) {
+			benchLoadPlugin();
+			const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+			sim_server& server = *simGetServer(sch);
+
+			bench_timer t;
+			int members = 0;
+			if (groups) {
+				std::string command = "lock group";
+				for (int g = 0; g < teams; g++) command += " " + std::to_string(SIM_TEAM_GROUP + g);
+				ts3plugin_processCommand(sch, command.c_str());
+				for (anyID id = 2; id < server.clients.size(); id++) members += id % SIM_TEAMS < teams;
+			}
+			else {
+				for (anyID id = 2; id < server.clients.size(); id++) {
+					if (id % SIM_TEAMS >= teams) continue;
+					lockUser(sch, id);
+					members++;
+				}
+			}
+			const double lock_ns = t.elapsedNs();
+			simPump();
+
+			queueStorm(sch, cfg.events);
+			const size_t queued = simPendingEvents();
+			simResetCounters();
+			t = bench_timer();
+			simPump();
+			const double ns = t.elapsedNs();
+
+			const sim_counters& c = simCounters();
+			char name[64];
+			snprintf(name, sizeof(name), "storm, %d teams locked (%s)", teams, groups ? "groups" : "clients");
+			benchReport(name, queued, ns, "members=%d lock=%.0f us lib calls/ev=%.2f moves=%llu",
+				members, lock_ns / 1000.0, (double)c.client_lib_calls / (double)queued, (unsigned long long)c.move_requests);
+
+			if (groups && teams == SIM_TEAMS) {
+				// clients change teams while every team is locked
+				const int changes = cfg.events / 10;
+				for (int i = 0; i < changes; i++) {
+					const anyID client = simRandomClient(server);
+					const uint64 team = SIM_TEAM_GROUP + server.rng() % SIM_TEAMS;
+					if (i % 2) simServerGroupRemove(sch, client, team);
+					else simServerGroupAdd(sch, client, team);
+				}
+				const size_t events = simPendingEvents();
+				t = bench_timer();
+				const size_t delivered = simPump();
+				benchReport("group membership change (16 groups locked)", events, t.elapsedNs(), "delivered=%zu", delivered);
+			}
+			benchUnloadPlugin();
+		}
+	}
+}
@@ -0,0 +1,188 @@
+#include "bench.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "teamspeak/public_definitions.h"
+#include "ts3_functions.h"
+#include "plugin.h"
+#include "chat_filter.h"
+#include "sim/sim_client.h"
+
+#define CHAT_BENCH_MESSAGES 20000
+#define CHAT_BENCH_SENDERS 200
+#define CHAT_BENCH_BLOCKED_PERCENT 2
+#define CHAT_BENCH_WORD_FILE "jat_bench_words.txt"
+
+static std::string randomWord(std::mt19937& rng, size_t min_length, size_t max_length) {
+	std::string word(min_length + rng() % (max_length - min_length + 1), ' ');
+	for (char& c : word) c = (char)('a' + rng() % 26);
+	return word;
+}
+
+/* Words of 6 to 12 letters, so random chat hardly ever hits one by chance */
+static std::vector<std::string> blockList(size_t count, unsigned int seed) {
+	std::mt19937 rng(seed);
+	std::vector<std::string> words;
+	for (size_t i = 0; i < count; i++) words.push_back(randomWord(rng, 6, 12));
+	return words;
+}
+
+/* Chat lines of short words, some mixed case, every one in CHAT_BENCH_BLOCKED_PERCENT has a blocked word inside */
+static std::vector<std::string> chatLines(const std::vector<std::string>& words, unsigned int seed) {
+	std::mt19937 rng(seed);
+	std::vector<std::string> lines;
+	for (int i = 0; i < CHAT_BENCH_MESSAGES; i++) {
+		std::string line;
+		const size_t count = 3 + rng() % 10;
+		for (size_t w = 0; w < count; w++) {
+			if (w) line += ' ';
+			std::string word = randomWord(rng, 1, 5);
+			if (rng() % 4 == 0) word[0] = (char)toupper(word[0]);
+			line += word;
+		}
+		if (!words.empty() && rng() % 100 < CHAT_BENCH_BLOCKED_PERCENT) {
+			std::string word = words[rng() % words.size()];
+			word[0] = (char)toupper(word[0]);
+			line += " xx" + word + "!";
+		}
+		lines.push_back(line);
+	}
+	return lines;
+}
+
+/* Every word against the message, what a filter without an automaton does */
+static int naiveFind(const std::vector<std::string>& words, const std::string& lower_line) {
+	for (size_t i = 0; i < words.size(); i++) {
+		if (lower_line.find(words[i]) != std::string::npos) return (int)i;
+	}
+	return -1;
+}
+
+static void runMatcher(const bench_config& cfg, size_t word_count, bool naive) {
+	const std::vector<std::string> words = blockList(word_count, cfg.seed);
+	const std::vector<std::string> lines = chatLines(words, cfg.seed + 1);
+	size_t bytes = 0;
+	for (const std::string& line : lines) bytes += line.size();
+
+	bench_timer t;
+	chat_matcher matcher;
+	chatMatcherBuild(matcher, words);
+	const double build_ns = t.elapsedNs();
+
+	// both have to find the same lines
+	int wrong = 0;
+	int found = 0;
+	for (const std::string& line : lines) {
+		std::string lower = line;
+		for (char& c : lower) c = (char)tolower(c);
+		const bool hit = chatMatcherFind(matcher, line.c_str(), line.size()) >= 0;
+		found += hit;
+		if (word_count > 1000) continue;  // checked on the smaller lists, the naive search is slow
+		wrong += hit != (naiveFind(words, lower) >= 0);
+	}
+
+	char name[64];
+	int sum = 0;
+	t = bench_timer();
+	if (naive) {
+		std::string lower;
+		for (const std::string& line : lines) {
+			lower = line;
+			for (char& c : lower) c = (char)tolower(c);
+			sum += naiveFind(words, lower);
+		}
+		snprintf(name, sizeof(name), "chat match (naive, %zu words)", word_count);
+	}
+	else {
+		for (const std::string& line : lines) sum += chatMatcherFind(matcher, line.c_str(), line.size());
+		snprintf(name, sizeof(name), "chat match (automaton, %zu words)", word_count);
+	}
+	const double ns = t.elapsedNs();
+	const size_t table = (matcher.next.size() + matcher.match.size() + matcher.fail.size() + matcher.first_edge.size()) * sizeof(uint32_t) +
+		matcher.edges.size() * sizeof(chat_edge);
+	benchReport(name, lines.size(), ns, "%.0f MB/s found=%d wrong=%d states=%zu (%u with rows) classes=%u table=%.1f MB build=%.1f ms (sum %d)",
+		bytes / (ns / 1e9) / 1e6, found, wrong, matcher.match.size(), matcher.dense, matcher.classes, table / 1e6, build_ns / 1e6, sum);
+}
+
+/* 1000 clients chatting every 5 s, 10 of them every 100 ms, against 5 messages in 10 s */
+static void runRate(const bench_config& cfg) {
+	const int clients = 1000;
+	const int spammers = 10;
+	chat_filter filter;
+	filter.enabled = true;
+	filter.config = chat_filter_config{ 5, 10, CHAT_ACTION_REPORT, 0 };
+
+	int limited[3] = { 0, 0, 0 };  // spammers limited, spammer messages flooding, others limited
+	uint64 checks = 0;
+	const bench_timer t;
+	for (uint64 now = 0; now < 60000; now += 100) {
+		for (anyID id = 1; id <= clients; id++) {
+			const bool spammer = id <= spammers;
+			if (!spammer && (now + id * 37) % 5000 != 0) continue;
+			const chat_verdict v = chatRateCheck(filter, id, now);
+			checks++;
+			if (v == CHAT_VERDICT_RATE_LIMITED) limited[spammer ? 0 : 2]++;
+			if (v == CHAT_VERDICT_FLOODING && spammer) limited[1]++;
+		}
+	}
+	const double ns = t.elapsedNs();
+	benchReport("chat rate limit (5 in 10 s)", checks, ns, "spammers limited=%d/%d flooding=%d others limited=%d",
+		limited[0], spammers, limited[1], limited[2]);
+}
+
+/* The text message callback with a word list from a file, senders of blocked words are kicked */
+static void runCallback(const bench_config& cfg, size_t word_count) {
+	const std::vector<std::string> words = blockList(word_count, cfg.seed);
+	const std::vector<std::string> lines = chatLines(words, cfg.seed + 1);
+	FILE* f = fopen(CHAT_BENCH_WORD_FILE, "wb");
+	if (!f) return;
+	fprintf(f, "# bench word list\n");
+	for (const std::string& w : words) fprintf(f, "%s\n", w.c_str());
+	fclose(f);
+
+	benchLoadPlugin();
+	const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+	sim_server& server = *simGetServer(sch);
+	ts3plugin_processCommand(sch, "chatfilter words " CHAT_BENCH_WORD_FILE " kick");
+	remove(CHAT_BENCH_WORD_FILE);
+
+	chat_matcher reference;
+	chatMatcherBuild(reference, words);
+
+	simResetCounters();
+	int expected = 0;
+	int hidden = 0;
+	double ns = 0;
+	for (size_t i = 0; i < lines.size(); i++) {
+		anyID sender = (anyID)(2 + i % CHAT_BENCH_SENDERS);
+		if (sender == server.own_client) sender++;
+		const sim_client& client = server.clients[sender];
+		const bool admin = std::find(client.server_groups.begin(), client.server_groups.end(), (uint64)SIM_ADMIN_GROUP) != client.server_groups.end();
+		expected += !admin && chatMatcherFind(reference, lines[i].c_str(), lines[i].size()) >= 0;
+		const bench_timer t;
+		hidden += ts3plugin_onTextMessageEvent(sch, TextMessageTarget_CHANNEL, 0, sender, "sim", "sim", lines[i].c_str(), 0);
+		ns += t.elapsedNs();
+	}
+	char name[64];
+	snprintf(name, sizeof(name), "text message callback (%zu words)", word_count);
+	benchReport(name, lines.size(), ns, "hidden=%d/%d kicks=%llu", hidden, expected, (unsigned long long)simCounters().kick_requests);
+	simPump();
+	benchUnloadPlugin();
+}
+
+void benchChat(const bench_config& cfg) {
+	runMatcher(cfg, 100, true);
+	runMatcher(cfg, 100, false);
+	runMatcher(cfg, 1000, true);
+	runMatcher(cfg, 1000, false);
+	runMatcher(cfg, 5000, false);
+	runMatcher(cfg, 20000, false);
+	runRate(cfg);
+	runCallback(cfg, 5000);
+}
@@ -0,0 +1,148 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <string>
+
+#include "teamspeak/public_definitions.h"
+#include "ts3_functions.h"
+#include "plugin.h"
+#include "command.h"
+#include "sim/sim_client.h"
+
+#define COMMAND_BENCH_CLIENTS 500
+#define COMMAND_BENCH_IDS_PER_LOCK 100
+
+static std::string buildScript(sim_server& server, int commands) {
+	std::string text;
+	char line[64];
+	for (int i = 0; i < commands; i++) {
+		switch (i % 4) {
+		case 0:
+			text += "lock";
+			for (int n = 0; n < 10; n++) {
+				snprintf(line, sizeof(line), " %llu", (unsigned long long)server.clients[simRandomClient(server)].db_id);
+				text += line;
+			}
+			text += "\n";
+			break;
+		case 1:
+			snprintf(line, sizeof(line), "move %d,%d,%d to %llu\n", simRandomClient(server), simRandomClient(server),
+				simRandomClient(server), (unsigned long long)simRandomChannel(server));
+			text += line;
+			break;
+		case 2:
+			snprintf(line, sizeof(line), "move tree %llu to %llu  # comment\n", (unsigned long long)simRandomChannel(server),
+				(unsigned long long)simRandomChannel(server));
+			text += line;
+			break;
+		default:
+			text += "unfollow; backup delta\n";
+			break;
+		}
+	}
+	return text;
+}
+
+static void benchParser(const bench_config& cfg) {
+	benchLoadPlugin();
+	const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+	const std::string text = buildScript(*simGetServer(sch), 1000);
+
+	command c;
+	char error[COMMAND_ERROR_BUFSIZE];
+	uint64 parsed = 0;
+	const int rounds = cfg.events / 1000 > 0 ? cfg.events / 1000 : 1;
+	const bench_timer t;
+	for (int r = 0; r < rounds; r++) {
+		command_parser parser;
+		commandParserInit(parser, text.data(), text.size());
+		while (commandNext(parser, &c, error, sizeof(error)) == COMMAND_OK) parsed++;
+	}
+	const double ns = t.elapsedNs();
+	benchReport("parse command", parsed, ns, "%.0f MB/s", (double)text.size() * rounds / ns * 1000.0);
+	benchUnloadPlugin();
+}
+
+/* Locks the first clients one by one the way the menu does, then with one batch */
+static void benchBatchLock(const bench_config& cfg) {
+	const int clients = COMMAND_BENCH_CLIENTS < cfg.clients - 2 ? COMMAND_BENCH_CLIENTS : cfg.clients - 2;
+	for (bool batch : { false, true }) {
+		benchLoadPlugin();
+		const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+		sim_server& server = *simGetServer(sch);
+		std::string text;
+		char id[32];
+		for (int i = 0; i < clients; i++) {
+			if (i % COMMAND_BENCH_IDS_PER_LOCK == 0) text += i ? "; lock" : "lock";
+			snprintf(id, sizeof(id), " %llu", (unsigned long long)server.clients[i + 2].db_id);
+			text += id;
+		}
+		simResetCounters();
+
+		const bench_timer t;
+		if (batch) {
+			ts3plugin_processCommand(sch, text.c_str());
+		}
+		else {
+			for (int i = 0; i < clients; i++) lockUser(sch, (anyID)(i + 2));
+		}
+		const double ns = t.elapsedNs();
+
+		const sim_counters& c = simCounters();
+		char name[64];
+		snprintf(name, sizeof(name), batch ? "lock %d clients (/jat lock)" : "lock %d clients (one by one)", clients);
+		benchReport(name, (uint64)clients, ns, "lib calls=%llu menu updates=%llu",
+			(unsigned long long)c.client_lib_calls, (unsigned long long)c.menu_updates);
+		benchUnloadPlugin();
+	}
+}
+
+/* Moves a list of clients into one channel with a command per client, then with one command */
+static void benchBatchMove(const bench_config& cfg) {
+	const int clients = COMMAND_BENCH_CLIENTS < cfg.clients - 2 ? COMMAND_BENCH_CLIENTS : cfg.clients - 2;
+	for (bool batch : { false, true }) {
+		benchLoadPlugin();
+		const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+		sim_server& server = *simGetServer(sch);
+		const uint64 target = server.channel_ids[0];
+		std::string text = "move";
+		char id[32];
+		for (int i = 0; i < clients; i++) {
+			snprintf(id, sizeof(id), " %d", i + 2);
+			text += id;
+		}
+		snprintf(id, sizeof(id), " to %llu", (unsigned long long)target);
+		text += id;
+		simResetCounters();
+
+		const bench_timer t;
+		if (batch) {
+			ts3plugin_processCommand(sch, text.c_str());
+		}
+		else {
+			for (int i = 0; i < clients; i++) {
+				char single[64];
+				snprintf(single, sizeof(single), "move %d to %llu", i + 2, (unsigned long long)target);
+				ts3plugin_processCommand(sch, single);
+			}
+		}
+		const double request_ns = t.elapsedNs();
+		simPump();
+		const double ns = t.elapsedNs();
+
+		int arrived = 0;
+		for (int i = 0; i < clients; i++) arrived += server.clients[i + 2].channel == target;
+		const sim_counters& c = simCounters();
+		char name[64];
+		snprintf(name, sizeof(name), batch ? "move %d clients (one command)" : "move %d clients (command each)", clients);
+		benchReport(name, (uint64)clients, ns, "requests=%.0f us arrived=%d moves=%llu lib calls=%llu",
+			request_ns / 1000.0, arrived, (unsigned long long)c.move_requests, (unsigned long long)c.client_lib_calls);
+		benchUnloadPlugin();
+	}
+}
+
+void benchCommands(const bench_config& cfg) {
+	benchParser(cfg);
+	benchBatchLock(cfg);
+	benchBatchMove(cfg);
+}
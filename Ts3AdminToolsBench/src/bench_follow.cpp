@@ -0,0 +1,152 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+
+#include "teamspeak/public_definitions.h"
+#include "ts3_functions.h"
+#include "plugin.h"
+#include "follow_engine.h"
+#include "metrics.h"
+#include "sim/sim_client.h"
+
+#define FOLLOW_BENCH_WINDOW_MS 20
+#define FOLLOW_BENCH_MAX_DELAY_MS 200
+#define FOLLOW_BENCH_BURSTS 40
+#define FOLLOW_BENCH_TARGETS 8
+
+static void setFollowWindow(unsigned int window_ms) {
+	followEngineSetConfig(follow_engine_config{ window_ms, FOLLOW_BENCH_MAX_DELAY_MS, false });
+}
+
+/* Lets the follow window run out and delivers the moves it flushed */
+static void settleFollow(unsigned int window_ms) {
+	if (window_ms) std::this_thread::sleep_for(std::chrono::milliseconds(window_ms + 2));
+	followEnginePoll();
+	simPump();
+}
+
+/*
+ * The target clicks through hops channels in a row, then stays. Without a window every hop is followed, with one
+ * only the channel the target stayed in. Time is the event handling only, without waiting for the window.
+ */
+static void runFollowHops(const bench_config& cfg, unsigned int window_ms, int hops) {
+	benchLoadPlugin();
+	setFollowWindow(window_ms);
+	const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+	sim_server& server = *simGetServer(sch);
+	const anyID target = simRandomClient(server);
+	enableFollow(sch, target);
+	simPump();
+	simResetCounters();
+	metricsReset();
+
+	double ns = 0;
+	int arrived = 0;
+	for (int b = 0; b < FOLLOW_BENCH_BURSTS; b++) {
+		const bench_timer t;
+		for (int h = 0; h < hops; h++) {
+			simClientSwitchChannel(sch, target, simRandomChannel(server));
+			simPump();
+		}
+		ns += t.elapsedNs();
+		settleFollow(window_ms);
+		arrived += server.clients[server.own_client].channel == server.clients[target].channel;
+	}
+
+	char name[64];
+	snprintf(name, sizeof(name), "follow %d hop bursts (window=%ums)", hops, window_ms);
+	benchReport(name, (uint64)(FOLLOW_BENCH_BURSTS * hops), ns, "moves/burst=%.2f coalesced=%llu arrived=%d/%d",
+		(double)simCounters().move_requests / FOLLOW_BENCH_BURSTS, (unsigned long long)metricsCounter(METRIC_FOLLOWS_COALESCED),
+		arrived, FOLLOW_BENCH_BURSTS);
+	disableFollow(sch);
+	benchUnloadPlugin();
+}
+
+/* Channel switches of random clients with one or several targets followed, the targets hop along with the rest */
+static void runFollowStorm(const bench_config& cfg, unsigned int window_ms, int targets) {
+	benchLoadPlugin();
+	setFollowWindow(window_ms);
+	const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+	sim_server& server = *simGetServer(sch);
+	for (int i = 0; i < targets && i + 2 < cfg.clients; i++) {
+		enableFollow(sch, (anyID)(i + 2));
+	}
+	simPump();
+
+	// the storm is spread over a few clients that include the targets, so the targets hop often
+	const int hoppers = 4 * FOLLOW_BENCH_TARGETS < cfg.clients - 2 ? 4 * FOLLOW_BENCH_TARGETS : cfg.clients - 2;
+	for (int i = 0; i < cfg.events; i++) {
+		simClientSwitchChannel(sch, (anyID)(2 + server.rng() % hoppers), simRandomChannel(server));
+	}
+	const size_t queued = simPendingEvents();
+	simResetCounters();
+
+	const bench_timer t;
+	simPump();
+	const double ns = t.elapsedNs();
+	settleFollow(window_ms);
+
+	const sim_counters& c = simCounters();
+	char name[64];
+	snprintf(name, sizeof(name), "follow storm (targets=%d, window=%ums)", targets, window_ms);
+	benchReport(name, queued, ns, "lib calls/ev=%.2f moves=%llu", (double)c.client_lib_calls / (double)queued,
+		(unsigned long long)c.move_requests);
+	disableFollow(sch);
+	benchUnloadPlugin();
+}
+
+/* The followed target leaves and comes back, the next target in view is followed meanwhile */
+static void runFollowFailover(const bench_config& cfg) {
+	benchLoadPlugin();
+	setFollowWindow(FOLLOW_BENCH_WINDOW_MS);
+	const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+	sim_server& server = *simGetServer(sch);
+	const int targets = FOLLOW_BENCH_TARGETS < cfg.clients - 2 ? FOLLOW_BENCH_TARGETS : cfg.clients - 2;
+	for (int i = 0; i < targets; i++) {
+		enableFollow(sch, (anyID)(i + 2));
+	}
+	simPump();
+	simResetCounters();
+
+	int correct = 0;
+	double ns = 0;
+	for (int round = 0; round < FOLLOW_BENCH_BURSTS; round++) {
+		// the first n targets leave, the one after them is followed
+		const int gone = round % targets;
+		bench_timer t;
+		for (int i = 0; i < gone; i++) simClientLeave(sch, (anyID)(i + 2));
+		simPump();
+		ns += t.elapsedNs();
+		settleFollow(FOLLOW_BENCH_WINDOW_MS);
+		correct += server.clients[server.own_client].channel == server.clients[gone + 2].channel;
+
+		// they come back in other channels, the first one is followed again
+		t = bench_timer();
+		for (int i = 0; i < gone; i++) simClientJoin(sch, (anyID)(i + 2), simRandomChannel(server));
+		simPump();
+		ns += t.elapsedNs();
+		settleFollow(FOLLOW_BENCH_WINDOW_MS);
+		correct += server.clients[server.own_client].channel == server.clients[2].channel;
+	}
+
+	char name[64];
+	snprintf(name, sizeof(name), "follow failover (%d targets)", targets);
+	benchReport(name, (uint64)(2 * FOLLOW_BENCH_BURSTS), ns, "moves=%llu followed right=%d/%d",
+		(unsigned long long)simCounters().move_requests, correct, 2 * FOLLOW_BENCH_BURSTS);
+	disableFollow(sch);
+	benchUnloadPlugin();
+}
+
+void benchFollow(const bench_config& cfg) {
+	for (int hops : { 1, 4, 8 }) {
+		runFollowHops(cfg, 0, hops);
+		runFollowHops(cfg, FOLLOW_BENCH_WINDOW_MS, hops);
+	}
+	for (int targets : { 1, FOLLOW_BENCH_TARGETS }) {
+		runFollowStorm(cfg, 0, targets);
+		runFollowStorm(cfg, FOLLOW_BENCH_WINDOW_MS, targets);
+	}
+	runFollowFailover(cfg);
+}
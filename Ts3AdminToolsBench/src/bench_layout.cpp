@@ -0,0 +1,130 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "teamspeak/public_definitions.h"
+#include "ts3_functions.h"
+#include "plugin.h"
+#include "move_scheduler.h"
+#include "metrics.h"
+#include "sim/sim_client.h"
+
+#define LAYOUT_BENCH_TEAM 10
+#define LAYOUT_BENCH_ROUND_MS 5
+
+/* Two teams of LAYOUT_BENCH_TEAM clients in channels 2 and 3, everyone else in channel 4 */
+static std::string layoutCommand(const sim_server& server) {
+	std::string text = "layout 2";
+	char id[32];
+	for (int i = 0; i < 2 * LAYOUT_BENCH_TEAM; i++) {
+		if (i == LAYOUT_BENCH_TEAM) text += "; layout 3";
+		snprintf(id, sizeof(id), " %llu", (unsigned long long)server.clients[i + 2].db_id);
+		text += id;
+	}
+	return text + "; layout others 4";
+}
+
+static uint64 layoutChannelOf(const sim_server& server, anyID clientID) {
+	if (clientID == server.own_client) return 0;
+	if (clientID >= 2 && clientID < 2 + LAYOUT_BENCH_TEAM) return 2;
+	if (clientID >= 2 + LAYOUT_BENCH_TEAM && clientID < 2 + 2 * LAYOUT_BENCH_TEAM) return 3;
+	return 4;
+}
+
+static int countMisplaced(const sim_server& server) {
+	int misplaced = 0;
+	for (anyID id = 1; id < server.clients.size(); id++) {
+		const uint64 channel = layoutChannelOf(server, id);
+		misplaced += server.clients[id].connected && channel && server.clients[id].channel != channel;
+	}
+	return misplaced;
+}
+
+/* Setting the layout moves only the misplaced clients, setting it again moves nobody */
+static void runApply(const bench_config& cfg) {
+	benchLoadPlugin();
+	const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+	sim_server& server = *simGetServer(sch);
+	// a share of the lobby is there already
+	for (anyID id = 2 + 2 * LAYOUT_BENCH_TEAM; id < server.clients.size(); id += 2) simPlaceClient(sch, id, 4);
+	const std::string command = layoutCommand(server);
+
+	for (int pass = 0; pass < 2; pass++) {
+		const int misplaced = countMisplaced(server);
+		simResetCounters();
+		const bench_timer t;
+		ts3plugin_processCommand(sch, command.c_str());
+		const double ns = t.elapsedNs();
+		const uint64 requests = simCounters().move_requests;
+		simPump();
+
+		char name[64];
+		snprintf(name, sizeof(name), "layout %s (%d clients)", pass ? "again" : "apply", cfg.clients);
+		benchReport(name, (uint64)cfg.clients, ns, "misplaced=%d requests=%llu misplaced after=%d", misplaced,
+			(unsigned long long)requests, countMisplaced(server));
+	}
+	benchUnloadPlugin();
+}
+
+/* Clients of the layout wander off, each is put back */
+static void runDrift(const bench_config& cfg) {
+	benchLoadPlugin();
+	const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+	sim_server& server = *simGetServer(sch);
+	ts3plugin_processCommand(sch, layoutCommand(server).c_str());
+	simPump();
+	metricsReset();
+
+	const int events = cfg.events / 10;
+	for (int i = 0; i < events; i++) {
+		simClientSwitchChannel(sch, simRandomClient(server), simRandomChannel(server));
+	}
+	const size_t queued = simPendingEvents();
+	simResetCounters();
+	const bench_timer t;
+	simPump();
+	const double ns = t.elapsedNs();
+
+	benchReport("layout drift", queued, ns, "layout moves=%llu requests=%llu misplaced after=%d",
+		(unsigned long long)metricsCounter(METRIC_LAYOUT_MOVES), (unsigned long long)simCounters().move_requests, countMisplaced(server));
+	benchUnloadPlugin();
+}
+
+/* Applying the layout on a flood limited server, the token bucket spreads the moves over round trips */
+static void runFloodLimited(const bench_config& cfg) {
+	const unsigned int flood_limit = 10;
+	benchLoadPlugin();
+	moveSchedulerSetConfig(move_scheduler_config{ 0.8 * flood_limit * 1000.0 / LAYOUT_BENCH_ROUND_MS, 0.8 * flood_limit, false });
+	const uint64 sch = simAddServer(cfg.channels, cfg.clients > 500 ? 500 : cfg.clients, cfg.seed);
+	sim_server& server = *simGetServer(sch);
+	server.flood_limit = flood_limit;
+	const int misplaced = countMisplaced(server);
+	simResetCounters();
+
+	const bench_timer t;
+	ts3plugin_processCommand(sch, layoutCommand(server).c_str());
+	int rounds = 0;
+	while (simPendingEvents() > 0 || moveSchedulerQueued() > 0) {
+		const auto round_start = std::chrono::steady_clock::now();
+		simPumpRound();
+		moveSchedulerPoll();
+		rounds++;
+		while (std::chrono::steady_clock::now() - round_start < std::chrono::milliseconds(LAYOUT_BENCH_ROUND_MS)) {
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+		}
+	}
+	const double ns = t.elapsedNs();
+
+	benchReport("layout apply (flood limit=10, token bucket)", (uint64)misplaced, ns, "round trips=%d requests=%llu flooded=%llu misplaced after=%d",
+		rounds, (unsigned long long)simCounters().move_requests, (unsigned long long)simCounters().move_requests_failed, countMisplaced(server));
+	benchUnloadPlugin();
+}
+
+void benchLayout(const bench_config& cfg) {
+	runApply(cfg);
+	runDrift(cfg);
+	runFloodLimited(cfg);
+}
@@ -0,0 +1,102 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#include "teamspeak/public_definitions.h"
+#include "logging.h"
+
+#define LOG_BENCH_BURST 1000
+
+/* The move trace line, the way the callbacks printed it before */
+static void printfLine(int i) {
+	printf("Client move ('%s'), clid=%d, oCid=%llu, nCid=%llu, was_moved=%d\n", "Changed channel", i & 0xffff, (unsigned long long)(i % 400), (unsigned long long)(i % 397), i & 1);
+}
+
+static void logLine(int i) {
+	LOG_INFO(1, "Client move ('%s'), clid=%d, oCid=%llu, nCid=%llu, was_moved=%d", "Changed channel", i & 0xffff, (unsigned long long)(i % 400), (unsigned long long)(i % 397), i & 1);
+}
+
+static void startLog(log_level level, unsigned int capacity) {
+	// stdout is /dev/null unless --verbose, the flush thread still formats and writes every record
+	logSetConfig(log_config{ level, capacity, false, false, true });
+	logResetStats();
+	logStart(NULL);
+}
+
+/* Logs calls lines from one thread, waiting for the flush thread after every burst lines (0 = never) */
+static double logFrom(int calls, int burst) {
+	const bench_timer t;
+	double paused_ns = 0;
+	for (int i = 0; i < calls; i++) {
+		logLine(i);
+		if (burst && (i + 1) % burst == 0) {
+			const bench_timer p;
+			logFlush();
+			paused_ns += p.elapsedNs();
+		}
+	}
+	return t.elapsedNs() - paused_ns;
+}
+
+static void reportLog(const char* name, int calls, double ns) {
+	log_stats stats;
+	logGetStats(&stats);
+	benchReport(name, (uint64)calls, ns, "written=%llu dropped=%llu", (unsigned long long)stats.written, (unsigned long long)stats.dropped);
+}
+
+void benchLogging(const bench_config& cfg) {
+	const int calls = cfg.events;
+	const log_config saved = logGetConfig();
+
+	bench_timer t;
+	for (int i = 0; i < calls; i++) printfLine(i);
+	fflush(stdout);
+	benchReport("printf move line (before)", (uint64)calls, t.elapsedNs());
+
+	startLog(LOG_LEVEL_TRACE, 2048);
+	const double burst_ns = logFrom(calls, LOG_BENCH_BURST);
+	logStop();
+	reportLog("LOG_INFO move line (bursts of 1000)", calls, burst_ns);
+
+	startLog(LOG_LEVEL_TRACE, 2048);
+	const double storm_ns = logFrom(calls, 0);
+	logStop();
+	reportLog("LOG_INFO move line (no pause, ring 2048)", calls, storm_ns);
+
+	startLog(LOG_LEVEL_WARN, 2048);
+	t = bench_timer();
+	for (int i = 0; i < calls; i++) logLine(i);
+	const double filtered_ns = t.elapsedNs();
+	logStop();
+	reportLog("LOG_INFO move line (runtime level WARN)", calls, filtered_ns);
+
+	startLog(LOG_LEVEL_TRACE, 2048);
+	t = bench_timer();
+	for (int i = 0; i < calls; i++) {
+		LOG_TRACE(1, "Client move ('%s'), clid=%d", "Changed channel", i);
+	}
+	const double trace_ns = t.elapsedNs();
+	logStop();
+	reportLog(LOG_MIN_LEVEL > LOG_LEVEL_TRACE ? "LOG_TRACE move line (compiled out)" : "LOG_TRACE move line", calls, trace_ns);
+
+	// the client thread, the event worker and the move scheduler log at the same time
+	for (int threads : { 2, 4 }) {
+		startLog(LOG_LEVEL_TRACE, 2048);
+		std::vector<std::thread> producers;
+		std::vector<double> ns(threads, 0.0);
+		for (int p = 0; p < threads; p++) {
+			producers.emplace_back([&ns, p, calls, threads]() { ns[p] = logFrom(calls / threads, LOG_BENCH_BURST); });
+		}
+		for (std::thread& p : producers) p.join();
+		logStop();
+		double total = 0;
+		for (double n : ns) total += n;
+		char name[64];
+		snprintf(name, sizeof(name), "LOG_INFO move line (%d threads, bursts)", threads);
+		reportLog(name, calls / threads * threads, total);
+	}
+
+	logSetConfig(saved);
+}
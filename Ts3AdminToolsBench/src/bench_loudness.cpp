@@ -0,0 +1,133 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <random>
+#include <vector>
+
+#include "teamspeak/public_definitions.h"
+#include "ts3_functions.h"
+#include "plugin.h"
+#include "loudness.h"
+#include "afk.h"
+#include "sim/sim_client.h"
+
+#define LOUDNESS_BENCH_SPEAKERS 100
+#define LOUDNESS_BENCH_CHANNELS 2
+#define LOUDNESS_BENCH_FRAME (LOUDNESS_SAMPLE_RATE / 50)  // 20 ms per channel
+#define LOUDNESS_BENCH_ROUNDS 2000                        // 40 s of audio
+#define LOUDNESS_BENCH_TICK_ROUNDS (AFK_TICK_MS / 20)     // frames between timer ticks
+#define LOUDNESS_BENCH_LOUD 5                             // speakers that start blasting
+
+/* Noise around level (0..32767), loud frames are a clipped square wave */
+static void fillFrame(std::vector<short>& frame, std::mt19937& rng, int level, bool loud) {
+	std::uniform_int_distribution<int> noise(-level, level);
+	for (size_t i = 0; i < frame.size(); i++) {
+		frame[i] = loud ? (short)((i / 40) % 2 ? 32767 : -32768) : (short)noise(rng);
+	}
+}
+
+/* Every kernel on the same frames, they have to agree to the last bit */
+static void runKernels(const bench_config& cfg) {
+	std::mt19937 rng(cfg.seed);
+	std::vector<std::vector<short>> frames(LOUDNESS_BENCH_SPEAKERS, std::vector<short>(LOUDNESS_BENCH_FRAME * LOUDNESS_BENCH_CHANNELS));
+	for (size_t i = 0; i < frames.size(); i++) fillFrame(frames[i], rng, 1000 + (int)i * 300, i % 20 == 0);
+	// odd lengths for the tails
+	std::vector<short> odd(LOUDNESS_BENCH_FRAME * LOUDNESS_BENCH_CHANNELS - 7);
+	fillFrame(odd, rng, 32767, false);
+	odd[odd.size() - 1] = -32768;
+
+	loudness_frame expected[LOUDNESS_BENCH_SPEAKERS];
+	loudness_frame expected_odd;
+	loudnessSetKernel(LOUDNESS_KERNEL_SCALAR);
+	for (size_t i = 0; i < frames.size(); i++) loudnessMeasure(frames[i].data(), frames[i].size(), &expected[i]);
+	loudnessMeasure(odd.data(), odd.size(), &expected_odd);
+
+	for (int k = 0; k < LOUDNESS_KERNEL_COUNT; k++) {
+		const loudness_kernel kernel = (loudness_kernel)k;
+		if (kernel > loudnessBestKernel()) continue;
+		loudnessSetKernel(kernel);
+		int wrong = 0;
+		loudness_frame f;
+		for (size_t i = 0; i < frames.size(); i++) {
+			loudnessMeasure(frames[i].data(), frames[i].size(), &f);
+			wrong += f.energy != expected[i].energy || f.peak != expected[i].peak || f.clipped != expected[i].clipped;
+		}
+		loudnessMeasure(odd.data(), odd.size(), &f);
+		wrong += f.energy != expected_odd.energy || f.peak != expected_odd.peak || f.clipped != expected_odd.clipped;
+
+		uint64 sum = 0;
+		const bench_timer t;
+		for (int round = 0; round < LOUDNESS_BENCH_ROUNDS; round++) {
+			for (const std::vector<short>& frame : frames) {
+				loudnessMeasure(frame.data(), frame.size(), &f);
+				sum += f.energy;
+			}
+		}
+		const double ns = t.elapsedNs();
+		char name[64];
+		snprintf(name, sizeof(name), "measure 20 ms stereo frame (%s)", loudnessKernelName(kernel));
+		benchReport(name, (uint64)LOUDNESS_BENCH_ROUNDS * frames.size(), ns, "100 speakers=%.2f us wrong=%d (sum %llu)",
+			ns / LOUDNESS_BENCH_ROUNDS / 1000.0, wrong, (unsigned long long)(sum & 0xffff));
+	}
+	loudnessSetKernel(loudnessBestKernel());
+}
+
+/*
+ * 100 speakers through the playback callback, 5 of them switch to a clipped square wave halfway. The callback cost
+ * per 20 ms of all speakers, how many of the loud ones were muted and whether anyone else was.
+ */
+static void runCallback(const bench_config& cfg, const char* command) {
+	benchLoadPlugin();
+	const uint64 sch = simAddServer(cfg.channels, cfg.clients > LOUDNESS_BENCH_SPEAKERS ? cfg.clients : LOUDNESS_BENCH_SPEAKERS + 1, cfg.seed);
+	sim_server& server = *simGetServer(sch);
+	if (command) ts3plugin_processCommand(sch, command);
+
+	std::vector<anyID> speakers;
+	for (anyID id = 1; id < server.clients.size() && speakers.size() < LOUDNESS_BENCH_SPEAKERS; id++) {
+		if (id != server.own_client) speakers.push_back(id);
+	}
+	std::mt19937 rng(cfg.seed);
+	std::vector<short> quiet(LOUDNESS_BENCH_FRAME * LOUDNESS_BENCH_CHANNELS);
+	std::vector<short> loud(quiet.size());
+	std::vector<short> frame(quiet.size());
+	fillFrame(quiet, rng, 3000, false);  // about -25 dBFS RMS
+	fillFrame(loud, rng, 0, true);
+
+	simResetCounters();
+	int loud_frames = 0;
+	int detected_at = -1;
+	double ns = 0;
+	for (int round = 0; round < LOUDNESS_BENCH_ROUNDS; round++) {
+		for (size_t s = 0; s < speakers.size(); s++) {
+			const bool blasting = round >= LOUDNESS_BENCH_ROUNDS / 2 && s < LOUDNESS_BENCH_LOUD && !server.clients[speakers[s]].muted;
+			loud_frames += blasting;
+			// the callback may edit the frame in place, every speaker gets a fresh copy
+			frame = blasting ? loud : quiet;
+			const bench_timer t;
+			ts3plugin_onEditPlaybackVoiceDataEvent(sch, speakers[s], frame.data(), LOUDNESS_BENCH_FRAME, LOUDNESS_BENCH_CHANNELS);
+			ns += t.elapsedNs();
+		}
+		// the plugin's timer reports and mutes the flagged clients once a second
+		if ((round + 1) % LOUDNESS_BENCH_TICK_ROUNDS == 0) reportLoudClients();
+		if (detected_at < 0 && simCounters().mute_requests >= LOUDNESS_BENCH_LOUD) detected_at = round - LOUDNESS_BENCH_ROUNDS / 2;
+	}
+
+	int muted = 0;
+	int wrong = 0;
+	for (size_t s = 0; s < speakers.size(); s++) {
+		if (!server.clients[speakers[s]].muted) continue;
+		muted += s < LOUDNESS_BENCH_LOUD;
+		wrong += s >= LOUDNESS_BENCH_LOUD;
+	}
+	char name[96];
+	snprintf(name, sizeof(name), "playback callback (%s)", command ? command : "meter off");
+	benchReport(name, (uint64)LOUDNESS_BENCH_ROUNDS * speakers.size(), ns, "100 speakers=%.2f us muted=%d/%d wrong=%d after %d ms (%d loud frames)",
+		ns / LOUDNESS_BENCH_ROUNDS / 1000.0, muted, command ? LOUDNESS_BENCH_LOUD : 0, wrong, detected_at < 0 ? -1 : (detected_at + 1) * 20, loud_frames);
+	benchUnloadPlugin();
+}
+
+void benchLoudness(const bench_config& cfg) {
+	runKernels(cfg);
+	runCallback(cfg, NULL);
+	runCallback(cfg, "loudness 12 hold 300 mute");
+}
@@ -0,0 +1,169 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+
+#include "teamspeak/public_definitions.h"
+#include "ts3_functions.h"
+#include "plugin.h"
+#include "occupancy.h"
+#include "sim/sim_client.h"
+
+#define OCCUPANCY_BENCH_MOVES 20
+#define OCCUPANCY_BENCH_GROUP 200
+
+/* Channel switches with some clients leaving and coming back, the index follows them from the events */
+static void churn(uint64 sch, int events) {
+	sim_server& server = *simGetServer(sch);
+	for (int i = 0; i < events; i++) {
+		const anyID client = simRandomClient(server);
+		if (server.rng() % 100 < 90) {
+			simClientSwitchChannel(sch, client, simRandomChannel(server));
+		}
+		else {
+			simClientLeave(sch, client);
+			simClientJoin(sch, client, simRandomChannel(server));
+		}
+	}
+}
+
+static uint64 libCallsWithoutMoves() {
+	return simCounters().client_lib_calls - simCounters().move_requests;
+}
+
+/* Mass moves after a churn: the clients come from the index, the channels must end up empty */
+static void runMassMoves(const bench_config& cfg) {
+	benchLoadPlugin();
+	const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+	sim_server& server = *simGetServer(sch);
+
+	// the first mass move seeds the index
+	simResetCounters();
+	bench_timer t;
+	moveClientsToOwnChannel(sch, server.clients[server.own_client].channel);
+	benchReport("occupancy seed", (uint64)cfg.clients, t.elapsedNs(), "lib calls=%llu", (unsigned long long)libCallsWithoutMoves());
+	simPump();
+
+	churn(sch, cfg.events / 10);
+	simPump();
+
+	simResetCounters();
+	double ns = 0;
+	int emptied = 0;
+	size_t clients = 0;
+	for (int i = 0; i < OCCUPANCY_BENCH_MOVES; i++) {
+		uint64 channel = simRandomChannel(server);
+		if (channel == server.clients[server.own_client].channel) continue;
+		clients += server.channels[channel].clients.size();
+		t = bench_timer();
+		moveClientsToOwnChannel(sch, channel);
+		ns += t.elapsedNs();
+		simPump();
+		emptied += server.channels[channel].clients.empty();
+	}
+	const sim_counters& c = simCounters();
+	benchReport("mass moves after churn", (uint64)OCCUPANCY_BENCH_MOVES, ns, "lib calls/move=%.1f clients=%zu emptied=%d/%d leaked arrays=%lld",
+		(double)libCallsWithoutMoves() / OCCUPANCY_BENCH_MOVES, clients, emptied, OCCUPANCY_BENCH_MOVES, (long long)(c.allocations - c.frees));
+	benchUnloadPlugin();
+}
+
+/* Cost the index adds to every move event once it is seeded */
+static void runEventCost(const bench_config& cfg, bool seeded) {
+	benchLoadPlugin();
+	const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+	sim_server& server = *simGetServer(sch);
+	if (seeded) {
+		moveClientsToOwnChannel(sch, server.clients[server.own_client].channel);
+		simPump();
+	}
+	churn(sch, cfg.events);
+	const size_t queued = simPendingEvents();
+
+	const bench_timer t;
+	simPump();
+	const double ns = t.elapsedNs();
+	benchReport(seeded ? "move events (index seeded)" : "move events (no index)", queued, ns);
+	benchUnloadPlugin();
+}
+
+/* A group where every tenth client is an admin and every third one talks, only the quiet non-admins are moved */
+static void runFilteredMove(const bench_config& cfg) {
+	benchLoadPlugin();
+	const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+	sim_server& server = *simGetServer(sch);
+	const int group = OCCUPANCY_BENCH_GROUP < cfg.clients - 1 ? OCCUPANCY_BENCH_GROUP : cfg.clients - 1;
+	for (anyID id = 2; id < server.clients.size(); id++) {
+		simPlaceClient(sch, id, id < group + 2 ? 2 : 3);
+	}
+	simPlaceClient(sch, server.own_client, 1);
+	moveClientsToOwnChannel(sch, 4);  // channel 4 is empty, this only seeds the index
+	simPump();
+
+	for (anyID id = 2; id < group + 2; id += 3) simClientTalk(sch, id, true);
+	simPump();
+
+	int expected = 0;
+	for (anyID id = 2; id < group + 2; id++) {
+		const sim_client& client = server.clients[id];
+		const bool admin = std::find(client.server_groups.begin(), client.server_groups.end(), (uint64)SIM_ADMIN_GROUP) != client.server_groups.end();
+		expected += !admin && !client.talking;
+	}
+
+	simResetCounters();
+	const bench_timer t;
+	ts3plugin_processCommand(sch, "move channel 2 to 4 where nonadmin silent");
+	const double ns = t.elapsedNs();
+	const uint64 lib_calls = libCallsWithoutMoves();
+	simPump();
+
+	int moved = 0;
+	int wrong = 0;
+	for (anyID id : server.channels[4].clients) {
+		if (id < 2 || id >= group + 2) continue;
+		const sim_client& client = server.clients[id];
+		const bool admin = std::find(client.server_groups.begin(), client.server_groups.end(), (uint64)SIM_ADMIN_GROUP) != client.server_groups.end();
+		moved++;
+		wrong += admin || client.talking;
+	}
+
+	char name[64];
+	snprintf(name, sizeof(name), "filtered move (group=%d, nonadmin silent)", group);
+	benchReport(name, (uint64)group, ns, "lib calls=%llu moved=%d/%d wrong=%d", (unsigned long long)lib_calls, moved, expected, wrong);
+	benchUnloadPlugin();
+}
+
+/* Idle filter on the index itself, the clock is handed in so minutes pass instantly */
+static void runIdleFilter(const bench_config& cfg) {
+	benchLoadPlugin();
+	const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+	sim_server& server = *simGetServer(sch);
+
+	channel_occupancy index;
+	const uint64 minute = 60000;
+	occupancySeed(index, sch, 0);
+	// half of the clients do something after 5 minutes
+	for (anyID id = 2; id < server.clients.size(); id += 2) {
+		occupancySetTalking(index, id, false, 5 * minute);
+	}
+
+	std::vector<anyID> result;
+	const occupancy_filter idle = occupancy_filter{ false, false, 10 };
+	int wrong = 0;
+	const bench_timer t;
+	for (uint64 channel : server.channel_ids) occupancyCollect(index, channel, idle, 11 * minute, result);
+	const double ns = t.elapsedNs();
+	for (anyID id : result) wrong += id >= 2 && id % 2 == 0;
+
+	benchReport("idle filter (idle 10, half active at 5 min)", server.channel_ids.size(), ns, "matched=%zu of %d wrong=%d",
+		result.size(), cfg.clients, wrong);
+	benchUnloadPlugin();
+}
+
+void benchOccupancy(const bench_config& cfg) {
+	runMassMoves(cfg);
+	runEventCost(cfg, false);
+	runEventCost(cfg, true);
+	runFilteredMove(cfg);
+	runIdleFilter(cfg);
+}
@@ -0,0 +1,140 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "teamspeak/public_definitions.h"
+#include "ts3_functions.h"
+#include "plugin.h"
+#include "state_store.h"
+#include "sim/sim_client.h"
+
+#define STATE_BENCH_DIRECTORY "./"
+#define STATE_BENCH_SERVERS 16
+
+static std::string statePath() {
+	return std::string(STATE_BENCH_DIRECTORY) + STATE_STORE_FILE_NAME;
+}
+
+/* Loads the plugin with the state store in the working directory, optionally starting from an empty file */
+static void loadWithStore(bool fresh) {
+	if (fresh) remove(statePath().c_str());
+	benchLoadPlugin();
+	stateStoreSetEnabled(true);
+	stateStoreOpen(STATE_BENCH_DIRECTORY);
+}
+
+/* Unloads and loads the plugin while the sim stays connected, the way the client reloads a plugin */
+static double reloadPlugin() {
+	ts3plugin_shutdown();
+	ts3plugin_registerPluginID("bench");
+	const bench_timer t;
+	ts3plugin_init();
+	return t.elapsedNs();
+}
+
+/* Moves the first locked clients away, counts the ones the plugin moved back */
+static int countHeld(uint64 sch, int clients) {
+	sim_server& server = *simGetServer(sch);
+	std::vector<uint64> locked_in(clients);
+	for (int i = 0; i < clients; i++) {
+		const anyID client = (anyID)(i + 2);
+		locked_in[i] = server.clients[client].channel;
+		uint64 away = simRandomChannel(server);
+		if (away == locked_in[i]) away = away == server.channel_ids[0] ? server.channel_ids[1] : server.channel_ids[0];
+		simClientSwitchChannel(sch, client, away);
+	}
+	simPump();
+	int held = 0;
+	for (int i = 0; i < clients; i++) held += server.clients[i + 2].channel == locked_in[i];
+	return held;
+}
+
+/* Locks clients one by one, every lock is saved right away */
+static void runSaveCost(const bench_config& cfg, bool store, int clients) {
+	if (store) loadWithStore(true);
+	else benchLoadPlugin();
+	const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+	clients = clients < cfg.clients - 2 ? clients : cfg.clients - 2;
+	stateStoreResetStats();
+
+	const bench_timer t;
+	for (int i = 0; i < clients; i++) lockUser(sch, (anyID)(i + 2));
+	const double ns = t.elapsedNs();
+
+	state_store_stats stats;
+	stateStoreGetStats(&stats);
+	char name[64];
+	snprintf(name, sizeof(name), "lock %d clients (%s)", clients, store ? "saved" : "not saved");
+	benchReport(name, (uint64)clients, ns, "saves=%llu", (unsigned long long)stats.saves);
+	benchUnloadPlugin();
+}
+
+/* Every server has clients locked, the plugin is reloaded and puts all of them back */
+static void runReload(const bench_config& cfg) {
+	loadWithStore(true);
+	const int clients = STATE_STORE_LOCKS < cfg.clients - 2 ? STATE_STORE_LOCKS : cfg.clients - 2;
+	std::vector<uint64> servers;
+	for (int s = 0; s < STATE_BENCH_SERVERS; s++) {
+		const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed + (unsigned int)s);
+		servers.push_back(sch);
+		std::string text = "lock";
+		char id[32];
+		for (int i = 0; i < clients; i++) {
+			snprintf(id, sizeof(id), " %llu", (unsigned long long)simGetServer(sch)->clients[i + 2].db_id);
+			text += id;
+		}
+		text += "; follow 2 3";
+		ts3plugin_processCommand(sch, text.c_str());
+	}
+	simPump();
+	simResetCounters();
+
+	const double ns = reloadPlugin();
+	state_store_stats stats;
+	stateStoreGetStats(&stats);
+	const uint64 lib_calls = simCounters().client_lib_calls;
+	int held = 0;
+	for (uint64 sch : servers) held += countHeld(sch, 100);
+
+	char name[64];
+	snprintf(name, sizeof(name), "reload, %d servers with %d locks", STATE_BENCH_SERVERS, clients);
+	benchReport(name, (uint64)STATE_BENCH_SERVERS, ns, "init=%.0f us restored=%llu lib calls=%llu held=%d/%d",
+		ns / 1000.0, (unsigned long long)stats.restores, (unsigned long long)lib_calls, held, 100 * STATE_BENCH_SERVERS);
+	benchUnloadPlugin();
+}
+
+/* The client dies while a save is written: the save is lost, the one before it is restored */
+static void runTornSave(const bench_config& cfg) {
+	loadWithStore(true);
+	const uint64 sch = simAddServer(cfg.channels, cfg.clients, cfg.seed);
+	for (int i = 0; i < 100; i++) lockUser(sch, (anyID)(i + 2));
+
+	const TS3Functions sim = simGetFunctions();
+	char* uid;
+	sim.getServerVariableAsString(sch, VIRTUALSERVER_UNIQUE_IDENTIFIER, &uid);
+	state_record* record = stateStoreBegin(uid);
+	sim.freeMemory(uid);
+	record->lock_count = 50;
+	memset(record->locks, 0xff, 50 * sizeof(record->locks[0]));
+	// no commit, the plugin is gone before the save completes
+
+	reloadPlugin();
+	state_store_stats stats;
+	stateStoreGetStats(&stats);
+	const int held = countHeld(sch, 100);
+	benchReport("torn save, previous save restored", 1, 0, "held=%d/100 restores=%llu", held, (unsigned long long)stats.restores);
+	benchUnloadPlugin();
+}
+
+void benchState(const bench_config& cfg) {
+	for (int clients : { 100, 1000 }) {
+		runSaveCost(cfg, false, clients);
+		runSaveCost(cfg, true, clients);
+	}
+	runReload(cfg);
+	runTornSave(cfg);
+	remove(statePath().c_str());
+}
@@ -0,0 +1,89 @@
+/*
+ * Benchmark suite for the plugin callbacks, driven against the simulated client lib.
+ *
+ * Usage: TS3AdminToolsBench [scenario...] [--clients N] [--channels N] [--events N] [--seed N] [--verbose]
+ * Results are written to stderr, plugin output to stdout is discarded unless --verbose is given.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "bench.h"
+
+#ifdef _WIN32
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
+
+struct bench_scenario {
+	const char* name;
+	void (*run)(const bench_config& cfg);
+};
+
+static const bench_scenario scenarios[] = {
+	{ "moved", benchClientMoved },
+	{ "massmove", benchMassMove },
+	{ "infodata", benchInfoData },
+	{ "locktable", benchLockTable },
+	{ "tabs", benchServerTabs },
+	{ "pipeline", benchMovePipeline },
+	{ "scheduler", benchMoveScheduler },
+	{ "dedup", benchMoveDedup },
+	{ "subtree", benchSubtreeMove },
+	{ "backup", benchServerBackup },
+	{ "delta", benchDeltaBackup },
+	{ "restore", benchServerRestore },
+	{ "worker", benchEventWorker },
+	{ "logging", benchLogging },
+	{ "metrics", benchMetrics },
+	{ "commands", benchCommands },
+	{ "grouplock", benchGroupLock },
+	{ "follow", benchFollow },
+	{ "state", benchState },
+	{ "occupancy", benchOccupancy },
+	{ "layout", benchLayout },
+	{ "broadcast", benchBroadcast },
+	{ "actions", benchActions },
+	{ "afk", benchAfk },
+	{ "loudness", benchLoudness },
+	{ "chat", benchChat },
+	{ "bans", benchBans },
+};
+
+int main(int argc, char** argv) {
+	bench_config cfg = { 1500, 400, 200000, 42 };
+	bool verbose = false;
+	std::vector<const char*> selected;
+
+	for (int i = 1; i < argc; i++) {
+		const bool has_value = i + 1 < argc;
+		if (strcmp(argv[i], "--clients") == 0 && has_value) cfg.clients = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--channels") == 0 && has_value) cfg.channels = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--events") == 0 && has_value) cfg.events = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--seed") == 0 && has_value) cfg.seed = (unsigned int)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--verbose") == 0) verbose = true;
+		else selected.push_back(argv[i]);
+	}
+
+	if (cfg.clients < 2 || cfg.clients > 65000 || cfg.channels < 2 || cfg.events < 1) {
+		fprintf(stderr, "Invalid configuration\n");
+		return 1;
+	}
+
+	if (!verbose && !freopen(NULL_DEVICE, "w", stdout)) {
+		fprintf(stderr, "Could not silence plugin output\n");
+	}
+
+	fprintf(stderr, "clients=%d channels=%d events=%d seed=%u\n", cfg.clients, cfg.channels, cfg.events, cfg.seed);
+	for (const bench_scenario& s : scenarios) {
+		bool run = selected.empty();
+		for (const char* name : selected) {
+			if (strcmp(name, s.name) == 0) run = true;
+		}
+		if (run) s.run(cfg);
+	}
+	return 0;
+}
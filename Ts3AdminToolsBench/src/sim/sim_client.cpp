@@ -0,0 +1,992 @@
+#include "sim/sim_client.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+
+#include "teamspeak/public_errors.h"
+#include "teamspeak/public_errors_rare.h"
+#include "teamspeak/public_rare_definitions.h"
+#include "teamspeak/clientlib_publicdefinitions.h"
+#include "plugin.h"
+
+/*********************************** Sim state ************************************/
+/*
+ *
+ */
+static std::map<uint64, sim_server> servers;
+static uint64 current_server = 0;
+static uint64 next_server_id = 1;
+static std::deque<sim_event> pending_events;
+static sim_counters counters = sim_counters{};
+
+static unsigned int call_delay_ns = 0;
+
+/* Busy waits like a client lib call that has to take a lock and look something up */
+static void simCallDelay() {
+	if (call_delay_ns == 0) return;
+	const auto until = std::chrono::steady_clock::now() + std::chrono::nanoseconds(call_delay_ns);
+	while (std::chrono::steady_clock::now() < until) {}
+}
+
+#define SIM_CALL counters.client_lib_calls++; simCallDelay()
+
+static sim_server* findServer(uint64 serverConnectionHandlerID) {
+	const auto it = servers.find(serverConnectionHandlerID);
+	return it == servers.end() ? nullptr : &it->second;
+}
+
+static sim_client* findClient(sim_server* server, anyID clientID) {
+	if (!server || clientID == 0 || clientID >= server->clients.size()) return nullptr;
+	sim_client* c = &server->clients[clientID];
+	return c->connected ? c : nullptr;
+}
+
+static void channelRemoveClient(sim_server& server, uint64 channelID, anyID clientID) {
+	const auto it = server.channels.find(channelID);
+	if (it == server.channels.end()) return;
+	std::vector<anyID>& clients = it->second.clients;
+	const auto c = std::find(clients.begin(), clients.end(), clientID);
+	if (c != clients.end()) {
+		*c = clients.back();
+		clients.pop_back();
+	}
+}
+
+/* Copies ids into a malloc'd, zero terminated array the plugin releases with freeMemory */
+template<typename T, typename Container>
+static T* allocIdArray(const Container& ids) {
+	T* out = (T*)malloc(sizeof(T) * (ids.size() + 1));
+	size_t n = 0;
+	for (const auto& id : ids) out[n++] = (T)id;
+	out[n] = 0;
+	counters.allocations++;
+	return out;
+}
+
+/*********************************** Function table ************************************/
+/*
+ *
+ */
+static unsigned int simFreeMemory(void* pointer) {
+	SIM_CALL;
+	counters.frees++;
+	free(pointer);
+	return ERROR_ok;
+}
+
+static unsigned int simLogMessage(const char* logMessage, enum LogLevel severity, const char* channel, uint64 logID) {
+	SIM_CALL;
+	return ERROR_ok;
+}
+
+static unsigned int simGetClientID(uint64 serverConnectionHandlerID, anyID* result) {
+	SIM_CALL;
+	sim_server* server = findServer(serverConnectionHandlerID);
+	if (!server) return ERROR_invalid_server_connection_handler_id;
+	*result = server->own_client;
+	return ERROR_ok;
+}
+
+static unsigned int simGetClientVariableAsUInt64(uint64 serverConnectionHandlerID, anyID clientID, size_t flag, uint64* result) {
+	SIM_CALL;
+	sim_client* client = findClient(findServer(serverConnectionHandlerID), clientID);
+	if (!client) return ERROR_client_invalid_id;
+	switch (flag) {
+	case CLIENT_DATABASE_ID:
+		*result = client->db_id;
+		return ERROR_ok;
+	case CLIENT_CHANNEL_GROUP_ID:
+		*result = client->channel_group;
+		return ERROR_ok;
+	default:
+		return ERROR_not_implemented;
+	}
+}
+
+static char* allocString(const std::string& value);
+
+static unsigned int simGetClientVariableAsString(uint64 serverConnectionHandlerID, anyID clientID, size_t flag, char** result) {
+	SIM_CALL;
+	sim_client* client = findClient(findServer(serverConnectionHandlerID), clientID);
+	if (!client) return ERROR_client_invalid_id;
+	switch (flag) {
+	case CLIENT_UNIQUE_IDENTIFIER:
+		*result = allocString(client->uid.empty() ? "client" + std::to_string(clientID) + "=" : client->uid);
+		return ERROR_ok;
+	case CLIENT_NICKNAME:
+		*result = allocString(client->nickname.empty() ? "Client " + std::to_string(clientID) : client->nickname);
+		return ERROR_ok;
+	case CLIENT_SERVERGROUPS:
+		break;
+	default:
+		return ERROR_not_implemented;
+	}
+	std::string groups;
+	for (uint64 g : client->server_groups) {
+		if (!groups.empty()) groups += ",";
+		groups += std::to_string(g);
+	}
+	*result = allocString(groups);
+	return ERROR_ok;
+}
+
+static unsigned int simGetConnectionVariableAsString(uint64 serverConnectionHandlerID, anyID clientID, size_t flag, char** result) {
+	SIM_CALL;
+	sim_client* client = findClient(findServer(serverConnectionHandlerID), clientID);
+	if (!client) return ERROR_client_invalid_id;
+	if (flag != CONNECTION_CLIENT_IP) return ERROR_not_implemented;
+	*result = allocString(client->ip.empty() ? "192.168." + std::to_string(clientID / 256) + "." + std::to_string(clientID % 256) : client->ip);
+	return ERROR_ok;
+}
+
+static unsigned int simGetClientVariableAsInt(uint64 serverConnectionHandlerID, anyID clientID, size_t flag, int* result) {
+	SIM_CALL;
+	sim_client* client = findClient(findServer(serverConnectionHandlerID), clientID);
+	if (!client) return ERROR_client_invalid_id;
+	switch (flag) {
+	case CLIENT_FLAG_TALKING:
+		*result = client->talking ? STATUS_TALKING : 0;
+		break;
+	case CLIENT_AWAY:
+		*result = client->away ? AWAY_ZZZ : AWAY_NONE;
+		break;
+	case CLIENT_INPUT_MUTED:
+		*result = client->input_muted ? MUTEINPUT_MUTED : MUTEINPUT_NONE;
+		break;
+	case CLIENT_OUTPUT_MUTED:
+		*result = client->output_muted ? MUTEOUTPUT_MUTED : MUTEOUTPUT_NONE;
+		break;
+	default:
+		*result = 0;
+		break;
+	}
+	return ERROR_ok;
+}
+
+static unsigned int simGetClientList(uint64 serverConnectionHandlerID, anyID** result) {
+	SIM_CALL;
+	sim_server* server = findServer(serverConnectionHandlerID);
+	if (!server) return ERROR_invalid_server_connection_handler_id;
+	std::vector<anyID> ids;
+	for (const sim_client& c : server->clients) {
+		if (c.connected) ids.push_back(c.id);
+	}
+	*result = allocIdArray<anyID>(ids);
+	return ERROR_ok;
+}
+
+static unsigned int simGetChannelOfClient(uint64 serverConnectionHandlerID, anyID clientID, uint64* result) {
+	SIM_CALL;
+	sim_client* client = findClient(findServer(serverConnectionHandlerID), clientID);
+	if (!client || client->channel == 0) return ERROR_client_invalid_id;
+	*result = client->channel;
+	return ERROR_ok;
+}
+
+static unsigned int simGetChannelList(uint64 serverConnectionHandlerID, uint64** result) {
+	SIM_CALL;
+	sim_server* server = findServer(serverConnectionHandlerID);
+	if (!server) return ERROR_invalid_server_connection_handler_id;
+	*result = allocIdArray<uint64>(server->channel_ids);
+	return ERROR_ok;
+}
+
+static unsigned int simGetChannelClientList(uint64 serverConnectionHandlerID, uint64 channelID, anyID** result) {
+	SIM_CALL;
+	sim_server* server = findServer(serverConnectionHandlerID);
+	if (!server) return ERROR_invalid_server_connection_handler_id;
+	const auto it = server->channels.find(channelID);
+	if (it == server->channels.end()) return ERROR_channel_invalid_id;
+	*result = allocIdArray<anyID>(it->second.clients);
+	return ERROR_ok;
+}
+
+static unsigned int simGetParentChannelOfChannel(uint64 serverConnectionHandlerID, uint64 channelID, uint64* result) {
+	SIM_CALL;
+	sim_server* server = findServer(serverConnectionHandlerID);
+	if (!server) return ERROR_invalid_server_connection_handler_id;
+	const auto it = server->channels.find(channelID);
+	if (it == server->channels.end()) return ERROR_channel_invalid_id;
+	*result = it->second.parent;
+	return ERROR_ok;
+}
+
+static char* allocString(const std::string& value) {
+	char* out = (char*)malloc(value.size() + 1);
+	memcpy(out, value.c_str(), value.size() + 1);
+	counters.allocations++;
+	return out;
+}
+
+static unsigned int simGetChannelVariableAsInt(uint64 serverConnectionHandlerID, uint64 channelID, size_t flag, int* result) {
+	SIM_CALL;
+	sim_server* server = findServer(serverConnectionHandlerID);
+	if (!server) return ERROR_invalid_server_connection_handler_id;
+	if (server->channels.find(channelID) == server->channels.end()) return ERROR_channel_invalid_id;
+	switch (flag) {
+	case CHANNEL_CODEC:
+		*result = CODEC_OPUS_VOICE;
+		break;
+	case CHANNEL_CODEC_QUALITY:
+		*result = 6;
+		break;
+	case CHANNEL_MAXCLIENTS:
+	case CHANNEL_MAXFAMILYCLIENTS:
+		*result = -1;
+		break;
+	case CHANNEL_FLAG_PERMANENT:
+	case CHANNEL_FLAG_MAXCLIENTS_UNLIMITED:
+	case CHANNEL_FLAG_MAXFAMILYCLIENTS_INHERITED:
+		*result = 1;
+		break;
+	case CHANNEL_NEEDED_TALK_POWER:
+		*result = (int)(channelID % 50);
+		break;
+	default:
+		*result = 0;
+		break;
+	}
+	return ERROR_ok;
+}
+
+static unsigned int simGetChannelVariableAsUInt64(uint64 serverConnectionHandlerID, uint64 channelID, size_t flag, uint64* result) {
+	SIM_CALL;
+	int value;
+	const unsigned int r = simGetChannelVariableAsInt(serverConnectionHandlerID, channelID, flag, &value);
+	counters.client_lib_calls--;
+	*result = (uint64)value;
+	return r;
+}
+
+static unsigned int simGetChannelVariableAsString(uint64 serverConnectionHandlerID, uint64 channelID, size_t flag, char** result) {
+	SIM_CALL;
+	sim_server* server = findServer(serverConnectionHandlerID);
+	if (!server) return ERROR_invalid_server_connection_handler_id;
+	if (server->channels.find(channelID) == server->channels.end()) return ERROR_channel_invalid_id;
+	switch (flag) {
+	case CHANNEL_NAME: {
+		const std::string& name = server->channels[channelID].name;
+		*result = allocString(name.empty() ? "Channel " + std::to_string(channelID) : name);
+		break;
+	}
+	case CHANNEL_TOPIC:
+		*result = allocString(channelID % 3 == 0 ? "Topic of channel " + std::to_string(channelID) : "");
+		break;
+	default:
+		*result = allocString("");
+		break;
+	}
+	return ERROR_ok;
+}
+
+static unsigned int simGetServerVariableAsString(uint64 serverConnectionHandlerID, size_t flag, char** result) {
+	SIM_CALL;
+	if (!findServer(serverConnectionHandlerID)) return ERROR_invalid_server_connection_handler_id;
+	switch (flag) {
+	case VIRTUALSERVER_UNIQUE_IDENTIFIER:
+		*result = allocString("sim-" + std::to_string(serverConnectionHandlerID));
+		break;
+	case VIRTUALSERVER_NAME:
+		*result = allocString("Sim server " + std::to_string(serverConnectionHandlerID));
+		break;
+	default:
+		*result = allocString("");
+		break;
+	}
+	return ERROR_ok;
+}
+
+static unsigned int queueList(uint64 serverConnectionHandlerID, sim_list list, uint64 id, const char* returnCode) {
+	if (!findServer(serverConnectionHandlerID)) return ERROR_invalid_server_connection_handler_id;
+	sim_event e = sim_event{ SIM_EVENT_LIST, serverConnectionHandlerID, 0, 0, 0, returnCode ? returnCode : "" };
+	e.list = list;
+	e.list_id = id;
+	simQueueEvent(e);
+	return ERROR_ok;
+}
+
+static unsigned int simRequestServerGroupList(uint64 serverConnectionHandlerID, const char* returnCode) {
+	SIM_CALL;
+	return queueList(serverConnectionHandlerID, SIM_LIST_SERVER_GROUPS, 0, returnCode);
+}
+
+static unsigned int simRequestChannelGroupList(uint64 serverConnectionHandlerID, const char* returnCode) {
+	SIM_CALL;
+	return queueList(serverConnectionHandlerID, SIM_LIST_CHANNEL_GROUPS, 0, returnCode);
+}
+
+static unsigned int simRequestServerGroupPermList(uint64 serverConnectionHandlerID, uint64 serverGroupID, const char* returnCode) {
+	SIM_CALL;
+	return queueList(serverConnectionHandlerID, SIM_LIST_SERVER_GROUP_PERMS, serverGroupID, returnCode);
+}
+
+static unsigned int simRequestChannelGroupPermList(uint64 serverConnectionHandlerID, uint64 channelGroupID, const char* returnCode) {
+	SIM_CALL;
+	return queueList(serverConnectionHandlerID, SIM_LIST_CHANNEL_GROUP_PERMS, channelGroupID, returnCode);
+}
+
+static unsigned int simRequestChannelPermList(uint64 serverConnectionHandlerID, uint64 channelID, const char* returnCode) {
+	SIM_CALL;
+	return queueList(serverConnectionHandlerID, SIM_LIST_CHANNEL_PERMS, channelID, returnCode);
+}
+
+static unsigned int simRequestBanList(uint64 serverConnectionHandlerID, const char* returnCode) {
+	SIM_CALL;
+	return queueList(serverConnectionHandlerID, SIM_LIST_BANS, 0, returnCode);
+}
+
+/* Permissions are not stored, the request is counted and answered */
+static unsigned int addPerms(uint64 serverConnectionHandlerID, bool exists, int arraySize, const char* returnCode) {
+	sim_server* server = findServer(serverConnectionHandlerID);
+	if (!server) return ERROR_invalid_server_connection_handler_id;
+	if (arraySize <= 0) return ERROR_parameter_invalid;
+	counters.perm_requests++;
+	counters.perms_added += arraySize;
+	simQueueEvent(sim_event{ SIM_EVENT_SERVER_ERROR, serverConnectionHandlerID, 0, 0, 0, returnCode ? returnCode : "", exists ? (unsigned int)ERROR_ok : (unsigned int)ERROR_parameter_invalid });
+	return ERROR_ok;
+}
+
+static unsigned int simRequestServerGroupAddPerm(uint64 serverConnectionHandlerID, uint64 serverGroupID, int continueonerror, const unsigned int* permissionIDArray, const int* permissionValueArray, const int* permissionNegatedArray, const int* permissionSkipArray, int arraySize, const char* returnCode) {
+	SIM_CALL;
+	sim_server* server = findServer(serverConnectionHandlerID);
+	return addPerms(serverConnectionHandlerID, server && serverGroupID >= 1 && serverGroupID <= server->server_groups, arraySize, returnCode);
+}
+
+static unsigned int simRequestChannelGroupAddPerm(uint64 serverConnectionHandlerID, uint64 channelGroupID, int continueonerror, const unsigned int* permissionIDArray, const int* permissionValueArray, int arraySize, const char* returnCode) {
+	SIM_CALL;
+	sim_server* server = findServer(serverConnectionHandlerID);
+	return addPerms(serverConnectionHandlerID, server && channelGroupID >= 1 && channelGroupID <= server->channel_groups, arraySize, returnCode);
+}
+
+static unsigned int simRequestChannelAddPerm(uint64 serverConnectionHandlerID, uint64 channelID, const unsigned int* permissionIDArray, const int* permissionValueArray, int arraySize, const char* returnCode) {
+	SIM_CALL;
+	sim_server* server = findServer(serverConnectionHandlerID);
+	return addPerms(serverConnectionHandlerID, server && server->channels.find(channelID) != server->channels.end(), arraySize, returnCode);
+}
+
+static unsigned int simGetConnectionStatus(uint64 serverConnectionHandlerID, int* result) {
+	SIM_CALL;
+	*result = findServer(serverConnectionHandlerID) ? STATUS_CONNECTION_ESTABLISHED : STATUS_DISCONNECTED;
+	return ERROR_ok;
+}
+
+static unsigned int simGetServerConnectionHandlerList(uint64** result) {
+	SIM_CALL;
+	std::vector<uint64> ids;
+	for (const auto& s : servers) ids.push_back(s.first);
+	*result = allocIdArray<uint64>(ids);
+	return ERROR_ok;
+}
+
+static unsigned int simRequestMuteClients(uint64 serverConnectionHandlerID, const anyID* clientIDArray, const char* returnCode) {
+	SIM_CALL;
+	counters.mute_requests++;
+	sim_server* server = findServer(serverConnectionHandlerID);
+	if (!server) return ERROR_invalid_server_connection_handler_id;
+	for (const anyID* it = clientIDArray; *it; it++) {
+		sim_client* client = findClient(server, *it);
+		if (client) client->muted = true;
+	}
+	return ERROR_ok;
+}
+
+static unsigned int simRequestClientKickFromServer(uint64 serverConnectionHandlerID, anyID clientID, const char* kickReason, const char* returnCode) {
+	SIM_CALL;
+	counters.kick_requests++;
+	sim_server* server = findServer(serverConnectionHandlerID);
+	if (!server) return ERROR_invalid_server_connection_handler_id;
+	if (!findClient(server, clientID)) return ERROR_client_invalid_id;
+	simQueueEvent(sim_event{ SIM_EVENT_KICK_SERVER, serverConnectionHandlerID, clientID, 0, server->own_client, returnCode ? returnCode : "" });
+	return ERROR_ok;
+}
+
+static unsigned int simRequestClientMove(uint64 serverConnectionHandlerID, anyID clientID, uint64 newChannelID, const char* password, const char* returnCode) {
+	SIM_CALL;
+	counters.move_requests++;
+	sim_server* server = findServer(serverConnectionHandlerID);
+	sim_client* client = findClient(server, clientID);
+	if (server) server->move_requests++;
+	if (!client) {
+		counters.move_requests_failed++;
+		return ERROR_client_invalid_id;
+	}
+	if (server->channels.find(newChannelID) == server->channels.end()) {
+		counters.move_requests_failed++;
+		return ERROR_channel_invalid_id;
+	}
+	const std::string rc = returnCode ? returnCode : "";
+	if (server->flood_limit && server->flood_used++ >= server->flood_limit) {
+		counters.move_requests_failed++;
+		simQueueEvent(sim_event{ SIM_EVENT_SERVER_ERROR, serverConnectionHandlerID, clientID, newChannelID, 0, rc, ERROR_client_is_flooding });
+		return ERROR_ok;
+	}
+	if (clientID == server->own_client) {
+		simQueueEvent(sim_event{ SIM_EVENT_MOVE, serverConnectionHandlerID, clientID, newChannelID, 0, rc });
+	}
+	else {
+		simQueueEvent(sim_event{ SIM_EVENT_MOVE_MOVED, serverConnectionHandlerID, clientID, newChannelID, server->own_client, rc });
+	}
+	return ERROR_ok;
+}
+
+static void simGetPath(char* path, size_t maxLen) {
+	SIM_CALL;
+	if (maxLen == 0) return;
+	strncpy(path, "./", maxLen - 1);
+	path[maxLen - 1] = '\0';
+}
+
+static void simGetPluginPath(char* path, size_t maxLen, const char* pluginID) {
+	simGetPath(path, maxLen);
+}
+
+static uint64 simGetCurrentServerConnectionHandlerID() {
+	SIM_CALL;
+	return current_server;
+}
+
+static void simPrintMessage(uint64 serverConnectionHandlerID, const char* message, enum PluginMessageTarget messageTarget) {
+	SIM_CALL;
+}
+
+static void simPrintMessageToCurrentTab(const char* message) {
+	SIM_CALL;
+}
+
+static void simCreateReturnCode(const char* pluginID, char* returnCode, size_t maxLen) {
+	SIM_CALL;
+	static uint64 next_return_code = 1;
+	snprintf(returnCode, maxLen, "PR:%s:%llu", pluginID ? pluginID : "", (unsigned long long)next_return_code++);
+}
+
+static void simSetPluginMenuEnabled(const char* pluginID, int menuID, int enabled) {
+	SIM_CALL;
+	counters.menu_updates++;
+}
+
+TS3Functions simGetFunctions() {
+	TS3Functions f;
+	memset(&f, 0, sizeof(f));  // unimplemented entries crash loudly instead of silently doing nothing
+	f.freeMemory = simFreeMemory;
+	f.logMessage = simLogMessage;
+	f.getClientID = simGetClientID;
+	f.getClientVariableAsInt = simGetClientVariableAsInt;
+	f.getClientVariableAsUInt64 = simGetClientVariableAsUInt64;
+	f.getClientVariableAsString = simGetClientVariableAsString;
+	f.getConnectionVariableAsString = simGetConnectionVariableAsString;
+	f.getClientList = simGetClientList;
+	f.getChannelOfClient = simGetChannelOfClient;
+	f.getChannelList = simGetChannelList;
+	f.getChannelClientList = simGetChannelClientList;
+	f.getParentChannelOfChannel = simGetParentChannelOfChannel;
+	f.getServerConnectionHandlerList = simGetServerConnectionHandlerList;
+	f.getConnectionStatus = simGetConnectionStatus;
+	f.getChannelVariableAsInt = simGetChannelVariableAsInt;
+	f.getChannelVariableAsUInt64 = simGetChannelVariableAsUInt64;
+	f.getChannelVariableAsString = simGetChannelVariableAsString;
+	f.getServerVariableAsString = simGetServerVariableAsString;
+	f.requestServerGroupList = simRequestServerGroupList;
+	f.requestChannelGroupList = simRequestChannelGroupList;
+	f.requestServerGroupPermList = simRequestServerGroupPermList;
+	f.requestChannelGroupPermList = simRequestChannelGroupPermList;
+	f.requestChannelPermList = simRequestChannelPermList;
+	f.requestBanList = simRequestBanList;
+	f.requestServerGroupAddPerm = simRequestServerGroupAddPerm;
+	f.requestChannelGroupAddPerm = simRequestChannelGroupAddPerm;
+	f.requestChannelAddPerm = simRequestChannelAddPerm;
+	f.requestClientMove = simRequestClientMove;
+	f.requestMuteClients = simRequestMuteClients;
+	f.requestClientKickFromServer = simRequestClientKickFromServer;
+	f.getAppPath = simGetPath;
+	f.getResourcesPath = simGetPath;
+	f.getConfigPath = simGetPath;
+	f.getPluginPath = simGetPluginPath;
+	f.getCurrentServerConnectionHandlerID = simGetCurrentServerConnectionHandlerID;
+	f.printMessage = simPrintMessage;
+	f.printMessageToCurrentTab = simPrintMessageToCurrentTab;
+	f.createReturnCode = simCreateReturnCode;
+	f.setPluginMenuEnabled = simSetPluginMenuEnabled;
+	return f;
+}
+
+/*********************************** Setup ************************************/
+/*
+ *
+ */
+void simReset() {
+	for (const auto& s : servers) {
+		ts3plugin_onConnectStatusChangeEvent(s.first, STATUS_DISCONNECTED, ERROR_ok);
+	}
+	servers.clear();
+	pending_events.clear();
+	current_server = 0;
+	next_server_id = 1;
+	call_delay_ns = 0;
+	simResetCounters();
+}
+
+uint64 simAddServer(int channel_count, int client_count, unsigned int seed) {
+	const uint64 id = next_server_id++;
+	sim_server& server = servers[id];
+	server.id = id;
+	server.own_client = 1;
+	server.rng.seed(seed);
+
+	// first tenth of the channels are top level, the rest hang below a random earlier channel
+	const int root_count = std::max(1, channel_count / 10);
+	for (int i = 1; i <= channel_count; i++) {
+		uint64 parent = 0;
+		if (i > root_count) {
+			parent = std::uniform_int_distribution<uint64>(1, i - 1)(server.rng);
+		}
+		server.channels[i] = sim_channel{ (uint64)i, parent, {} };
+		server.channel_ids.push_back(i);
+	}
+	server.next_channel_id = channel_count + 1;
+
+	server.clients.resize(client_count + 1);
+	for (int i = 1; i <= client_count; i++) {
+		const uint64 channel = simRandomChannel(server);
+		server.clients[i] = sim_client{ (anyID)i, 1000 + (uint64)i, channel, true };
+		server.clients[i].server_groups = { SIM_GUEST_GROUP, SIM_TEAM_GROUP + (uint64)(i % SIM_TEAMS) };
+		if (i % 10 == 0) server.clients[i].server_groups.push_back(SIM_ADMIN_GROUP);
+		server.clients[i].channel_group = i % 4 == 0 ? SIM_OPERATOR_CHANNEL_GROUP : SIM_GUEST_CHANNEL_GROUP;
+		server.channels[channel].clients.push_back((anyID)i);
+	}
+
+	if (current_server == 0) current_server = id;
+
+	ts3plugin_onConnectStatusChangeEvent(id, STATUS_CONNECTING, ERROR_ok);
+	ts3plugin_onConnectStatusChangeEvent(id, STATUS_CONNECTED, ERROR_ok);
+	ts3plugin_onConnectStatusChangeEvent(id, STATUS_CONNECTION_ESTABLISHING, ERROR_ok);
+	for (uint64 c : server.channel_ids) {
+		ts3plugin_onNewChannelEvent(id, c, server.channels[c].parent);
+	}
+	ts3plugin_onConnectStatusChangeEvent(id, STATUS_CONNECTION_ESTABLISHED, ERROR_ok);
+	return id;
+}
+
+void simRemoveServer(uint64 serverConnectionHandlerID) {
+	if (!findServer(serverConnectionHandlerID)) return;
+	ts3plugin_onConnectStatusChangeEvent(serverConnectionHandlerID, STATUS_DISCONNECTED, ERROR_ok);
+	servers.erase(serverConnectionHandlerID);
+	if (current_server == serverConnectionHandlerID) {
+		current_server = servers.empty() ? 0 : servers.begin()->first;
+	}
+}
+
+void simSetCurrentServer(uint64 serverConnectionHandlerID) {
+	current_server = serverConnectionHandlerID;
+}
+
+sim_server* simGetServer(uint64 serverConnectionHandlerID) {
+	return findServer(serverConnectionHandlerID);
+}
+
+sim_counters& simCounters() {
+	return counters;
+}
+
+void simResetCounters() {
+	counters = sim_counters{};
+}
+
+void simSetCallDelay(unsigned int ns) {
+	call_delay_ns = ns;
+}
+
+uint64 simRandomChannel(sim_server& server) {
+	return server.channel_ids[std::uniform_int_distribution<size_t>(0, server.channel_ids.size() - 1)(server.rng)];
+}
+
+anyID simRandomClient(sim_server& server, bool include_self) {
+	const anyID first = include_self ? 1 : 2;
+	return (anyID)std::uniform_int_distribution<int>(first, (int)server.clients.size() - 1)(server.rng);
+}
+
+/*********************************** Events ************************************/
+/*
+ *
+ */
+void simQueueEvent(const sim_event& e) {
+	pending_events.push_back(e);
+}
+
+void simClientSwitchChannel(uint64 serverConnectionHandlerID, anyID clientID, uint64 channelID) {
+	simQueueEvent(sim_event{ SIM_EVENT_MOVE, serverConnectionHandlerID, clientID, channelID, 0 });
+}
+
+void simClientMovedBy(uint64 serverConnectionHandlerID, anyID clientID, uint64 channelID, anyID invokerID) {
+	simQueueEvent(sim_event{ SIM_EVENT_MOVE_MOVED, serverConnectionHandlerID, clientID, channelID, invokerID });
+}
+
+void simClientLeave(uint64 serverConnectionHandlerID, anyID clientID) {
+	simQueueEvent(sim_event{ SIM_EVENT_MOVE, serverConnectionHandlerID, clientID, 0, 0 });
+}
+
+void simClientJoin(uint64 serverConnectionHandlerID, anyID clientID, uint64 channelID) {
+	simQueueEvent(sim_event{ SIM_EVENT_MOVE, serverConnectionHandlerID, clientID, channelID, 0 });
+}
+
+void simServerGroupAdd(uint64 serverConnectionHandlerID, anyID clientID, uint64 serverGroupID) {
+	sim_event e = sim_event{ SIM_EVENT_SERVER_GROUP_ADDED, serverConnectionHandlerID, clientID, 0, 0 };
+	e.list_id = serverGroupID;
+	simQueueEvent(e);
+}
+
+void simServerGroupRemove(uint64 serverConnectionHandlerID, anyID clientID, uint64 serverGroupID) {
+	sim_event e = sim_event{ SIM_EVENT_SERVER_GROUP_DELETED, serverConnectionHandlerID, clientID, 0, 0 };
+	e.list_id = serverGroupID;
+	simQueueEvent(e);
+}
+
+void simChannelGroupSet(uint64 serverConnectionHandlerID, anyID clientID, uint64 channelGroupID) {
+	sim_event e = sim_event{ SIM_EVENT_CHANNEL_GROUP_CHANGED, serverConnectionHandlerID, clientID, 0, 0 };
+	e.list_id = channelGroupID;
+	simQueueEvent(e);
+}
+
+void simClientTalk(uint64 serverConnectionHandlerID, anyID clientID, bool talking) {
+	sim_event e = sim_event{ SIM_EVENT_TALK_STATUS, serverConnectionHandlerID, clientID, 0, 0 };
+	e.list_id = talking ? 1 : 0;
+	simQueueEvent(e);
+}
+
+void simClientUpdate(uint64 serverConnectionHandlerID, anyID clientID, size_t flag, bool value) {
+	sim_event e = sim_event{ SIM_EVENT_CLIENT_UPDATED, serverConnectionHandlerID, clientID, 0, 0 };
+	e.list = (int)flag;
+	e.list_id = value ? 1 : 0;
+	simQueueEvent(e);
+}
+
+void simPlaceClient(uint64 serverConnectionHandlerID, anyID clientID, uint64 channelID) {
+	sim_server* server = findServer(serverConnectionHandlerID);
+	sim_client* client = findClient(server, clientID);
+	if (!client || client->channel == channelID) return;
+	channelRemoveClient(*server, client->channel, clientID);
+	client->channel = channelID;
+	server->channels[channelID].clients.push_back(clientID);
+}
+
+uint64 simChannelCreate(uint64 serverConnectionHandlerID, uint64 parentID) {
+	sim_server* server = findServer(serverConnectionHandlerID);
+	if (!server) return 0;
+	const uint64 channelID = server->next_channel_id++;
+	sim_event e = sim_event{ SIM_EVENT_CHANNEL_CREATED, serverConnectionHandlerID, 0, channelID, 0 };
+	e.parent_channel = parentID;
+	simQueueEvent(e);
+	return channelID;
+}
+
+void simChannelDelete(uint64 serverConnectionHandlerID, uint64 channelID) {
+	simQueueEvent(sim_event{ SIM_EVENT_CHANNEL_DELETED, serverConnectionHandlerID, 0, channelID, 0 });
+}
+
+void simChannelMove(uint64 serverConnectionHandlerID, uint64 channelID, uint64 parentID) {
+	sim_event e = sim_event{ SIM_EVENT_CHANNEL_MOVED, serverConnectionHandlerID, 0, channelID, 0 };
+	e.parent_channel = parentID;
+	simQueueEvent(e);
+}
+
+static void deleteChannel(sim_server& server, uint64 channelID) {
+	std::vector<uint64> children;
+	for (const auto& c : server.channels) {
+		if (c.second.parent == channelID) children.push_back(c.first);
+	}
+	for (uint64 c : children) deleteChannel(server, c);
+
+	const uint64 fallback = server.channel_ids.front() != channelID ? server.channel_ids.front() : server.channel_ids.back();
+	for (anyID id : server.channels[channelID].clients) {
+		server.clients[id].channel = fallback;
+		server.channels[fallback].clients.push_back(id);
+	}
+	server.channels.erase(channelID);
+	server.channel_ids.erase(std::find(server.channel_ids.begin(), server.channel_ids.end(), channelID));
+}
+
+static void deliverChannelEvent(sim_server& server, const sim_event& e) {
+	const auto it = server.channels.find(e.new_channel);
+	switch (e.type) {
+	case SIM_EVENT_CHANNEL_CREATED:
+		if (e.parent_channel != 0 && server.channels.find(e.parent_channel) == server.channels.end()) return;
+		server.channels[e.new_channel] = sim_channel{ e.new_channel, e.parent_channel, {} };
+		server.channel_ids.push_back(e.new_channel);
+		counters.events_delivered++;
+		ts3plugin_onNewChannelCreatedEvent(server.id, e.new_channel, e.parent_channel, server.own_client, "sim", "sim");
+		break;
+	case SIM_EVENT_CHANNEL_DELETED:
+		if (it == server.channels.end() || server.channel_ids.size() < 2) return;
+		deleteChannel(server, e.new_channel);
+		counters.events_delivered++;
+		ts3plugin_onDelChannelEvent(server.id, e.new_channel, server.own_client, "sim", "sim");
+		break;
+	case SIM_EVENT_CHANNEL_MOVED:
+		if (it == server.channels.end()) return;
+		// refuse to move a channel below itself
+		for (uint64 p = e.parent_channel; p != 0; p = server.channels[p].parent) {
+			if (p == e.new_channel || server.channels.find(p) == server.channels.end()) return;
+		}
+		it->second.parent = e.parent_channel;
+		counters.events_delivered++;
+		ts3plugin_onChannelMoveEvent(server.id, e.new_channel, e.parent_channel, server.own_client, "sim", "sim");
+		break;
+	default:
+		break;
+	}
+}
+
+static void deliverClientEvent(sim_server& server, const sim_event& e) {
+	sim_client* client = findClient(&server, e.client);
+	if (!client) return;
+	std::vector<uint64>& groups = client->server_groups;
+	const auto it = std::find(groups.begin(), groups.end(), e.list_id);
+	switch (e.type) {
+	case SIM_EVENT_SERVER_GROUP_ADDED:
+		if (it != groups.end()) return;
+		groups.push_back(e.list_id);
+		counters.events_delivered++;
+		ts3plugin_onServerGroupClientAddedEvent(server.id, e.client, "sim", "sim", e.list_id, server.own_client, "sim", "sim");
+		break;
+	case SIM_EVENT_SERVER_GROUP_DELETED:
+		if (it == groups.end()) return;
+		groups.erase(it);
+		counters.events_delivered++;
+		ts3plugin_onServerGroupClientDeletedEvent(server.id, e.client, "sim", "sim", e.list_id, server.own_client, "sim", "sim");
+		break;
+	case SIM_EVENT_CHANNEL_GROUP_CHANGED:
+		client->channel_group = e.list_id;
+		counters.events_delivered++;
+		ts3plugin_onClientChannelGroupChangedEvent(server.id, e.list_id, client->channel, e.client, server.own_client, "sim", "sim");
+		break;
+	case SIM_EVENT_TALK_STATUS:
+		if (client->talking == (e.list_id != 0)) return;
+		client->talking = e.list_id != 0;
+		counters.events_delivered++;
+		ts3plugin_onTalkStatusChangeEvent(server.id, client->talking ? STATUS_TALKING : STATUS_NOT_TALKING, 0, e.client);
+		break;
+	case SIM_EVENT_CLIENT_UPDATED: {
+		bool* value = e.list == CLIENT_AWAY ? &client->away : e.list == CLIENT_INPUT_MUTED ? &client->input_muted : e.list == CLIENT_OUTPUT_MUTED ? &client->output_muted : NULL;
+		if (!value || *value == (e.list_id != 0)) return;
+		*value = e.list_id != 0;
+		counters.events_delivered++;
+		ts3plugin_onUpdateClientEvent(server.id, e.client, server.own_client, "sim", "sim");
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+static void answer(const sim_event& e, unsigned int error) {
+	if (e.return_code.empty()) return;
+	ts3plugin_onServerErrorEvent(e.server_id, error == ERROR_ok ? "ok" : "error", error, e.return_code.c_str(), "");
+}
+
+sim_permission simPermission(uint64 ownerID, unsigned int n) {
+	return sim_permission{ 1 + n * 3, (int)((ownerID * 31 + n * 7) % 151) - 75, n % 5 == 0, n % 7 == 0 };
+}
+
+/* Delivers the rows of a list at once followed by the answer (the plugin does not implement the *FinishedEvent callbacks) */
+static void deliverList(sim_server& server, const sim_event& e) {
+	unsigned int rows = 0;
+	bool exists = true;
+	switch (e.list) {
+	case SIM_LIST_SERVER_GROUPS:
+		for (unsigned int g = 1; g <= server.server_groups; g++, rows++) {
+			const std::string name = "Server Group " + std::to_string(g);
+			ts3plugin_onServerGroupListEvent(server.id, g, name.c_str(), 1, 0, 1);
+		}
+		break;
+	case SIM_LIST_CHANNEL_GROUPS:
+		for (unsigned int g = 1; g <= server.channel_groups; g++, rows++) {
+			const std::string name = "Channel Group " + std::to_string(g);
+			ts3plugin_onChannelGroupListEvent(server.id, g, name.c_str(), 1, 0, 1);
+		}
+		break;
+	case SIM_LIST_SERVER_GROUP_PERMS:
+		exists = e.list_id >= 1 && e.list_id <= server.server_groups;
+		for (unsigned int n = 0; exists && n < server.perms_per_group; n++, rows++) {
+			const sim_permission p = simPermission(e.list_id, n);
+			ts3plugin_onServerGroupPermListEvent(server.id, e.list_id, p.id, p.value, p.negated, p.skip);
+		}
+		break;
+	case SIM_LIST_CHANNEL_GROUP_PERMS:
+		exists = e.list_id >= 1 && e.list_id <= server.channel_groups;
+		for (unsigned int n = 0; exists && n < server.perms_per_group; n++, rows++) {
+			const sim_permission p = simPermission(e.list_id, n);
+			ts3plugin_onChannelGroupPermListEvent(server.id, e.list_id, p.id, p.value, p.negated, p.skip);
+		}
+		break;
+	case SIM_LIST_CHANNEL_PERMS:
+		exists = server.channels.find(e.list_id) != server.channels.end();
+		for (unsigned int n = 0; exists && n < server.perms_per_channel; n++, rows++) {
+			sim_permission p = simPermission(e.list_id, n);
+			const auto offset = server.perm_offsets.find(e.list_id);
+			if (offset != server.perm_offsets.end()) p.value += offset->second;
+			ts3plugin_onChannelPermListEvent(server.id, e.list_id, p.id, p.value, p.negated, p.skip);
+		}
+		break;
+	case SIM_LIST_BANS:
+		if (server.deny_bans) {
+			counters.events_delivered++;
+			if (!e.return_code.empty()) {
+				ts3plugin_onServerPermissionErrorEvent(server.id, "insufficient client permissions", ERROR_permissions_client_insufficient, e.return_code.c_str(), 0);
+			}
+			return;
+		}
+		for (unsigned int b = 1; b <= server.bans; b++, rows++) {
+			const std::string ip = "10.0." + std::to_string(b / 256) + "." + std::to_string(b % 256);
+			const std::string name = "banned" + std::to_string(b);
+			const std::string uid = "uid" + std::to_string(b) + "=";
+			ts3plugin_onBanListEvent(server.id, b, ip.c_str(), name.c_str(), uid.c_str(), 1500000000 + b, b % 2 ? 0 : 3600, "sim", 1, "sim=", "benchmark ban", (int)(b % 3), name.c_str());
+		}
+		for (const sim_ban& b : server.ban_rules) {
+			ts3plugin_onBanListEvent(server.id, b.id, b.ip.c_str(), b.name.c_str(), b.uid.c_str(), (uint64)time(NULL), b.duration, "sim", 1, "sim=", "benchmark ban", 0, "");
+			rows++;
+		}
+		break;
+	}
+	counters.events_delivered += rows + 1;
+	answer(e, !exists ? ERROR_parameter_invalid : (rows ? ERROR_ok : ERROR_database_empty_result));
+}
+
+static void deliver(const sim_event& e) {
+	if (e.type == SIM_EVENT_SERVER_ERROR) {
+		counters.events_delivered++;
+		answer(e, e.error);
+		return;
+	}
+
+	sim_server* server = findServer(e.server_id);
+	if (server && e.type == SIM_EVENT_LIST) {
+		deliverList(*server, e);
+		return;
+	}
+	if (server && (e.type == SIM_EVENT_CHANNEL_CREATED || e.type == SIM_EVENT_CHANNEL_DELETED || e.type == SIM_EVENT_CHANNEL_MOVED)) {
+		deliverChannelEvent(*server, e);
+		return;
+	}
+	if (server && (e.type == SIM_EVENT_SERVER_GROUP_ADDED || e.type == SIM_EVENT_SERVER_GROUP_DELETED || e.type == SIM_EVENT_CHANNEL_GROUP_CHANGED || e.type == SIM_EVENT_TALK_STATUS || e.type == SIM_EVENT_CLIENT_UPDATED)) {
+		deliverClientEvent(*server, e);
+		return;
+	}
+	if (!server || e.client == 0 || e.client >= server->clients.size()) return;
+	sim_client& client = server->clients[e.client];
+
+	if (e.duplicate) {
+		counters.events_delivered++;
+		counters.duplicates_delivered++;
+		if (e.type == SIM_EVENT_MOVE) {
+			ts3plugin_onClientMoveEvent(e.server_id, e.client, e.old_channel, e.new_channel, RETAIN_VISIBILITY, "");
+		}
+		else {
+			ts3plugin_onClientMoveMovedEvent(e.server_id, e.client, e.old_channel, e.new_channel, RETAIN_VISIBILITY, e.invoker, "sim", "sim", "");
+		}
+		return;
+	}
+
+	const bool joining = !client.connected;
+	if (joining && (e.type != SIM_EVENT_MOVE || e.new_channel == 0 || !e.return_code.empty())) {
+		// only the client itself can (re)join
+		answer(e, ERROR_client_invalid_id);
+		return;
+	}
+	if (!joining && client.channel == e.new_channel) {
+		answer(e, ERROR_channel_already_in);
+		return;
+	}
+	if (e.new_channel != 0 && server->channels.find(e.new_channel) == server->channels.end()) {
+		answer(e, ERROR_channel_invalid_id);
+		return;
+	}
+
+	const uint64 old_channel = joining ? 0 : client.channel;
+	if (old_channel != 0) channelRemoveClient(*server, old_channel, e.client);
+	client.connected = true;
+	client.channel = e.new_channel;
+	if (e.new_channel != 0) server->channels[e.new_channel].clients.push_back(e.client);
+
+	const int visibility = e.new_channel == 0 ? LEAVE_VISIBILITY : (old_channel == 0 ? ENTER_VISIBILITY : RETAIN_VISIBILITY);
+	counters.events_delivered++;
+	switch (e.type) {
+	case SIM_EVENT_MOVE:
+		ts3plugin_onClientMoveEvent(e.server_id, e.client, old_channel, e.new_channel, visibility, "");
+		break;
+	case SIM_EVENT_MOVE_MOVED:
+		ts3plugin_onClientMoveMovedEvent(e.server_id, e.client, old_channel, e.new_channel, visibility, e.invoker, "sim", "sim", "");
+		break;
+	case SIM_EVENT_MOVE_TIMEOUT:
+		ts3plugin_onClientMoveTimeoutEvent(e.server_id, e.client, old_channel, e.new_channel, visibility, "");
+		break;
+	case SIM_EVENT_KICK_CHANNEL:
+		ts3plugin_onClientKickFromChannelEvent(e.server_id, e.client, old_channel, e.new_channel, visibility, e.invoker, "sim", "sim", "");
+		break;
+	case SIM_EVENT_KICK_SERVER:
+		ts3plugin_onClientKickFromServerEvent(e.server_id, e.client, old_channel, e.new_channel, visibility, e.invoker, "sim", "sim", "");
+		break;
+	case SIM_EVENT_SERVER_ERROR:
+	case SIM_EVENT_CHANNEL_CREATED:
+	case SIM_EVENT_CHANNEL_DELETED:
+	case SIM_EVENT_CHANNEL_MOVED:
+	case SIM_EVENT_LIST:
+	case SIM_EVENT_SERVER_GROUP_ADDED:
+	case SIM_EVENT_SERVER_GROUP_DELETED:
+	case SIM_EVENT_CHANNEL_GROUP_CHANGED:
+	case SIM_EVENT_TALK_STATUS:
+	case SIM_EVENT_CLIENT_UPDATED:
+		break;
+	}
+
+	// clients that left stay queryable for the duration of the callback only
+	if (e.new_channel == 0) client.connected = false;
+	answer(e, ERROR_ok);
+}
+
+/* Queues a copy of a delivered channel change somewhere among the remaining events of the round */
+static bool maybeDuplicate(const sim_event& e, uint64 old_channel, size_t remaining) {
+	sim_server* server = findServer(e.server_id);
+	if (!server || !server->duplicate_percent || e.duplicate) return false;
+	if (e.type != SIM_EVENT_MOVE && e.type != SIM_EVENT_MOVE_MOVED) return false;
+	if (old_channel == 0 || e.new_channel == 0 || server->clients[e.client].channel != e.new_channel) return false;
+	if (server->rng() % 100 >= server->duplicate_percent) return false;
+
+	sim_event copy = e;
+	copy.duplicate = true;
+	copy.old_channel = old_channel;
+	copy.return_code.clear();
+	pending_events.insert(pending_events.begin() + (server->rng() % (remaining + 1)), copy);
+	return true;
+}
+
+size_t simPumpRound() {
+	for (auto& s : servers) s.second.flood_used = 0;
+	size_t n = pending_events.size();
+	for (size_t i = 0; i < n; i++) {
+		const sim_event e = pending_events.front();
+		pending_events.pop_front();
+
+		sim_server* server = findServer(e.server_id);
+		const bool known = server && e.client != 0 && e.client < server->clients.size() && server->clients[e.client].connected;
+		const uint64 old_channel = known ? server->clients[e.client].channel : 0;
+		deliver(e);
+		// events the plugin caused while delivering were appended, the copy goes in front of them
+		if (maybeDuplicate(e, old_channel, n - i - 1)) n++;
+	}
+	return n;
+}
+
+size_t simPump(size_t max_events) {
+	size_t n = 0;
+	while (!pending_events.empty() && n < max_events) {
+		n += simPumpRound();
+	}
+	return n;
+}
+
+size_t simPendingEvents() {
+	return pending_events.size();
+}
@@ -0,0 +1,212 @@
+#pragma once
+
+/*
+ * Simulated TeamSpeak client lib.
+ *
+ * Provides a TS3Functions table backed by in-memory servers, so the plugin callbacks can be driven
+ * headless. Requests made by the plugin (e.g. requestClientMove) are queued and delivered back to the
+ * plugin as events by simPump(), the same way the real client lib delivers server answers asynchronously.
+ */
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <map>
+#include <random>
+
+#include "teamspeak/public_definitions.h"
+#include "ts3_functions.h"
+
+struct sim_client {
+	anyID id;
+	uint64 db_id;
+	uint64 channel;
+	bool connected;
+	std::vector<uint64> server_groups = std::vector<uint64>();
+	uint64 channel_group = 0;
+	bool talking = false;
+	bool away = false;
+	bool input_muted = false;
+	bool output_muted = false;
+	bool muted = false;  // muted locally by requestMuteClients
+	std::string uid = std::string();       // empty = "client<id>="
+	std::string nickname = std::string();  // empty = "Client <id>"
+	std::string ip = std::string();        // empty = "192.168.<id / 256>.<id % 256>"
+};
+
+/* A ban row of the ban list, see sim_server::ban_rules */
+struct sim_ban {
+	uint64 id;
+	std::string ip;
+	std::string name;
+	std::string uid;
+	uint64 duration;  // seconds from now, 0 = permanent
+};
+
+struct sim_channel {
+	uint64 id;
+	uint64 parent;
+	std::vector<anyID> clients;
+	std::string name = std::string();  // empty = "Channel <id>"
+};
+
+struct sim_server {
+	uint64 id;
+	anyID own_client;
+	std::vector<sim_client> clients;  // indexed by client id, slot 0 unused
+	std::unordered_map<uint64, sim_channel> channels;
+	std::vector<uint64> channel_ids;
+	std::mt19937 rng;
+	uint64 move_requests = 0;  // requestClientMove calls targeting this server
+	unsigned int flood_limit = 0;  // requests accepted per round, more are answered with ERROR_client_is_flooding. 0 = unlimited
+	unsigned int flood_used = 0;
+	uint64 next_channel_id = 1;
+
+	// server data answered to list requests, generated on the fly (see simPermission)
+	unsigned int server_groups = 0;       // ids 1..n
+	unsigned int channel_groups = 0;      // ids 1..n
+	unsigned int perms_per_group = 0;
+	unsigned int perms_per_channel = 0;
+	unsigned int bans = 0;
+	bool deny_bans = false;               // ban list requests fail with a permission error
+	std::vector<sim_ban> ban_rules;       // answered after the generated bans, ids should be above bans
+	std::unordered_map<uint64, int> perm_offsets;  // channel -> added to its permission values, to change them between backups
+	unsigned int duplicate_percent = 0;  // chance a channel change is delivered twice, the copy arrives later in the same round
+};
+
+enum sim_event_type {
+	SIM_EVENT_MOVE,            // client switched channel itself
+	SIM_EVENT_MOVE_MOVED,      // client was moved by invoker
+	SIM_EVENT_MOVE_TIMEOUT,    // client timed out
+	SIM_EVENT_KICK_CHANNEL,    // client was kicked from its channel
+	SIM_EVENT_KICK_SERVER,     // client was kicked from the server
+	SIM_EVENT_SERVER_ERROR,    // answer to a request that failed before it was executed
+	SIM_EVENT_CHANNEL_CREATED, // new_channel was created below parent_channel
+	SIM_EVENT_CHANNEL_DELETED, // new_channel and its sub-channels were deleted
+	SIM_EVENT_CHANNEL_MOVED,   // new_channel was moved below parent_channel
+	SIM_EVENT_LIST,            // answer to a list request, see sim_list
+	SIM_EVENT_SERVER_GROUP_ADDED,    // client was added to server group list_id
+	SIM_EVENT_SERVER_GROUP_DELETED,  // client was removed from server group list_id
+	SIM_EVENT_CHANNEL_GROUP_CHANGED, // client got channel group list_id
+	SIM_EVENT_TALK_STATUS,           // client started (list_id 1) or stopped (list_id 0) talking
+	SIM_EVENT_CLIENT_UPDATED,        // client variable list (CLIENT_AWAY, CLIENT_INPUT_MUTED or CLIENT_OUTPUT_MUTED) changed to list_id
+};
+
+struct sim_event {
+	sim_event_type type;
+	uint64 server_id;
+	anyID client;
+	uint64 new_channel;
+	anyID invoker;
+	std::string return_code;  // answered through ts3plugin_onServerErrorEvent if set
+	unsigned int error;
+	bool duplicate = false;  // repeats a delivered move from old_channel without changing the server
+	uint64 old_channel = 0;
+	uint64 parent_channel = 0;  // channel events
+	int list = 0;               // sim_list of SIM_EVENT_LIST
+	uint64 list_id = 0;         // group or channel the list belongs to
+};
+
+enum sim_list {
+	SIM_LIST_SERVER_GROUPS,
+	SIM_LIST_CHANNEL_GROUPS,
+	SIM_LIST_SERVER_GROUP_PERMS,
+	SIM_LIST_CHANNEL_GROUP_PERMS,
+	SIM_LIST_CHANNEL_PERMS,
+	SIM_LIST_BANS,
+};
+
+struct sim_permission {
+	unsigned int id;
+	int value;
+	int negated;
+	int skip;
+};
+
+struct sim_counters {
+	uint64 client_lib_calls;      // every call through the TS3Functions table
+	uint64 move_requests;         // requestClientMove calls
+	uint64 move_requests_failed;  // requestClientMove calls rejected by the sim
+	uint64 menu_updates;          // setPluginMenuEnabled calls
+	uint64 events_delivered;      // callbacks invoked by simPump
+	uint64 duplicates_delivered;  // repeated move callbacks, see sim_server::duplicate_percent
+	uint64 allocations;           // arrays handed to the plugin
+	uint64 frees;                 // freeMemory calls
+	uint64 perm_requests;         // request*AddPerm calls
+	uint64 perms_added;           // permissions in these calls
+	uint64 mute_requests;         // requestMuteClients calls
+	uint64 kick_requests;         // requestClientKickFromServer calls
+};
+
+#define SIM_GUEST_GROUP 8
+#define SIM_TEAM_GROUP 100
+#define SIM_TEAMS 16
+#define SIM_ADMIN_GROUP 6
+#define SIM_GUEST_CHANNEL_GROUP 8
+#define SIM_OPERATOR_CHANNEL_GROUP 6
+
+/* Drops all servers, queued events and counters */
+void simReset();
+
+/*
+ * Adds a server connection with channel_count channels arranged in a random tree and client_count clients
+ * spread over them. The own client always has id 1 and client n has database id 1000 + n on every server.
+ * Every client is in server group SIM_GUEST_GROUP and in the team group SIM_TEAM_GROUP + n % SIM_TEAMS, every tenth
+ * client also in SIM_ADMIN_GROUP. Every fourth client has channel group SIM_OPERATOR_CHANNEL_GROUP, the others
+ * SIM_GUEST_CHANNEL_GROUP.
+ * Notifies the plugin about the connection. Returns the server connection handler id.
+ */
+uint64 simAddServer(int channel_count, int client_count, unsigned int seed);
+
+/* Disconnects from a server, notifying the plugin */
+void simRemoveServer(uint64 serverConnectionHandlerID);
+
+/* Function table to hand to ts3plugin_setFunctionPointers */
+TS3Functions simGetFunctions();
+
+void simSetCurrentServer(uint64 serverConnectionHandlerID);
+sim_server* simGetServer(uint64 serverConnectionHandlerID);
+sim_counters& simCounters();
+void simResetCounters();
+
+/* Makes every call through the function table take at least ns nanoseconds, reset by simReset */
+void simSetCallDelay(unsigned int ns);
+
+/* Queue server side events (delivered by simPump) */
+void simQueueEvent(const sim_event& e);
+void simClientSwitchChannel(uint64 serverConnectionHandlerID, anyID clientID, uint64 channelID);
+void simClientMovedBy(uint64 serverConnectionHandlerID, anyID clientID, uint64 channelID, anyID invokerID);
+void simClientLeave(uint64 serverConnectionHandlerID, anyID clientID);
+void simClientJoin(uint64 serverConnectionHandlerID, anyID clientID, uint64 channelID);
+
+void simServerGroupAdd(uint64 serverConnectionHandlerID, anyID clientID, uint64 serverGroupID);
+void simServerGroupRemove(uint64 serverConnectionHandlerID, anyID clientID, uint64 serverGroupID);
+void simChannelGroupSet(uint64 serverConnectionHandlerID, anyID clientID, uint64 channelGroupID);
+void simClientTalk(uint64 serverConnectionHandlerID, anyID clientID, bool talking);
+void simClientUpdate(uint64 serverConnectionHandlerID, anyID clientID, size_t flag, bool value);
+
+/* Relocates a client without generating an event, used to set up scenarios */
+void simPlaceClient(uint64 serverConnectionHandlerID, anyID clientID, uint64 channelID);
+
+/* Channel changes, applied when the event is delivered. Clients in deleted channels are silently moved to the first channel. */
+uint64 simChannelCreate(uint64 serverConnectionHandlerID, uint64 parentID);
+void simChannelDelete(uint64 serverConnectionHandlerID, uint64 channelID);
+void simChannelMove(uint64 serverConnectionHandlerID, uint64 channelID, uint64 parentID);
+
+/*
+ * Delivers the events queued so far. Events caused by the plugin while delivering wait for the next round,
+ * so one round corresponds to one round trip to the server. Returns number of events.
+ */
+size_t simPumpRound();
+
+/* Delivers queued events to the plugin, including events caused by the plugin while delivering. Returns number of events. */
+size_t simPump(size_t max_events = 10000000);
+size_t simPendingEvents();
+
+/* n-th permission row of a group or channel, the same for every call */
+sim_permission simPermission(uint64 ownerID, unsigned int n);
+
+/* Random helpers */
+uint64 simRandomChannel(sim_server& server);
+anyID simRandomClient(sim_server& server, bool include_self = false);
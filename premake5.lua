@@ -1,9 +1,38 @@
-build_dir = "build\\"
-bin_dir = build_dir .. "%{prj.name}\\bin\\%{cfg.buildcfg}-%{cfg.system}-%{cfg.architecture}"
-bin_int_dir = build_dir .. "%{prj.name}\\bin-int\\%{cfg.buildcfg}-%{cfg.system}-%{cfg.architecture}"
+build_dir = "build/"
+bin_dir = build_dir .. "%{prj.name}/bin/%{cfg.buildcfg}-%{cfg.system}-%{cfg.architecture}"
+bin_int_dir = build_dir .. "%{prj.name}/bin-int/%{cfg.buildcfg}-%{cfg.system}-%{cfg.architecture}"
 
 ts_plugin_dir = "C:/Users/Kanjiu Akuma/AppData/Roaming/TS3Client/plugins"
 
+-- settings shared by the plugin, the core library and the benchmark
+function common_settings()
+	language "C++"
+	cppdialect "C++17"
+	systemversion "latest"
+
+	targetdir("%{wks.location}/" .. bin_dir)
+	objdir("%{wks.location}/" .. bin_int_dir)
+
+	includedirs {
+		"Ts3AdminTools/src",
+		"Ts3AdminTools/src/vendor",
+	}
+
+	filter "configurations:Debug"
+		symbols "Full"
+		defines {
+			"AT_DEBUG"
+		}
+
+	filter "configurations:Release"
+		optimize "On"
+		defines {
+			"AT_RELEASE"
+		}
+
+	filter {}
+end
+
 workspace "TS3AdminTools"
 	architecture "x64"
 
@@ -14,36 +43,57 @@ workspace "TS3AdminTools"
 	}
 
 project "TS3AdminTools"
-	location "TS3AdminTools"
-	language "C++"
-	cppdialect "C++17"
-	systemversion "latest"
+	location "Ts3AdminTools"
 	kind "SharedLib"
+	pic "On"
+	common_settings()
 
-	targetdir("%{wks.location}/" .. bin_dir)
-	objdir("%{wks.location}/" .. bin_int_dir)
+	files {
+		"Ts3AdminTools/src/**",
+	}
+
+	filter "system:linux"
+		links {
+			"pthread",
+		}
+
+	filter "system:windows"
+		postbuildcommands {
+			"copy /Y \"%{wks.location}" .. bin_dir:gsub("/", "\\") .. "\\%{prj.name}.dll\" \"" .. ts_plugin_dir .. "/\""
+		}
+	filter {}
+
+-- plugin sources as a static library, so they can be driven without the ts3 client
+project "TS3AdminToolsCore"
+	location "Ts3AdminTools"
+	kind "StaticLib"
+	pic "On"
+	common_settings()
+
+	files {
+		"Ts3AdminTools/src/**",
+	}
+
+-- simulated client lib + benchmark suite
+project "TS3AdminToolsBench"
+	location "Ts3AdminToolsBench"
+	kind "ConsoleApp"
+	common_settings()
 
 	files {
-		"%{prj.name}/src/**",
+		"Ts3AdminToolsBench/src/**",
 	}
 
 	includedirs {
-		"%{prj.name}/src",
-		"%{prj.name}/src/vendor",
+		"Ts3AdminToolsBench/src",
 	}
 
-	postbuildcommands {
-		"copy /Y \"%{wks.location}" .. bin_dir .. "\\%{prj.name}.dll\" \"" .. ts_plugin_dir .. "/\""
+	links {
+		"TS3AdminToolsCore",
 	}
 
-	filter "configurations:Debug"
-		symbols "Full"
-		defines {
-			"AT_DEBUG"
+	filter "system:linux"
+		links {
+			"pthread",
 		}
-
-	filter "configurations:Release"
-		optimize "On"
-		defines {
-			"AT_RELEASE"
-		}
\ No newline at end of file
+	filter {}
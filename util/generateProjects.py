@@ -4,7 +4,13 @@ import os
 if __name__ == '__main__':
     root = os.path.realpath(os.path.dirname(__file__) + "/../")
     os.chdir(root)
-    premake_path = root + "\\util\\premake\\premake5.exe"
-    premake_args = "vs2017"
+    if sys.platform == "win32":
+        premake_path = root + "\\util\\premake\\premake5.exe"
+        premake_args = "vs2017"
+    else:
+        # expects premake5 on the PATH, generates makefiles
+        premake_path = "premake5"
+        premake_args = "gmake2"
     os.system("%s %s" % (premake_path, premake_args))
-    input("Press enter to exit...")
+    if sys.platform == "win32":
+        input("Press enter to exit...")